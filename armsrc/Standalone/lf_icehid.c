@@ -89,7 +89,7 @@ static void append(uint8_t *entry, size_t entry_len) {
 
 static uint32_t IceEM410xdemod(void) {
 
-    size_t size = MIN(16385, palloc_sram_left());
+    size_t size = MIN(16385, palloc_largest_free());
     uint8_t *dest = palloc(1, size);
 
     if(dest == nullptr) {
@@ -146,7 +146,7 @@ static uint32_t IceEM410xdemod(void) {
 
 static uint32_t IceAWIDdemod(void) {
 
-    size_t size = MIN(12800, palloc_sram_left());
+    size_t size = MIN(12800, palloc_largest_free());
     uint8_t *dest = palloc(1, size);
 
     if(dest == nullptr) {
@@ -203,7 +203,7 @@ static uint32_t IceAWIDdemod(void) {
 
 static uint32_t IceIOdemod(void) {
 
-    size_t size = MIN(12000, palloc_sram_left());
+    size_t size = MIN(12000, palloc_largest_free());
     uint8_t *dest = (uint8_t*)palloc(1, size);
 
     if(dest == nullptr) {
@@ -254,7 +254,7 @@ static uint32_t IceHIDDemod(void) {
     uint32_t hi2 = 0, hi = 0, lo = 0;
 
     // large enough to catch 2 sequences of largest format
-    size_t size = MIN(12800, palloc_sram_left());
+    size_t size = MIN(12800, palloc_largest_free());
     uint8_t *dest = (uint8_t*)palloc(1, size);
 
     if(dest == nullptr) {
@@ -376,7 +376,7 @@ void RunMod(void) {
         uint32_t res;
 
         // since we steal 12800 from bigbuffer, no need to sample it.
-        size_t size = MIN(28000, palloc_sram_left());
+        size_t size = MIN(28000, palloc_largest_free());
         DoAcquisition_config(false, size, true);
         res = IceHIDDemod();
         if (res == PM3_SUCCESS) {
@@ -398,7 +398,7 @@ void RunMod(void) {
             continue;
         }
 
-        size = MIN(20000, palloc_sram_left());
+        size = MIN(20000, palloc_largest_free());
         DoAcquisition_config(false, size, true);
         res = IceEM410xdemod();
         if (res == PM3_SUCCESS) {
@@ -579,7 +579,7 @@ void ReadTItag(bool ledcontrol) {
     // Set up the memory to use
     start_tracing();
     signed char *dest = (signed char *)get_current_trace();
-    uint16_t n = get_max_trace_length();
+    uint32_t n = get_max_trace_length();
 
     for (i = 0; i < n - 1; i++) {
         // count cycles by looking for lo to hi zero crossings
@@ -1332,7 +1332,7 @@ void CmdNRZsimTAG(uint8_t invert, uint8_t separator, uint8_t clk, uint16_t size,
 // loop to get raw HID waveform then FSK demodulate the TAG ID from it
 int lf_hid_watch(int findone, uint32_t *high, uint32_t *low, bool ledcontrol) {
 
-    size_t size = MIN(12800, palloc_sram_left());
+    size_t size = MIN(12800, palloc_largest_free());
     uint8_t *dest = (uint8_t*)palloc(1, size);
 
     uint32_t hi2 = 0, hi = 0, lo = 0;
@@ -1434,7 +1434,7 @@ int lf_hid_watch(int findone, uint32_t *high, uint32_t *low, bool ledcontrol) {
 // loop to get raw HID waveform then FSK demodulate the TAG ID from it
 int lf_awid_watch(int findone, uint32_t *high, uint32_t *low, bool ledcontrol) {
 
-    size_t size = MIN(12800, palloc_sram_left());
+    size_t size = MIN(12800, palloc_largest_free());
     uint8_t *dest = (uint8_t*)palloc(1, size);
     if(dest == nullptr) {
         Dbprintf("Unable to allocate memory, aborting...");
@@ -1531,7 +1531,7 @@ int lf_awid_watch(int findone, uint32_t *high, uint32_t *low, bool ledcontrol) {
 
 int lf_em410x_watch(int findone, uint32_t *high, uint64_t *low, bool ledcontrol) {
 
-    size_t size = MIN(16385, palloc_sram_left());
+    size_t size = MIN(16385, palloc_largest_free());
     uint8_t *dest = (uint8_t*)palloc(1, size);
     if(dest == nullptr) {
         Dbprintf("Unable to allocate memory, aborting...");
@@ -1625,7 +1625,7 @@ int lf_em410x_watch(int findone, uint32_t *high, uint64_t *low, bool ledcontrol)
 
 int lf_io_watch(int findone, uint32_t *high, uint32_t *low, bool ledcontrol) {
 
-    size_t size = MIN(12000, palloc_sram_left());
+    size_t size = MIN(12000, palloc_largest_free());
     uint8_t *dest = (uint8_t*)palloc(1, size);
 
 
@@ -138,7 +138,7 @@ int initSampleBuffer(uint32_t *sample_size) {
         return PM3_EINVARG;
     }
 
-    if(*sample_size >= palloc_sram_size() || *sample_size > palloc_sram_left()) {
+    if(*sample_size >= palloc_sram_size() || *sample_size > palloc_largest_free()) {
         Dbprintf("initSampleBuffer, not enough memory for samples");
         return PM3_ELENGTH;
     }
@@ -597,7 +597,7 @@ uint8_t *doT55x7Acquisition(size_t sample_size, bool ledcontrol) {
 #define T55xx_READ_LOWER_THRESHOLD 128-60  // -60 grph
 #define T55xx_READ_TOL   5
 
-    uint16_t bufsize = palloc_sram_left();
+    uint16_t bufsize = palloc_largest_free();
 
     if (bufsize > sample_size)
         bufsize = sample_size;
@@ -693,8 +693,7 @@ uint8_t *doT55x7Acquisition(size_t sample_size, bool ledcontrol) {
 #endif
 uint8_t *doCotagAcquisition(void) {
 
-    uint16_t bufsize = palloc_sram_left();
-    palloc_compact_heap();
+    uint16_t bufsize = palloc_largest_free();
     uint8_t *dest = (uint8_t*)palloc(1, bufsize);
 
     if(dest == nullptr) {
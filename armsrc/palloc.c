@@ -19,62 +19,81 @@
 // Iceman firmware uses
 //============================== Special Thanks ================================
 // thi-ng/tinyalloc - for the initial chunk of code palloc used
+// TLSF (M. Masmano et al.) - for the segregated size class layout
 //==============================================================================
 #include "palloc.h"
 
-#include "proxmark3_arm.h"
 #include "dbprint.h" // logging
-#include "ticks.h"
-
-// Word size alignment
-#define ALIGN_BYTES sizeof(uint32_t) // Word size of the Atmel SAM7S should be 4 bytes (32-bit)
-#define ALIGN_MASK (0xFFFF + 1 - ALIGN_BYTES)
 
+#ifdef ON_DEVICE
 // The values set by the linker for what we have as bounds of memory to use
 extern uint32_t _stack_start[], __bss_start__[], __bss_end__[];
 
+#define MEM_USABLE ((size_t)_stack_start - (size_t)__bss_end__) // The memory (in bytes) we can use
+#define MEM_GUARD  32 // Guard size (in words) between the end of .bss and the heap
+#endif
+
 // Memory defines
 #define MEM_SIZE   65536 // Total memory size (in bytes) of the Atmel SAM7S series MCU we use
-#define MEM_USABLE ((size_t)_stack_start - (size_t)__bss_end__) // The memory (in bytes) we can use
-#define MEM_GUARD  32 // Guard size at the top of the heap
 
-// Block configuration
-#define BLOCK_SPLIT_THRESHOLD 16
-#define MAX_BLOCKS 32 // 32 blocks should give us an overall overhead of 768 bytes
+/**
+ * Every block starts with an 8 byte header, and block sizes and offsets are counted in 8 byte
+ * units. That keeps the payload 8 byte aligned and lets a 16-bit offset reach all of the SRAM.
+ *
+ * Free blocks also keep their free list links in the first word of the payload, which is why a
+ * block is never smaller than 2 units.
+ */
+#define UNIT_BYTES  8
+#define UNIT_MIN    2      // Smallest block we'll create (header + free list links)
+#define BLOCK_NIL   0xFFFF // "No block" offset
+
+// Block tags, xor'd with the block offset so a stray pointer is very unlikely to look valid
+#define TAG_USED 0xA55A
+#define TAG_FREE 0x5AA5
+#define TAG_END  0x0FF0
+
+/**
+ * Size classes. The first level splits sizes by power of two, the second level splits every
+ * power of two into 8 linear steps. Blocks below 8 units all live in first level 0, one class
+ * per unit count. With 64kb of SRAM at most (8192 units) we need 12 first level classes.
+ */
+#define SL_LOG2  3
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_COUNT 12
 
 typedef struct Block pBlock;
-typedef struct Heap pHeap;
+typedef struct Links pLinks;
 
-struct PACKED Block {
-    void *address; // The memory address this block points to
-    ALIGNED(4) pBlock *next;  // The next block in the list, or nullptr if there is none
-    int16_t size;  // The size of the data at `address`
+struct Block {
+    uint16_t prev;   // Offset of the block physically before this one, or BLOCK_NIL for the first
+    uint16_t size;   // Size of this block in units, header included (0 for the end marker)
+    uint16_t tag;    // TAG_USED, TAG_FREE or TAG_END, xor'd with the offset of this block
+    uint16_t length; // The size in bytes that was asked for, if this block is used
 };
 
-/**
- * Heap Metadata is as follows: {uint32_t} 0x(flags)(used_count)(free_count)(fresh_count)
- * * Flags store boolean states of various things (if a block was changed recently, for example)
- * * used_count is the last stored count of used blocks
- * * free_count is the last stored count of free blocks
- * * fresh_count is the last stored count of fresh blocks
- * 
- * This metadata isn't exposed outside of palloc.
- */
-struct PACKED Heap {
-    ALIGNED(4) pBlock *fresh; // Fresh (never used) Blocks List
-    ALIGNED(4) pBlock *free;  // Free (previously used) Blocks List
-    ALIGNED(4) pBlock *used;  // Currently used Blocks List
-    uint32_t metadata;        // Heap metadata
-    uint32_t top;             // Top free address
+struct Links {
+    uint16_t next;   // Next free block in the same size class
+    uint16_t prev;   // Previous free block in the same size class
 };
 
+typedef struct {
+    uint8_t *base;                       // Start of the heap
+    uint16_t units;                      // Size of the heap in units, end marker included
+    uint16_t fl_map;                     // Bit `fl` is set if any `sl_map[fl]` bit is set
+    uint8_t sl_map[FL_COUNT];            // Bit `sl` is set if `heads[fl][sl]` has blocks
+    uint16_t heads[FL_COUNT][SL_COUNT];  // First free block of every size class
+    uint16_t used_blocks;                // Number of blocks handed out
+    uint16_t free_blocks;                // Number of blocks in the free lists
+    uint16_t free_units;                 // Units in the free lists, headers included
+} pHeap;
+
 /**
  * @brief The FPGA Queue
  * @note
  * This is a buffer where we can queue things up to be sent through the FPGA, for
  * any purpose (fake tag, as reader, whatever).
- * @note 
- * We go MSB first, since that is the order in which they go out on the wire. 
+ * @note
+ * We go MSB first, since that is the order in which they go out on the wire.
  */
 static fpga_queue_t fpgaQueue = {
     .max = -1,
@@ -82,207 +101,258 @@ static fpga_queue_t fpgaQueue = {
     .data = nullptr
 };
 
-// This will automagically calculate the overhead we have if we tweak the values we use
-#define OVERHEAD (MAX_BLOCKS * sizeof(pBlock))
+static pHeap heap = { .base = nullptr };
+
+static inline pBlock *block_at(uint16_t offset) {
+    return (pBlock*)(heap.base + ((size_t)offset * UNIT_BYTES));
+}
 
-static pHeap *heap = nullptr;
-static size_t free_space = 0;
+static inline uint16_t block_offset(const pBlock *blk) {
+    return (uint16_t)(((const uint8_t*)blk - heap.base) / UNIT_BYTES);
+}
 
-/**
- * @brief Initialize the palloc heap and blocks. 
- * This must be used before any other `palloc_*` function!
- */
-void palloc_init(void) {
-    // Set up the heap
-    heap = (pHeap*)(__bss_end__ + MEM_GUARD);
-    heap->free = nullptr;
-    heap->used = nullptr;
-    heap->fresh = (pBlock*)(heap + 1);
-    heap->top = (size_t)(heap + MAX_BLOCKS + 1);
-
-    // Set up the fresh blocks to use
-    pBlock *block = heap->fresh;
-    uint8_t i = MAX_BLOCKS - 1;
-
-    while(i--) {
-        LED_A_INV();
-        SpinDelay(25);
-        block->next = block + 1;
-        block->size = 0;
-        block++;
-    }
+static inline pLinks *block_links(pBlock *blk) {
+    return (pLinks*)(blk + 1);
+}
 
-    // Initialize the metadata. Set all the flags to 1, and 0 everything else out.
-    heap->metadata = 0xFF000000;
+static inline bool block_is(const pBlock *blk, uint16_t tag) {
+    return (blk->tag ^ block_offset(blk)) == tag;
+}
 
-    // Calculate the amount of free space we have in the heap
-    free_space = (MEM_USABLE - OVERHEAD);
+/**
+ * @brief Index of the highest set bit. The ARM7TDMI has no `clz` instruction, so this is done in
+ * a fixed number of steps instead of pulling in the libgcc loop.
+ *
+ * @param value The value to check, must not be 0
+ * @return The index of the highest set bit
+ */
+static inline uint8_t fls16(uint16_t value) {
+    uint8_t bit = 0;
+    if(value & 0xFF00) { bit += 8; value >>= 8; }
+    if(value & 0x00F0) { bit += 4; value >>= 4; }
+    if(value & 0x000C) { bit += 2; value >>= 2; }
+    if(value & 0x0002) { bit += 1; }
+    return bit;
+}
 
-    block->size = 0;
-    block->next = nullptr; // Set the last next block to nullptr to signal end of list
+// Index of the lowest set bit, `value` must not be 0
+static inline uint8_t ffs16(uint16_t value) {
+    return fls16(value & (uint16_t)(-value));
 }
 
 /**
- * @brief Merge the blocks inbetween `from` and `to` together into the fresh list.
- * 
- * @param from The block to strat from
- * @param to The block to end at
+ * @brief Find the size class a block of `units` belongs in
  */
-static void merge_blocks(pBlock *from, pBlock *to) {
-    if(PRINT_DEBUG) Dbprintf(" - Palloc: Merging blocks...");
-    pBlock *scan;
-
-    // Merge the Blocks together into the fresh list.
-    //
-    // Note, this doesn't reset the data that these blocks stored. We do that in `palloc()`, so
-    // we don't have to here
-    while(from != to) {
-        scan = from->next;
-        from->next = heap->fresh;
-        heap->fresh = from;
-        from->address = 0;
-        from->size = 0;
-        from = scan;
+static void mapping(uint16_t units, uint8_t *fl, uint8_t *sl) {
+    if(units < SL_COUNT) {
+        *fl = 0;
+        *sl = units;
+    } else {
+        uint8_t bit = fls16(units);
+        *fl = bit - SL_LOG2 + 1;
+        *sl = (units >> (bit - SL_LOG2)) & (SL_COUNT - 1);
     }
-
-    // Reset the heap metadata
-    heap->metadata = 0xFF000000;
 }
 
 /**
- * @brief Inserts a block into the heap, sorted by it's address
- * 
- * @param blk The block to insert
+ * @brief Puts a free block at the head of its size class
  */
-static void insert_block(pBlock *blk) {
-    if(PRINT_EXTEND) Dbprintf(" - Palloc: Inserting block into heap...");
-    pBlock *ptr = heap->free;
-    pBlock *prev = nullptr;
+static void insert_free(pBlock *blk) {
+    uint8_t fl, sl;
+    mapping(blk->size, &fl, &sl);
 
-    while(ptr != nullptr) {
-        if((size_t)blk->address <= (size_t)ptr->address) break;
+    uint16_t offset = block_offset(blk);
+    pLinks *links = block_links(blk);
+    links->prev = BLOCK_NIL;
+    links->next = heap.heads[fl][sl];
 
-        prev = ptr;
-        ptr = ptr->next;
-    }
+    if(links->next != BLOCK_NIL) block_links(block_at(links->next))->prev = offset;
 
-    if(prev != nullptr) prev->next = blk;
-    else heap->free = blk;
+    heap.heads[fl][sl] = offset;
+    heap.sl_map[fl] |= (1 << sl);
+    heap.fl_map |= (1 << fl);
 
-    blk->next = ptr;
+    blk->tag = offset ^ TAG_FREE;
+    blk->length = 0;
+    heap.free_blocks++;
+    heap.free_units += blk->size;
 }
 
 /**
- * @brief Compress the blocks in the Heap to help deal with fragmentation
+ * @brief Takes a free block out of its size class
  */
-static void compact_heap(void) {
-    if(PRINT_DEBUG) Dbprintf(" - Palloc: Compacting heap...");
+static void remove_free(pBlock *blk) {
+    uint8_t fl, sl;
+    mapping(blk->size, &fl, &sl);
 
-    pBlock *ptr = heap->free;
-    pBlock *prev, *scan;
+    pLinks *links = block_links(blk);
 
-    while(ptr != nullptr) {
-        prev = ptr;
-        scan = ptr->next;
+    if(links->next != BLOCK_NIL) block_links(block_at(links->next))->prev = links->prev;
 
-        while(scan != nullptr && ((size_t)prev->address + prev->size == (size_t)scan->address)) {
-            prev = scan;
-            scan = scan->next;
+    if(links->prev != BLOCK_NIL) {
+        block_links(block_at(links->prev))->next = links->next;
+    } else {
+        heap.heads[fl][sl] = links->next;
+
+        if(links->next == BLOCK_NIL) { // That was the last block of this class
+            heap.sl_map[fl] &= ~(1 << sl);
+            if(heap.sl_map[fl] == 0) heap.fl_map &= ~(1 << fl);
         }
+    }
+
+    heap.free_blocks--;
+    heap.free_units -= blk->size;
+}
+
+/**
+ * @brief Finds a free block of at least `units`. The head of the request's own class is taken if
+ * it is big enough, otherwise the request is rounded up to the next size class, so the head of
+ * any non-empty class at or above it is big enough and we can pick it straight from the bitmaps.
+ * Like TLSF we never walk a free list, so a request above the lower bound of the largest class
+ * can fail even if a block in that class would fit it. `palloc_largest_free()` returns that
+ * lower bound.
+ *
+ * @param units The block size we need, header included
+ * @return A free block that is big enough, or `nullptr` if there is none
+ */
+static pBlock *find_free(uint16_t units) {
+    uint8_t fl, sl;
+    uint32_t rounded = units;
+
+    mapping(units, &fl, &sl);
 
-        if(prev != ptr) { // We can merge blocks together. This DOESN'T check against the 32kb max size we have
-            if(PRINT_EXTEND) Dbprintf(" - Palloc: Merging blocks 0x%4x & 0x%4x...", ptr->address, prev->address);
-            size_t newSize = ((size_t)prev->address - (size_t)ptr->address + prev->size);
-            ptr->size = newSize;
-            pBlock *next = prev->next;
+    if(heap.heads[fl][sl] != BLOCK_NIL && block_at(heap.heads[fl][sl])->size >= units) {
+        return block_at(heap.heads[fl][sl]);
+    }
+
+    if(rounded >= SL_COUNT) rounded += (1 << (fls16(units) - SL_LOG2)) - 1;
+
+    if(rounded < (1 << (FL_COUNT + SL_LOG2 - 1))) {
+        mapping((uint16_t)rounded, &fl, &sl);
+
+        uint16_t sl_map = heap.sl_map[fl] & (0xFF << sl);
 
-            merge_blocks(ptr->next, prev->next);
+        if(sl_map == 0) { // Nothing in this first level class, move up to the next one we have
+            uint16_t fl_map = heap.fl_map & (0xFFFF << (fl + 1));
 
-            ptr->next = next;
+            if(fl_map != 0) {
+                fl = ffs16(fl_map);
+                sl_map = heap.sl_map[fl];
+            }
         }
 
-        ptr = ptr->next;
+        if(sl_map != 0) return block_at(heap.heads[fl][ffs16(sl_map)]);
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Initialize the palloc heap on a region of memory. `palloc_init()` does this for the
+ * SRAM left over between `.bss` and the stack, this is split out so the allocator can be run
+ * (and tested) against any other chunk of memory.
+ *
+ * @param start The start of the memory region
+ * @param size The size of the memory region, in bytes
+ */
+void palloc_init_region(void *start, size_t size) {
+    uint8_t *base = (uint8_t*)(((size_t)start + UNIT_BYTES - 1) & ~(size_t)(UNIT_BYTES - 1));
+    size = (size > (size_t)(base - (uint8_t*)start) ? size - (base - (uint8_t*)start) : 0);
+    if(size > MEM_SIZE) size = MEM_SIZE;
+
+    heap.base = base;
+    heap.units = size / UNIT_BYTES;
+    heap.fl_map = 0;
+    heap.used_blocks = 0;
+    heap.free_blocks = 0;
+    heap.free_units = 0;
+
+    for(uint8_t fl = 0; fl < FL_COUNT; fl++) {
+        heap.sl_map[fl] = 0;
+        for(uint8_t sl = 0; sl < SL_COUNT; sl++) heap.heads[fl][sl] = BLOCK_NIL;
+    }
+
+    if(heap.units < UNIT_MIN + 1) { // Not even room for one block
+        heap.base = nullptr;
+        return;
     }
 
-    if(PRINT_DEBUG) Dbprintf(" - Palloc: Heap Compacted!");
+    // One big free block, followed by the end marker that keeps merges inside the heap
+    uint16_t last = heap.units - 1;
+    pBlock *blk = block_at(0);
+    blk->prev = BLOCK_NIL;
+    blk->size = last;
+    insert_free(blk);
+
+    pBlock *end = block_at(last);
+    end->prev = 0;
+    end->size = 0;
+    end->tag = last ^ TAG_END;
+    end->length = 0;
+
+    fpgaQueue.data = nullptr;
+    fpgaQueue.max = -1;
+    fpgaQueue.bit = 8;
+}
+
+#ifdef ON_DEVICE
+/**
+ * @brief Initialize the palloc heap and blocks.
+ * This must be used before any other `palloc_*` function!
+ */
+void palloc_init(void) {
+    palloc_init_region(__bss_end__ + MEM_GUARD, MEM_USABLE - (MEM_GUARD * sizeof(uint32_t)));
 }
+#endif
 
 /**
  * @brief Takes a usable block from the heap and allocates it for the data we need. This will split
  * up blocks as well to keep things as compact as possible.
- * 
+ *
  * @param alloc The amount of space we need to allocate, in bytes
- * @return The pointer to the block of memory we allocated, or `nullptr` if we couldn't allocate the memory
+ * @return The pointer to the memory we allocated, or `nullptr` if we couldn't allocate the memory
  */
-static pBlock *allocate_block(size_t alloc) {
+static void *allocate_block(size_t alloc) {
     if(PRINT_DEBUG) Dbprintf(" - Palloc: Allocating block with size of %u", alloc);
-    pBlock *ptr = heap->free;
-    pBlock *prev = nullptr;
-    size_t top = heap->top;
-
-    // Try to get a free block
-    while(ptr != nullptr) {
-        const bool isTop = ((size_t)ptr->address + ptr->size >= top);
-
-        if(isTop || ptr->size >= alloc) {
-            if(PRINT_EXTEND) Dbprintf(" - Palloc: Found suitable block! (isTop = %s, blk->size = %d)", (isTop ? "true" : "false"), ptr->size);
-            if(prev != nullptr) prev->next = ptr->next;
-            else heap->free = ptr->next;
-
-            ptr->next = heap->used;
-            heap->used = ptr;
-
-            if(isTop) {
-                ptr->size = alloc;
-                heap->top = (size_t)ptr->address + alloc;
-            } else if(heap->fresh != nullptr) {
-                size_t excess = ptr->size - alloc;
-
-                if(excess >= BLOCK_SPLIT_THRESHOLD) { // Split the block
-                    if(PRINT_EXTEND) Dbprintf(" - Palloc: Spliting block 0x%4x...", ptr->address);
-                    ptr->size = alloc;
-                    pBlock *split = heap->fresh;
-                    heap->fresh = split->next;
-                    split->address = (void*)((size_t)ptr->address + alloc);
-                    split->size = excess;
-                    insert_block(split);
-                    compact_heap();
-                }
-            }
 
-            return ptr;
-        }
+    if(heap.base == nullptr || alloc == 0 || alloc > MAX_BLOCK_SIZE) return nullptr;
+
+    uint16_t units = (alloc + sizeof(pBlock) + UNIT_BYTES - 1) / UNIT_BYTES;
+    if(units < UNIT_MIN) units = UNIT_MIN;
 
-        prev = ptr;
-        ptr = ptr->next;
+    pBlock *blk = find_free(units);
+
+    if(blk == nullptr) {
+        if(PRINT_ERROR) Dbprintf(" - Palloc: "_RED_("Unable to allocate a new block!"));
+        return nullptr;
     }
 
-    // We didn't match any free blocks, try to get a fresh one
-    if(heap->fresh != nullptr) {
-        if(PRINT_EXTEND) Dbprintf(" - Palloc: Using a fresh block for allocation...");
-        ptr = heap->fresh;
-        heap->fresh = ptr->next;
-        ptr->address = (void*)top;
-        ptr->next = heap->used;
-        ptr->size = alloc;
-        heap->used = ptr;
-        heap->top = top + alloc;
+    remove_free(blk);
 
-        return ptr;
+    uint16_t offset = block_offset(blk);
+
+    if(blk->size - units >= UNIT_MIN) { // Split off what we don't need
+        if(PRINT_EXTEND) Dbprintf(" - Palloc: Spliting block 0x%4x...", blk);
+        pBlock *split = block_at(offset + units);
+        split->prev = offset;
+        split->size = blk->size - units;
+        block_at(offset + blk->size)->prev = offset + units;
+        blk->size = units;
+        insert_free(split); // The block after this one is never free, no need to merge
     }
 
-    if(PRINT_ERROR) Dbprintf(" - Palloc: "_RED_("Unable to allocate a new block!"));
+    blk->tag = offset ^ TAG_USED;
+    blk->length = alloc;
+    heap.used_blocks++;
 
-    // We were unable to get a block
-    return nullptr;
-    
+    return blk + 1;
 }
 
 /**
  * @brief Allocates a block of memory to use. This acts like `calloc` internally, so the pointer
  * that's returned can safely be used and won't have issues with garbage data. Each block has a
  * hard limit of 32kb that can be allocated for, any amount over this will return a nullptr
- * 
+ *
  * @param numElement The number of elements to allocate data for
  * @param size The size of each element
  * @return the address of the block of memory, or nullptr
@@ -290,28 +360,23 @@ static pBlock *allocate_block(size_t alloc) {
 memptr_t *palloc(uint16_t numElement, const uint16_t size) {
     if(PRINT_DEBUG) Dbprintf(" - Palloc: Allocating memory... (size %u numElement %u)", size, numElement);
 
-    if(heap == nullptr) return nullptr; // Can't allocate memory if we haven't initialized any
-    
-    size_t allocSize = numElement * size;
+    if(heap.base == nullptr) return nullptr; // Can't allocate memory if we haven't initialized any
+
+    size_t allocSize = (size_t)numElement * size;
 
     if(PRINT_EXTEND) Dbprintf(" - - Alloc size: %u", allocSize);
 
-    if((allocSize > MAX_BLOCK_SIZE) || (allocSize > free_space)) { // We would overflow if we attempted to allocate this memory
+    if(allocSize > MAX_BLOCK_SIZE) { // We would overflow if we attempted to allocate this memory
         if(PRINT_ERROR) Dbprintf(" - Palloc: "_RED_("Allocation size is too big!") " (%u)", allocSize);
         return nullptr;
-    } else if(allocSize < (numElement * size)) { // Sanity check to make sure we are allocating enough memory
-        if(PRINT_ERROR) Dbprintf(" - Palloc: "_RED_("Allocation sanity check failed!") " (%u < %u * %u)", allocSize, numElement, size);
-        return nullptr;
     }
 
-    pBlock *blk = allocate_block(allocSize);
+    void *ptr = allocate_block(allocSize);
 
-    if(blk != nullptr) {
-        palloc_set(blk->address, 0, blk->size); // Zero the memory
-        free_space -= blk->size; // Remove the space we took up with this allocation
-        if(PRINT_DEBUG) Dbprintf(" - Palloc: Allocated block of memory at 0x%4x with size of %u", blk->address, blk->size);
-        heap->metadata = 0xFF000000;
-        return blk->address;
+    if(ptr != nullptr) {
+        palloc_set(ptr, 0, allocSize); // Zero the memory
+        if(PRINT_DEBUG) Dbprintf(" - Palloc: Allocated block of memory at 0x%4x with size of %u", ptr, allocSize);
+        return ptr;
     }
 
     if(PRINT_ERROR) Dbprintf(" - Palloc: " _RED_("There was an issue with allocating memory!"));
@@ -373,7 +438,7 @@ void palloc_set(void *ptr, const uint16_t value, uint16_t len) {
 
 /**
  * @brief Free the memory a pointer holds
- * 
+ *
  * @param ptr The pointer to free
  * @return true If the memory at pointer was freed
  * @return false otherwise
@@ -383,174 +448,209 @@ bool palloc_free(void *ptr) {
 }
 
 /**
- * @brief Free the memory a pointer holds
- * 
+ * @brief Free the memory a pointer holds. The block is merged with its free neighbours right
+ * away, so the heap never holds two free blocks next to each other.
+ *
  * @param ptr The pointer to free
  * @param verbose Flag to print extended info and debug messages
  * @return true If the memory at pointer was freed
  * @return false otherwise
  */
 bool palloc_freeEX(void *ptr, bool verbose) {
-    if(PRINT_EXTEND) Dbprintf(" - Palloc: Freeing allocated memory at 0x%4x", ptr);
-    if(heap == nullptr) return false; // Can't free memory if we haven't initialized any
-
-    pBlock *blk = heap->used;
-    pBlock *prev = nullptr;
-
-    // Check to see where this memory is at
-    while(blk != nullptr) {
-        if(ptr == blk->address) {
-            if(prev) {
-                prev->next = blk->next;
-            } else {
-                heap->used = blk->next;
-            }
+    if(PRINT_EXTEND || verbose) Dbprintf(" - Palloc: Freeing allocated memory at 0x%4x", ptr);
+    if(heap.base == nullptr) return false; // Can't free memory if we haven't initialized any
+
+    // Make sure this is the start of one of our blocks before touching anything
+    size_t at = (size_t)ptr - (size_t)heap.base;
+    if((uint8_t*)ptr < heap.base + sizeof(pBlock) || (at % UNIT_BYTES) != 0 || (at / UNIT_BYTES) >= heap.units) {
+        if(PRINT_INFO || verbose) Dbprintf(" - Palloc: "_YELLOW_("Couldn't find a block for this memory, are you sure it's ours?"));
+        return false;
+    }
 
-            insert_block(blk); // Insert the block into the free list
-            compact_heap();   // Compact our free space to keep fragmentation low
-            free_space += blk->size; // Add the amount of space back into our counter
+    pBlock *blk = (pBlock*)ptr - 1;
 
-            if(PRINT_DEBUG) Dbprintf(" - Palloc: Memory at 0x%4x Freed!", ptr);
-            heap->metadata = 0xFF000000;
-            return true;
+    if(!block_is(blk, TAG_USED)) {
+        if(PRINT_INFO || verbose) {
+            if(block_is(blk, TAG_FREE)) Dbprintf(" - Palloc: "_YELLOW_("Memory at 0x%4x was already freed!"), ptr);
+            else Dbprintf(" - Palloc: "_YELLOW_("Couldn't find a block for this memory, are you sure it's ours?"));
         }
-
-        prev = blk;
-        blk = blk->next;
+        return false;
     }
 
-    if(PRINT_INFO) Dbprintf(" - Palloc: "_YELLOW_("Couldn't find a block for this memory, are you sure it's ours?"));
-
-    return false; // Couldn't find the address of this memory in our blocks
-}
+    heap.used_blocks--;
+    uint16_t offset = block_offset(blk);
 
-/**
- * @brief Returns the amount of blocks in a specific Block container
- * 
- * @param ptr The pointer of the Block container to count
- * @return The amount of blocks in that container (`int8_t`) or -1 for uninitialized heap
- */
-static int count_blocks(pBlock *ptr) {
-    if(heap == nullptr) return -1;
+    // Headers that get merged away are wiped, so a second free of the same pointer is caught
+    pBlock *next = block_at(offset + blk->size);
+    if(block_is(next, TAG_FREE)) {
+        remove_free(next);
+        blk->size += next->size;
+        block_at(offset + blk->size)->prev = offset;
+        next->tag = 0;
+    }
 
-    int count = 0;
+    if(blk->prev != BLOCK_NIL) {
+        pBlock *prev = block_at(blk->prev);
 
-    while(ptr != nullptr) {
-        count++;
-        pBlock *blk = ptr->next;
-        if(blk == nullptr) break;
-        ptr = blk->next;
+        if(block_is(prev, TAG_FREE)) {
+            remove_free(prev);
+            prev->size += blk->size;
+            block_at(blk->prev + prev->size)->prev = blk->prev;
+            blk->tag = 0;
+            blk = prev;
+        }
     }
 
-    if(PRINT_EXTEND) Dbprintf("count = %d", count);
+    insert_free(blk);
 
-    return count;
+    if(PRINT_DEBUG || verbose) Dbprintf(" - Palloc: Memory at 0x%4x Freed!", ptr);
+    return true;
 }
 
 /**
  * @brief Returns the amount of Blocks that are free to use
- * (These blocks were previously used)
- * 
+ *
  * @return The number of free blocks in the Heap, or -1 if the heap hasn't been initialized
  */
 int palloc_free_blocks(void) {
-    if(PRINT_EXTEND) Dbprintf("palloc_free_blocks");
-    return count_blocks(heap->free);
+    if(heap.base == nullptr) return -1;
+    return heap.free_blocks;
 }
 
 /**
  * @brief Returns the amount of Blocks that are currently being used
- * 
+ *
  * @return The number of used Blocks in the Heap, or -1 if the heap hasn't been initialized
  */
 int palloc_used_blocks(void) {
-    if(PRINT_EXTEND) Dbprintf("palloc_used_blocks");
-    return count_blocks(heap->used);
-}
-
-/**
- * @brief Returns the number of Blocks that haven't been used before
- * 
- * @return The number of fresh Blocks in the Heap, or -1 if the heap hasn't been initialized
- */
-int palloc_fresh_blocks(void) {
-    if(PRINT_EXTEND) Dbprintf("palloc_fresh_blocks");
-    return count_blocks(heap->fresh);
+    if(heap.base == nullptr) return -1;
+    return heap.used_blocks;
 }
 
 /**
  * @brief Returns the amount of sram we have left to allocate stuff with. This is only taking the
  * microprocessor sram into account, not any connect flash memory space
- * 
- * @return The amount of sram we have left, in bytes 
+ *
+ * @note This is the total over all free blocks, use `palloc_largest_free()` to size a buffer
+ * @return The amount of sram we have left, in bytes
  */
 size_t palloc_sram_left(void) {
-    return free_space;
+    if(heap.base == nullptr) return 0;
+    return ((size_t)heap.free_units * UNIT_BYTES) - (heap.free_blocks * sizeof(pBlock));
 }
 
 /**
- * @brief Manually compact the heap. Palloc does a good job at doing this itself, but in some
- * dire situations, it might be useful to manually do it.
+ * @brief Returns the biggest single allocation that will currently succeed, capped at
+ * `MAX_BLOCK_SIZE`. Use this to size buffers that should take "whatever is left".
+ *
+ * @note This is the lower bound of the highest non-empty size class, the largest free block
+ * can be up to 1/8th bigger than that (see `find_free()`)
+ * @return The size of the largest allocation we can make, in bytes
  */
-void palloc_compact_heap(void) {
-    if(heap == nullptr) return; // Sanity checking
+size_t palloc_largest_free(void) {
+    if(heap.base == nullptr || heap.fl_map == 0) return 0;
 
-    compact_heap();
+    uint8_t fl = fls16(heap.fl_map);
+    uint8_t sl = fls16(heap.sl_map[fl]);
+    uint16_t units = (fl == 0 ? sl : (uint16_t)((SL_COUNT + sl) << (fl - 1)));
+
+    size_t largest = ((size_t)units * UNIT_BYTES) - sizeof(pBlock);
+    return (largest > MAX_BLOCK_SIZE ? MAX_BLOCK_SIZE : largest);
 }
 
 /**
- * @brief Checks the integrity of the heap
- * 
- * @return `true` if the heap is okay 
+ * @brief Checks the integrity of the heap. This walks every block, so keep it out of anything
+ * timing sensitive.
+ *
+ * @return `true` if the heap is okay
  * @return `false` otherwise
  */
 bool palloc_heap_integrity(void) {
-    int count = palloc_used_blocks();
+    if(heap.base == nullptr) return false;
 
-    return count == 0;
+    uint16_t offset = 0, prev = BLOCK_NIL;
+    uint16_t n_used = 0, n_free = 0, free_units = 0;
+    bool last_free = false;
+
+    // Walk the blocks in address order
+    while(offset < heap.units) {
+        pBlock *blk = block_at(offset);
+        if(blk->prev != prev) return false;
+
+        if(block_is(blk, TAG_END)) {
+            if(offset != heap.units - 1) return false;
+            break;
+        }
+
+        bool is_free = block_is(blk, TAG_FREE);
+        if(!is_free && !block_is(blk, TAG_USED)) return false;
+        if(blk->size < UNIT_MIN || (is_free && last_free)) return false; // Free neighbours should have merged
+
+        if(is_free) {
+            n_free++;
+            free_units += blk->size;
+        } else {
+            n_used++;
+        }
+
+        last_free = is_free;
+        prev = offset;
+        offset += blk->size;
+    }
+
+    if(offset != heap.units - 1 || n_used != heap.used_blocks || n_free != heap.free_blocks || free_units != heap.free_units) return false;
+
+    // Every free block has to be filed under the class its size maps to
+    uint16_t listed = 0;
+    for(uint8_t fl = 0; fl < FL_COUNT; fl++) {
+        if(((heap.fl_map >> fl) & 1) != (heap.sl_map[fl] != 0)) return false;
+
+        for(uint8_t sl = 0; sl < SL_COUNT; sl++) {
+            if(((heap.sl_map[fl] >> sl) & 1) != (heap.heads[fl][sl] != BLOCK_NIL)) return false;
+
+            for(uint16_t at = heap.heads[fl][sl]; at != BLOCK_NIL; at = block_links(block_at(at))->next) {
+                uint8_t bfl, bsl;
+                if(at >= heap.units || !block_is(block_at(at), TAG_FREE)) return false;
+                mapping(block_at(at)->size, &bfl, &bsl);
+                if(bfl != fl || bsl != sl || ++listed > n_free) return false;
+            }
+        }
+    }
+
+    return listed == n_free;
 }
 
 void palloc_status(void) {
     Dbprintf("--- " _CYAN_("Memory") " --------------------");
-    Dbprintf(" - Heap Top:............... "_YELLOW_("0x%4x"), heap->top);
-    Dbprintf(" - Usable:................. "_YELLOW_("%d"), MEM_USABLE);
+    Dbprintf(" - Heap Start:............. "_YELLOW_("0x%4x"), heap.base);
+    Dbprintf(" - Usable:................. "_YELLOW_("%d"), palloc_sram_size());
     Dbprintf(" - Free:................... "_YELLOW_("%d"), palloc_sram_left());
-    Dbprintf(" - Heap Initialized:....... %s", (heap != nullptr ? _GREEN_("YES") : _RED_("NO")));
+    Dbprintf(" - Largest Free:........... "_YELLOW_("%d"), palloc_largest_free());
+    Dbprintf(" - Heap Initialized:....... %s", (heap.base != nullptr ? _GREEN_("YES") : _RED_("NO")));
     Dbprintf(" - Heap Status:............ %s", (palloc_heap_integrity() ? _GREEN_("OK") : _RED_("INTEGRITY ISSUES")));
 
     Dbprintf("--- " _CYAN_("Blocks") " --------------------");
-    Dbprintf(" - Fresh:.................. "_YELLOW_("%d"), palloc_fresh_blocks());
     Dbprintf(" - Used:................... "_YELLOW_("%d"), palloc_used_blocks());
     Dbprintf(" - Free:................... "_YELLOW_("%d"), palloc_free_blocks());
 }
 
-uint32_t palloc_sram_size() {
-    return MEM_USABLE;
+uint32_t palloc_sram_size(void) {
+    return (heap.base == nullptr ? 0 : (uint32_t)heap.units * UNIT_BYTES);
 }
 
 /**
  * @brief Create a general purpose 8-bit buffer
- * 
+ *
  * @param numElement the amount of elements in this buffer
  * @return a buffer8u_t object, or an empty buffer if we couldn't allocate the space for it
  */
 buffer8u_t palloc_buffer8(uint16_t numElement) {
     buffer8u_t buffer = { .data = nullptr, .size = 0 }; // initialize a "empty" buffer
 
-    if(heap == nullptr || numElement > MAX_BLOCK_SIZE) return buffer; // Sanity checking
-
-    if(numElement & ALIGN_MASK) { // Make sure we align our sizes
-        numElement = (numElement + ALIGN_BYTES - 1) & ~ALIGN_MASK;
-    }
-
-    // We would overflow if we attempted to allocate this memory
-    if((numElement > free_space)) return buffer; // Return the "empty" buffer
-
-    pBlock *blk = allocate_block(numElement);
-    if(blk != nullptr) {
-        palloc_set(blk->address, 0, blk->size); // Remove any garbage
-        buffer.data = (uint8_t*)blk->address;
-        buffer.size = blk->size;
+    buffer.data = (uint8_t*)allocate_block(numElement);
+    if(buffer.data != nullptr) {
+        palloc_set(buffer.data, 0, numElement); // Remove any garbage
+        buffer.size = numElement;
     }
 
     return buffer;
@@ -558,7 +658,7 @@ buffer8u_t palloc_buffer8(uint16_t numElement) {
 
 /**
  * @brief Create a general purpose 16-bit buffer
- * 
+ *
  * @param numElement the amount of elements in this buffer
  * @return a buffer16u_t object, or an empty buffer if we couldn't allocate the space for it
  */
@@ -566,20 +666,10 @@ buffer16u_t palloc_buffer16(uint16_t numElement) {
     buffer16u_t buffer = { .data = nullptr, .size = 0 }; // initialize a "empty" buffer
     size_t alloc = numElement * sizeof(uint16_t); // Adjust for the buffer type
 
-    if(heap == nullptr || alloc > MAX_BLOCK_SIZE) return buffer; // Sanity checking
-
-    if(alloc & ALIGN_MASK) { // Make sure we align our sizes
-        alloc = (alloc + ALIGN_BYTES - 1) & ~ALIGN_MASK;
-    }
-
-    // We would overflow if we attempted to allocate this memory
-    if((alloc > free_space)) return buffer; // Return the "empty" buffer
-
-    pBlock *blk = allocate_block(alloc);
-    if(blk != nullptr) {
-        palloc_set(blk->address, 0, blk->size); // Remove any garbage
-        buffer.data = (uint16_t*)blk->address;
-        buffer.size = blk->size;
+    buffer.data = (uint16_t*)allocate_block(alloc);
+    if(buffer.data != nullptr) {
+        palloc_set(buffer.data, 0, alloc); // Remove any garbage
+        buffer.size = alloc;
     }
 
     return buffer;
@@ -587,7 +677,7 @@ buffer16u_t palloc_buffer16(uint16_t numElement) {
 
 /**
  * @brief Create a general purpose 32-bit buffer
- * 
+ *
  * @param numElement the amount of elements in this buffer
  * @return a buffer32u_t object, or an empty buffer if we couldn't allocate the space for it
  */
@@ -595,20 +685,10 @@ buffer32u_t palloc_buffer32(uint16_t numElement) {
     buffer32u_t buffer = { .data = nullptr, .size = 0 }; // initialize a "empty" buffer
     size_t alloc = numElement * sizeof(uint32_t); // Adjust for the buffer type
 
-    if(heap == nullptr || alloc > MAX_BLOCK_SIZE) return buffer; // Sanity checking
-
-    if(alloc & ALIGN_MASK) { // Make sure we align our sizes
-        alloc = (alloc + ALIGN_BYTES - 1) & ~ALIGN_MASK;
-    }
-
-    // We would overflow if we attempted to allocate this memory
-    if((alloc > free_space)) return buffer; // Return the "empty" buffer
-
-    pBlock *blk = allocate_block(alloc);
-    if(blk != nullptr) {
-        palloc_set(blk->address, 0, blk->size); // Remove any garbage
-        buffer.data = (uint32_t*)blk->address;
-        buffer.size = blk->size;
+    buffer.data = (uint32_t*)allocate_block(alloc);
+    if(buffer.data != nullptr) {
+        palloc_set(buffer.data, 0, alloc); // Remove any garbage
+        buffer.size = alloc;
     }
 
     return buffer;
@@ -616,16 +696,15 @@ buffer32u_t palloc_buffer32(uint16_t numElement) {
 
 /**
  * @brief Get the fpga queue object
- * 
+ *
  * @return The FPGA queue, or `nullptr` if there was an issue allocating memory for it
  */
 fpga_queue_t *get_fpga_queue(void) {
     if(fpgaQueue.data == nullptr) { // If the queue hasn't been initialized yet, do so
-        pBlock *blk = allocate_block(QUEUE_BUFFER_SIZE);
+        fpgaQueue.data = (uint8_t*)allocate_block(QUEUE_BUFFER_SIZE);
 
-        if(blk != nullptr) { // If we did get data to initialize
-            palloc_set(blk->address, 0, blk->size); // Remove any garbage
-            fpgaQueue.data = blk->address;
+        if(fpgaQueue.data != nullptr) { // If we did get data to initialize
+            palloc_set(fpgaQueue.data, 0, QUEUE_BUFFER_SIZE); // Remove any garbage
         } else return nullptr;
     }
 
@@ -32,17 +32,24 @@
 // handle situations where we can't allocate memory. It is also up to the
 // functions that request memory to free it after it's done with it. The
 // Proxmark3 only has 64kb of memory, so every bit literally counts
+//
+// Free memory is kept in segregated size classes (two level bitmaps, like
+// TLSF), so allocating and freeing takes the same few steps no matter how
+// many blocks are around. Neighbouring free blocks are merged as soon as a
+// block is freed, there is no separate compaction pass to run.
 //-----------------------------------------------------------------------------
 
 #define MAX_FRAME_SIZE    256 // maximum allowed ISO14443 frame
 #define MAX_PARITY_SIZE   ((MAX_FRAME_SIZE + 7) / 8)
 #define MAX_BLOCK_SIZE    32000 // 32k should be more than enough
+#define TRACE_HEAP_RESERVE 8192 // what get_max_trace_length() leaves for the buffers next to the trace
 
 //====================
 // General Functions
 //====================
 
 void palloc_init(void);
+void palloc_init_region(void *start, size_t size);
 memptr_t *palloc(uint16_t numElement, const uint16_t size);
 void palloc_copy(void *ptr, const void *src, uint16_t len);
 void palloc_set(void *ptr, const uint16_t value, uint16_t len);
@@ -51,9 +58,8 @@ bool palloc_freeEX(void *ptr, bool verbose);
 
 int palloc_free_blocks(void);
 int palloc_used_blocks(void);
-int palloc_fresh_blocks(void);
 size_t palloc_sram_left(void);
-void palloc_compact_heap(void);
+size_t palloc_largest_free(void);
 bool palloc_heap_integrity(void);
 
 void palloc_status(void);
@@ -26,8 +26,8 @@
 #include "dbprint.h"
 #include "util.h"
 
-static uint16_t trace_len = 0;       // How long our current trace is
-static uint16_t free_space = 0;      // The amount of free space, in bytes
+static uint32_t trace_len = 0;       // How long our current trace is
+static uint32_t free_space = 0;      // The amount of free space, in bytes
 static bool tracing = false;         // Flag for if we are currently tracing or not
 static memptr_t *blk_addr = nullptr; // The address to the space we have from palloc
 
@@ -82,10 +82,14 @@ bool is_tracing(void) {
 /**
  * @brief Get the maximum trace length we can have stored in memory (max is 32kb)
  * 
+ * The trace is held for the whole command, so it leaves `TRACE_HEAP_RESERVE` bytes (or half of
+ * what is left, on a tight heap) of the largest free block for everything else.
+ * 
  * @return the maximum amount of space we can use for trace data
  */
-uint16_t get_max_trace_length(void) {
-    return (palloc_sram_left() > MAX_BLOCK_SIZE ? MAX_BLOCK_SIZE : palloc_sram_left());
+uint32_t get_max_trace_length(void) {
+    size_t largest = palloc_largest_free();
+    return (largest > 2 * TRACE_HEAP_RESERVE ? largest - TRACE_HEAP_RESERVE : largest / 2);
 }
 
 /**
@@ -93,14 +97,14 @@ uint16_t get_max_trace_length(void) {
  * 
  * @return the length of the trace
  */
-uint16_t get_trace_length(void) {
+uint32_t get_trace_length(void) {
     return trace_len;
 }
 
 /**
  * @brief Returns the amount of space we have left that we can store trace data, in bytes
  */
-uint16_t get_trace_space_left(void) {
+uint32_t get_trace_space_left(void) {
     return free_space;
 }
 
@@ -161,7 +165,7 @@ bool RAMFUNC log_trace(const uint8_t *trace, uint16_t len, uint32_t ts_start, ui
     uint16_t num_parity = (len - 1) / 8 + 1; // number of valid paritybytes in *parity
 
     // Check to make sure we won't overflow our block of memory
-    if(TRACELOG_HDR_LEN + len + num_parity >= get_max_trace_length() - trace_len) {
+    if(TRACELOG_HDR_LEN + len + num_parity >= free_space - trace_len) {
         if(PRINT_ERROR) Dbprintf(_RED_("Cannot trace anymore! Memory almost full!"));
         tracing = false;
         return false;
@@ -59,6 +59,7 @@ THE SOFTWARE.
 #include <string.h>
 #include "crapto1/crapto1.h"
 #include "parity.h"
+#include "commonutil.h"     // ARRAYLEN
 #include "ui.h"             // PrintAndLogEx
 //#include "common.h"
 
@@ -445,6 +446,12 @@ uint64_t CRACK_STATES_BITSLICED(uint32_t cuid, uint8_t *best_first_bytes, statel
 #if MAX_BITSLICES > 128
                                 && results.bytes64[2] == 0
                                 && results.bytes64[3] == 0
+#endif
+#if MAX_BITSLICES > 256
+                                && results.bytes64[4] == 0
+                                && results.bytes64[5] == 0
+                                && results.bytes64[6] == 0
+                                && results.bytes64[7] == 0
 #endif
                            ) {
 #if defined (DEBUG_BRUTE_FORCE)
@@ -552,6 +559,56 @@ out:
 
 #ifdef NOSIMD_BUILD
 
+// trailing_zeros() and verify_key() are compiled once, in the NOSIMD build, and live here
+// so that standalone tools (tools/hardnested_worker) can link them together with the bitsliced cores.
+uint8_t trailing_zeros(uint8_t byte) {
+    static const uint8_t trailing_zeros_LUT[256] = {
+        8, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        7, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
+        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
+    };
+
+    return trailing_zeros_LUT[byte];
+}
+
+// unsliced check of a candidate against all other acquired nonces
+bool verify_key(uint32_t cuid, noncelist_t *nonces, const uint8_t *best_first_bytes, uint32_t odd, uint32_t even) {
+    struct Crypto1State pcs;
+    for (uint16_t test_first_byte = 1; test_first_byte < 256; test_first_byte++) {
+        noncelistentry_t *test_nonce = nonces[best_first_bytes[test_first_byte]].first;
+        while (test_nonce != NULL) {
+            pcs.odd = odd;
+            pcs.even = even;
+            lfsr_rollback_byte(&pcs, (cuid >> 24) ^ best_first_bytes[0], true);
+            for (int8_t byte_pos = 3; byte_pos >= 0; byte_pos--) {
+                uint8_t test_par_enc_bit = (test_nonce->par_enc >> byte_pos) & 0x01;     // the encoded parity bit
+                uint8_t test_byte_enc = (test_nonce->nonce_enc >> (8 * byte_pos)) & 0xff; // the encoded nonce byte
+                uint8_t test_byte_dec = crypto1_byte(&pcs, test_byte_enc /* ^ (cuid >> (8*byte_pos)) */, true) ^ test_byte_enc; // decode the nonce byte
+                uint8_t ks_par = filter(pcs.odd);                                        // the keystream bit to encode/decode the parity bit
+                uint8_t test_par_enc2 = ks_par ^ evenparity8(test_byte_dec);             // determine the decoded byte's parity and encode it
+                if (test_par_enc_bit != test_par_enc2) {
+                    return false;
+                }
+            }
+            test_nonce = test_nonce->next;
+        }
+    }
+    return true;
+}
+
 // pointers to functions:
 crack_states_bitsliced_t *crack_states_bitsliced_function_p = &crack_states_bitsliced_dispatch;
 bitslice_test_nonces_t *bitslice_test_nonces_function_p = &bitslice_test_nonces_dispatch;
@@ -565,119 +622,116 @@ void SetSIMDInstr(SIMDExecInstr instr) {
     bitslice_test_nonces_function_p = &bitslice_test_nonces_dispatch;
 }
 
-static SIMDExecInstr GetSIMDInstr(void) {
-    SIMDExecInstr instr;
-
-#if defined(COMPILER_HAS_SIMD_X86)
-    __builtin_cpu_init();
-#endif
+// Registry of the brute force kernels compiled into this binary, best first.
+// The first one supported by the CPU is used unless another one was chosen with SetSIMDInstr().
+typedef struct {
+    bf_kernel_t info;
+    crack_states_bitsliced_t *crack_states;
+    bitslice_test_nonces_t *bitslice_test_nonces;
+} bf_kernel_entry_t;
 
+static bf_kernel_entry_t bf_kernels[] = {
 #if defined(COMPILER_HAS_SIMD_AVX512)
-    if (__builtin_cpu_supports("avx512f"))
-        instr = SIMD_AVX512;
-    else
+    { { SIMD_AVX512, "AVX512F", 512, 0.0 }, crack_states_bitsliced_AVX512, bitslice_test_nonces_AVX512 },
 #endif
 #if defined(COMPILER_HAS_SIMD_X86)
-        if (__builtin_cpu_supports("avx2"))
-            instr = SIMD_AVX2;
-        else if (__builtin_cpu_supports("avx"))
-            instr = SIMD_AVX;
-        else if (__builtin_cpu_supports("sse2"))
-            instr = SIMD_SSE2;
-        else if (__builtin_cpu_supports("mmx"))
-            instr = SIMD_MMX;
-        else
+    { { SIMD_AVX2,   "AVX2",    256, 0.0 }, crack_states_bitsliced_AVX2,   bitslice_test_nonces_AVX2 },
+    { { SIMD_AVX,    "AVX",     128, 0.0 }, crack_states_bitsliced_AVX,    bitslice_test_nonces_AVX },
+    { { SIMD_SSE2,   "SSE2",    128, 0.0 }, crack_states_bitsliced_SSE2,   bitslice_test_nonces_SSE2 },
+    { { SIMD_MMX,    "MMX",      64, 0.0 }, crack_states_bitsliced_MMX,    bitslice_test_nonces_MMX },
 #endif
 #if defined(COMPILER_HAS_SIMD_NEON)
-            if (arm_has_neon())
-                instr = SIMD_NEON;
-            else
+    { { SIMD_NEON,   "NEON",    128, 0.0 }, crack_states_bitsliced_NEON,   bitslice_test_nonces_NEON },
 #endif
-                instr = SIMD_NONE;
+    { { SIMD_NONE,   "no",       64, 0.0 }, crack_states_bitsliced_NOSIMD, bitslice_test_nonces_NOSIMD },
+};
 
-    return instr;
+uint32_t bf_kernel_count(void) {
+    return ARRAYLEN(bf_kernels);
 }
 
-SIMDExecInstr GetSIMDInstrAuto(void) {
-    SIMDExecInstr instr = intSIMDInstr;
-    if (instr == SIMD_AUTO)
-        return GetSIMDInstr();
-
-    return instr;
+bf_kernel_t *bf_kernel_get(uint32_t idx) {
+    if (idx >= ARRAYLEN(bf_kernels))
+        return NULL;
+    return &bf_kernels[idx].info;
 }
 
-// determine the available instruction set at runtime and call the correct function
-uint64_t crack_states_bitsliced_dispatch(uint32_t cuid, uint8_t *best_first_bytes, statelist_t *p,
-                                         uint32_t *keys_found, uint64_t *num_keys_tested,
-                                         uint32_t nonces_to_bruteforce, const uint8_t *bf_test_nonce_2nd_byte,
-                                         noncelist_t *nonces) {
-    switch (GetSIMDInstrAuto()) {
+bool bf_kernel_supported(const bf_kernel_t *kernel) {
+#if defined(COMPILER_HAS_SIMD_X86)
+    __builtin_cpu_init();
+#endif
+    // __builtin_cpu_supports() wants a string literal
+    switch (kernel->instr) {
 #if defined(COMPILER_HAS_SIMD_AVX512)
         case SIMD_AVX512:
-            crack_states_bitsliced_function_p = &crack_states_bitsliced_AVX512;
-            break;
+            return __builtin_cpu_supports("avx512f");
 #endif
 #if defined(COMPILER_HAS_SIMD_X86)
         case SIMD_AVX2:
-            crack_states_bitsliced_function_p = &crack_states_bitsliced_AVX2;
-            break;
+            return __builtin_cpu_supports("avx2");
         case SIMD_AVX:
-            crack_states_bitsliced_function_p = &crack_states_bitsliced_AVX;
-            break;
+            return __builtin_cpu_supports("avx");
         case SIMD_SSE2:
-            crack_states_bitsliced_function_p = &crack_states_bitsliced_SSE2;
-            break;
+            return __builtin_cpu_supports("sse2");
         case SIMD_MMX:
-            crack_states_bitsliced_function_p = &crack_states_bitsliced_MMX;
-            break;
+            return __builtin_cpu_supports("mmx");
 #endif
 #if defined(COMPILER_HAS_SIMD_NEON)
         case SIMD_NEON:
-            crack_states_bitsliced_function_p = &crack_states_bitsliced_NEON;
-            break;
+            return arm_has_neon();
 #endif
         case SIMD_AUTO:
+            return false;
         case SIMD_NONE:
-            crack_states_bitsliced_function_p = &crack_states_bitsliced_NOSIMD;
-            break;
+            return true;
+    }
+    return false;
+}
+
+static bf_kernel_entry_t *find_kernel(SIMDExecInstr instr) {
+    for (uint32_t i = 0; i < ARRAYLEN(bf_kernels); i++) {
+        if (bf_kernels[i].info.instr == instr)
+            return &bf_kernels[i];
     }
+    // NOSIMD is always last
+    return &bf_kernels[ARRAYLEN(bf_kernels) - 1];
+}
 
+static SIMDExecInstr GetSIMDInstr(void) {
+    for (uint32_t i = 0; i < ARRAYLEN(bf_kernels); i++) {
+        if (bf_kernel_supported(&bf_kernels[i].info))
+            return bf_kernels[i].info.instr;
+    }
+    return SIMD_NONE;
+}
+
+SIMDExecInstr GetSIMDInstrAuto(void) {
+    SIMDExecInstr instr = intSIMDInstr;
+    if (instr == SIMD_AUTO)
+        return GetSIMDInstr();
+
+    return instr;
+}
+
+// switch both function pointers at once, test nonces and cracking must use the same kernel
+void bf_kernel_select(const bf_kernel_t *kernel) {
+    bf_kernel_entry_t *k = find_kernel(kernel ? kernel->instr : GetSIMDInstrAuto());
+    crack_states_bitsliced_function_p = k->crack_states;
+    bitslice_test_nonces_function_p = k->bitslice_test_nonces;
+}
+
+// determine the available instruction set at runtime and call the correct function
+uint64_t crack_states_bitsliced_dispatch(uint32_t cuid, uint8_t *best_first_bytes, statelist_t *p,
+                                         uint32_t *keys_found, uint64_t *num_keys_tested,
+                                         uint32_t nonces_to_bruteforce, const uint8_t *bf_test_nonce_2nd_byte,
+                                         noncelist_t *nonces) {
+    bf_kernel_select(NULL);
     // call the most optimized function for this CPU
     return (*crack_states_bitsliced_function_p)(cuid, best_first_bytes, p, keys_found, num_keys_tested, nonces_to_bruteforce, bf_test_nonce_2nd_byte, nonces);
 }
 
 void bitslice_test_nonces_dispatch(uint32_t nonces_to_bruteforce, const uint32_t *bf_test_nonce, const uint8_t *bf_test_nonce_par) {
-    switch (GetSIMDInstrAuto()) {
-#if defined(COMPILER_HAS_SIMD_AVX512)
-        case SIMD_AVX512:
-            bitslice_test_nonces_function_p = &bitslice_test_nonces_AVX512;
-            break;
-#endif
-#if defined(COMPILER_HAS_SIMD_X86)
-        case SIMD_AVX2:
-            bitslice_test_nonces_function_p = &bitslice_test_nonces_AVX2;
-            break;
-        case SIMD_AVX:
-            bitslice_test_nonces_function_p = &bitslice_test_nonces_AVX;
-            break;
-        case SIMD_SSE2:
-            bitslice_test_nonces_function_p = &bitslice_test_nonces_SSE2;
-            break;
-        case SIMD_MMX:
-            bitslice_test_nonces_function_p = &bitslice_test_nonces_MMX;
-            break;
-#endif
-#if defined(COMPILER_HAS_SIMD_NEON)
-        case SIMD_NEON:
-            bitslice_test_nonces_function_p = &bitslice_test_nonces_NEON;
-            break;
-#endif
-        case SIMD_AUTO:
-        case SIMD_NONE:
-            bitslice_test_nonces_function_p = &bitslice_test_nonces_NOSIMD;
-            break;
-    }
-
+    bf_kernel_select(NULL);
     // call the most optimized function for this CPU
     (*bitslice_test_nonces_function_p)(nonces_to_bruteforce, bf_test_nonce, bf_test_nonce_par);
 }
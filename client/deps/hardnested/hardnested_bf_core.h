@@ -90,6 +90,19 @@ typedef enum {
 void SetSIMDInstr(SIMDExecInstr instr);
 SIMDExecInstr GetSIMDInstrAuto(void);
 
+// brute force kernels compiled into this binary, best first
+typedef struct {
+    SIMDExecInstr instr;
+    const char *name;
+    uint16_t lanes;             // keys tested in parallel per bitsliced operation
+    float keys_per_second;      // measured by brute_force_benchmark(), 0 if not measured
+} bf_kernel_t;
+
+uint32_t bf_kernel_count(void);
+bf_kernel_t *bf_kernel_get(uint32_t idx);
+bool bf_kernel_supported(const bf_kernel_t *kernel);
+void bf_kernel_select(const bf_kernel_t *kernel);  // NULL = the one chosen by SetSIMDInstr() / auto detection
+
 uint64_t crack_states_bitsliced(uint32_t cuid, uint8_t *best_first_bytes, statelist_t *p, uint32_t *keys_found, uint64_t *num_keys_tested, uint32_t nonces_to_bruteforce, uint8_t *bf_test_nonce_2nd_byte, noncelist_t *nonces);
 void bitslice_test_nonces(uint32_t nonces_to_bruteforce, uint32_t *bf_test_nonce, uint8_t *bf_test_nonce_par);
 
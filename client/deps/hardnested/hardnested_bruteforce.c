@@ -55,6 +55,7 @@ THE SOFTWARE.
 #include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "common.h"
 #include "proxmark3.h"
@@ -80,6 +81,12 @@ THE SOFTWARE.
 
 #define MIN_BUCKETS_SIZE                128
 
+// checkpointing of the brute force phase
+#define CHECKPOINT_MAGIC                "PM3HNCP"
+#define CHECKPOINT_VERSION              1
+#define CHECKPOINT_INTERVAL_MS          (60 * 1000)
+#define CHECKPOINT_MAX_PHASES           (NUM_SUMS + 1)
+
 typedef enum {
     EVEN_STATE = 0,
     ODD_STATE = 1
@@ -96,53 +103,249 @@ static uint32_t keys_found = 0;
 static uint64_t num_keys_tested;
 static uint64_t found_bs_key = 0;
 
-uint8_t trailing_zeros(uint8_t byte) {
-    static const uint8_t trailing_zeros_LUT[256] = {
-        8, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        7, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0,
-        4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
-    };
-
-    return trailing_zeros_LUT[byte];
+// A phase is one brute_force_bs() call over a given candidate set. The hardnested attack
+// runs one phase per Sum(a8) guess. Each phase remembers which buckets were fully tested.
+typedef struct {
+    uint64_t fingerprint;
+    uint32_t bucket_count;
+    uint8_t *done;
+} bf_phase_t;
+
+static char checkpoint_filename[FILE_PATH_SIZE] = {0};
+static bf_phase_t checkpoint_phases[CHECKPOINT_MAX_PHASES];
+static uint32_t checkpoint_num_phases = 0;
+static bf_phase_t *current_phase = NULL;
+static uint64_t last_checkpoint_time = 0;
+static pthread_mutex_t checkpoint_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void free_checkpoint_phases(void) {
+    for (uint32_t i = 0; i < checkpoint_num_phases; i++) {
+        free(checkpoint_phases[i].done);
+        checkpoint_phases[i].done = NULL;
+    }
+    checkpoint_num_phases = 0;
+    current_phase = NULL;
 }
 
+static bool bucket_is_done(uint32_t bucket) {
+    if (current_phase == NULL) {
+        return false;
+    }
+    return (__atomic_load_n(&current_phase->done[bucket >> 3], __ATOMIC_RELAXED) >> (bucket & 0x07)) & 0x01;
+}
 
-bool verify_key(uint32_t cuid, noncelist_t *nonces, const uint8_t *best_first_bytes, uint32_t odd, uint32_t even) {
-    struct Crypto1State pcs;
-    for (uint16_t test_first_byte = 1; test_first_byte < 256; test_first_byte++) {
-        noncelistentry_t *test_nonce = nonces[best_first_bytes[test_first_byte]].first;
-        while (test_nonce != NULL) {
-            pcs.odd = odd;
-            pcs.even = even;
-            lfsr_rollback_byte(&pcs, (cuid >> 24) ^ best_first_bytes[0], true);
-            for (int8_t byte_pos = 3; byte_pos >= 0; byte_pos--) {
-                uint8_t test_par_enc_bit = (test_nonce->par_enc >> byte_pos) & 0x01;     // the encoded parity bit
-                uint8_t test_byte_enc = (test_nonce->nonce_enc >> (8 * byte_pos)) & 0xff; // the encoded nonce byte
-                uint8_t test_byte_dec = crypto1_byte(&pcs, test_byte_enc /* ^ (cuid >> (8*byte_pos)) */, true) ^ test_byte_enc; // decode the nonce byte
-                uint8_t ks_par = filter(pcs.odd);                                        // the keystream bit to encode/decode the parity bit
-                uint8_t test_par_enc2 = ks_par ^ evenparity8(test_byte_dec);             // determine the decoded byte's parity and encode it
-                if (test_par_enc_bit != test_par_enc2) {
-                    return false;
-                }
-            }
-            test_nonce = test_nonce->next;
+static void set_bucket_done(uint32_t bucket) {
+    if (current_phase == NULL) {
+        return;
+    }
+    __atomic_fetch_or(&current_phase->done[bucket >> 3], 1 << (bucket & 0x07), __ATOMIC_RELAXED);
+}
+
+// caller must hold checkpoint_lock
+static bool write_checkpoint(void) {
+
+    if (checkpoint_filename[0] == '\0') {
+        return false;
+    }
+
+    char tmpfn[FILE_PATH_SIZE + 4];
+    snprintf(tmpfn, sizeof(tmpfn), "%s.tmp", checkpoint_filename);
+
+    FILE *f = fopen(tmpfn, "wb");
+    if (f == NULL) {
+        PrintAndLogEx(WARNING, "Could not write checkpoint " _YELLOW_("%s"), tmpfn);
+        return false;
+    }
+
+    uint32_t version = CHECKPOINT_VERSION;
+    bool ok = (fwrite(CHECKPOINT_MAGIC, 1, 8, f) == 8);
+    ok &= (fwrite(&version, sizeof(version), 1, f) == 1);
+    ok &= (fwrite(&checkpoint_num_phases, sizeof(checkpoint_num_phases), 1, f) == 1);
+
+    for (uint32_t i = 0; i < checkpoint_num_phases && ok; i++) {
+        bf_phase_t *phase = &checkpoint_phases[i];
+        ok &= (fwrite(&phase->fingerprint, sizeof(phase->fingerprint), 1, f) == 1);
+        ok &= (fwrite(&phase->bucket_count, sizeof(phase->bucket_count), 1, f) == 1);
+        for (uint32_t j = 0; j < (phase->bucket_count + 7) / 8 && ok; j++) {
+            uint8_t b = __atomic_load_n(&phase->done[j], __ATOMIC_RELAXED);
+            ok &= (fwrite(&b, 1, 1, f) == 1);
         }
     }
+
+    if (fclose(f) != 0 || ok == false) {
+        PrintAndLogEx(WARNING, "Could not write checkpoint " _YELLOW_("%s"), tmpfn);
+        remove(tmpfn);
+        return false;
+    }
+
+#if defined(_WIN32)
+    remove(checkpoint_filename);
+#endif
+    if (rename(tmpfn, checkpoint_filename) != 0) {
+        remove(tmpfn);
+        return false;
+    }
+
+    last_checkpoint_time = msclock();
     return true;
 }
+
+static bool read_checkpoint(void) {
+
+    FILE *f = fopen(checkpoint_filename, "rb");
+    if (f == NULL) {
+        return false;
+    }
+
+    char magic[8] = {0};
+    uint32_t version = 0;
+    uint32_t num_phases = 0;
+    bool ok = (fread(magic, 1, sizeof(magic), f) == sizeof(magic));
+    ok &= (fread(&version, sizeof(version), 1, f) == 1);
+    ok &= (fread(&num_phases, sizeof(num_phases), 1, f) == 1);
+    ok &= (memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) == 0);
+    ok &= (version == CHECKPOINT_VERSION);
+    ok &= (num_phases <= CHECKPOINT_MAX_PHASES);
+
+    for (uint32_t i = 0; i < num_phases && ok; i++) {
+        bf_phase_t *phase = &checkpoint_phases[i];
+        ok &= (fread(&phase->fingerprint, sizeof(phase->fingerprint), 1, f) == 1);
+        ok &= (fread(&phase->bucket_count, sizeof(phase->bucket_count), 1, f) == 1);
+        if (ok == false) {
+            break;
+        }
+        phase->done = calloc((phase->bucket_count + 7) / 8 + 1, sizeof(uint8_t));
+        if (phase->done == NULL) {
+            ok = false;
+            break;
+        }
+        checkpoint_num_phases++;
+        ok &= (fread(phase->done, 1, (phase->bucket_count + 7) / 8, f) == (phase->bucket_count + 7) / 8);
+    }
+    fclose(f);
+
+    if (ok == false) {
+        PrintAndLogEx(WARNING, "Ignoring damaged checkpoint " _YELLOW_("%s"), checkpoint_filename);
+        free_checkpoint_phases();
+    }
+    return ok;
+}
+
+void brute_force_checkpoint_init(const char *filename, bool resume) {
+
+    free_checkpoint_phases();
+    checkpoint_filename[0] = '\0';
+    last_checkpoint_time = msclock();
+
+    if (filename == NULL || filename[0] == '\0') {
+        return;
+    }
+
+    snprintf(checkpoint_filename, sizeof(checkpoint_filename), "%s", filename);
+
+    if (resume) {
+        if (read_checkpoint()) {
+            PrintAndLogEx(INFO, "Resuming from checkpoint " _YELLOW_("%s"), checkpoint_filename);
+        } else {
+            PrintAndLogEx(INFO, "No checkpoint found at " _YELLOW_("%s") ", starting from scratch", checkpoint_filename);
+        }
+    } else if (fileExists(checkpoint_filename)) {
+        PrintAndLogEx(HINT, "Hint: Existing checkpoint " _YELLOW_("%s") " will be overwritten, use `--resume` to continue it", checkpoint_filename);
+    }
+}
+
+void brute_force_checkpoint_done(bool key_found) {
+    if (key_found && checkpoint_filename[0] != '\0') {
+        remove(checkpoint_filename);
+    }
+    free_checkpoint_phases();
+    checkpoint_filename[0] = '\0';
+}
+
+// Identifies a candidate set without storing it. Candidates are derived deterministically
+// from the nonce file, so the list sizes and their boundary states are sufficient.
+static uint64_t candidates_fingerprint(uint32_t cuid, const uint8_t *best_first_bytes) {
+    uint64_t h = 0xcbf29ce484222325ULL; // FNV-1a
+#define FNV_ADD(v) do { h ^= (uint64_t)(v); h *= 0x100000001b3ULL; } while (0)
+    FNV_ADD(cuid);
+    FNV_ADD(best_first_bytes[0]);
+    FNV_ADD(nonces_to_bruteforce);
+    for (uint32_t i = 0; i < nonces_to_bruteforce; i++) {
+        FNV_ADD(bf_test_nonce[i]);
+        FNV_ADD(bf_test_nonce_par[i]);
+    }
+    FNV_ADD(bucket_count);
+    for (uint32_t i = 0; i < bucket_count; i++) {
+        const statelist_t *b = buckets[i];
+        for (odd_even_t oe = EVEN_STATE; oe <= ODD_STATE; oe++) {
+            FNV_ADD(b->len[oe]);
+            if (b->len[oe]) {
+                FNV_ADD(b->states[oe][0]);
+                FNV_ADD(b->states[oe][b->len[oe] - 1]);
+            }
+        }
+    }
+#undef FNV_ADD
+    return h;
+}
+
+static void checkpoint_start_phase(uint32_t cuid, const uint8_t *best_first_bytes, uint32_t num_acquired_nonces) {
+
+    current_phase = NULL;
+    if (checkpoint_filename[0] == '\0') {
+        return;
+    }
+
+    uint64_t fp = candidates_fingerprint(cuid, best_first_bytes);
+    for (uint32_t i = 0; i < checkpoint_num_phases; i++) {
+        if (checkpoint_phases[i].fingerprint == fp && checkpoint_phases[i].bucket_count == bucket_count) {
+            current_phase = &checkpoint_phases[i];
+            break;
+        }
+    }
+
+    if (current_phase == NULL) {
+        if (checkpoint_num_phases == CHECKPOINT_MAX_PHASES) {
+            return;
+        }
+        bf_phase_t *phase = &checkpoint_phases[checkpoint_num_phases];
+        phase->done = calloc((bucket_count + 7) / 8 + 1, sizeof(uint8_t));
+        if (phase->done == NULL) {
+            return;
+        }
+        phase->fingerprint = fp;
+        phase->bucket_count = bucket_count;
+        checkpoint_num_phases++;
+        current_phase = phase;
+        return;
+    }
+
+    // resumed phase, account already tested states
+    uint32_t skipped = 0;
+    for (uint32_t i = 0; i < bucket_count; i++) {
+        if (bucket_is_done(i)) {
+            num_keys_tested += (uint64_t)buckets[i]->len[ODD_STATE] * buckets[i]->len[EVEN_STATE];
+            skipped++;
+        }
+    }
+
+    char progress_text[80];
+    snprintf(progress_text, sizeof(progress_text), "Resuming brute force, %u of %u buckets already done", skipped, bucket_count);
+    hardnested_print_progress(num_acquired_nonces, progress_text, 0.0, 0);
+}
+
+static void maybe_write_checkpoint(void) {
+    if (current_phase == NULL || msclock() - last_checkpoint_time < CHECKPOINT_INTERVAL_MS) {
+        return;
+    }
+    if (pthread_mutex_trylock(&checkpoint_lock) == 0) {
+        if (msclock() - last_checkpoint_time >= CHECKPOINT_INTERVAL_MS) {
+            write_checkpoint();
+        }
+        pthread_mutex_unlock(&checkpoint_lock);
+    }
+}
+
 static void *
 #ifdef __has_attribute
 #if __has_attribute(force_align_arg_pointer)
@@ -166,7 +369,7 @@ crack_states_thread(void *x) {
     uint32_t current_bucket = thread_id;
     while (current_bucket < bucket_count) {
         statelist_t *bucket = buckets[current_bucket];
-        if (bucket) {
+        if (bucket && bucket_is_done(current_bucket) == false) {
 #if defined (DEBUG_BRUTE_FORCE)
             PrintAndLogEx(INFO, "Thread " _YELLOW_("%u") " starts working on bucket " _YELLOW_("%u") "\n", thread_id, current_bucket);
 #endif
@@ -184,6 +387,8 @@ crack_states_thread(void *x) {
             } else if (keys_found) {
                 break;
             } else {
+                set_bucket_done(current_bucket);
+                maybe_write_checkpoint();
                 if (!thread_arg->silent) {
                     char progress_text[80];
                     snprintf(progress_text, sizeof(progress_text), "Brute force phase: %6.02f%%  ", 100.0 * (float)num_keys_tested / (float)(thread_arg->maximum_states));
@@ -347,6 +552,12 @@ bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint
         }
     }
 
+    if (silent == false) {
+        checkpoint_start_phase(cuid, best_first_bytes, num_acquired_nonces);
+    } else {
+        current_phase = NULL;
+    }
+
     uint64_t start_time = msclock();
 
 #if defined(__linux__) ||  defined(__APPLE__)
@@ -379,6 +590,13 @@ bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint
         pthread_join(threads[i], 0);
     }
 
+    if (current_phase != NULL && keys_found == 0) {
+        pthread_mutex_lock(&checkpoint_lock);
+        write_checkpoint();
+        pthread_mutex_unlock(&checkpoint_lock);
+    }
+    current_phase = NULL;
+
     free(buckets);
     buckets = NULL;
     buckets_allocated = 0;
@@ -395,6 +613,125 @@ bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint
 }
 
 
+#define EXPORT_UNITS_PER_GUESS          32
+
+static bool write_unit(const char *path, uint32_t unit_idx, uint32_t guess, statelist_t **unit_buckets, uint32_t num_buckets, uint32_t cuid, noncelist_t *nonces, uint8_t *best_first_bytes) {
+
+    char fn[FILE_PATH_SIZE];
+    char name[40];
+    snprintf(name, sizeof(name), HN_UNIT_FILE, unit_idx);
+    snprintf(fn, sizeof(fn), "%s%s%s", path, PATHSEP, name);
+
+    FILE *f = fopen(fn, "wb");
+    if (f == NULL) {
+        PrintAndLogEx(ERR, "Could not create work unit " _YELLOW_("%s"), fn);
+        return false;
+    }
+
+    uint32_t version = HN_UNIT_VERSION;
+    bool ok = (fwrite(HN_UNIT_MAGIC, 1, 8, f) == 8);
+    ok &= (fwrite(&version, sizeof(uint32_t), 1, f) == 1);
+    ok &= (fwrite(&unit_idx, sizeof(uint32_t), 1, f) == 1);
+    ok &= (fwrite(&guess, sizeof(uint32_t), 1, f) == 1);
+    ok &= (fwrite(&cuid, sizeof(uint32_t), 1, f) == 1);
+    ok &= (fwrite(best_first_bytes, 1, 256, f) == 256);
+
+    ok &= (fwrite(&nonces_to_bruteforce, sizeof(uint32_t), 1, f) == 1);
+    ok &= (fwrite(bf_test_nonce, sizeof(uint32_t), nonces_to_bruteforce, f) == nonces_to_bruteforce);
+    ok &= (fwrite(bf_test_nonce_par, 1, nonces_to_bruteforce, f) == nonces_to_bruteforce);
+
+    for (uint16_t i = 0; i < 256 && ok; i++) {
+        uint32_t count = 0;
+        for (noncelistentry_t *n = nonces[i].first; n != NULL; n = n->next) {
+            count++;
+        }
+        ok &= (fwrite(&count, sizeof(uint32_t), 1, f) == 1);
+        for (noncelistentry_t *n = nonces[i].first; n != NULL && ok; n = n->next) {
+            ok &= (fwrite(&n->nonce_enc, sizeof(uint32_t), 1, f) == 1);
+            ok &= (fwrite(&n->par_enc, 1, 1, f) == 1);
+        }
+    }
+
+    ok &= (fwrite(&num_buckets, sizeof(uint32_t), 1, f) == 1);
+    for (uint32_t i = 0; i < num_buckets && ok; i++) {
+        statelist_t *b = unit_buckets[i];
+        ok &= (fwrite(&b->len[EVEN_STATE], sizeof(uint32_t), 1, f) == 1);
+        ok &= (fwrite(&b->len[ODD_STATE], sizeof(uint32_t), 1, f) == 1);
+        ok &= (fwrite(b->states[EVEN_STATE], sizeof(uint32_t), b->len[EVEN_STATE], f) == b->len[EVEN_STATE]);
+        ok &= (fwrite(b->states[ODD_STATE], sizeof(uint32_t), b->len[ODD_STATE], f) == b->len[ODD_STATE]);
+    }
+
+    if (fclose(f) != 0 || ok == false) {
+        PrintAndLogEx(ERR, "Write error with " _YELLOW_("%s"), fn);
+        return false;
+    }
+    return true;
+}
+
+// Split the candidates of one Sum(a8) guess into work units of roughly equal number of states.
+int brute_force_export(const char *path, uint32_t *unit_idx, uint32_t guess, statelist_t *candidates, uint32_t cuid, noncelist_t *nonces, uint8_t *best_first_bytes) {
+
+    uint64_t total_states = 0;
+    uint32_t num_buckets = 0;
+    for (statelist_t *p = candidates; p != NULL; p = p->next) {
+        if (p->states[ODD_STATE] != NULL && p->states[EVEN_STATE] != NULL && p->len[ODD_STATE] && p->len[EVEN_STATE]) {
+            total_states += (uint64_t)p->len[ODD_STATE] * p->len[EVEN_STATE];
+            num_buckets++;
+        }
+    }
+
+    if (num_buckets == 0) {
+        return PM3_SUCCESS;
+    }
+
+    statelist_t **unit_buckets = calloc(num_buckets, sizeof(statelist_t *));
+    if (unit_buckets == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+
+    uint64_t states_per_unit = total_states / EXPORT_UNITS_PER_GUESS + 1;
+    uint64_t unit_states = 0;
+    uint32_t n = 0;
+    uint32_t first_unit = *unit_idx;
+
+    for (statelist_t *p = candidates; p != NULL; p = p->next) {
+        if (p->states[ODD_STATE] == NULL || p->states[EVEN_STATE] == NULL || p->len[ODD_STATE] == 0 || p->len[EVEN_STATE] == 0) {
+            continue;
+        }
+
+        unit_buckets[n++] = p;
+        unit_states += (uint64_t)p->len[ODD_STATE] * p->len[EVEN_STATE];
+
+        if (unit_states >= states_per_unit || p->next == NULL) {
+            if (write_unit(path, *unit_idx, guess, unit_buckets, n, cuid, nonces, best_first_bytes) == false) {
+                free(unit_buckets);
+                return PM3_EFILE;
+            }
+            (*unit_idx)++;
+            n = 0;
+            unit_states = 0;
+        }
+    }
+
+    // trailing buckets when the list ended with an empty one
+    if (n) {
+        if (write_unit(path, *unit_idx, guess, unit_buckets, n, cuid, nonces, best_first_bytes) == false) {
+            free(unit_buckets);
+            return PM3_EFILE;
+        }
+        (*unit_idx)++;
+    }
+
+    free(unit_buckets);
+
+    char progress_text[80];
+    snprintf(progress_text, sizeof(progress_text), "Exported work units %u..%u", first_unit, *unit_idx - 1);
+    hardnested_print_progress(0, progress_text, (float)total_states, 0);
+    return PM3_SUCCESS;
+}
+
+
 static bool read_bench_data(statelist_t *test_candidates) {
 
     size_t bytes_read = 0;
@@ -478,7 +815,35 @@ static bool read_bench_data(statelist_t *test_candidates) {
 }
 
 
-float brute_force_benchmark(void) {
+static void print_kernel_benchmark(void) {
+    const bf_kernel_t *selected = NULL;
+    SIMDExecInstr instr = GetSIMDInstrAuto();
+
+    PrintAndLogEx(INFO, "Brute force kernels");
+    PrintAndLogEx(INFO, "  kernel   | lanes |  keys/s");
+    PrintAndLogEx(INFO, "-----------+-------+-----------------------------");
+    for (uint32_t i = 0; i < bf_kernel_count(); i++) {
+        const bf_kernel_t *k = bf_kernel_get(i);
+        if (k->instr == instr) {
+            selected = k;
+        }
+        if (k->keys_per_second == 0.0) {
+            PrintAndLogEx(INFO, "  %-8s |  %4u | " _YELLOW_("not supported by this CPU"), k->name, k->lanes);
+            continue;
+        }
+        PrintAndLogEx(INFO, "  %-8s |  %4u | %5.0f million (2^%1.1f)%s",
+                      k->name,
+                      k->lanes,
+                      k->keys_per_second / 1000000,
+                      log(k->keys_per_second) / log(2.0),
+                      (k == selected) ? " " _GREEN_("<- used") : ""
+                     );
+    }
+}
+
+// Measures the brute force rate of the kernel in use. With all_kernels set, every kernel supported by the CPU
+// is measured (see bf_kernel_get()->keys_per_second) and the results are printed side by side.
+float brute_force_benchmark(bool all_kernels) {
     const int num_brute_force_threads = NUM_BRUTE_FORCE_THREADS;
     statelist_t test_candidates[num_brute_force_threads];
 
@@ -507,13 +872,39 @@ float brute_force_benchmark(void) {
 
     uint64_t maximum_states = TEST_BENCH_SIZE * TEST_BENCH_SIZE * (uint64_t)num_brute_force_threads;
 
-    float bf_rate;
+    float bf_rate = 0.0;
     uint64_t found_key = 0;
-    brute_force_bs(&bf_rate, test_candidates, 0, 0, maximum_states, NULL, 0, &found_key);
+    SIMDExecInstr instr = GetSIMDInstrAuto();
+
+    for (uint32_t i = 0; i < bf_kernel_count(); i++) {
+        bf_kernel_t *k = bf_kernel_get(i);
+        bool in_use = (k->instr == instr);
+        if ((all_kernels == false && in_use == false) || bf_kernel_supported(k) == false) {
+            continue;
+        }
+
+        float rate = 0.0;
+        bf_kernel_select(k);
+        brute_force_bs(&rate, test_candidates, 0, 0, maximum_states, NULL, 0, &found_key);
+        k->keys_per_second = rate;
+        if (in_use) {
+            bf_rate = rate;
+        }
+    }
+    bf_kernel_select(NULL);
+
+    if (all_kernels) {
+        print_kernel_benchmark();
+    }
 
     free(test_candidates[0].states[ODD_STATE]);
     free(test_candidates[0].states[EVEN_STATE]);
     test_candidates[0].len[ODD_STATE] = 0;
     test_candidates[0].len[EVEN_STATE] = 0;
+
+    if (bf_rate == 0.0) {
+        // the forced kernel isn't supported by this CPU
+        return DEFAULT_BRUTE_FORCE_RATE;
+    }
     return bf_rate;
 }
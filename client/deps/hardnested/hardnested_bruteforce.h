@@ -53,9 +53,25 @@ typedef struct {
     void *next;
 } statelist_t;
 
+// Work units for distributing the brute force phase over several processes or machines.
+// Written by `hf mf hardnested --export`, cracked by tools/hardnested_worker, collected by `--merge`.
+//
+// unit layout (native endianness):
+//   magic[8] | version | unit | guess | cuid | best_first_bytes[256]
+//   nonces_to_bruteforce | bf_test_nonce[n] | bf_test_nonce_par[n]
+//   256 x { count | count x { nonce_enc, par_enc } }      (pre XORed nonces, for verify_key)
+//   num_buckets | num_buckets x { len_even | len_odd | even states | odd states }
+#define HN_UNIT_MAGIC       "PM3HNWU"
+#define HN_UNIT_VERSION     1
+#define HN_UNIT_FILE        "hardnested_unit_%05u.bin"
+#define HN_RESULT_FILE      "hardnested_unit_%05u.res"
+
 void prepare_bf_test_nonces(noncelist_t *nonces, uint8_t best_first_byte);
 bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint32_t num_acquired_nonces, uint64_t maximum_states, noncelist_t *nonces, uint8_t *best_first_bytes, uint64_t *found_key);
-float brute_force_benchmark(void);
+float brute_force_benchmark(bool all_kernels);
+void brute_force_checkpoint_init(const char *filename, bool resume);
+void brute_force_checkpoint_done(bool key_found);
+int brute_force_export(const char *path, uint32_t *unit_idx, uint32_t guess, statelist_t *candidates, uint32_t cuid, noncelist_t *nonces, uint8_t *best_first_bytes);
 uint8_t trailing_zeros(uint8_t byte);
 bool verify_key(uint32_t cuid, noncelist_t *nonces, const uint8_t *best_first_bytes, uint32_t odd, uint32_t even);
 
@@ -9,6 +9,9 @@ int main(int argc, char *argv[]) {
     }
     pm3 *p;
     p = pm3_open(argv[1]);
+    if (p == NULL) {
+        exit(EXIT_FAILURE);
+    }
     pm3_console(p, "hw status");
     pm3_close(p);
 }
@@ -37,6 +37,9 @@ int main(int argc, char *argv[]) {
 
         pm3 *p;
         p = pm3_open(argv[1]);
+        if (p == NULL) {
+            _exit(-1);
+        }
 
         // Execute the command
         pm3_console(p, "hw status");
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+# need access to pm3.py
+PYTHONPATH=../../pyscripts ./test_multi.py "$@"
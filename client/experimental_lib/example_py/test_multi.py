@@ -0,0 +1,21 @@
+#!/usr/bin/env python3
+
+# runs the same command on several Proxmark3s at once, one thread per device
+# usage: ./test_multi.py /dev/ttyACM0 /dev/ttyACM1 ...
+
+import sys
+import threading
+import pm3
+
+devices = [pm3.pm3(port) for port in sys.argv[1:]]
+
+def run(p):
+    p.console("hw status")
+
+threads = [threading.Thread(target=run, args=(p,)) for p in devices]
+for t in threads:
+    t.start()
+for t in threads:
+    t.join()
+for p in devices:
+    print("Device:", p.name)
@@ -36,6 +36,7 @@
 #include "cliparser.h"
 #include "generator.h"    // generate nuid
 #include "iso14b.h"       // defines for ETU conversions
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 
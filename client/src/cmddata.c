@@ -22,6 +22,7 @@
 #include <math.h>                // pow
 #include <ctype.h>               // tolower
 #include <locale.h>              // number formatter..
+#include <pthread.h>
 #include "commonutil.h"          // ARRAYLEN
 #include "cmdparser.h"           // for command_t
 #include "ui.h"                  // for show graph controls
@@ -41,12 +42,9 @@
 #include "mbedtls/ctr_drbg.h"    // random generator
 #include "atrs.h"                // ATR lookup
 #include "crypto/libpcrypto.h"   // Cryptography
+#include "lfctx.h"
 
 
-uint8_t g_DemodBuffer[MAX_DEMOD_BUF_LEN] = { 0x00 };
-size_t g_DemodBufferLen = 0;
-int32_t g_DemodStartIdx = 0;
-int g_DemodClock = 0;
 
 static int CmdHelp(const char *Cmd);
 
@@ -454,8 +452,11 @@ int ASKDemod_ext(int clk, int invert, int maxErr, size_t maxlen, bool amplify, b
 
     if (st) {
         *stCheck = st;
-        g_MarkerC.pos = ststart;
-        g_MarkerD.pos = stend;
+        // the graph window shows the default signal context only
+        if (lf_signal_ctx_is_default()) {
+            g_MarkerC.pos = ststart;
+            g_MarkerD.pos = stend;
+        }
         if (verbose)
             PrintAndLogEx(DEBUG, "Found Sequence Terminator - First one is shown by orange / blue graph markers");
     }
@@ -843,6 +844,126 @@ static int Cmdaskrawdemod(const char *Cmd) {
     return ASKDemod_ext(clk, invert, max_err, max_len, amplify, true, false, 0, &st);
 }
 
+#define AUTOCORR_MAX_THREADS 16
+
+// The autocovariance of the last correlated signal is cached per lag in the signal context.
+// `lf search` correlates the same graph with growing windows for each modulation it detects,
+// so the lags are only computed once.
+typedef struct {
+    double *autocv;
+    const double *centered;
+    size_t len;
+    size_t from;
+    size_t to;
+    uint32_t idx;
+    uint32_t step;
+} autocorr_thread_arg_t;
+
+static void *autocorr_lag_thread(void *arg) {
+    autocorr_thread_arg_t *t = arg;
+    const double *c = t->centered;
+    // interleaved, the sums get shorter with every lag
+    for (size_t i = t->from + t->idx; i < t->to; i += t->step) {
+        // independent partial sums, lets the cpu pipeline the multiply-adds
+        double sum[4] = {0.0, 0.0, 0.0, 0.0};
+        size_t n = t->len - i;
+        size_t j = 0;
+        for (; j + 4 <= n; j += 4) {
+            sum[0] += c[j] * c[j + i];
+            sum[1] += c[j + 1] * c[j + 1 + i];
+            sum[2] += c[j + 2] * c[j + 2 + i];
+            sum[3] += c[j + 3] * c[j + 3 + i];
+        }
+        for (; j < n; j++) {
+            sum[0] += c[j] * c[j + i];
+        }
+        t->autocv[i] = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    }
+    return NULL;
+}
+
+static uint64_t autocorr_hash(const int *in, size_t len) {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ULL ^ len;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint32_t)in[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// make sure the autocovariance of lags 0 .. lags - 1 is in the cache
+static int autocorr_compute(const int *in, size_t len, size_t lags, double mean) {
+
+    lf_autocorr_cache_t *cache = &g_lf_ctx->autocorr;
+    uint64_t hash = autocorr_hash(in, len);
+    if (cache->autocv == NULL || cache->hash != hash || cache->len != len) {
+        free(cache->autocv);
+        cache->autocv = calloc(len + 1, sizeof(double));
+        if (cache->autocv == NULL) {
+            cache->computed = 0;
+            return PM3_EMALLOC;
+        }
+        cache->hash = hash;
+        cache->len = len;
+        cache->computed = 0;
+    }
+
+    size_t from = cache->computed;
+    if (lags <= from) {
+        return PM3_SUCCESS;
+    }
+
+    uint32_t num_threads = num_CPUs();
+    if (num_threads > AUTOCORR_MAX_THREADS)
+        num_threads = AUTOCORR_MAX_THREADS;
+    if (num_threads == 0 || (lags - from) < 256)
+        num_threads = 1;
+
+    double *centered = calloc(len, sizeof(double));
+    if (centered == NULL) {
+        return PM3_EMALLOC;
+    }
+    for (size_t i = 0; i < len; i++) {
+        centered[i] = in[i] - mean;
+    }
+
+    pthread_t thread_id[AUTOCORR_MAX_THREADS];
+    autocorr_thread_arg_t args[AUTOCORR_MAX_THREADS];
+    for (uint32_t i = 0; i < num_threads; i++) {
+        args[i] = (autocorr_thread_arg_t) {
+            .autocv = cache->autocv, .centered = centered, .len = len, .from = from, .to = lags, .idx = i, .step = num_threads
+        };
+    }
+
+    uint32_t started = 1;
+    for (uint32_t i = 1; i < num_threads; i++, started++) {
+        if (pthread_create(&thread_id[i], NULL, autocorr_lag_thread, &args[i])) {
+            break;
+        }
+    }
+    // lags of threads which didn't start are done here
+    for (uint32_t i = started; i < num_threads; i++) {
+        args[0].idx = i;
+        autocorr_lag_thread(&args[0]);
+    }
+    args[0].idx = 0;
+    autocorr_lag_thread(&args[0]);
+    for (uint32_t i = 1; i < started; i++) {
+        pthread_join(thread_id[i], NULL);
+    }
+    free(centered);
+
+    // the autocovariance is accumulated over the lags
+    double autocv = (from) ? cache->autocv[from - 1] : 0.0;
+    for (size_t i = from; i < lags; i++) {
+        autocv = (1.0 / (len - i)) * (autocv + cache->autocv[i]);
+        cache->autocv[i] = autocv;
+    }
+    cache->computed = lags;
+    return PM3_SUCCESS;
+}
+
 int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveGrph, bool verbose) {
     // sanity check
     if (window > len) {
@@ -861,16 +982,23 @@ int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveG
 
     //int *correl_buf = calloc(MAX_GRAPH_TRACE_LEN, sizeof(int));
     int32_t *correl_buf = calloc(MAX_GRAPH_TRACE_LEN, sizeof(int32_t));
+    if (correl_buf == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return -1;
+    }
+
+    if (autocorr_compute(in, len, len - window, mean) != PM3_SUCCESS) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        free(correl_buf);
+        return -1;
+    }
 
     uint8_t peak_cnt = 0;
     size_t peaks[10] = {0};
 
     for (size_t i = 0; i < len - window; ++i) {
 
-        for (size_t j = 0; j < (len - i); j++) {
-            autocv += (in[j] - mean) * (in[j + i] - mean);
-        }
-        autocv = (1.0 / (len - i)) * autocv;
+        autocv = g_lf_ctx->autocorr.autocv[i];
 
         correl_buf[i] = autocv;
 
@@ -916,6 +1044,7 @@ int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveG
     } else {
         PrintAndLogEx(HINT, "No repeating pattern found, try increasing window size");
         // return value -1, indication to increase window size
+        free(correl_buf);
         return -1;
     }
 
@@ -1656,6 +1785,8 @@ void setClockGrid(uint32_t clk, int offset) {
     if (offset < 0) offset += clk;
 
     if (offset > g_GraphTraceLen || offset < 0) return;
+    // the graph window shows the default signal context only
+    if (lf_signal_ctx_is_default() == false) return;
     if (clk < 8 || clk > g_GraphTraceLen) {
         g_GridLocked = false;
         g_GridOffset = 0;
@@ -59,6 +59,7 @@
 #include "cmddata.h"
 #include "graph.h"
 #include "fpga.h"
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -237,7 +237,7 @@ static int CmdHF14AList(const char *Cmd) {
 }
 
 int hf14a_getconfig(hf14a_config *config) {
-    if (!g_session.pm3_present) return PM3_ENOTTY;
+    if (!IfPm3Present()) return PM3_ENOTTY;
 
     if (config == NULL)
         return PM3_EINVARG;
@@ -255,7 +255,7 @@ int hf14a_getconfig(hf14a_config *config) {
 }
 
 int hf14a_setconfig(hf14a_config *config, bool verbose) {
-    if (!g_session.pm3_present) return PM3_ENOTTY;
+    if (!IfPm3Present()) return PM3_ENOTTY;
 
     clearCommandBuffer();
     if (config != NULL) {
@@ -295,7 +295,7 @@ static int hf_14a_config_example(void) {
     return PM3_SUCCESS;
 }
 static int CmdHf14AConfig(const char *Cmd) {
-    if (!g_session.pm3_present) return PM3_ENOTTY;
+    if (!IfPm3Present()) return PM3_ENOTTY;
 
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "hf 14a config",
@@ -3204,7 +3204,7 @@ int CmdHF14ANdefFormat(const char *Cmd) {
     bool verbose = arg_get_lit(ctx, 1);
     CLIParserFree(ctx);
 
-    if (g_session.pm3_present == false)
+    if (IfPm3Present() == false)
         return PM3_ENOTTY;
 
     bool activate_field = true;
@@ -3478,7 +3478,7 @@ int CmdHF14ANdefWrite(const char *Cmd) {
     bool verbose = arg_get_lit(ctx, 4);
     CLIParserFree(ctx);
 
-    if (g_session.pm3_present == false) {
+    if (IfPm3Present() == false) {
         return PM3_ENOTTY;
     }
 
@@ -43,6 +43,7 @@
 #include "cliparser.h"
 #include "util_posix.h"         // msleep
 #include "iso15.h"              // typedef structs / enum
+#include "lfctx.h"
 
 #define FrameSOF                Iso15693FrameSOF
 #define Logic0                  Iso15693Logic0
@@ -1851,7 +1852,6 @@ static int CmdHF15Dump(const char *Cmd) {
             if (getUID(verbose, false, uid) != PM3_SUCCESS) {
                 free(tag);
                 free(packet);
-                free(tag);
                 PrintAndLogEx(WARNING, "no tag found");
                 return PM3_EINVARG;
             }
@@ -2021,8 +2021,6 @@ static int CmdHF15Dump(const char *Cmd) {
     }
 
     pm3_save_dump(filename, (uint8_t *)tag, sizeof(iso15_tag_t), jsf15_v4);
-    free(tag);
-
     free(tag);
     return PM3_SUCCESS;
 }
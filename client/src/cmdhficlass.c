@@ -29,6 +29,7 @@
 #include "loclass/cipher.h"
 #include "loclass/ikeys.h"
 #include "loclass/elite_crack.h"
+#include "loclass/iclass_keycache.h"
 #include "utils/fileutils.h"
 #include "protocols.h"
 #include "cardhelper.h"
@@ -98,8 +99,8 @@ bool check_known_default(uint8_t *csn, uint8_t *epurse, uint8_t *rmac, uint8_t *
     memcpy(ccnr, epurse, 8);
     memcpy(ccnr + 8, rmac, 4);
 
-    GenerateMacKeyFrom(csn, ccnr, false, false, (uint8_t *)iClass_Key_Table, ICLASS_KEYS_MAX, prekey);
-    GenerateMacKeyFrom(csn, ccnr, false, true, (uint8_t *)iClass_Key_Table, ICLASS_KEYS_MAX, prekey + ICLASS_KEYS_MAX);
+    GenerateMacKeyFrom(csn, ccnr, false, false, (uint8_t *)iClass_Key_Table, ICLASS_KEYS_MAX, NULL, prekey);
+    GenerateMacKeyFrom(csn, ccnr, false, true, (uint8_t *)iClass_Key_Table, ICLASS_KEYS_MAX, NULL, prekey + ICLASS_KEYS_MAX);
     qsort(prekey, ICLASS_KEYS_MAX * 2, sizeof(iclass_prekey_t), cmp_uint32);
 
     iclass_prekey_t lookup;
@@ -3581,7 +3582,8 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
     CLIParserInit(&ctx, "hf iclass chk",
                   "Checkkeys loads a dictionary text file with 8byte hex keys to test authenticating against a iClass tag",
                   "hf iclass chk -f iclass_default_keys.dic\n"
-                  "hf iclass chk -f iclass_elite_keys.dic --elite");
+                  "hf iclass chk -f iclass_elite_keys.dic --elite\n"
+                  "hf iclass chk -f iclass_elite_keys.dic --elite --nocache  --> don't use or update the key table");
 
     void *argtable[] = {
         arg_param_begin,
@@ -3590,6 +3592,7 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
         arg_lit0(NULL, "elite", "elite computations applied to key"),
         arg_lit0(NULL, "raw", "no computations applied to key (raw)"),
         arg_lit0(NULL, "shallow", "use shallow (ASK) reader modulation instead of OOK"),
+        arg_lit0(NULL, "nocache", "don't use the precomputed key table of the dictionary"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, false);
@@ -3602,6 +3605,7 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
     bool use_elite = arg_get_lit(ctx, 3);
     bool use_raw = arg_get_lit(ctx, 4);
     bool shallow_mod = arg_get_lit(ctx, 5);
+    bool use_cache = (arg_get_lit(ctx, 6) == false);
 
     CLIParserFree(ctx);
 
@@ -3626,6 +3630,12 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
         return PM3_EFILE;
     }
 
+    // the key only parts of the diversification, raw keys need none
+    iclass_keycache_t *kc = NULL;
+    if (use_cache && use_raw == false) {
+        iclass_keycache_open(filename, keyBlock, keycount, use_elite, &kc);
+    }
+
     // Get CSN / UID and CCNR
     PrintAndLogEx(SUCCESS, "Reading tag CSN / CCNR...");
 
@@ -3640,6 +3650,7 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
 
     if (got_csn == false) {
         PrintAndLogEx(WARNING, "Tried %d times. Can't select card, aborting...", ICLASS_AUTH_RETRY);
+        iclass_keycache_close(kc);
         free(keyBlock);
         DropField();
         return PM3_ESOFT;
@@ -3649,6 +3660,9 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
     iclass_premac_t *pre = calloc(keycount, sizeof(iclass_premac_t));
     if (pre == NULL) {
         PrintAndLogEx(WARNING, "failed to allocate memory");
+        iclass_keycache_close(kc);
+        free(keyBlock);
+        DropField();
         return PM3_EMALLOC;
     }
 
@@ -3661,7 +3675,8 @@ static int CmdHFiClassCheckKeys(const char *Cmd) {
     if (use_raw)
         PrintAndLogEx(NORMAL, "using " _YELLOW_("raw mode"));
 
-    GenerateMacFrom(CSN, CCNR, use_raw, use_elite, keyBlock, keycount, pre);
+    GenerateMacFrom(CSN, CCNR, use_raw, use_elite, keyBlock, keycount, kc, pre);
+    iclass_keycache_close(kc);
 
     PrintAndLogEx(SUCCESS, "Searching for " _YELLOW_("%s") " key...", (use_credit_key) ? "CREDIT" : "DEBIT");
 
@@ -3779,7 +3794,8 @@ static int CmdHFiClassLookUp(const char *Cmd) {
     CLIParserInit(&ctx, "hf iclass lookup",
                   "This command take sniffed trace data and try to recovery a iCLASS Standard or iCLASS Elite key.",
                   "hf iclass lookup --csn 9655a400f8ff12e0 --epurse f0ffffffffffffff --macs 0000000089cb984b -f iclass_default_keys.dic\n"
-                  "hf iclass lookup --csn 9655a400f8ff12e0 --epurse f0ffffffffffffff --macs 0000000089cb984b -f iclass_default_keys.dic --elite"
+                  "hf iclass lookup --csn 9655a400f8ff12e0 --epurse f0ffffffffffffff --macs 0000000089cb984b -f iclass_default_keys.dic --elite\n"
+                  "hf iclass lookup --csn 9655a400f8ff12e0 --epurse f0ffffffffffffff --macs 0000000089cb984b -f iclass_default_keys.dic --nocache"
                  );
 
     void *argtable[] = {
@@ -3790,6 +3806,7 @@ static int CmdHFiClassLookUp(const char *Cmd) {
         arg_str1(NULL, "macs", "<hex>", "MACs"),
         arg_lit0(NULL, "elite", "Elite computations applied to key"),
         arg_lit0(NULL, "raw", "no computations applied to key"),
+        arg_lit0(NULL, "nocache", "don't use the precomputed key table of the dictionary"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, false);
@@ -3836,6 +3853,7 @@ static int CmdHFiClassLookUp(const char *Cmd) {
 
     bool use_elite = arg_get_lit(ctx, 5);
     bool use_raw = arg_get_lit(ctx, 6);
+    bool use_cache = (arg_get_lit(ctx, 7) == false);
 
     CLIParserFree(ctx);
 
@@ -3873,8 +3891,15 @@ static int CmdHFiClassLookUp(const char *Cmd) {
         return PM3_EMALLOC;
     }
 
+    // the key only parts of the diversification, raw keys need none
+    iclass_keycache_t *kc = NULL;
+    if (use_cache && use_raw == false) {
+        iclass_keycache_open(filename, keyBlock, keycount, use_elite, &kc);
+    }
+
     PrintAndLogEx(INFO, "Generating diversified keys...");
-    GenerateMacKeyFrom(csn, CCNR, use_raw, use_elite, keyBlock, keycount, prekey);
+    GenerateMacKeyFrom(csn, CCNR, use_raw, use_elite, keyBlock, keycount, kc, prekey);
+    iclass_keycache_close(kc);
 
     if (use_elite)
         PrintAndLogEx(INFO, "Using " _YELLOW_("elite algo"));
@@ -3916,6 +3941,7 @@ typedef struct {
     uint8_t csn[8];
     uint8_t cc_nr[12];
     uint8_t *keys;
+    const iclass_keycache_t *kc;
     union {
         iclass_premac_t *premac;
         iclass_prekey_t *prekey;
@@ -3924,7 +3950,24 @@ typedef struct {
 
 static size_t iclass_tc = 1;
 
-static pthread_mutex_t generator_mutex = PTHREAD_MUTEX_INITIALIZER;
+// diversifies a batch of keys, starting at key index start, their MACs are then calculated in one bitsliced pass
+static void generate_div_keys(const uint8_t *csn, uint8_t use_raw, uint8_t use_elite, const iclass_keycache_t *kc, const uint8_t *keys, uint32_t start, uint32_t n, uint8_t *div_keys) {
+    if (kc != NULL && use_raw == false) {
+        iclass_keycache_divkeys(kc, csn, start, n, div_keys);
+        return;
+    }
+
+    keys += 8 * start;
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t key[8];
+        memcpy(key, keys + (8 * i), 8);
+        if (use_raw)
+            memcpy(div_keys + (8 * i), key, 8);
+        else
+            HFiClassCalcDivKey((uint8_t *)csn, key, div_keys + (8 * i), use_elite);
+    }
+}
+
 static void *bf_generate_mac(void *thread_arg) {
 
     iclass_thread_arg_t *targ = (iclass_thread_arg_t *)thread_arg;
@@ -3941,29 +3984,25 @@ static void *bf_generate_mac(void *thread_arg) {
     memcpy(csn, targ->csn, sizeof(csn));
     memcpy(cc_nr, targ->cc_nr, sizeof(cc_nr));
 
-    uint8_t key[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-    uint8_t div_key[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-
-    for (uint32_t i = idx; i < keycnt; i += iclass_tc) {
+    uint8_t div_keys[ICLASS_MAC_BATCH_SIZE * 8];
+    uint8_t macs[ICLASS_MAC_BATCH_SIZE * 4];
 
-        memcpy(key, keys + 8 * i, 8);
+    // each thread takes every iclass_tc:th batch of keys
+    for (uint32_t i = idx * ICLASS_MAC_BATCH_SIZE; i < keycnt; i += iclass_tc * ICLASS_MAC_BATCH_SIZE) {
 
-        pthread_mutex_lock(&generator_mutex);
-        if (use_raw)
-            memcpy(div_key, key, 8);
-        else
-            HFiClassCalcDivKey(csn, key, div_key, use_elite);
+        uint32_t n = MIN(keycnt - i, ICLASS_MAC_BATCH_SIZE);
+        generate_div_keys(csn, use_raw, use_elite, targ->kc, keys, i, n, div_keys);
+        doMAC_batch(cc_nr, div_keys, n, macs);
 
-        doMAC(cc_nr, div_key, list[i].mac);
-        pthread_mutex_unlock(&generator_mutex);
+        for (uint32_t j = 0; j < n; j++) {
+            memcpy(list[i + j].mac, macs + (4 * j), 4);
+        }
     }
     return NULL;
 }
 
 // precalc diversified keys and their MAC
-void GenerateMacFrom(uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, uint8_t *keys, uint32_t keycnt, iclass_premac_t *list) {
-
-    pthread_mutex_init(&generator_mutex, NULL);
+void GenerateMacFrom(uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, uint8_t *keys, uint32_t keycnt, const iclass_keycache_t *kc, iclass_premac_t *list) {
 
     iclass_tc = num_CPUs();
     pthread_t threads[iclass_tc];
@@ -3975,6 +4014,7 @@ void GenerateMacFrom(uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite,
         args[i].use_elite = use_elite;
         args[i].keycnt = keycnt;
         args[i].keys = keys;
+        args[i].kc = kc;
         args[i].list.premac = list;
 
         memcpy(args[i].csn, CSN, sizeof(args[i].csn));
@@ -4010,27 +4050,26 @@ static void *bf_generate_mackey(void *thread_arg) {
     memcpy(csn, targ->csn, sizeof(csn));
     memcpy(cc_nr, targ->cc_nr, sizeof(cc_nr));
 
-    uint8_t div_key[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    uint8_t div_keys[ICLASS_MAC_BATCH_SIZE * 8];
+    uint8_t macs[ICLASS_MAC_BATCH_SIZE * 4];
 
-    for (uint32_t i = idx; i < keycnt; i += iclass_tc) {
+    // each thread takes every iclass_tc:th batch of keys
+    for (uint32_t i = idx * ICLASS_MAC_BATCH_SIZE; i < keycnt; i += iclass_tc * ICLASS_MAC_BATCH_SIZE) {
 
-        memcpy(list[i].key, keys + 8 * i, 8);
+        uint32_t n = MIN(keycnt - i, ICLASS_MAC_BATCH_SIZE);
+        generate_div_keys(csn, use_raw, use_elite, targ->kc, keys, i, n, div_keys);
+        doMAC_batch(cc_nr, div_keys, n, macs);
 
-        pthread_mutex_lock(&generator_mutex);
-        if (use_raw)
-            memcpy(div_key, list[i].key, 8);
-        else
-            HFiClassCalcDivKey(csn, list[i].key, div_key, use_elite);
-
-        doMAC(cc_nr, div_key, list[i].mac);
-        pthread_mutex_unlock(&generator_mutex);
+        for (uint32_t j = 0; j < n; j++) {
+            memcpy(list[i + j].key, keys + 8 * (i + j), 8);
+            memcpy(list[i + j].mac, macs + (4 * j), 4);
+        }
     }
     return NULL;
 }
 
-void GenerateMacKeyFrom(uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, uint8_t *keys, uint32_t keycnt, iclass_prekey_t *list) {
+void GenerateMacKeyFrom(uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elite, uint8_t *keys, uint32_t keycnt, const iclass_keycache_t *kc, iclass_prekey_t *list) {
 
-    pthread_mutex_init(&generator_mutex, NULL);
     iclass_tc = num_CPUs();
     pthread_t threads[iclass_tc];
     iclass_thread_arg_t args[iclass_tc];
@@ -4041,6 +4080,7 @@ void GenerateMacKeyFrom(uint8_t *CSN, uint8_t *CCNR, bool use_raw, bool use_elit
         args[i].use_elite = use_elite;
         args[i].keycnt = keycnt;
         args[i].keys = keys;
+        args[i].kc = kc;
         args[i].list.prekey = list;
 
         memcpy(args[i].csn, CSN, sizeof(args[i].csn));
@@ -4392,7 +4432,7 @@ static int CmdHFiClassEncode(const char *Cmd) {
         }
     }
 
-    if (!g_session.pm3_present) {
+    if (!IfPm3Present()) {
         PrintAndLogEx(ERR, "Device offline\n");
         return PM3_EFAILED;
     }
@@ -28,6 +28,7 @@
 #include "ui.h"
 #include "crc16.h"
 #include "crapto1/crapto1.h"
+#include "crapto1/bs_crypto1.h"
 #include "protocols.h"
 #include "cmdhficlass.h"
 
@@ -52,6 +53,47 @@ void ClearAuthData(void) {
     AuthData.ks3 = 0;
 }
 
+// Keys found while decoding a trace, by UID / block / key type.
+// A failed dictionary search is kept as well, the dictionary is not searched
+// again for the next authentications of that block.
+#define MF_TRACE_KEYS_MAX   512
+
+typedef struct {
+    uint32_t uid;
+    uint8_t block;
+    uint8_t auth_cmd;
+    bool found;
+    bool dic_failed;
+    uint64_t key;
+} mf_trace_key_t;
+
+static mf_trace_key_t gs_mf_trace_keys[MF_TRACE_KEYS_MAX];
+static uint16_t gs_mf_trace_keys_cnt = 0;
+
+void ClearTraceKeyCache(void) {
+    gs_mf_trace_keys_cnt = 0;
+}
+
+// entry of the current authentication, NULL when the cache is full
+static mf_trace_key_t *mf_trace_key_get(const AuthData_t *ad) {
+    for (uint16_t i = 0; i < gs_mf_trace_keys_cnt; i++) {
+        mf_trace_key_t *k = &gs_mf_trace_keys[i];
+        if (k->uid == ad->uid && k->block == ad->block && k->auth_cmd == ad->auth_cmd) {
+            return k;
+        }
+    }
+
+    if (gs_mf_trace_keys_cnt == MF_TRACE_KEYS_MAX) {
+        return NULL;
+    }
+
+    mf_trace_key_t *k = &gs_mf_trace_keys[gs_mf_trace_keys_cnt++];
+    memset(k, 0, sizeof(*k));
+    k->uid = ad->uid;
+    k->block = ad->block;
+    k->auth_cmd = ad->auth_cmd;
+    return k;
+}
 
 static int gs_ntag_i2c_state = 0;
 static int gs_mfuc_state = 0;
@@ -312,6 +354,8 @@ int applyIso14443a(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize, bool i
                 if (cmdsize > 3) {
                     snprintf(exp, size, "AUTH-A(" _MAGENTA_("%d") ")", cmd[1]);
                     MifareAuthState = masNt;
+                    AuthData.block = cmd[1];
+                    AuthData.auth_cmd = cmd[0];
                 } else {
                     // case MIFARE_ULEV1_VERSION :  both 0x60.
                     snprintf(exp, size, "EV1 VERSION");
@@ -320,6 +364,8 @@ int applyIso14443a(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize, bool i
             }
             case MIFARE_AUTH_KEYB: {
                 MifareAuthState = masNt;
+                AuthData.block = cmd[1];
+                AuthData.auth_cmd = cmd[0];
                 snprintf(exp, size, "AUTH-B(" _MAGENTA_("%d") ")", cmd[1]);
                 break;
             }
@@ -327,6 +373,8 @@ int applyIso14443a(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize, bool i
                 if (cmdsize > 3) {
                     snprintf(exp, size, "MAGIC AUTH (" _MAGENTA_("%d") ")", cmd[1]);
                     MifareAuthState = masNt;
+                    AuthData.block = cmd[1];
+                    AuthData.auth_cmd = cmd[0];
                 }
                 break;
             }
@@ -465,6 +513,11 @@ void annotateIso14443a(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize, bo
     applyIso14443a(exp, size, cmd, cmdsize, is_response);
 }
 
+// an Ultralight C authentication or an NTAG I2C sector select is under way
+bool annotateIso14443a_pending(void) {
+    return (gs_mfuc_state != 0 || gs_ntag_i2c_state != 0);
+}
+
 void annotateIclass(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize, bool isResponse) {
 
     enum pico_state {PICO_NONE, PICO_SELECT, PICO_AUTH_EPURSE, PICO_AUTH_MACS };
@@ -2123,17 +2176,106 @@ static void mf_get_paritybinstr(char *s, uint32_t val, uint8_t par) {
     s[0] = '\0';
 }
 
+// Crypto1 state right after an authentication with a known key
+static void mf_auth_state(uint64_t key, const AuthData_t *ad, bool nested, struct Crypto1State *s) {
+    crypto1_init(s, key);
+    if (nested) {
+        crypto1_word(s, ad->nt_enc ^ ad->uid, 1);
+    } else {
+        crypto1_word(s, ad->nt ^ ad->uid, 0);
+    }
+    crypto1_word(s, ad->nr_enc, 1);
+    crypto1_word(s, 0, 0);
+    crypto1_word(s, 0, 0);
+}
+
+// lfsr_recovery64() without keeping the state list around
+static bool mf_recovery64(uint32_t ks2, uint32_t ks3, struct Crypto1State *s) {
+    struct Crypto1State *sl = lfsr_recovery64(ks2, ks3);
+    if (sl == NULL) {
+        return false;
+    }
+    *s = *sl;
+    crypto1_destroy(sl);
+    return true;
+}
+
+static bool FirstAuthCheckKey(uint64_t key, const AuthData_t *ad) {
+    struct Crypto1State s;
+    crypto1_init(&s, key);
+    crypto1_word(&s, ad->nt ^ ad->uid, 0);
+    crypto1_word(&s, ad->nr_enc, 1);
+    return (crypto1_word(&s, 0, 0) == ad->ks2) && (crypto1_word(&s, 0, 0) == ad->ks3);
+}
+
+// lanes where the bitsliced word w equals prng_successor(nt, n), cols[j] = prng_successor(1 << j, n)
+static bitslice_t bs_prng_match(const bitslice_t nt[32], const uint32_t cols[32], const bitslice_t w[32]) {
+    bitslice_t suc[32] = {0};
+    for (int j = 0; j < 32; j++) {
+        for (int b = 0; b < 32; b++) {
+            if (BIT(cols[j], b)) {
+                suc[b] ^= nt[j];
+            }
+        }
+    }
+
+    bitslice_t diff = 0;
+    for (int b = 0; b < 32; b++) {
+        diff |= suc[b] ^ w[b];
+    }
+    return ~diff;
+}
+
+// The ar / at part of NestedCheckKey() for up to 64 keys at once.
+// Returns the lanes that pass, only those are worth a NestedCheckKey() call.
+static bitslice_t NestedCheckKeysBs(const uint64_t *keys, uint8_t n, const AuthData_t *ad) {
+    // prng_successor() is linear, its columns give the bitsliced version
+    static uint32_t suc64[32], suc96[32];
+    static bool suc_init = false;
+    if (suc_init == false) {
+        for (int j = 0; j < 32; j++) {
+            suc64[j] = prng_successor(1u << j, 64);
+            suc96[j] = prng_successor(1u << j, 96);
+        }
+        suc_init = true;
+    }
+
+    bs_crypto1_t s;
+    bitslice_t nt[32], w[32];
+    bs_crypto1_init(&s, keys, n);
+
+    bs_crypto1_word_ks(&s, ad->nt_enc ^ ad->uid, true, nt);
+    for (int b = 0; b < 32; b++) {
+        nt[b] ^= BIT(ad->nt_enc, b) ? ~(bitslice_t)0 : 0;
+    }
+    bs_crypto1_word(&s, ad->nr_enc, true);
+
+    bitslice_t lanes = (n < BS_LANES) ? (((bitslice_t)1 << n) - 1) : ~(bitslice_t)0;
+
+    bs_crypto1_word_ks(&s, 0, false, w);
+    for (int b = 0; b < 32; b++) {
+        w[b] ^= BIT(ad->ar_enc, b) ? ~(bitslice_t)0 : 0;
+    }
+    lanes &= bs_prng_match(nt, suc64, w);
+    if (lanes == 0) {
+        return 0;
+    }
+
+    bs_crypto1_word_ks(&s, 0, false, w);
+    for (int b = 0; b < 32; b++) {
+        w[b] ^= BIT(ad->at_enc, b) ? ~(bitslice_t)0 : 0;
+    }
+    return lanes & bs_prng_match(nt, suc96, w);
+}
+
 bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isResponse, uint8_t *mfData, size_t *mfDataLen, const uint64_t *dicKeys, uint32_t dicKeysCount) {
-    static struct Crypto1State *traceCrypto1;
+    static struct Crypto1State traceCrypto1;
+    static bool traceCrypto1Valid = false;
 
     *mfDataLen = 0;
 
     if (MifareAuthState == masAuthComplete) {
-        if (traceCrypto1) {
-            crypto1_destroy(traceCrypto1);
-            traceCrypto1 = NULL;
-        }
-
+        traceCrypto1Valid = false;
         MifareAuthState = masFirstData;
         return false;
     }
@@ -2147,7 +2289,14 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
             AuthData.ks2 = AuthData.ar_enc ^ prng_successor(AuthData.nt, 64);
             AuthData.ks3 = AuthData.at_enc ^ prng_successor(AuthData.nt, 96);
 
-            mfLastKey = GetCrypto1ProbableKey(&AuthData);
+            // the key of an earlier authentication is much cheaper to check than to recover
+            mf_trace_key_t *k = mf_trace_key_get(&AuthData);
+            if (k && k->found && FirstAuthCheckKey(k->key, &AuthData)) {
+                mfLastKey = k->key;
+            } else if (mfLastKey == 0 || FirstAuthCheckKey(mfLastKey, &AuthData) == false) {
+                mfLastKey = GetCrypto1ProbableKey(&AuthData);
+            }
+
             PrintAndLogEx(NORMAL, "            |            |  *  |%49s " _GREEN_("%012" PRIX64) " prng %s |     |",
                           "key",
                           mfLastKey,
@@ -2155,36 +2304,68 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
 
             AuthData.first_auth = false;
 
-            traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
-        } else {
-            if (traceCrypto1) {
-                crypto1_destroy(traceCrypto1);
-                traceCrypto1 = NULL;
+            mf_auth_state(mfLastKey, &AuthData, false, &traceCrypto1);
+            traceCrypto1Valid = true;
+            if (k) {
+                k->found = true;
+                k->key = mfLastKey;
             }
+        } else {
+            mf_trace_key_t *k = mf_trace_key_get(&AuthData);
+            traceCrypto1Valid = false;
 
             // check last used key
             if (mfLastKey) {
                 if (NestedCheckKey(mfLastKey, &AuthData, cmd, cmdsize, parity)) {
                     PrintAndLogEx(NORMAL, "            |            |  *  |%60s " _GREEN_("%012" PRIX64) "|     |", "last used key", mfLastKey);
-                    traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
+                    traceCrypto1Valid = true;
                 };
             }
 
-            // check default keys
-            if (!traceCrypto1 && dicKeys != NULL && dicKeysCount > 0) {
-                for (int i = 0; i < dicKeysCount; i++) {
-                    if (NestedCheckKey(dicKeys[i], &AuthData, cmd, cmdsize, parity)) {
-                        PrintAndLogEx(NORMAL, "            |            |  *  |%60s " _GREEN_("%012" PRIX64) "|     |", "key", dicKeys[i]);
+            // check the keys found earlier in this trace for this card
+            for (uint16_t i = 0; !traceCrypto1Valid && i < gs_mf_trace_keys_cnt; i++) {
+                const mf_trace_key_t *kk = &gs_mf_trace_keys[i];
+                if (kk->uid != AuthData.uid || kk->found == false || kk->key == mfLastKey) {
+                    continue;
+                }
+                if (NestedCheckKey(kk->key, &AuthData, cmd, cmdsize, parity)) {
+                    PrintAndLogEx(NORMAL, "            |            |  *  |%60s " _GREEN_("%012" PRIX64) "|     |", "known key", kk->key);
+                    mfLastKey = kk->key;
+                    traceCrypto1Valid = true;
+                }
+            }
 
-                        mfLastKey = dicKeys[i];
-                        traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
-                        break;
-                    };
+            // check default keys, 64 at the time
+            if (!traceCrypto1Valid && !(k && k->dic_failed) && dicKeys != NULL && dicKeysCount > 0) {
+                bool candidates = false;
+                for (uint32_t i = 0; !traceCrypto1Valid && i < dicKeysCount; i += BS_LANES) {
+                    uint8_t n = MIN(dicKeysCount - i, BS_LANES);
+                    bitslice_t lanes = NestedCheckKeysBs(&dicKeys[i], n, &AuthData);
+                    for (uint8_t l = 0; lanes && l < n; l++, lanes >>= 1) {
+                        if ((lanes & 1) == 0) {
+                            continue;
+                        }
+                        candidates = true;
+                        if (NestedCheckKey(dicKeys[i + l], &AuthData, cmd, cmdsize, parity)) {
+                            PrintAndLogEx(NORMAL, "            |            |  *  |%60s " _GREEN_("%012" PRIX64) "|     |", "key", dicKeys[i + l]);
+
+                            mfLastKey = dicKeys[i + l];
+                            traceCrypto1Valid = true;
+                            break;
+                        };
+                    }
                 }
+                if (k && !candidates) {
+                    k->dic_failed = true;
+                }
+            }
+
+            if (traceCrypto1Valid) {
+                mf_auth_state(mfLastKey, &AuthData, true, &traceCrypto1);
             }
 
             // nested
-            if (!traceCrypto1 && validate_prng_nonce(AuthData.nt)) {
+            if (!traceCrypto1Valid && validate_prng_nonce(AuthData.nt)) {
                 uint32_t ntx = prng_successor(AuthData.nt, 90);
                 for (int i = 0; i < 16383; i++) {
                     ntx = prng_successor(ntx, 1);
@@ -2192,10 +2373,13 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
 
                         uint32_t ks2 = AuthData.ar_enc ^ prng_successor(ntx, 64);
                         uint32_t ks3 = AuthData.at_enc ^ prng_successor(ntx, 96);
-                        struct Crypto1State *pcs = lfsr_recovery64(ks2, ks3);
+                        struct Crypto1State pcs;
+                        if (mf_recovery64(ks2, ks3, &pcs) == false) {
+                            continue;
+                        }
+                        traceCrypto1 = pcs;
                         memcpy(mfData, cmd, cmdsize);
-                        mf_crypto1_decrypt(pcs, mfData, cmdsize, 0);
-                        crypto1_destroy(pcs);
+                        mf_crypto1_decrypt(&pcs, mfData, cmdsize, 0);
 
                         if (CheckCrypto1Parity(cmd, cmdsize, mfData, parity) && check_crc(CRC_14443_A, mfData, cmdsize)) {
                             AuthData.ks2 = ks2;
@@ -2207,15 +2391,20 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
                                           AuthData.ks2,
                                           AuthData.ks3);
 
-                            traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
+                            traceCrypto1Valid = true;
                             break;
                         }
                     }
                 }
             }
 
+            if (k && traceCrypto1Valid) {
+                k->found = true;
+                k->key = mfLastKey;
+            }
+
             //hardnested
-            if (!traceCrypto1) {
+            if (!traceCrypto1Valid) {
 
                 //PrintAndLogEx(NORMAL, "hardnested not implemented. uid:%x nt:%x ar_enc:%x at_enc:%x\n", AuthData.uid, AuthData.nt, AuthData.ar_enc, AuthData.at_enc);
 
@@ -2268,9 +2457,9 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
         MifareAuthState = masData;
     }
 
-    if (MifareAuthState == masData && traceCrypto1) {
+    if (MifareAuthState == masData && traceCrypto1Valid) {
         memcpy(mfData, cmd, cmdsize);
-        mf_crypto1_decrypt(traceCrypto1, mfData, cmdsize, 0);
+        mf_crypto1_decrypt(&traceCrypto1, mfData, cmdsize, 0);
         *mfDataLen = cmdsize;
     }
 
@@ -2307,29 +2496,27 @@ bool NTParityChk(AuthData_t *ad, uint32_t ntx) {
 
 bool NestedCheckKey(uint64_t key, AuthData_t *ad, uint8_t *cmd, uint8_t cmdsize, uint8_t *parity) {
     uint8_t buf[32] = {0};
-    struct Crypto1State *pcs;
+    struct Crypto1State pcs;
 
     AuthData.ks2 = 0;
     AuthData.ks3 = 0;
 
-    pcs = crypto1_create(key);
-    uint32_t nt1 = crypto1_word(pcs, ad->nt_enc ^ ad->uid, 1) ^ ad->nt_enc;
+    crypto1_init(&pcs, key);
+    uint32_t nt1 = crypto1_word(&pcs, ad->nt_enc ^ ad->uid, 1) ^ ad->nt_enc;
     uint32_t ar = prng_successor(nt1, 64);
     uint32_t at = prng_successor(nt1, 96);
 
-    crypto1_word(pcs, ad->nr_enc, 1);
-//   uint32_t nr1 = crypto1_word(pcs, ad->nr_enc, 1) ^ ad->nr_enc;  // if needs deciphered nr
-    uint32_t ar1 = crypto1_word(pcs, 0, 0) ^ ad->ar_enc;
-    uint32_t at1 = crypto1_word(pcs, 0, 0) ^ ad->at_enc;
+    crypto1_word(&pcs, ad->nr_enc, 1);
+//   uint32_t nr1 = crypto1_word(&pcs, ad->nr_enc, 1) ^ ad->nr_enc;  // if needs deciphered nr
+    uint32_t ar1 = crypto1_word(&pcs, 0, 0) ^ ad->ar_enc;
+    uint32_t at1 = crypto1_word(&pcs, 0, 0) ^ ad->at_enc;
 
     if (!(ar == ar1 && at == at1 && NTParityChk(ad, nt1))) {
-        crypto1_destroy(pcs);
         return false;
     }
 
     memcpy(buf, cmd, cmdsize);
-    mf_crypto1_decrypt(pcs, buf, cmdsize, 0);
-    crypto1_destroy(pcs);
+    mf_crypto1_decrypt(&pcs, buf, cmdsize, 0);
 
     if (!CheckCrypto1Parity(cmd, cmdsize, buf, parity))
         return false;
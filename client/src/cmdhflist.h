@@ -34,9 +34,12 @@ typedef struct {
     bool first_auth;    // is first authentication
     uint32_t ks2;       // ar ^ ar_enc
     uint32_t ks3;       // at ^ at_enc
+    uint8_t block;      // authenticated block
+    uint8_t auth_cmd;   // authentication command, i.e. key type
 } AuthData_t;
 
 void ClearAuthData(void);
+void ClearTraceKeyCache(void);
 
 uint8_t iso14443A_CRC_check(bool isResponse, uint8_t *d, uint8_t n);
 uint8_t iso14443B_CRC_check(uint8_t *d, uint8_t n);
@@ -55,6 +58,7 @@ void annotateFelica(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize);
 void annotateIso7816(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize);
 void annotateIso14443b(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize);
 void annotateIso14443a(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize, bool is_response);
+bool annotateIso14443a_pending(void);
 void annotateMfDesfire(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize);
 const char *mfpGetAnnotationForCode(uint8_t code);
 const char *mfpGetEncryptedForCode(uint8_t code);
@@ -28,6 +28,7 @@
 #include "mifare/mifaredefault.h"  // mifare default key array
 #include "cliparser.h"             // argtable
 #include "hardnested_bf_core.h"    // SetSIMDInstr
+#include "hardnested_bruteforce.h" // brute_force_checkpoint_init
 #include "mifare/mad.h"
 #include "nfc/ndef.h"
 #include "protocols.h"
@@ -44,6 +45,7 @@
 #include "preferences.h"
 #include "mifare/gen4.h"
 #include "generator.h"              // keygens.
+#include "crc16.h"                  // check_crc
 
 static int CmdHelp(const char *Cmd);
 
@@ -1729,6 +1731,7 @@ static int CmdHF14AMfNested(const char *Cmd) { //TODO: single mode broken? can't
 
     if (singleSector) {
         int16_t isOK = mfnested(blockNo, keyType, key, trgBlockNo, trgKeyType, keyBlock, true);
+        mfNestedFree();
         switch (isOK) {
             case PM3_ETIMEOUT:
                 PrintAndLogEx(ERR, "Command execute timeout\n");
@@ -1839,12 +1842,15 @@ static int CmdHF14AMfNested(const char *Cmd) { //TODO: single mode broken? can't
                         default :
                             PrintAndLogEx(ERR, "Unknown error\n");
                     }
+                    mfNestedFree();
                     free(e_sector);
                     return PM3_ESOFT;
                 }
             }
         }
 
+        mfNestedFree();
+
         t1 = msclock() - t1;
         PrintAndLogEx(SUCCESS, "time in nested " _YELLOW_("%.0f") " seconds\n", (float)t1 / 1000.0);
 
@@ -2086,12 +2092,15 @@ static int CmdHF14AMfNestedStatic(const char *Cmd) {
                     default :
                         PrintAndLogEx(ERR, "unknown error.\n");
                 }
+                mfNestedFree();
                 free(e_sector);
                 return PM3_ESOFT;
             }
         }
     }
 
+    mfNestedFree();
+
     t1 = msclock() - t1;
     PrintAndLogEx(SUCCESS, "time in static nested " _YELLOW_("%.0f") " seconds\n", (float)t1 / 1000.0);
 
@@ -2199,6 +2208,10 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
                   "hf mf hardnested -r --tk a0a1a2a3a4a5\n"
                   "hf mf hardnested -t --tk a0a1a2a3a4a5\n"
                   "hf mf hardnested --blk 0 -a -k a0a1a2a3a4a5 --tblk 4 --ta --tk FFFFFFFFFFFF\n"
+                  "hf mf hardnested --compile     --> decompress bitflip tables once, later runs map them\n"
+                  "hf mf hardnested -r --resume   --> continue an interrupted brute force\n"
+                  "hf mf hardnested -r --export work   --> write work units for hardnested_worker\n"
+                  "hf mf hardnested --merge work       --> collect worker results\n"
                  );
 
     void *argtable[] = {
@@ -2217,6 +2230,10 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
         arg_lit0("s",  "slow",           "Slower acquisition (required by some non standard cards)"),
         arg_lit0("t",  "tests",          "Run tests"),
         arg_lit0("w",  "wr",             "Acquire nonces and UID, and write them to file `hf-mf-<UID>-nonces.bin`"),
+        arg_lit0(NULL, "compile",        "Precompile bitflip tables into one memory mapped cache file and exit"),
+        arg_lit0(NULL, "resume",         "Resume an interrupted brute force from the checkpoint next to the nonce file"),
+        arg_str0(NULL, "export", "<dir>", "Export the brute force phase as work units for `hardnested_worker` instead of running it"),
+        arg_str0(NULL, "merge",  "<dir>", "Collect the results of exported work units and report the key"),
 
         arg_lit0(NULL, "in", "None (use CPU regular instruction set)"),
 #if defined(COMPILER_HAS_SIMD_X86)
@@ -2277,19 +2294,29 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
     bool slow = arg_get_lit(ctx, 12);
     bool tests = arg_get_lit(ctx, 13);
     bool nonce_file_write = arg_get_lit(ctx, 14);
+    bool compile = arg_get_lit(ctx, 15);
+    bool resume = arg_get_lit(ctx, 16);
+
+    int exportlen = 0;
+    char exportdir[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 17), (uint8_t *)exportdir, FILE_PATH_SIZE, &exportlen);
 
-    bool in = arg_get_lit(ctx, 15);
+    int mergelen = 0;
+    char mergedir[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 18), (uint8_t *)mergedir, FILE_PATH_SIZE, &mergelen);
+
+    bool in = arg_get_lit(ctx, 19);
 #if defined(COMPILER_HAS_SIMD_X86)
-    bool im = arg_get_lit(ctx, 16);
-    bool is = arg_get_lit(ctx, 17);
-    bool ia = arg_get_lit(ctx, 18);
-    bool i2 = arg_get_lit(ctx, 19);
+    bool im = arg_get_lit(ctx, 20);
+    bool is = arg_get_lit(ctx, 21);
+    bool ia = arg_get_lit(ctx, 22);
+    bool i2 = arg_get_lit(ctx, 23);
 #endif
 #if defined(COMPILER_HAS_SIMD_AVX512)
-    bool i5 = arg_get_lit(ctx, 20);
+    bool i5 = arg_get_lit(ctx, 24);
 #endif
 #if defined(COMPILER_HAS_SIMD_NEON)
-    bool ie = arg_get_lit(ctx, 16);
+    bool ie = arg_get_lit(ctx, 20);
 #endif
     CLIParserFree(ctx);
 
@@ -2320,10 +2347,37 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
     if (in)
         SetSIMDInstr(SIMD_NONE);
 
+    if (compile) {
+        return hardnested_compile_tables();
+    }
+
+    if (mergelen) {
+        uint64_t foundkey = 0;
+        int res = hardnested_merge(mergedir, &foundkey);
+        if (res == PM3_SUCCESS) {
+            PrintAndLogEx(SUCCESS, "Found key [ " _GREEN_("%012" PRIx64) " ]", foundkey);
+        } else if (res == PM3_EPARTIAL) {
+            PrintAndLogEx(INFO, "No key found yet, some work units are still pending");
+        } else if (res == PM3_EFAILED) {
+            PrintAndLogEx(FAILED, "All work units done, no key found");
+        }
+        return res;
+    }
+
+    if (exportlen && tests) {
+        PrintAndLogEx(WARNING, "Export can't be combined with tests");
+        return PM3_EINVARG;
+    }
+
+    if (resume && nonce_file_read == false) {
+        PrintAndLogEx(WARNING, "Resume needs the nonces from file, use `" _YELLOW_("-r") "`");
+        return PM3_EINVARG;
+    }
 
     bool known_target_key = (trg_keylen);
 
-    if (nonce_file_read) {
+    // `-f` names the nonce file, only fall back to the default name without it
+    if (nonce_file_read && fnlen == 0) {
         char *fptr = GenerateFilename("hf-mf-", "-nonces.bin");
         if (fptr == NULL)
             strncpy(filename, "nonces.bin", FILE_PATH_SIZE - 1);
@@ -2332,7 +2386,7 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
         free(fptr);
     }
 
-    if (nonce_file_write) {
+    if (nonce_file_write && fnlen == 0) {
         char *fptr = GenerateFilename("hf-mf-", "-nonces.bin");
         if (fptr == NULL) {
             return PM3_EFILE;
@@ -2345,7 +2399,7 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
         snprintf(filename, FILE_PATH_SIZE, "hf-mf-%s-nonces.bin", uid);
     }
 
-    if (g_session.pm3_present && !tests) {
+    if (IfPm3Present() && !tests) {
         // detect MFC EV1 Signature
         if (detect_mfc_ev1_signature() && keylen == 0) {
             PrintAndLogEx(INFO, "MIFARE Classic EV1 card detected");
@@ -2382,8 +2436,30 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
                   slow ? "Yes" : "No",
                   tests);
 
+    // checkpoint the brute force phase next to the nonce file
+    if ((nonce_file_read || nonce_file_write) && tests == false && strlen(filename)) {
+        char cpfn[FILE_PATH_SIZE + 8] = {0};
+        snprintf(cpfn, sizeof(cpfn), "%s.bfcp", filename);
+        brute_force_checkpoint_init(cpfn, resume);
+    }
+
+    if (exportlen) {
+        hardnested_set_export(exportdir);
+        brute_force_checkpoint_init(NULL, false);
+    }
+
     uint64_t foundkey = 0;
     int16_t isOK = mfnestedhard(blockno, keytype, key, trg_blockno, trg_keytype, known_target_key ? trg_key : NULL, nonce_file_read, nonce_file_write, slow, tests, &foundkey, filename);
+    brute_force_checkpoint_done(isOK == PM3_SUCCESS);
+
+    if (exportlen) {
+        hardnested_set_export(NULL);
+        if (isOK == PM3_SUCCESS || isOK == PM3_EFAILED) {
+            PrintAndLogEx(SUCCESS, "Work units written to " _YELLOW_("%s"), exportdir);
+            PrintAndLogEx(HINT, "Hint: Run `" _YELLOW_("hardnested_worker <unit file>") "` on each unit, then `" _YELLOW_("hf mf hardnested --merge %s") "`", exportdir);
+            return PM3_SUCCESS;
+        }
+    }
     switch (isOK) {
         case PM3_ETIMEOUT :
             PrintAndLogEx(ERR, "Error: No response from Proxmark3\n");
@@ -2419,7 +2495,8 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
                   "hf mf autopwn -s 0 -a -k FFFFFFFFFFFF     --> target MFC 1K card, Sector 0 with known key A 'FFFFFFFFFFFF'\n"
                   "hf mf autopwn --1k -f mfc_default_keys    --> target MFC 1K card, default dictionary\n"
                   "hf mf autopwn --1k -s 0 -a -k FFFFFFFFFFFF -f mfc_default_keys  --> combo of the two above samples\n"
-                  "hf mf autopwn --1k -s 0 -a -k FFFFFFFFFFFF -k a0a1a2a3a4a5      --> multiple user supplied keys"
+                  "hf mf autopwn --1k -s 0 -a -k FFFFFFFFFFFF -k a0a1a2a3a4a5      --> multiple user supplied keys\n"
+                  "hf mf autopwn --1k --pipeline             --> nested attack on all sectors, cracking while collecting"
                  );
 
     void *argtable[] = {
@@ -2437,6 +2514,7 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
         arg_lit0(NULL, "1k", "MIFARE Classic 1k / S50 (default)"),
         arg_lit0(NULL, "2k", "MIFARE Classic/Plus 2k"),
         arg_lit0(NULL, "4k", "MIFARE Classic 4k / S70"),
+        arg_lit0(NULL, "pipeline", "nested / staticnested, collect nonces of the next sector while cracking the previous ones"),
 
         arg_lit0(NULL, "in", "None (use CPU regular instruction set)"),
 #if defined(COMPILER_HAS_SIMD_X86)
@@ -2483,18 +2561,20 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
     bool m2 = arg_get_lit(ctx, 11);
     bool m4 = arg_get_lit(ctx, 12);
 
-    bool in = arg_get_lit(ctx, 13);
+    bool pipeline = arg_get_lit(ctx, 13);
+
+    bool in = arg_get_lit(ctx, 14);
 #if defined(COMPILER_HAS_SIMD_X86)
-    bool im = arg_get_lit(ctx, 14);
-    bool is = arg_get_lit(ctx, 15);
-    bool ia = arg_get_lit(ctx, 16);
-    bool i2 = arg_get_lit(ctx, 17);
+    bool im = arg_get_lit(ctx, 15);
+    bool is = arg_get_lit(ctx, 16);
+    bool ia = arg_get_lit(ctx, 17);
+    bool i2 = arg_get_lit(ctx, 18);
 #endif
 #if defined(COMPILER_HAS_SIMD_AVX512)
-    bool i5 = arg_get_lit(ctx, 18);
+    bool i5 = arg_get_lit(ctx, 19);
 #endif
 #if defined(COMPILER_HAS_SIMD_NEON)
-    bool ie = arg_get_lit(ctx, 14);
+    bool ie = arg_get_lit(ctx, 15);
 #endif
 
     CLIParserFree(ctx);
@@ -2870,6 +2950,32 @@ noValidKeyFound:
     num_to_bytes(0, MIFARE_KEY_SIZE, tmp_key);
     bool nested_failed = false;
 
+    // pipelined nested, all sectors at once. Leftovers go through the per sector attacks below
+    if (pipeline && (prng_type || has_staticnonce == NONCE_STATIC)) {
+        if (verbose) {
+            PrintAndLogEx(INFO, "======================= " _YELLOW_("START NESTED PIPELINE") " =======================");
+        }
+        isOK = mfNestedPipeline(mfFirstBlockOfSector(sectorno), keytype, key, sector_cnt, e_sector, has_staticnonce == NONCE_STATIC, &calibrate, verbose);
+        DropField();
+        switch (isOK) {
+            case PM3_ETIMEOUT: {
+                PrintAndLogEx(ERR, "\nError: No response from Proxmark3.");
+                free(e_sector);
+                free(fptr);
+                return isOK;
+            }
+            case PM3_EOPABORTED: {
+                PrintAndLogEx(WARNING, "\nButton pressed. Aborted.");
+                free(e_sector);
+                free(fptr);
+                return isOK;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+
     // Iterate over each sector and key(A/B)
     for (current_sector_i = 0; current_sector_i < sector_cnt; current_sector_i++) {
 
@@ -2976,12 +3082,14 @@ tryNested:
                         switch (isOK) {
                             case PM3_ETIMEOUT: {
                                 PrintAndLogEx(ERR, "\nError: No response from Proxmark3.");
+                                mfNestedFree();
                                 free(e_sector);
                                 free(fptr);
                                 return isOK;
                             }
                             case PM3_EOPABORTED: {
                                 PrintAndLogEx(WARNING, "\nButton pressed. Aborted.");
+                                mfNestedFree();
                                 free(e_sector);
                                 free(fptr);
                                 return isOK;
@@ -3015,6 +3123,7 @@ tryNested:
                                 PrintAndLogEx(SUCCESS, _GREEN_("found keys:"));
                                 printKeyTable(sector_cnt, e_sector);
                                 PrintAndLogEx(NORMAL, "");
+                                mfNestedFree();
                                 free(e_sector);
                                 free(fptr);
                                 return isOK;
@@ -3027,6 +3136,7 @@ tryNested:
                             }
                             default: {
                                 PrintAndLogEx(ERR, "unknown Error.\n");
+                                mfNestedFree();
                                 free(e_sector);
                                 free(fptr);
                                 return isOK;
@@ -3077,6 +3187,7 @@ tryHardnested: // If the nested attack fails then we try the hardnested attack
                                     break;
                                 }
                             }
+                            mfNestedFree();
                             free(e_sector);
                             free(fptr);
                             return PM3_ESOFT;
@@ -3102,12 +3213,14 @@ tryStaticnested:
                         switch (isOK) {
                             case PM3_ETIMEOUT: {
                                 PrintAndLogEx(ERR, "\nError: No response from Proxmark3");
+                                mfNestedFree();
                                 free(e_sector);
                                 free(fptr);
                                 return isOK;
                             }
                             case PM3_EOPABORTED: {
                                 PrintAndLogEx(WARNING, "\nButton pressed, user aborted");
+                                mfNestedFree();
                                 free(e_sector);
                                 free(fptr);
                                 return isOK;
@@ -3138,6 +3251,8 @@ tryStaticnested:
 
 all_found:
 
+    mfNestedFree();
+
     // Show the results to the user
     PrintAndLogEx(NORMAL, "");
     PrintAndLogEx(SUCCESS, _GREEN_("found keys:"));
@@ -5736,6 +5851,311 @@ static int CmdHf14AMfDecryptBytes(const char *Cmd) {
     return tryDecryptWord(nt, ar_enc, at_enc, data, datalen);
 }
 
+#define MFKEY_MAX_NONCES    4096
+
+static bool mfkey_add_nonce(mfkey_nonce_t *nonces, size_t *count, const mfkey_nonce_t *n) {
+    if (*count >= MFKEY_MAX_NONCES) {
+        return false;
+    }
+    nonces[(*count)++] = *n;
+    return true;
+}
+
+// walk a ISO14443a trace and collect  AUTH -> nt -> {nr}{ar} [-> {at}]  sequences.
+// Only authentications in clear are found, nested ones are encrypted.
+static void mfkey_nonces_from_trace(const uint8_t *trace, uint32_t trace_len, mfkey_nonce_t *nonces, size_t *count) {
+
+    enum { MFK_IDLE, MFK_AUTH, MFK_NT, MFK_NRAR } state = MFK_IDLE;
+    mfkey_nonce_t cur = {0};
+    uint32_t cuid = 0;
+    bool dropped = false;
+
+    uint32_t tracepos = 0;
+    while (tracepos + TRACELOG_HDR_LEN <= trace_len) {
+
+        const tracelog_hdr_t *hdr = (const tracelog_hdr_t *)(trace + tracepos);
+        uint16_t data_len = hdr->data_len;
+        if (data_len == 0 || tracepos + TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr) > trace_len) {
+            break;
+        }
+        tracepos += TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr);
+
+        const uint8_t *frame = hdr->frame;
+
+        if (hdr->isResponse == false) {
+
+            // SELECT,  the last cascade level without cascade tag holds the uid used by crypto1
+            if (data_len == 9 && (frame[0] == ISO14443A_CMD_ANTICOLL_OR_SELECT || frame[0] == ISO14443A_CMD_ANTICOLL_OR_SELECT_2 || frame[0] == ISO14443A_CMD_ANTICOLL_OR_SELECT_3) && frame[1] == 0x70) {
+                if (frame[2] != 0x88) {
+                    cuid = bytes_to_num(frame + 2, 4);
+                }
+                state = MFK_IDLE;
+                continue;
+            }
+
+            if (data_len == 4 && (frame[0] == MIFARE_AUTH_KEYA || frame[0] == MIFARE_AUTH_KEYB) && check_crc(CRC_14443_A, frame, 4)) {
+                memset(&cur, 0, sizeof(cur));
+                cur.cuid = cuid;
+                cur.sector = mfSectorNum(frame[1]);
+                cur.keytype = (frame[0] == MIFARE_AUTH_KEYA) ? MF_KEY_A : MF_KEY_B;
+                state = MFK_AUTH;
+                continue;
+            }
+
+            if (data_len == 8 && state == MFK_NT) {
+                cur.nr = bytes_to_num(frame, 4);
+                cur.ar = bytes_to_num(frame + 4, 4);
+                if (mfkey_add_nonce(nonces, count, &cur) == false) {
+                    dropped = true;
+                }
+                state = MFK_NRAR;
+                continue;
+            }
+
+        } else {
+
+            if (data_len == 4 && state == MFK_AUTH) {
+                cur.nt = bytes_to_num(frame, 4);
+                state = MFK_NT;
+                continue;
+            }
+
+            // tag answer to the last authentication
+            if (data_len == 4 && state == MFK_NRAR && dropped == false) {
+                nonces[*count - 1].at = bytes_to_num(frame, 4);
+                nonces[*count - 1].has_at = true;
+            }
+        }
+
+        state = MFK_IDLE;
+    }
+
+    if (dropped) {
+        PrintAndLogEx(WARNING, "More than " _YELLOW_("%u") " authentications, the rest is ignored", MFKEY_MAX_NONCES);
+    }
+}
+
+static bool mfkey_json_u32(json_t *item, const char *name, uint32_t *val) {
+    const char *s = json_string_value(json_object_get(item, name));
+    if (s == NULL || strlen(s) != 8) {
+        return false;
+    }
+    return sscanf(s, "%8x", val) == 1;
+}
+
+// {"nonces": [ {"uid": "12345678", "sector": 1, "keytype": "A", "nt": .., "nr": .., "ar": .., "at": ..}, ... ]}
+// "block" can be used instead of "sector", "at" is optional
+static int mfkey_nonces_from_json(const char *filename, mfkey_nonce_t *nonces, size_t *count) {
+
+    json_t *root = NULL;
+    int res = loadFileJSONroot(filename, (void **)&root, true);
+    if (res != PM3_SUCCESS) {
+        return res;
+    }
+
+    json_t *list = json_object_get(root, "nonces");
+    if (json_is_array(list) == false) {
+        PrintAndLogEx(ERR, "ERROR: " _YELLOW_("%s") " has no " _YELLOW_("nonces") " array", filename);
+        json_decref(root);
+        return PM3_ESOFT;
+    }
+
+    size_t idx;
+    json_t *item;
+    json_array_foreach(list, idx, item) {
+
+        mfkey_nonce_t cur = {0};
+        bool ok = mfkey_json_u32(item, "uid", &cur.cuid);
+        ok &= mfkey_json_u32(item, "nt", &cur.nt);
+        ok &= mfkey_json_u32(item, "nr", &cur.nr);
+        ok &= mfkey_json_u32(item, "ar", &cur.ar);
+        cur.has_at = mfkey_json_u32(item, "at", &cur.at);
+
+        json_t *sector = json_object_get(item, "sector");
+        json_t *block = json_object_get(item, "block");
+        if (json_is_integer(sector)) {
+            cur.sector = json_integer_value(sector);
+        } else if (json_is_integer(block)) {
+            cur.sector = mfSectorNum(json_integer_value(block));
+        } else {
+            ok = false;
+        }
+
+        const char *kt = json_string_value(json_object_get(item, "keytype"));
+        if (kt && (kt[0] == 'A' || kt[0] == 'a')) {
+            cur.keytype = MF_KEY_A;
+        } else if (kt && (kt[0] == 'B' || kt[0] == 'b')) {
+            cur.keytype = MF_KEY_B;
+        } else {
+            ok = false;
+        }
+
+        if (ok == false) {
+            PrintAndLogEx(WARNING, "skipping invalid entry %zu", idx);
+            continue;
+        }
+
+        if (mfkey_add_nonce(nonces, count, &cur) == false) {
+            PrintAndLogEx(WARNING, "More than " _YELLOW_("%u") " authentications, the rest is ignored", MFKEY_MAX_NONCES);
+            break;
+        }
+    }
+
+    json_decref(root);
+    return PM3_SUCCESS;
+}
+
+// one dictionary for all recovered keys, each key with a comment where it came from
+static int mfkey_save_keys(const char *filename, const mfkey_result_t *res, size_t n) {
+
+    char *fn = newfilenamemcopy(filename, ".dic");
+    if (fn == NULL) {
+        return PM3_EMALLOC;
+    }
+
+    FILE *f = fopen(fn, "w");
+    if (f == NULL) {
+        PrintAndLogEx(WARNING, "file not found or locked `" _YELLOW_("%s") "`", fn);
+        free(fn);
+        return PM3_EFILE;
+    }
+
+    uint32_t keys = 0;
+    fprintf(f, "# keys recovered by hf mf mfkey\n");
+    for (size_t i = 0; i < n; i++) {
+        if (res[i].found == false) {
+            continue;
+        }
+        fprintf(f, "# uid %08X sector %u key %c\n", res[i].cuid, res[i].sector, (res[i].keytype == MF_KEY_B) ? 'B' : 'A');
+        fprintf(f, "%012" PRIX64 "\n", res[i].key);
+        keys++;
+    }
+    fclose(f);
+
+    PrintAndLogEx(SUCCESS, "Saved " _YELLOW_("%u") " keys to dictionary file `" _YELLOW_("%s") "`", keys, fn);
+    free(fn);
+    return PM3_SUCCESS;
+}
+
+static int CmdHf14AMfMfkey(const char *Cmd) {
+    CLIParserContext *ctx;
+    CLIParserInit(&ctx, "hf mf mfkey",
+                  "Recover keys from many collected reader authentications at once, no tag needed.\n"
+                  "Authentications are grouped per UID / sector / key type and duplicates dropped.\n"
+                  "A group is solved with mfkey64 when the tag answered, else with mfkey32v2 from two authentications.\n"
+                  "Authentications are taken from a trace (`hf mf sim`, sniff or trace file)\n"
+                  "or from a JSON file  { \"nonces\": [ { \"uid\", \"sector\" | \"block\", \"keytype\", \"nt\", \"nr\", \"ar\" [, \"at\"] } ] }",
+                  "hf mf mfkey                          -> trace downloaded from device\n"
+                  "hf mf mfkey -1                       -> trace buffer\n"
+                  "hf mf mfkey -f sim_session.trace     -> trace file\n"
+                  "hf mf mfkey -f nonces.json -o keys   -> JSON file, keys saved to keys.dic"
+                 );
+    void *argtable[] = {
+        arg_param_begin,
+        arg_lit0("1", "buffer", "use data from trace buffer"),
+        arg_str0("f", "file", "<fn>", "trace file (.trace) or JSON nonce list (.json)"),
+        arg_str0("o", "out", "<fn>", "key file to save (def: hf-mf-mfkey-keys.dic)"),
+        arg_int0("t", "threads", "<dec>", "number of threads (def: number of CPUs)"),
+        arg_param_end
+    };
+    CLIExecWithReturn(ctx, Cmd, argtable, true);
+
+    bool use_buffer = arg_get_lit(ctx, 1);
+
+    int fnlen = 0;
+    char filename[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 2), (uint8_t *)filename, FILE_PATH_SIZE, &fnlen);
+
+    int outlen = 0;
+    char outname[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 3), (uint8_t *)outname, FILE_PATH_SIZE, &outlen);
+
+    uint32_t threads = arg_get_u32_def(ctx, 4, 0);
+    CLIParserFree(ctx);
+
+    mfkey_nonce_t *nonces = calloc(MFKEY_MAX_NONCES, sizeof(mfkey_nonce_t));
+    if (nonces == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+
+    size_t count = 0;
+    int res = PM3_SUCCESS;
+    if (fnlen && str_endswith(filename, ".json")) {
+        res = mfkey_nonces_from_json(filename, nonces, &count);
+    } else if (fnlen) {
+        uint8_t *trace = NULL;
+        size_t trace_len = 0;
+        res = loadFile_safe(filename, ".trace", (void **)&trace, &trace_len);
+        if (res == PM3_SUCCESS) {
+            mfkey_nonces_from_trace(trace, trace_len, nonces, &count);
+            free(trace);
+        }
+    } else {
+        const uint8_t *trace = NULL;
+        uint32_t trace_len = 0;
+        res = GetTraceBuffer(use_buffer == false, &trace, &trace_len);
+        if (res == PM3_SUCCESS) {
+            mfkey_nonces_from_trace(trace, trace_len, nonces, &count);
+        }
+    }
+
+    if (res != PM3_SUCCESS) {
+        free(nonces);
+        return res;
+    }
+
+    PrintAndLogEx(SUCCESS, "Found " _YELLOW_("%zu") " authentications", count);
+    if (count == 0) {
+        free(nonces);
+        return PM3_ENODATA;
+    }
+
+    uint64_t t1 = msclock();
+    mfkey_result_t *results = NULL;
+    size_t nresults = 0;
+    res = mfkey_batch(nonces, count, threads, &results, &nresults);
+    free(nonces);
+    if (res != PM3_SUCCESS) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return res;
+    }
+    t1 = msclock() - t1;
+
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(INFO, "  UID    | Sec | Key | Auths | Found key    | Method");
+    PrintAndLogEx(INFO, "----------+-----+-----+-------+--------------+-----------");
+
+    uint32_t found = 0;
+    for (size_t i = 0; i < nresults; i++) {
+        const mfkey_result_t *r = &results[i];
+        char key[40];
+        if (r->found) {
+            snprintf(key, sizeof(key), _GREEN_("%012" PRIX64), r->key);
+            found++;
+        } else {
+            snprintf(key, sizeof(key), _RED_("------------"));
+        }
+        PrintAndLogEx(INFO, " %08X | %03u |  %c  | %5u | %s | %s"
+                      , r->cuid
+                      , r->sector
+                      , (r->keytype == MF_KEY_B) ? 'B' : 'A'
+                      , r->nonces
+                      , key
+                      , (r->found) ? ((r->mfkey64) ? "mfkey64" : "mfkey32v2") : ((r->nonces < 2) ? "need 2 auths" : "")
+                     );
+    }
+    PrintAndLogEx(INFO, "----------+-----+-----+-------+--------------+-----------");
+    PrintAndLogEx(SUCCESS, "Recovered " _YELLOW_("%u") " of " _YELLOW_("%zu") " keys in " _YELLOW_("%.1f") " seconds", found, nresults, (float)t1 / 1000.0);
+
+    if (found) {
+        res = mfkey_save_keys((outlen) ? outname : "hf-mf-mfkey-keys", results, nresults);
+    }
+
+    free(results);
+    return res;
+}
+
 static int CmdHf14AMfSetMod(const char *Cmd) {
 
     CLIParserContext *ctx;
@@ -6090,7 +6510,7 @@ static int CmdHF14AMfMAD(const char *Cmd) {
         return PM3_SUCCESS;
     }
 
-    if (g_session.pm3_present == false)
+    if (IfPm3Present() == false)
         return PM3_ENOTTY;
 
 
@@ -6448,7 +6868,7 @@ int CmdHFMFNDEFFormat(const char *Cmd) {
     }
 
 
-    if (g_session.pm3_present == false)
+    if (IfPm3Present() == false)
         return PM3_ENOTTY;
 
     // Select card to get UID/UIDLEN/ATQA/SAK information
@@ -6647,7 +7067,7 @@ int CmdHFMFNDEFWrite(const char *Cmd) {
         PrintAndLogEx(INFO, "Number of sectors selected: %u", numSectors);
     }
 
-    if (g_session.pm3_present == false) {
+    if (IfPm3Present() == false) {
         PrintAndLogEx(FAILED, "No Proxmark3 device present");
         return PM3_ENOTTY;
     }
@@ -9038,7 +9458,7 @@ static int CmdHF14AMfValue(const char *Cmd) {
     if (action < 4) {
 
         uint8_t isok = true;
-        if (g_session.pm3_present == false)
+        if (IfPm3Present() == false)
             return PM3_ENOTTY;
 
         // 0 Increment, 1 - Decrement, 2 - Restore, 3 - Set, 4 - Get, 5 - Decode from data
@@ -9556,6 +9976,7 @@ static command_t CommandTable[] = {
     {"chk",         CmdHF14AMfChk,          IfPm3Iso14443a,  "Check keys"},
     {"fchk",        CmdHF14AMfChk_fast,     IfPm3Iso14443a,  "Check keys fast, targets all keys on card"},
     {"decrypt",     CmdHf14AMfDecryptBytes, AlwaysAvailable, "Decrypt Crypto1 data from sniff or trace"},
+    {"mfkey",       CmdHf14AMfMfkey,        AlwaysAvailable, "Recover keys from many collected reader authentications"},
     {"supercard",   CmdHf14AMfSuperCard,    IfPm3Iso14443a,  "Extract info from a `super card`"},
     {"-----------", CmdHelp,                IfPm3Iso14443a,  "----------------------- " _CYAN_("operations") " -----------------------"},
     {"auth4",       CmdHF14AMfAuth4,        IfPm3Iso14443a,  "ISO14443-4 AES authentication"},
@@ -32,6 +32,12 @@
 #include <time.h> // MingW
 #include <lz4frame.h>
 #include <bzlib.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "commonutil.h"  // ARRAYLEN
 #include "comms.h"
@@ -56,6 +62,13 @@
 #define STATE_FILE_TEMPLATE_LZ4         "bitflip_%d_%03" PRIx16 "_states.bin.lz4"
 #define STATE_FILE_TEMPLATE_BZ2         "bitflip_%d_%03" PRIx16 "_states.bin.bz2"
 
+// precompiled, uncompressed bitflip tables (see hf mf hardnested --compile)
+#define STATE_FILE_CACHE                "hardnested_bitflips.cache"
+#define STATE_CACHE_MAGIC               "PM3HNBF"
+#define STATE_CACHE_VERSION             1
+#define STATE_CACHE_ALIGN               4096
+#define STATE_BITARRAY_SIZE             (sizeof(uint32_t) * (1 << 19))
+
 #define DEBUG_KEY_ELIMINATION
 // #define DEBUG_REDUCTION
 
@@ -89,35 +102,14 @@ static uint32_t test_state[2] = {0, 0};
 static float brute_force_per_second;
 
 static void get_SIMD_instruction_set(char *instruction_set) {
-    switch (GetSIMDInstrAuto()) {
-#if defined(COMPILER_HAS_SIMD_AVX512)
-        case SIMD_AVX512:
-            strcpy(instruction_set, "AVX512F");
-            break;
-#endif
-#if defined(COMPILER_HAS_SIMD_X86)
-        case SIMD_AVX2:
-            strcpy(instruction_set, "AVX2");
-            break;
-        case SIMD_AVX:
-            strcpy(instruction_set, "AVX");
-            break;
-        case SIMD_SSE2:
-            strcpy(instruction_set, "SSE2");
-            break;
-        case SIMD_MMX:
-            strcpy(instruction_set, "MMX");
-            break;
-#endif
-#if defined(COMPILER_HAS_SIMD_NEON)
-        case SIMD_NEON:
-            strcpy(instruction_set, "NEON");
-            break;
-#endif
-        case SIMD_AUTO:
-        case SIMD_NONE:
-            strcpy(instruction_set, "no");
+    SIMDExecInstr instr = GetSIMDInstrAuto();
+    strcpy(instruction_set, "no");
+    for (uint32_t i = 0; i < bf_kernel_count(); i++) {
+        const bf_kernel_t *k = bf_kernel_get(i);
+        if (k->instr == instr) {
+            strcpy(instruction_set, k->name);
             break;
+        }
     }
 }
 
@@ -233,6 +225,181 @@ static int compare_count_bitflip_bitarrays(const void *b1, const void *b2) {
     return (count1 > count2) - (count2 > count1);
 }
 
+//----------------------------------------------------------------------------
+// Precompiled bitflip table cache.
+// One file holding all effective bitflip bitarrays, uncompressed and page aligned,
+// so it can be mapped read-only and shared between concurrent hardnested runs.
+//
+// layout:  header | entries[num_entries] | padding | bitarray 0 | bitarray 1 | ...
+//----------------------------------------------------------------------------
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_entries;
+    uint32_t bitarray_size;
+    uint32_t alignment;
+    uint64_t file_size;
+} PACKED bitflip_cache_header_t;
+
+typedef struct {
+    uint16_t odd_even;
+    uint16_t bitflip;
+    uint32_t count;
+    uint64_t offset;
+} PACKED bitflip_cache_entry_t;
+
+static uint8_t *bitflip_cache = NULL;
+static size_t bitflip_cache_size = 0;
+
+static void unmap_bitflip_cache(void) {
+    if (bitflip_cache == NULL) {
+        return;
+    }
+#if defined(_WIN32)
+    free_bitarray((uint32_t *)bitflip_cache);
+#else
+    munmap(bitflip_cache, bitflip_cache_size);
+#endif
+    bitflip_cache = NULL;
+    bitflip_cache_size = 0;
+    memset(bitflip_bitarrays, 0, sizeof(bitflip_bitarrays));
+}
+
+static bool check_bitflip_cache(const uint8_t *data, size_t datalen) {
+
+    if (datalen < sizeof(bitflip_cache_header_t)) {
+        return false;
+    }
+
+    const bitflip_cache_header_t *hdr = (const bitflip_cache_header_t *)data;
+    if (memcmp(hdr->magic, STATE_CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+            hdr->version != STATE_CACHE_VERSION ||
+            hdr->bitarray_size != STATE_BITARRAY_SIZE ||
+            hdr->alignment != STATE_CACHE_ALIGN ||
+            hdr->file_size != datalen) {
+        return false;
+    }
+
+    if (sizeof(bitflip_cache_header_t) + (uint64_t)hdr->num_entries * sizeof(bitflip_cache_entry_t) > datalen) {
+        return false;
+    }
+
+    const bitflip_cache_entry_t *entries = (const bitflip_cache_entry_t *)(data + sizeof(bitflip_cache_header_t));
+    for (uint32_t i = 0; i < hdr->num_entries; i++) {
+        if (entries[i].odd_even > ODD_STATE ||
+                entries[i].bitflip == 0 || entries[i].bitflip >= 0x400 ||
+                (entries[i].offset % STATE_CACHE_ALIGN) != 0 ||
+                entries[i].offset + STATE_BITARRAY_SIZE > datalen) {
+            return false;
+        }
+        // entries must be ordered like the table files are read
+        if (i > 0) {
+            uint32_t prev = (entries[i - 1].odd_even << 16) | entries[i - 1].bitflip;
+            uint32_t cur = (entries[i].odd_even << 16) | entries[i].bitflip;
+            if (cur <= prev) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static int map_bitflip_cache(void) {
+
+    char *path;
+    if (searchFile(&path, "", STATE_FILE_CACHE, "", true) != PM3_SUCCESS) {
+        return PM3_EFILE;
+    }
+
+#if defined(_WIN32)
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        free(path);
+        return PM3_EFILE;
+    }
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    rewind(f);
+    if (fsize <= 0) {
+        fclose(f);
+        free(path);
+        return PM3_EFILE;
+    }
+
+    uint8_t *data = (uint8_t *)malloc_bitarray(fsize);
+    if (data == NULL) {
+        fclose(f);
+        free(path);
+        return PM3_EMALLOC;
+    }
+
+    if (fread(data, 1, fsize, f) != (size_t)fsize) {
+        free_bitarray((uint32_t *)data);
+        fclose(f);
+        free(path);
+        return PM3_EFILE;
+    }
+    fclose(f);
+    size_t datalen = fsize;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        free(path);
+        return PM3_EFILE;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size <= 0) {
+        close(fd);
+        free(path);
+        return PM3_EFILE;
+    }
+
+    size_t datalen = st.st_size;
+    uint8_t *data = mmap(NULL, datalen, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        free(path);
+        return PM3_EFILE;
+    }
+#endif
+
+    bitflip_cache = data;
+    bitflip_cache_size = datalen;
+
+    if (check_bitflip_cache(data, datalen) == false) {
+        PrintAndLogEx(WARNING, "Ignoring outdated or damaged bitflip cache " _YELLOW_("%s"), path);
+        PrintAndLogEx(HINT, "Hint: Rebuild it with `" _YELLOW_("hf mf hardnested --compile") "`");
+        free(path);
+        unmap_bitflip_cache();
+        return PM3_EFILE;
+    }
+    free(path);
+
+    const bitflip_cache_header_t *hdr = (const bitflip_cache_header_t *)data;
+    const bitflip_cache_entry_t *entries = (const bitflip_cache_entry_t *)(data + sizeof(bitflip_cache_header_t));
+
+    for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+        num_effective_bitflips[odd_even] = 0;
+        for (uint16_t bitflip = 0x001; bitflip < 0x400; bitflip++) {
+            bitflip_bitarrays[odd_even][bitflip] = NULL;
+            count_bitflip_bitarrays[odd_even][bitflip] = 1 << 24;
+        }
+    }
+
+    for (uint32_t i = 0; i < hdr->num_entries; i++) {
+        odd_even_t odd_even = entries[i].odd_even;
+        uint16_t bitflip = entries[i].bitflip;
+        effective_bitflip[odd_even][num_effective_bitflips[odd_even]++] = bitflip;
+        bitflip_bitarrays[odd_even][bitflip] = (uint32_t *)(data + entries[i].offset);
+        count_bitflip_bitarrays[odd_even][bitflip] = entries[i].count;
+    }
+
+    effective_bitflip[EVEN_STATE][num_effective_bitflips[EVEN_STATE]] = 0x400; // EndOfList marker
+    effective_bitflip[ODD_STATE][num_effective_bitflips[ODD_STATE]] = 0x400;
+    return PM3_SUCCESS;
+}
+
 
 #define OUTPUT_BUFFER_LEN 80
 #define INPUT_BUFFER_LEN 80
@@ -254,12 +421,23 @@ static void init_bunzip2(bz_stream *compressed_stream, char *input_buffer, uint3
 
 }
 
-static void init_bitflip_bitarrays(void) {
+static void sort_effective_bitflips(void);
+
+static void init_bitflip_bitarrays(bool use_cache) {
 #if defined (DEBUG_REDUCTION)
     uint8_t line = 0;
 #endif
     uint64_t init_bitflip_bitarrays_starttime = msclock();
 
+    if (use_cache && map_bitflip_cache() == PM3_SUCCESS) {
+        char progress_text[80];
+        snprintf(progress_text, sizeof(progress_text), "Mapped %u precompiled bitflip tables in %"PRIu64" ms",
+                 num_effective_bitflips[EVEN_STATE] + num_effective_bitflips[ODD_STATE], msclock() - init_bitflip_bitarrays_starttime);
+        hardnested_print_progress(0, progress_text, (float)(1LL << 47), 0);
+        sort_effective_bitflips();
+        return;
+    }
+
     char state_file_name[MAX(strlen(STATE_FILE_TEMPLATE_RAW), MAX(strlen(STATE_FILE_TEMPLATE_LZ4), strlen(STATE_FILE_TEMPLATE_BZ2))) + 1];
     char state_files_path[strlen(get_my_executable_directory()) + strlen(STATE_FILES_DIRECTORY) + sizeof(state_file_name)];
     uint16_t nraw = 0, nlz4 = 0, nbz2 = 0;
@@ -490,6 +668,10 @@ static void init_bitflip_bitarrays(void) {
         snprintf(progress_text, sizeof(progress_text), "Loaded %u RAW / %u LZ4 / %u BZ2 in %"PRIu64" ms", nraw, nlz4, nbz2, msclock() - init_bitflip_bitarrays_starttime);
         hardnested_print_progress(0, progress_text, (float)(1LL << 47), 0);
     }
+    sort_effective_bitflips();
+}
+
+static void sort_effective_bitflips(void) {
     uint16_t i = 0;
     uint16_t j = 0;
     num_all_effective_bitflips = 0;
@@ -532,6 +714,10 @@ static void init_bitflip_bitarrays(void) {
 }
 
 static void free_bitflip_bitarrays(void) {
+    if (bitflip_cache != NULL) {
+        unmap_bitflip_cache();
+        return;
+    }
     for (int16_t bitflip = 0x3ff; bitflip > 0x000; bitflip--) {
         free_bitarray(bitflip_bitarrays[ODD_STATE][bitflip]);
     }
@@ -2282,13 +2468,87 @@ static void pre_XOR_nonces(void) {
     }
 }
 
+static char export_path[FILE_PATH_SIZE] = {0};
+static uint32_t export_unit_idx = 0;
+static uint32_t export_guess = 0;
+
+void hardnested_set_export(const char *path) {
+    export_unit_idx = 0;
+    export_guess = 0;
+    if (path == NULL) {
+        export_path[0] = '\0';
+    } else {
+        snprintf(export_path, sizeof(export_path), "%s", path);
+    }
+}
+
 static bool brute_force(uint64_t *found_key) {
     if (known_target_key != -1) {
         TestIfKeyExists(known_target_key);
     }
+
+    // export the candidates instead of testing them, keep going with the next guess
+    if (export_path[0] != '\0') {
+        brute_force_export(export_path, &export_unit_idx, export_guess++, candidates, cuid, nonces, best_first_bytes);
+        return false;
+    }
+
     return brute_force_bs(NULL, candidates, cuid, num_acquired_nonces, maximum_states, nonces, best_first_bytes, found_key);
 }
 
+int hardnested_merge(const char *path, uint64_t *foundkey) {
+
+    uint32_t num_units = 0;
+    uint32_t num_done = 0;
+    uint64_t num_states = 0;
+    bool found = false;
+
+    for (;; num_units++) {
+        char fn[FILE_PATH_SIZE];
+        char name[40];
+        snprintf(name, sizeof(name), HN_UNIT_FILE, num_units);
+        snprintf(fn, sizeof(fn), "%s%s%s", path, PATHSEP, name);
+        if (fileExists(fn) == false) {
+            break;
+        }
+
+        snprintf(name, sizeof(name), HN_RESULT_FILE, num_units);
+        snprintf(fn, sizeof(fn), "%s%s%s", path, PATHSEP, name);
+        FILE *f = fopen(fn, "r");
+        if (f == NULL) {
+            continue;
+        }
+
+        uint32_t unit = 0;
+        uint64_t states = 0;
+        char keystr[13] = {0};
+        int n = fscanf(f, "unit %u states %" SCNu64 " key %12s", &unit, &states, keystr);
+        fclose(f);
+        if (n != 3 || unit != num_units) {
+            PrintAndLogEx(WARNING, "Ignoring malformed result " _YELLOW_("%s"), fn);
+            continue;
+        }
+
+        num_done++;
+        num_states += states;
+        if (strcmp(keystr, "none") != 0 && found == false) {
+            found = (sscanf(keystr, "%" SCNx64, foundkey) == 1);
+        }
+    }
+
+    if (num_units == 0) {
+        PrintAndLogEx(WARNING, "No work units found in " _YELLOW_("%s"), path);
+        return PM3_EFILE;
+    }
+
+    PrintAndLogEx(INFO, "Work units done... " _YELLOW_("%u") " of " _YELLOW_("%u") ", %" PRIu64 " states tested", num_done, num_units, num_states);
+    if (found) {
+        return PM3_SUCCESS;
+    }
+
+    return (num_done == num_units) ? PM3_EFAILED : PM3_EPARTIAL;
+}
+
 static uint16_t SumProperty(struct Crypto1State *s) {
     uint16_t sum_odd = PartialSumProperty(s->odd, ODD_STATE);
     uint16_t sum_even = PartialSumProperty(s->even, EVEN_STATE);
@@ -2392,6 +2652,124 @@ static void init_it_all(void) {
     memset(sum_a0_bitarrays, 0, sizeof(sum_a0_bitarrays));
 }
 
+int hardnested_compile_tables(void) {
+
+    const char *user_path = get_my_user_directory();
+    if (user_path == NULL) {
+        PrintAndLogEx(ERR, "Could not determine user directory");
+        return PM3_EFILE;
+    }
+
+    size_t pathlen = strlen(user_path) + strlen(PM3_USER_DIRECTORY) + strlen(STATE_FILE_CACHE) + 5;
+    char *path = calloc(pathlen, sizeof(char));
+    char *tmppath = calloc(pathlen, sizeof(char));
+    if (path == NULL || tmppath == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        free(path);
+        free(tmppath);
+        return PM3_EMALLOC;
+    }
+    snprintf(path, pathlen, "%s%s%s", user_path, PM3_USER_DIRECTORY, STATE_FILE_CACHE);
+    snprintf(tmppath, pathlen, "%s.tmp", path);
+
+    brute_force_per_second = brute_force_benchmark(false);
+    start_time = msclock();
+    print_progress_header();
+
+    // always decompress the original table files
+    init_bitflip_bitarrays(false);
+
+    uint32_t num_entries = num_effective_bitflips[EVEN_STATE] + num_effective_bitflips[ODD_STATE];
+    if (num_entries == 0) {
+        PrintAndLogEx(ERR, "No bitflip tables found, nothing to compile");
+        free(path);
+        free(tmppath);
+        return PM3_EFILE;
+    }
+
+    size_t hdrlen = sizeof(bitflip_cache_header_t) + num_entries * sizeof(bitflip_cache_entry_t);
+    uint64_t data_offset = (hdrlen + STATE_CACHE_ALIGN - 1) & ~((uint64_t)STATE_CACHE_ALIGN - 1);
+
+    uint8_t *hdrbuf = calloc(data_offset, sizeof(uint8_t));
+    if (hdrbuf == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        free_bitflip_bitarrays();
+        free(path);
+        free(tmppath);
+        return PM3_EMALLOC;
+    }
+
+    bitflip_cache_header_t *hdr = (bitflip_cache_header_t *)hdrbuf;
+    memcpy(hdr->magic, STATE_CACHE_MAGIC, sizeof(hdr->magic));
+    hdr->version = STATE_CACHE_VERSION;
+    hdr->num_entries = num_entries;
+    hdr->bitarray_size = STATE_BITARRAY_SIZE;
+    hdr->alignment = STATE_CACHE_ALIGN;
+    hdr->file_size = data_offset + (uint64_t)num_entries * STATE_BITARRAY_SIZE;
+
+    bitflip_cache_entry_t *entries = (bitflip_cache_entry_t *)(hdrbuf + sizeof(bitflip_cache_header_t));
+    uint32_t n = 0;
+    for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+        for (uint16_t i = 0; i < num_effective_bitflips[odd_even]; i++) {
+            uint16_t bitflip = effective_bitflip[odd_even][i];
+            entries[n].odd_even = odd_even;
+            entries[n].bitflip = bitflip;
+            entries[n].count = count_bitflip_bitarrays[odd_even][bitflip];
+            entries[n].offset = data_offset + (uint64_t)n * STATE_BITARRAY_SIZE;
+            n++;
+        }
+    }
+
+    int res = PM3_SUCCESS;
+    FILE *f = fopen(tmppath, "wb");
+    if (f == NULL) {
+        PrintAndLogEx(ERR, "Could not create file " _YELLOW_("%s"), tmppath);
+        res = PM3_EFILE;
+        goto out;
+    }
+
+    if (fwrite(hdrbuf, 1, data_offset, f) != data_offset) {
+        res = PM3_EFILE;
+    }
+
+    for (uint32_t i = 0; i < num_entries && res == PM3_SUCCESS; i++) {
+        if (fwrite(bitflip_bitarrays[entries[i].odd_even][entries[i].bitflip], 1, STATE_BITARRAY_SIZE, f) != STATE_BITARRAY_SIZE) {
+            res = PM3_EFILE;
+        }
+    }
+
+    if (fclose(f) != 0) {
+        res = PM3_EFILE;
+    }
+
+    if (res != PM3_SUCCESS) {
+        PrintAndLogEx(ERR, "Write error with " _YELLOW_("%s"), tmppath);
+        remove(tmppath);
+        goto out;
+    }
+
+    // replace atomically, processes still mapping an older cache keep their pages
+#if defined(_WIN32)
+    remove(path);
+#endif
+    if (rename(tmppath, path) != 0) {
+        PrintAndLogEx(ERR, "Could not rename " _YELLOW_("%s") " to " _YELLOW_("%s"), tmppath, path);
+        remove(tmppath);
+        res = PM3_EFILE;
+        goto out;
+    }
+
+    PrintAndLogEx(SUCCESS, "Compiled " _YELLOW_("%u") " bitflip tables ( " _YELLOW_("%" PRIu64) " MB ) to " _YELLOW_("%s"),
+                  num_entries, hdr->file_size >> 20, path);
+
+out:
+    free(hdrbuf);
+    free_bitflip_bitarrays();
+    free(path);
+    free(tmppath);
+    return res;
+}
+
 int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *trgkey, bool nonce_file_read, bool nonce_file_write, bool slow, int tests, uint64_t *foundkey, char *filename) {
     char progress_text[80];
     char instr_set[12] = {0};
@@ -2403,7 +2781,7 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
     init_it_all();
 
     srand((unsigned) time(NULL));
-    brute_force_per_second = brute_force_benchmark();
+    brute_force_per_second = brute_force_benchmark(tests > 0);
     write_stats = false;
 
     if (tests) {
@@ -2429,7 +2807,7 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
                 known_target_key = -1;
             }
 
-            init_bitflip_bitarrays();
+            init_bitflip_bitarrays(true);
             init_part_sum_bitarrays();
             init_sum_bitarrays();
             init_allbitflips_array();
@@ -2535,7 +2913,7 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
         print_progress_header();
         snprintf(progress_text, sizeof(progress_text), "Brute force benchmark: %1.0f million (2^%1.1f) keys/s", brute_force_per_second / 1000000, log(brute_force_per_second) / log(2.0));
         hardnested_print_progress(0, progress_text, (float)(1LL << 47), 0);
-        init_bitflip_bitarrays();
+        init_bitflip_bitarrays(true);
         init_part_sum_bitarrays();
         init_sum_bitarrays();
         init_allbitflips_array();
@@ -28,6 +28,7 @@
 #include "cmdhf14a.h"
 #include "cmddata.h"
 #include "graph.h"
+#include "lfctx.h"
 
 #define TEXKOM_NOISE_THRESHOLD (10)
 
@@ -618,7 +618,7 @@ static int CmdHF14AWSLoad(const char *Cmd) {
         PrintAndLogEx(WARNING, "Unknown model");
         return PM3_EINVARG;
     }
-    if (!g_session.pm3_present && !outfilelen) {
+    if (!IfPm3Present() && !outfilelen) {
         PrintAndLogEx(WARNING, "Offline - can only perform image conversion");
         return PM3_ENOTTY;
     }
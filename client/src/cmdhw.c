@@ -40,6 +40,7 @@
 #include "flash.h"          // reboot to bootloader mode
 #include "gui/proxgui.h"
 #include "graph.h"          // for graph data
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -1378,14 +1379,14 @@ static int CmdConnect(const char *Cmd) {
         memcpy(port, g_conn.serial_port_name, sizeof(port));
     }
 
-    if (g_session.pm3_present) {
+    if (IfPm3Present()) {
         CloseProxmark(g_session.current_device);
     }
 
     // 10 second timeout
     OpenProxmark(&g_session.current_device, port, false, 10, false, baudrate);
 
-    if (g_session.pm3_present && (TestProxmark(g_session.current_device) != PM3_SUCCESS)) {
+    if (IfPm3Present() && (TestProxmark(g_session.current_device) != PM3_SUCCESS)) {
         PrintAndLogEx(ERR, _RED_("ERROR:") " cannot communicate with the Proxmark3\n");
         CloseProxmark(g_session.current_device);
         return PM3_ENOTTY;
@@ -1545,7 +1546,7 @@ void pm3_version_short(void) {
     PrintAndLogEx(NORMAL, "  [ " _CYAN_("Proxmark3 RFID instrument") " ]");
     PrintAndLogEx(NORMAL, "");
 
-    if (g_session.pm3_present) {
+    if (IfPm3Present()) {
 
         PacketResponseNG resp;
         clearCommandBuffer();
@@ -1682,7 +1683,7 @@ void pm3_version(bool verbose, bool oneliner) {
     PrintAndLogEx(NORMAL, "  Python SWIG support....... " _YELLOW_("absent"));
 #endif
 
-    if (g_session.pm3_present) {
+    if (IfPm3Present()) {
         PrintAndLogEx(NORMAL, "\n [ " _YELLOW_("Proxmark3") " ]");
 
         PacketResponseNG resp;
@@ -15,6 +15,8 @@
 //-----------------------------------------------------------------------------
 // Low frequency commands
 //-----------------------------------------------------------------------------
+// this define is needed for scandir/alphasort to work
+#define _GNU_SOURCE
 #include "cmdlf.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -67,6 +69,16 @@
 #include "cmdlfzx8211.h"    // for ZX8211 menu
 #include "crc.h"
 #include "pm3_cmd.h"        // for LF_CMDREAD_MAX_EXTRA_SYMBOLS
+#include "utils/fileutils.h" // loadFilePM3 / loadFileWAVE
+#include "scandir.h"        // batch search
+#include "util_posix.h"     // msclock
+#include <pthread.h>
+#if !defined(_WIN32)
+#include <glob.h>
+#endif
+#include "lfctx.h"
+
+#define LF_SEARCH_MAX_WORKERS 64
 
 static int CmdHelp(const char *Cmd);
 
@@ -289,7 +301,7 @@ int CmdLFCommandRead(const char *Cmd) {
     bool cm = arg_get_lit(ctx, 10);
     CLIParserFree(ctx);
 
-    if (g_session.pm3_present == false) {
+    if (IfPm3Present() == false) {
         return PM3_ENOTTY;
     }
 
@@ -571,7 +583,7 @@ int lf_config_savereset(sample_config *config) {
 }
 
 int lf_getconfig(sample_config *config) {
-    if (!g_session.pm3_present) return PM3_ENOTTY;
+    if (!IfPm3Present()) return PM3_ENOTTY;
 
     if (config == NULL)
         return PM3_EINVARG;
@@ -589,7 +601,7 @@ int lf_getconfig(sample_config *config) {
 }
 
 int lf_config(sample_config *config) {
-    if (!g_session.pm3_present) return PM3_ENOTTY;
+    if (!IfPm3Present()) return PM3_ENOTTY;
 
     clearCommandBuffer();
     if (config != NULL)
@@ -644,7 +656,7 @@ int CmdLFConfig(const char *Cmd) {
     int16_t trigg = arg_get_int_def(ctx, 10, -1);
     CLIParserFree(ctx);
 
-    if (g_session.pm3_present == false)
+    if (IfPm3Present() == false)
         return PM3_ENOTTY;
 
     // if called with no params, just print the device config
@@ -726,7 +738,7 @@ int CmdLFConfig(const char *Cmd) {
 }
 
 static int lf_read_internal(bool realtime, bool verbose, uint64_t samples) {
-    if (!g_session.pm3_present) return PM3_ENOTTY;
+    if (!IfPm3Present()) return PM3_ENOTTY;
 
     lf_sample_payload_t payload = {0};
     payload.realtime = realtime;
@@ -831,7 +843,7 @@ int CmdLFRead(const char *Cmd) {
     // but IDK how to get it.
     bool realtime = samples > 40000;
 
-    if (g_session.pm3_present == false)
+    if (IfPm3Present() == false)
         return PM3_ENOTTY;
 
     if (cm || realtime) {
@@ -853,7 +865,7 @@ int CmdLFRead(const char *Cmd) {
 }
 
 int lf_sniff(bool realtime, bool verbose, uint64_t samples) {
-    if (!g_session.pm3_present) return PM3_ENOTTY;
+    if (!IfPm3Present()) return PM3_ENOTTY;
 
     lf_sample_payload_t payload = {0};
     payload.realtime = realtime;
@@ -957,7 +969,7 @@ int CmdLFSniff(const char *Cmd) {
     // but IDK how to get it.
     bool realtime = samples > 40000;
 
-    if (g_session.pm3_present == false)
+    if (IfPm3Present() == false)
         return PM3_ENOTTY;
 
     if (cm || realtime) {
@@ -1049,7 +1061,7 @@ int CmdLFSim(const char *Cmd) {
     uint16_t gap = arg_get_u32_def(ctx, 1, 0);
     CLIParserFree(ctx);
 
-    if (g_session.pm3_present == false) {
+    if (IfPm3Present() == false) {
         PrintAndLogEx(DEBUG, "DEBUG: no proxmark present");
         return PM3_ENOTTY;
     }
@@ -1630,6 +1642,493 @@ static int check_autocorrelate(const char *prefix, int clock) {
     return PM3_EFAILED;
 }
 
+static int demodIdteckSearch(bool verbose) {
+    return demodIdteck(NULL, verbose);
+}
+
+static int demodParadoxSearch(bool verbose) {
+    return demodParadox(verbose, false);
+}
+
+typedef struct {
+    const char *name;
+    int (*demod)(bool verbose);
+} lf_search_demod_t;
+
+// known tags, in the order `lf search` tries them
+static const lf_search_demod_t lf_search_demods[] = {
+    // ask / man
+    {"EM410x ID", demodEM410x},
+    {"FDX-A FECAVA Destron ID", demodDestron}, // to do before HID
+    {"GALLAGHER ID", demodGallagher},
+    {"Noralsy ID", demodNoralsy},
+    {"Presco ID", demodPresco},
+    {"Securakey ID", demodSecurakey},
+    {"Viking ID", demodViking},
+    {"Visa2000 ID", demodVisa2k},
+    // ask / bi
+    {"FDX-B ID", demodFDXB},
+    {"Jablotron ID", demodJablotron},
+    {"Guardall G-Prox II ID", demodGuard},
+    {"NEDAP ID", demodNedap},
+    // nrz
+    {"PAC/Stanley ID", demodPac},
+    // fsk
+    {"HID Prox ID", demodHID},
+    {"AWID ID", demodAWID},
+    {"IO Prox ID", demodIOProx},
+    {"Pyramid ID", demodPyramid},
+    {"Paradox ID", demodParadoxSearch},
+    // psk
+    {"Idteck ID", demodIdteckSearch},
+    {"KERI ID", demodKeri},
+    {"NexWatch ID", demodNexWatch},
+    {"Indala ID", demodIndala},
+//    {"Texas Instrument ID", demodTI},
+//    {"Fermax ID", demodFermax},
+};
+
+// demods use large stack buffers, don't depend on the platform default for threads
+#define LF_SEARCH_STACK_SIZE (16 * 1024 * 1024)
+
+// outcome of one known tag demod of a sweep
+typedef struct {
+    bool found;
+    size_t bits;
+    uint8_t *demod;
+} lf_search_result_t;
+
+// one signal run through all known tag demods, the demods are handed out through a shared counter
+typedef struct {
+    const int32_t *graph;
+    size_t len;
+    signal_t signal;
+    demod_cache_t *cache;
+    lf_search_result_t *results;
+    bool first_only;
+    uint32_t next;
+    uint32_t stop;
+    bool failed;
+} lf_search_sweep_t;
+
+// every demod starts from the signal as it was given to the sweep
+static void lf_search_sweep_load(const lf_search_sweep_t *s) {
+    memcpy(g_GraphBuffer, s->graph, s->len * sizeof(int32_t));
+    g_GraphTraceLen = s->len;
+    *getSignalProperties() = s->signal;
+    g_DemodBufferLen = 0;
+    g_DemodStartIdx = 0;
+    g_DemodClock = 0;
+}
+
+// the clock and field clock detections the demods auto-detect with, done once for all of them
+static void lf_search_analyze(void) {
+
+    // nrz / psk clock and psk carrier
+    GetNrzClock("", false);
+    GetPskClock("", false);
+    GetPskCarrier(false);
+
+    // fsk field clocks and bit clock
+    uint8_t fc1 = 0, fc2 = 0, rf1 = 0;
+    int edge = 0;
+    fskClocks(&fc1, &fc2, &rf1, &edge);
+
+    // ask clock the way ASKDemod_ext detects it for EM410x and Viking
+    uint8_t *bits = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
+    if (bits == NULL) {
+        return;
+    }
+    size_t size = getFromGraphBuffer(bits);
+    if (g_pm3_capabilities.sram_size && g_pm3_capabilities.sram_size < size) {
+        size = g_pm3_capabilities.sram_size;
+    }
+    if (size >= 255) {
+        int clk = 0;
+        size_t ststart = 0, stend = 0;
+        DetectST(bits, &size, &clk, &ststart, &stend);
+        if (clk != 32 && clk != 64) {
+            clk = 0;
+        }
+        DetectASKClock(bits, size, &clk, 100);
+    }
+    free(bits);
+}
+
+// runs the demods handed out on the signal context of the calling thread
+static void lf_search_sweep_run(lf_search_sweep_t *s) {
+    setDemodCache(s->cache);
+
+    uint32_t idx;
+    while ((idx = __atomic_fetch_add(&s->next, 1, __ATOMIC_RELAXED)) < ARRAYLEN(lf_search_demods)) {
+        // the demods before a found tag are already handed out
+        if (idx > __atomic_load_n(&s->stop, __ATOMIC_RELAXED)) {
+            break;
+        }
+        lf_search_sweep_load(s);
+        if (lf_search_demods[idx].demod(false) != PM3_SUCCESS) {
+            continue;
+        }
+        lf_search_result_t *r = &s->results[idx];
+        r->demod = calloc(g_DemodBufferLen + 1, sizeof(uint8_t));
+        if (r->demod == NULL) {
+            __atomic_store_n(&s->failed, true, __ATOMIC_RELAXED);
+            continue;
+        }
+        memcpy(r->demod, g_DemodBuffer, g_DemodBufferLen);
+        r->bits = g_DemodBufferLen;
+        r->found = true;
+
+        if (s->first_only) {
+            uint32_t stop = __atomic_load_n(&s->stop, __ATOMIC_RELAXED);
+            while (idx < stop && __atomic_compare_exchange_n(&s->stop, &stop, idx, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED) == false) {
+            }
+        }
+    }
+    setDemodCache(NULL);
+}
+
+static void *lf_search_sweep_thread(void *arg) {
+    lf_search_sweep_t *s = arg;
+
+    lf_signal_ctx_t *ctx = lf_signal_ctx_new();
+    if (ctx == NULL) {
+        return NULL;
+    }
+    lf_signal_ctx_t *prev = lf_signal_ctx_bind(ctx);
+    lf_search_sweep_run(s);
+    lf_signal_ctx_bind(prev);
+    lf_signal_ctx_free(ctx);
+    return NULL;
+}
+
+static void lf_search_results_free(lf_search_result_t *results) {
+    for (size_t i = 0; i < ARRAYLEN(lf_search_demods); i++) {
+        free(results[i].demod);
+        results[i].demod = NULL;
+    }
+}
+
+// run the known tag demods on the signal of the calling thread's context, on up to `threads` threads.
+// The shared detections are done first, the demods look them up in `cache`.
+// With `first_only` no demods after the first tag found in table order are run.
+// The signal of the calling thread's context is left untouched
+static int lf_search_sweep(lf_search_result_t *results, uint32_t threads, bool first_only, demod_cache_t *cache) {
+
+    memset(results, 0, ARRAYLEN(lf_search_demods) * sizeof(lf_search_result_t));
+
+    lf_search_sweep_t s = {
+        .graph = g_GraphBuffer,
+        .len = g_GraphTraceLen,
+        .signal = *getSignalProperties(),
+        .cache = cache,
+        .results = results,
+        .first_only = first_only,
+        .next = 0,
+        .stop = UINT32_MAX,
+        .failed = false
+    };
+
+    lf_signal_ctx_t *ctx = lf_signal_ctx_new();
+    if (ctx == NULL) {
+        return PM3_EMALLOC;
+    }
+    lf_signal_ctx_t *prev = lf_signal_ctx_bind(ctx);
+    setDemodCache(cache);
+    lf_search_sweep_load(&s);
+    lf_search_analyze();
+    setDemodCache(NULL);
+
+    if (threads > ARRAYLEN(lf_search_demods))
+        threads = ARRAYLEN(lf_search_demods);
+
+    pthread_t thread_id[ARRAYLEN(lf_search_demods)];
+    uint32_t started = 0;
+    if (threads > 1) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, LF_SEARCH_STACK_SIZE);
+        for (; started < threads; started++) {
+            if (pthread_create(&thread_id[started], &attr, lf_search_sweep_thread, &s)) {
+                break;
+            }
+        }
+        pthread_attr_destroy(&attr);
+    }
+    // single threaded, or no thread could start, run the demods on the context of the analysis
+    if (started == 0) {
+        lf_search_sweep_run(&s);
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(thread_id[i], NULL);
+    }
+
+    lf_signal_ctx_bind(prev);
+    lf_signal_ctx_free(ctx);
+
+    // a worker without a context leaves its demods to the others, none got one
+    if (s.next < ARRAYLEN(lf_search_demods) && s.stop == UINT32_MAX) {
+        return PM3_EMALLOC;
+    }
+    return (s.failed) ? PM3_EMALLOC : PM3_SUCCESS;
+}
+
+// search one signal file for known tags, on the signal context of the calling thread.
+// Returns a json result line, to be freed by the caller.
+static char *lf_search_file(const char *fn) {
+
+    json_t *root = json_object();
+    json_object_set_new(root, "file", json_string(fn));
+
+    int *samples = calloc(MAX_GRAPH_TRACE_LEN, sizeof(int));
+    if (samples == NULL) {
+        json_object_set_new(root, "error", json_string("failed to allocate memory"));
+        goto out;
+    }
+
+    size_t len = 0;
+    int res;
+    if (str_endswith(fn, ".wav") || str_endswith(fn, ".WAV")) {
+        res = loadFileWAVE(fn, samples, MAX_GRAPH_TRACE_LEN, &len);
+    } else {
+        res = loadFilePM3(fn, samples, MAX_GRAPH_TRACE_LEN, &len);
+    }
+    json_object_set_new(root, "samples", json_integer(len));
+
+    if (res != PM3_SUCCESS) {
+        json_object_set_new(root, "error", json_string("failed to load file"));
+        goto out;
+    }
+    if (len < 2000) {
+        json_object_set_new(root, "error", json_string("data too small"));
+        goto out;
+    }
+
+    // same preparation as `data load`, on cleared buffers so results don't depend on the files searched before
+    memset(g_GraphBuffer, 0, MAX_GRAPH_TRACE_LEN * sizeof(int32_t));
+    memset(g_DemodBuffer, 0, MAX_DEMOD_BUF_LEN);
+    memcpy(g_GraphBuffer, samples, len * sizeof(int));
+    g_GraphTraceLen = len;
+    uint8_t *bits = (uint8_t *)samples;
+    size_t size = getFromGraphBuffer(bits);
+    removeSignalOffset(bits, size);
+    setGraphBuffer(bits, size);
+    computeSignalProperties(bits, size);
+    setClockGrid(0, 0);
+    g_DemodBufferLen = 0;
+
+    // files are already searched in parallel, one sweep thread per file
+    lf_search_result_t results[ARRAYLEN(lf_search_demods)];
+    demod_cache_t cache;
+    demodCacheInit(&cache);
+    res = lf_search_sweep(results, 1, false, &cache);
+    demodCacheFree(&cache);
+    if (res != PM3_SUCCESS) {
+        lf_search_results_free(results);
+        json_object_set_new(root, "error", json_string("failed to allocate memory"));
+        goto out;
+    }
+
+    json_t *found = json_array();
+    for (size_t i = 0; i < ARRAYLEN(lf_search_demods); i++) {
+        if (results[i].found) {
+            char hex[(MAX_DEMOD_BUF_LEN / 4) + 1] = {0};
+            binarray_2_hex(hex, sizeof(hex), (char *)results[i].demod, results[i].bits);
+            json_array_append_new(found, json_pack("{s:s, s:I, s:s}",
+                                                   "tag", lf_search_demods[i].name,
+                                                   "bits", (json_int_t)results[i].bits,
+                                                   "raw", hex));
+        }
+    }
+    json_object_set_new(root, "found", found);
+    lf_search_results_free(results);
+
+out:
+    free(samples);
+    char *line = json_dumps(root, JSON_COMPACT);
+    json_decref(root);
+    return line;
+}
+
+static int lf_search_file_select(const struct dirent *entry) {
+    return str_endswith(entry->d_name, ".pm3") || str_endswith(entry->d_name, ".wav")
+           || str_endswith(entry->d_name, ".PM3") || str_endswith(entry->d_name, ".WAV");
+}
+
+// all .pm3 / .wav files of a directory, or the files matching a glob pattern
+static char **lf_search_file_list(const char *path, size_t *cnt) {
+
+    char **files = NULL;
+    *cnt = 0;
+
+    struct dirent **namelist;
+    int n = scandir(path, &namelist, lf_search_file_select, alphasort);
+    if (n >= 0) {
+        files = calloc(n + 1, sizeof(char *));
+        for (int i = 0; i < n; i++) {
+            size_t len = strlen(path) + strlen(namelist[i]->d_name) + 2;
+            if (files) {
+                files[*cnt] = calloc(len, sizeof(char));
+                if (files[*cnt]) {
+                    bool slash = str_endswith(path, "/") || str_endswith(path, PATHSEP);
+                    snprintf(files[*cnt], len, "%s%s%s", path, slash ? "" : PATHSEP, namelist[i]->d_name);
+                    (*cnt)++;
+                }
+            }
+            free(namelist[i]);
+        }
+        free(namelist);
+        return files;
+    }
+
+#if !defined(_WIN32)
+    glob_t g;
+    if (glob(path, 0, NULL, &g) == 0) {
+        files = calloc(g.gl_pathc + 1, sizeof(char *));
+        for (size_t i = 0; files && i < g.gl_pathc; i++) {
+            files[*cnt] = strdup(g.gl_pathv[i]);
+            if (files[*cnt])
+                (*cnt)++;
+        }
+        globfree(&g);
+    }
+#endif
+    return files;
+}
+
+static void lf_search_emit(FILE *out, const char *line) {
+    if (out) {
+        fprintf(out, "%s\n", line);
+    } else {
+        PrintAndLogEx(NORMAL, "%s", line);
+    }
+}
+
+typedef struct {
+    char **files;
+    char **lines;
+    size_t cnt;
+    uint32_t next;
+} lf_search_batch_t;
+
+// each worker searches on its own signal context, files are handed out through a shared counter
+static void *lf_search_batch_thread(void *arg) {
+    lf_search_batch_t *b = arg;
+
+    lf_signal_ctx_t *ctx = lf_signal_ctx_new();
+    if (ctx == NULL) {
+        return NULL;
+    }
+    lf_signal_ctx_bind(ctx);
+
+    uint32_t idx;
+    while ((idx = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED)) < b->cnt) {
+        b->lines[idx] = lf_search_file(b->files[idx]);
+    }
+
+    lf_signal_ctx_free(ctx);
+    return NULL;
+}
+
+// offline batch search, one json result line per file
+static int lf_search_batch(const char *path, const char *jsonfn, uint32_t workers) {
+
+    size_t cnt = 0;
+    char **files = lf_search_file_list(path, &cnt);
+    if (files == NULL || cnt == 0) {
+        PrintAndLogEx(FAILED, "No .pm3 / .wav files found in `" _YELLOW_("%s") "`", path);
+        free(files);
+        return PM3_EFILE;
+    }
+
+    FILE *out = NULL;
+    if (jsonfn && strlen(jsonfn)) {
+        out = fopen(jsonfn, "w");
+        if (out == NULL) {
+            PrintAndLogEx(WARNING, "couldn't open '%s'", jsonfn);
+            for (size_t i = 0; i < cnt; i++)
+                free(files[i]);
+            free(files);
+            return PM3_EFILE;
+        }
+    }
+
+    if (workers == 0)
+        workers = num_CPUs();
+    if (workers > LF_SEARCH_MAX_WORKERS)
+        workers = LF_SEARCH_MAX_WORKERS;
+    if (workers > cnt)
+        workers = cnt;
+
+    lf_search_batch_t batch = {
+        .files = files,
+        .lines = calloc(cnt, sizeof(char *)),
+        .cnt = cnt,
+        .next = 0
+    };
+    if (batch.lines == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        if (out)
+            fclose(out);
+        for (size_t i = 0; i < cnt; i++)
+            free(files[i]);
+        free(files);
+        return PM3_EMALLOC;
+    }
+
+    uint64_t t1 = msclock();
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, LF_SEARCH_STACK_SIZE);
+
+    // demods are quiet, results are printed afterwards in file order
+    uint8_t old_printAndLog = g_printAndLog;
+    g_printAndLog = 0;
+
+    pthread_t thread_id[LF_SEARCH_MAX_WORKERS];
+    uint32_t started = 0;
+    for (; started < workers; started++) {
+        if (pthread_create(&thread_id[started], &attr, lf_search_batch_thread, &batch)) {
+            break;
+        }
+    }
+    // no thread could start, search here
+    if (started == 0) {
+        lf_search_batch_thread(&batch);
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(thread_id[i], NULL);
+    }
+    pthread_attr_destroy(&attr);
+
+    g_printAndLog = old_printAndLog;
+    workers = MAX(started, 1);
+
+    int res = PM3_SUCCESS;
+    for (size_t i = 0; i < cnt; i++) {
+        if (batch.lines[i] == NULL) {
+            res = PM3_EMALLOC;
+            continue;
+        }
+        lf_search_emit(out, batch.lines[i]);
+        free(batch.lines[i]);
+    }
+    free(batch.lines);
+    t1 = msclock() - t1;
+
+    if (out) {
+        fclose(out);
+        PrintAndLogEx(SUCCESS, "Saved results to `" _YELLOW_("%s") "`", jsonfn);
+    }
+    PrintAndLogEx(SUCCESS, "Searched " _YELLOW_("%zu") " files with %u worker%s in %.1f seconds", cnt, workers, (workers > 1) ? "s" : "", (float)t1 / 1000.0);
+
+    for (size_t i = 0; i < cnt; i++)
+        free(files[i]);
+    free(files);
+    return res;
+}
+
 int CmdLFfind(const char *Cmd) {
 
     CLIParserContext *ctx;
@@ -1639,6 +2138,8 @@ int CmdLFfind(const char *Cmd) {
                   "lf search -u    -> try reading data from tag & search for known and unknown tag\n"
                   "lf search -1    -> use data from the GraphBuffer & search for known tag\n"
                   "lf search -1uc  -> use data from the GraphBuffer & search for known and unknown tag\n"
+                  "lf search --dir captures/ --json result.jsonl  -> search all .pm3 / .wav files in a folder, one JSON line per file\n"
+                  "lf search --dir 'captures/*_em*.pm3'           -> search all matching files, results to console\n"
                  );
 
     void *argtable[] = {
@@ -1646,15 +2147,32 @@ int CmdLFfind(const char *Cmd) {
         arg_lit0("1", NULL, "Use data from Graphbuffer to search (offline mode)"),
         arg_lit0("c", NULL, "Continue searching after successful match"),
         arg_lit0("u", NULL, "Search for unknown tags"),
+        arg_str0(NULL, "dir", "<path>", "Batch mode, search all .pm3 / .wav files in a directory or matching a glob pattern"),
+        arg_str0(NULL, "json", "<fn>", "Batch mode, save the JSON result lines to file"),
+        arg_u64_0("t", "threads", "<dec>", "Batch mode, number of workers (def: number of CPUs)"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, true);
     bool use_gb = arg_get_lit(ctx, 1);
     bool search_cont = arg_get_lit(ctx, 2);
     bool search_unk = arg_get_lit(ctx, 3);
+
+    int dlen = 0;
+    char dir[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 4), (uint8_t *)dir, FILE_PATH_SIZE, &dlen);
+
+    int jlen = 0;
+    char jsonfn[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 5), (uint8_t *)jsonfn, FILE_PATH_SIZE, &jlen);
+
+    uint32_t workers = arg_get_u32_def(ctx, 6, 0);
     CLIParserFree(ctx);
+
+    if (dlen) {
+        return lf_search_batch(dir, jsonfn, workers);
+    }
     int found = 0;
-    bool is_online = (g_session.pm3_present && (use_gb == false));
+    bool is_online = (IfPm3Present() && (use_gb == false));
     if (is_online)
         lf_read(false, 30000);
 
@@ -1737,209 +2255,33 @@ int CmdLFfind(const char *Cmd) {
 
     int retval = PM3_SUCCESS;
 
-    // ask / man
-    if (demodEM410x(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("EM410x ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodDestron(true) == PM3_SUCCESS) { // to do before HID
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("FDX-A FECAVA Destron ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodGallagher(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("GALLAGHER ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodNoralsy(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Noralsy ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodPresco(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Presco ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodSecurakey(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Securakey ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodViking(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Viking ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodVisa2k(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Visa2000 ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-
-    // ask / bi
-    if (demodFDXB(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("FDX-B ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodJablotron(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Jablotron ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodGuard(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Guardall G-Prox II ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodNedap(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("NEDAP ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
+    // all demods run quietly on their own contexts first, then the tags found are demodulated
+    // again in table order on the graph, to print them and to leave them in the demod buffer
+    demod_cache_t cache;
+    demodCacheInit(&cache);
+    lf_search_result_t results[ARRAYLEN(lf_search_demods)];
 
-    // nrz
-    if (demodPac(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("PAC/Stanley ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
+    uint8_t old_printAndLog = g_printAndLog;
+    g_printAndLog = 0;
+    retval = lf_search_sweep(results, num_CPUs(), (search_cont == false), &cache);
+    g_printAndLog = old_printAndLog;
+    if (retval != PM3_SUCCESS) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        goto out;
     }
+    setDemodCache(&cache);
 
-    // fsk
-    if (demodHID(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("HID Prox ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodAWID(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("AWID ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodIOProx(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("IO Prox ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodPyramid(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Pyramid ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodParadox(true, false) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Paradox ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
+    for (size_t i = 0; i < ARRAYLEN(lf_search_demods); i++) {
+        if (results[i].found && lf_search_demods[i].demod(true) == PM3_SUCCESS) {
+            PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("%s") " found!", lf_search_demods[i].name);
+            if (search_cont) {
+                found++;
+            } else {
+                goto out;
+            }
         }
     }
 
-    // psk
-    if (demodIdteck(NULL, true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Idteck ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodKeri(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("KERI ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodNexWatch(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("NexWatch ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodIndala(true) == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Indala ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    /*
-    if (demodTI() == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Texas Instrument ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    if (demodFermax() == PM3_SUCCESS) {
-        PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Fermax ID") " found!");
-        if (search_cont) {
-            found++;
-        } else {
-            goto out;
-        }
-    }
-    */
     if (found == 0) {
         PrintAndLogEx(FAILED, _RED_("No known 125/134 kHz tags found!"));
     }
@@ -2044,6 +2386,10 @@ int CmdLFfind(const char *Cmd) {
     }
 
 out:
+    setDemodCache(NULL);
+    demodCacheFree(&cache);
+    lf_search_results_free(results);
+
     // identify chipset
     if (check_chiptype(is_online) == false) {
         PrintAndLogEx(DEBUG, "Automatic chip type detection " _RED_("failed"));
@@ -557,7 +557,7 @@ static int CmdAWIDBrute(const char *Cmd) {
     // main loop
     for (;;) {
 
-        if (!g_session.pm3_present) {
+        if (!IfPm3Present()) {
             PrintAndLogEx(WARNING, "Device offline\n");
             return PM3_ENODATA;
         }
@@ -26,6 +26,7 @@
 #include "ctype.h"      // tolower
 #include "cliparser.h"
 #include "commonutil.h" // reflect32
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -32,6 +32,7 @@
 #include "parity.h"
 #include "cliparser.h"    // cli parse input
 #include "cmdlfem4x05.h"  // EM defines
+#include "lfctx.h"
 
 #define DESTRON_FRAME_SIZE 96
 #define DESTRON_PREAMBLE_SIZE 16
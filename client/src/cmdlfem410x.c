@@ -39,6 +39,7 @@
 #include "generator.h"
 #include "cliparser.h"
 #include "cmdhw.h"
+#include "lfctx.h"
 
 static uint64_t gs_em410xid = 0;
 
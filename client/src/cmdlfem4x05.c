@@ -42,6 +42,7 @@
 #include "cliparser.h"
 #include "cmdhw.h"
 #include "utils/util.h"
+#include "lfctx.h"
 
 //////////////// 4205 / 4305 commands
 
@@ -1759,7 +1760,7 @@ int CmdEM4x05Chk(const char *Cmd) {
 
         for (uint32_t c = 0; c < keycount; ++c) {
 
-            if (!g_session.pm3_present) {
+            if (!IfPm3Present()) {
                 PrintAndLogEx(WARNING, "device offline\n");
                 free(keyBlock);
                 return PM3_ENODATA;
@@ -1937,7 +1938,7 @@ int CmdEM4x05Unlock(const char *Cmd) {
         return PM3_EINVARG;
     }
 
-    if (g_session.pm3_present == false) {
+    if (IfPm3Present() == false) {
         PrintAndLogEx(WARNING, "device offline\n");
         return PM3_ENODATA;
     }
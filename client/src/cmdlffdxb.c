@@ -34,6 +34,7 @@
 #include "cmdlft55xx.h"   // verifywrite
 #include "cliparser.h"
 #include "cmdlfem4x05.h"  // EM defines
+#include "lfctx.h"
 
 /*
     FDX-B ISO11784/85 demod  (aka animal tag)  BIPHASE, inverted, rf/32,  with preamble of 00000000001 (128bits)
@@ -36,6 +36,7 @@
 #include "crc.h"           // CRC8/Cardx
 #include "cmdlfem4x05.h"   //
 #include "cliparser.h"
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 
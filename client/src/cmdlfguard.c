@@ -32,6 +32,7 @@
 #include "cmdlft55xx.h"   // verifywrite
 #include "cliparser.h"
 #include "cmdlfem4x05.h"  // EM defines
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 
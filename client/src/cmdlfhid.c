@@ -45,6 +45,7 @@
 #include "wiegand_formatutils.h"
 #include "cmdlfem4x05.h"  // EM defines
 #include "loclass/cipherutils.h"  // bitstreamout
+#include "lfctx.h"
 
 #ifndef BITS
 # define BITS 96
@@ -602,7 +603,7 @@ static int CmdHIDBrute(const char *Cmd) {
     fin_hi = fin_low = false;
     do {
 
-        if (g_session.pm3_present == false) {
+        if (IfPm3Present() == false) {
             PrintAndLogEx(WARNING, "Device offline\n");
             return PM3_ENODATA;
         }
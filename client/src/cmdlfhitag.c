@@ -17,6 +17,7 @@
 //-----------------------------------------------------------------------------
 #include "cmdlfhitag.h"
 #include <ctype.h>
+#include <time.h>
 #include "cmdparser.h"  // command_t
 #include "comms.h"
 #include "cmdtrace.h"
@@ -31,6 +32,8 @@
 #include "cmddata.h"    // setDemodBuff
 #include "pm3_cmd.h"    // return codes
 #include "hitag2/hitag2_crypto.h"
+#include "hitag2/hitag2_crack5.h"
+#include "utils/util.h"             // num_CPUs
 #include "util_posix.h"             // msclock
 
 static int CmdHelp(const char *Cmd);
@@ -91,7 +94,7 @@ static int CmdLFHitagList(const char *Cmd) {
         return PM3_ETIMEOUT;
     }
 
-    uint16_t traceLen = resp.arg[2];
+    uint32_t traceLen = resp.arg[2];
     if (traceLen > PM3_CMD_DATA_SIZE) {
         uint8_t *p = realloc(got, traceLen);
         if (p == NULL) {
@@ -107,11 +110,11 @@ static int CmdLFHitagList(const char *Cmd) {
         }
     }
 
-    PrintAndLogEx(NORMAL, "recorded activity (TraceLen = %d bytes):");
+    PrintAndLogEx(NORMAL, "recorded activity (TraceLen = %" PRIu32 " bytes):", traceLen);
     PrintAndLogEx(NORMAL, " ETU     :nbits: who bytes");
     PrintAndLogEx(NORMAL, "---------+-----+----+-----------");
 
-    int i = 0;
+    uint32_t i = 0;
     int prev = -1;
     int len = strlen(Cmd);
 
@@ -2229,6 +2232,317 @@ static int CmdLFHitag2Lookup(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+#define HT2_CRACK5_MAX_PAIRS   64
+
+// nR / aR as 8 bytes in the `lf hitag lookup --nrar` / trace byte order
+static void ht2_nrar_from_bytes(const uint8_t *nrar, uint32_t *nr, uint32_t *ar) {
+    uint8_t tmp[4];
+    memcpy(tmp, nrar, sizeof(tmp));
+    rev_msb_array(tmp, sizeof(tmp));
+    *nr = MemLeToUint4byte(tmp);
+    *ar = MemBeToUint4byte(nrar + 4);
+}
+
+static bool ht2_add_nrar(uint32_t *nr, uint32_t *ar, uint8_t *count, uint32_t n, uint32_t a) {
+    for (uint8_t i = 0; i < *count; i++) {
+        if (nr[i] == n && ar[i] == a) {
+            return false;
+        }
+    }
+
+    if (*count >= HT2_CRACK5_MAX_PAIRS) {
+        return false;
+    }
+
+    nr[*count] = n;
+    ar[*count] = a;
+    (*count)++;
+    return true;
+}
+
+// one "NR AR" pair per line in hex, as written by tools/hitag2crack/hitag2_gen_nRaR.py
+static int ht2_load_nrar_file(const char *filename, uint32_t *nr, uint32_t *ar, uint8_t *count) {
+
+    char *path = NULL;
+    if (searchFile(&path, RESOURCES_SUBDIR, filename, "", false) != PM3_SUCCESS) {
+        return PM3_EFILE;
+    }
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        PrintAndLogEx(ERR, "file not found or locked `" _YELLOW_("%s") "`", path);
+        free(path);
+        return PM3_EFILE;
+    }
+
+    char line[80];
+    uint32_t lines = 0;
+    while (fgets(line, sizeof(line), f)) {
+
+        lines++;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+            continue;
+        }
+
+        uint32_t n = 0, a = 0;
+        if (sscanf(line, "%x %x", &n, &a) != 2) {
+            PrintAndLogEx(WARNING, "skipping invalid line %u", lines);
+            continue;
+        }
+
+        uint8_t nrar[8];
+        Uint4byteToMemBe(nrar, n);
+        Uint4byteToMemBe(nrar + 4, a);
+        ht2_nrar_from_bytes(nrar, &n, &a);
+        ht2_add_nrar(nr, ar, count, n, a);
+    }
+
+    fclose(f);
+    PrintAndLogEx(SUCCESS, "Loaded " _YELLOW_("%u") " nR/aR pairs from `" _YELLOW_("%s") "`", *count, path);
+    free(path);
+    return PM3_SUCCESS;
+}
+
+// walk a Hitag2 trace and collect  START AUTH -> UID -> Nr Ar  sequences
+static int ht2_load_nrar_trace(bool use_buffer, uint32_t *uid, bool *have_uid, uint32_t *nr, uint32_t *ar, uint8_t *count) {
+
+    const uint8_t *trace = NULL;
+    uint32_t trace_len = 0;
+    int res = GetTraceBuffer(use_buffer == false, &trace, &trace_len);
+    if (res != PM3_SUCCESS) {
+        return res;
+    }
+
+    bool in_auth = false;
+    bool got_uid = false;
+    uint32_t cur_uid = 0;
+    uint32_t skipped = 0;
+
+    uint32_t tracepos = 0;
+    while (tracepos + TRACELOG_HDR_LEN <= trace_len) {
+
+        const tracelog_hdr_t *hdr = (const tracelog_hdr_t *)(trace + tracepos);
+        uint16_t data_len = hdr->data_len;
+        if (data_len == 0 || tracepos + TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr) > trace_len) {
+            break;
+        }
+
+        const uint8_t *frame = hdr->frame;
+        // the first parity byte holds the number of bits used in the last data byte
+        uint8_t nbits = frame[data_len];
+        uint16_t bits = (nbits) ? ((data_len - 1) * 8) + nbits : data_len * 8;
+
+        tracepos += TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr);
+
+        if (hdr->isResponse == false && bits == 5) {
+            // 11000  START AUTH
+            in_auth = ((frame[0] & 0xF8) == 0xC0);
+            got_uid = false;
+            continue;
+        }
+
+        if (in_auth == false) {
+            continue;
+        }
+
+        if (hdr->isResponse && bits == 32) {
+            uint8_t tmp[4];
+            memcpy(tmp, frame, sizeof(tmp));
+            rev_msb_array(tmp, sizeof(tmp));
+            cur_uid = MemLeToUint4byte(tmp);
+            got_uid = true;
+            continue;
+        }
+
+        if (hdr->isResponse == false && bits == 64 && got_uid) {
+
+            in_auth = false;
+
+            if (*have_uid == false) {
+                *uid = cur_uid;
+                *have_uid = true;
+            }
+
+            if (cur_uid != *uid) {
+                skipped++;
+                continue;
+            }
+
+            uint32_t n, a;
+            ht2_nrar_from_bytes(frame, &n, &a);
+            if (ht2_add_nrar(nr, ar, count, n, a)) {
+                PrintAndLogEx(INFO, "Nr Ar... " _YELLOW_("%s"), sprint_hex_inrow(frame, 8));
+            }
+            continue;
+        }
+
+        in_auth = false;
+    }
+
+    if (skipped) {
+        PrintAndLogEx(WARNING, "Skipped " _YELLOW_("%u") " authentications from other tags", skipped);
+    }
+
+    PrintAndLogEx(SUCCESS, "Found " _YELLOW_("%u") " nR/aR pairs in trace", *count);
+    return PM3_SUCCESS;
+}
+
+static int CmdLFHitag2Crack5(const char *Cmd) {
+
+    CLIParserContext *ctx;
+    CLIParserInit(&ctx, "lf hitag crack",
+                  "Recover a Hitag2 crypto key from two recorded authentications (nR/aR pairs), no tag needed.\n"
+                  "Runs the bitsliced crack5 attack multithreaded on this computer.\n"
+                  "Pairs are taken from the command line, from a file with one `NR AR` pair per line\n"
+                  "or from a Hitag2 trace (sniff, `lf hitag crack2` or `trace load`)",
+                  "lf hitag crack --uid 12345678 --nrar 71DA20AA7EFDF3FA --nrar 2A4265F959653B07\n"
+                  "lf hitag crack --uid 12345678 -f nrar.txt  -> pairs from file\n"
+                  "lf hitag crack                             -> pairs from trace downloaded from device\n"
+                  "lf hitag crack -1                          -> pairs from trace buffer\n"
+                  "lf hitag crack --bench                     -> measure search speed"
+                 );
+
+    void *argtable[] = {
+        arg_param_begin,
+        arg_str0("u", "uid", "<hex>", "UID as 4 hex bytes"),
+        arg_strx0(NULL, "nrar", "<hex>", "nonce / answer as 8 hex bytes"),
+        arg_str0("f", "file", "<fn>", "file with nR/aR pairs"),
+        arg_lit0("1", "buffer", "use data from trace buffer"),
+        arg_int0("t", "threads", "<dec>", "number of threads (def: number of CPUs)"),
+        arg_lit0(NULL, "bench", "benchmark with random key and nonces"),
+        arg_param_end
+    };
+    CLIExecWithReturn(ctx, Cmd, argtable, true);
+
+    int ulen = 0;
+    uint8_t uidarr[4] = {0};
+    CLIGetHexWithReturn(ctx, 1, uidarr, &ulen);
+
+    int nalen = 0;
+    uint8_t nrar[HT2_CRACK5_MAX_PAIRS * 8] = {0};
+    CLIGetHexWithReturn(ctx, 2, nrar, &nalen);
+
+    int fnlen = 0;
+    char filename[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 3), (uint8_t *)filename, FILE_PATH_SIZE, &fnlen);
+
+    bool use_buffer = arg_get_lit(ctx, 4);
+    uint32_t threads = arg_get_u32_def(ctx, 5, 0);
+    bool bench = arg_get_lit(ctx, 6);
+    CLIParserFree(ctx);
+
+    if (ulen && ulen != 4) {
+        PrintAndLogEx(WARNING, "UID wrong length. expected 4, got %i", ulen);
+        return PM3_EINVARG;
+    }
+
+    if (nalen % 8) {
+        PrintAndLogEx(WARNING, "NrAr wrong length. expected multiple of 8, got %i", nalen);
+        return PM3_EINVARG;
+    }
+
+    uint32_t uid = 0;
+    bool have_uid = false;
+    if (ulen) {
+        rev_msb_array(uidarr, sizeof(uidarr));
+        uid = MemLeToUint4byte(uidarr);
+        have_uid = true;
+    }
+
+    uint32_t nr[HT2_CRACK5_MAX_PAIRS] = {0};
+    uint32_t ar[HT2_CRACK5_MAX_PAIRS] = {0};
+    uint8_t count = 0;
+
+    ht2_crack5_opt_t opt = {
+        .threads = threads,
+        .limit = 0,
+        .verbose = true,
+    };
+
+    uint64_t bench_key = 0;
+    if (bench) {
+
+        // random tag and two authentications, only a slice of the search space is searched
+        srand(time(NULL));
+        bench_key = ((uint64_t)rand() << 32 | (uint32_t)rand()) & 0xFFFFFFFFFFFF;
+        uid = (uint32_t)rand();
+        have_uid = true;
+        for (uint8_t i = 0; i < 2; i++) {
+            nr[i] = (uint32_t)rand();
+            hitag_state_t hs;
+            ht2_hitag2_init_ex(&hs, bench_key, uid, nr[i]);
+            ar[i] = ht2_hitag2_nstep(&hs, 32) ^ 0xFFFFFFFF;
+        }
+        count = 2;
+        opt.limit = ((threads) ? threads : num_CPUs()) * 16;
+        opt.verbose = false;
+
+    } else if (nalen) {
+
+        for (int i = 0; i < nalen; i += 8) {
+            uint32_t n, a;
+            ht2_nrar_from_bytes(nrar + i, &n, &a);
+            ht2_add_nrar(nr, ar, &count, n, a);
+        }
+
+    } else if (fnlen) {
+
+        int res = ht2_load_nrar_file(filename, nr, ar, &count);
+        if (res != PM3_SUCCESS) {
+            return res;
+        }
+
+    } else {
+
+        int res = ht2_load_nrar_trace(use_buffer, &uid, &have_uid, nr, ar, &count);
+        if (res != PM3_SUCCESS) {
+            return res;
+        }
+    }
+
+    if (have_uid == false) {
+        PrintAndLogEx(WARNING, "No UID given or found in trace");
+        return PM3_EINVARG;
+    }
+
+    if (count < 2) {
+        PrintAndLogEx(WARNING, "Need at least two different nR/aR pairs, got %u", count);
+        return PM3_EINVARG;
+    }
+
+    uint8_t tmp[4];
+    Uint4byteToMemLe(tmp, uid);
+    rev_msb_array(tmp, sizeof(tmp));
+    PrintAndLogEx(INFO, "UID... " _YELLOW_("%s"), sprint_hex_inrow(tmp, sizeof(tmp)));
+
+    uint8_t key[HITAG_CRYPTOKEY_SIZE] = {0};
+    ht2_crack5_stats_t stats = {0};
+    int res = ht2_crack5(uid, nr, ar, &opt, key, &stats);
+
+    if (bench) {
+        double rate = (stats.ms) ? (double)stats.searched * 1000 / stats.ms : 0;
+        PrintAndLogEx(INFO, "Searched " _YELLOW_("%u") " / %u candidates in %" PRIu64 " ms", stats.searched, stats.candidates, stats.ms);
+        PrintAndLogEx(INFO, "Speed....... " _YELLOW_("%.2f") " candidates/s  ( " _YELLOW_("%.0f") " M states/s )", rate, rate * (1 << 28) / 1000000);
+        if (rate > 0) {
+            PrintAndLogEx(INFO, "Worst case.. " _YELLOW_("%.0f") " s", stats.candidates / rate);
+        }
+        PrintAndLogEx(NORMAL, "");
+        return PM3_SUCCESS;
+    }
+
+    if (res == PM3_SUCCESS) {
+        PrintAndLogEx(SUCCESS, "Found valid key [ " _GREEN_("%s")" ]", sprint_hex_inrow(key, sizeof(key)));
+    } else if (res == PM3_EOPABORTED) {
+        PrintAndLogEx(WARNING, "aborted via keyboard!");
+    } else if (res == PM3_ESOFT) {
+        PrintAndLogEx(FAILED, "Key not found");
+    }
+
+    PrintAndLogEx(INFO, "time in crack " _YELLOW_("%.1f") " seconds", (float)stats.ms / 1000.0);
+    PrintAndLogEx(NORMAL, "");
+    return res;
+}
+
 static int CmdLFHitag2Crack2(const char *Cmd) {
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "lf hitag crack2",
@@ -2482,6 +2796,7 @@ static command_t CommandTable[] = {
     {"sim",         CmdLFHitagSim,              IfPm3Hitag,      "Simulate Hitag transponder"},
     {"-----------", CmdHelp,                    IfPm3Hitag,      "----------------------- " _CYAN_("Recovery") " -----------------------"},
     {"cc",          CmdLFHitagSCheckChallenges, IfPm3Hitag,      "Hitag S: test all provided challenges"},
+    {"crack",       CmdLFHitag2Crack5,          AlwaysAvailable, "Recover key from two recorded authentications"},
     {"crack2",      CmdLFHitag2Crack2,          IfPm3Hitag,      "Recover 2048bits of crypto stream"},
     {"chk",         CmdLFHitag2Chk,             IfPm3Hitag,      "Check keys"},
     {"lookup",      CmdLFHitag2Lookup,          AlwaysAvailable, "Uses authentication trace to check for key in dictionary file"},
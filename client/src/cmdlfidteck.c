@@ -34,6 +34,7 @@
 #include "cmdlft55xx.h"  // verifywrite
 #include "generator.h"
 #include "wiegand_formats.h"
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 
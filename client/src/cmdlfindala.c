@@ -38,6 +38,7 @@
 #include "cmdlfem4x05.h"  // EM defines
 #include "parity.h"       // parity
 #include "util_posix.h"
+#include "lfctx.h"
 
 #define INDALA_ARR_LEN 64
 
@@ -1035,7 +1036,7 @@ static int CmdIndalaBrute(const char *Cmd) {
     fin_hi = fin_low = false;
     do {
 
-        if (g_session.pm3_present == false) {
+        if (IfPm3Present() == false) {
             PrintAndLogEx(WARNING, "Device offline\n");
             return PM3_ENODATA;
         }
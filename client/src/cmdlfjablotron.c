@@ -33,6 +33,7 @@
 #include "cmdlft55xx.h"   // verifywrite
 #include "cliparser.h"
 #include "cmdlfem4x05.h"  // EM defines
+#include "lfctx.h"
 
 #define JABLOTRON_ARR_LEN 64
 
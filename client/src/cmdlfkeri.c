@@ -32,6 +32,7 @@
 #include "lfdemod.h"      // preamble test
 #include "cmdlft55xx.h"   // verifywrite
 #include "cmdlfem4x05.h"  //
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 typedef enum  {Scramble = 0, Descramble = 1} KeriMSScramble_t;
@@ -31,6 +31,7 @@
 #include "cmdlf.h"        // cmdlfconfig
 #include "cliparser.h"    // cli parse input
 #include "cmdlfem4x05.h"  // EM defines
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 
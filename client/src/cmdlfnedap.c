@@ -34,6 +34,7 @@
 #include "cliparser.h"
 #include "cmdlfem4x05.h"  // EM defines
 #include "commonutil.h"
+#include "lfctx.h"
 
 #define FIXED_71    0x71
 #define FIXED_40    0x40
@@ -34,6 +34,7 @@
 #include "cmdlfem4x05.h"   //
 #include "cliparser.h"
 #include "utils/util.h"
+#include "lfctx.h"
 
 
 typedef enum {
@@ -34,6 +34,7 @@
 #include "parity.h"
 #include "cmdlfem4x05.h"   //
 #include "cliparser.h"
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 
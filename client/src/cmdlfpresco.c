@@ -32,6 +32,7 @@
 #include "cmdlft55xx.h"   // verifywrite
 #include "cmdlfem4x05.h"  //
 #include "cliparser.h"
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -38,6 +38,7 @@
 #include "cmdlf.h"        // for lf sniff
 #include "generator.h"
 #include "cliparser.h"    // cliparsing
+#include "lfctx.h"
 
 // Some defines for readability
 #define T55XX_DLMODE_FIXED         0 // Default Mode
@@ -1052,7 +1053,7 @@ static bool DecodeT5555TraceBlock(void) {
 
 // sanity check. Don't use proxmark if it is offline and you didn't specify useGraphbuf
 static int SanityOfflineCheck(bool useGraphBuffer) {
-    if (!useGraphBuffer && !g_session.pm3_present) {
+    if (!useGraphBuffer && !IfPm3Present()) {
         PrintAndLogEx(WARNING, "Your proxmark3 device is offline. Specify [1] to use graphbuffer data instead");
         return PM3_ENODATA;
     }
@@ -3491,7 +3492,7 @@ static int CmdT55xxChkPwds(const char *Cmd) {
 
         for (uint32_t c = 0; c < keycount && found == false; ++c) {
 
-            if (!g_session.pm3_present) {
+            if (!IfPm3Present()) {
                 PrintAndLogEx(WARNING, "device offline\n");
                 free(keyblock);
                 return PM3_ENODATA;
@@ -29,6 +29,7 @@
 #include "graph.h"
 #include "gui/proxgui.h"
 #include "cliparser.h"
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 
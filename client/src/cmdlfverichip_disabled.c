@@ -30,6 +30,7 @@
 #include "lfdemod.h"    // preamble test
 #include "protocols.h"  // t55xx defines
 #include "cmdlft55xx.h" // clone..
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -29,6 +29,7 @@
 #include "lfdemod.h"
 #include "commonutil.h"     // num_to_bytes
 #include "cliparser.h"
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 
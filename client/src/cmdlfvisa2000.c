@@ -37,6 +37,7 @@
 #include "cmdlft55xx.h"    // write verify
 #include "cmdlfem4x05.h"   //
 #include "cliparser.h"
+#include "lfctx.h"
 
 #ifndef VISA2k_BL0CK1
 #define VISA2k_BL0CK1 0x56495332
@@ -35,6 +35,7 @@
 #include "cmdlft55xx.h"    // write verify
 #include "cliparser.h"
 #include "zx8211.h"
+#include "lfctx.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -47,7 +47,7 @@ bool IfGUIEnabled(void) {
 bool IfPm3Present(void) {
     if (g_session.help_dump_mode)
         return false;
-    return g_session.pm3_present;
+    return CurrentProxmark()->present;
 }
 
 bool IfPm3Rdv4Fw(void) {
@@ -35,22 +35,95 @@ static int CmdHelp(const char *Cmd);
 
 // trace pointer
 static uint8_t *gs_trace;
-static uint16_t gs_traceLen = 0;
+static uint32_t gs_traceLen = 0;
 
-static bool is_last_record(uint16_t tracepos, uint16_t traceLen) {
-    return ((tracepos + TRACELOG_HDR_LEN) >= traceLen);
+static bool is_last_record(uint32_t tracepos, uint32_t traceLen) {
+    return (((uint64_t)tracepos + TRACELOG_HDR_LEN) >= traceLen);
 }
 
-static bool next_record_is_response(uint16_t tracepos, uint8_t *trace) {
+// the record at tracepos, NULL unless header, data and parity fit in the trace
+static tracelog_hdr_t *get_record(uint32_t tracepos, uint32_t traceLen, uint8_t *trace) {
+    if (is_last_record(tracepos, traceLen)) {
+        return NULL;
+    }
+    tracelog_hdr_t *hdr = (tracelog_hdr_t *)(trace + tracepos);
+    uint64_t end = (uint64_t)tracepos + TRACELOG_HDR_LEN + hdr->data_len + TRACELOG_PARITY_LEN(hdr);
+    if (end > traceLen) {
+        PrintAndLogEx(DEBUG, "trace pos offset %" PRIu64 " larger than reported tracelen %u", end, traceLen);
+        return NULL;
+    }
+    return hdr;
+}
+
+static bool next_record_is_response(uint32_t tracepos, uint8_t *trace) {
     const tracelog_hdr_t *hdr = (tracelog_hdr_t *)(trace + tracepos);
     return (hdr->isResponse);
 }
 
-static bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, uint16_t *tracepos, uint16_t traceLen,
-                                      uint8_t *trace, const uint8_t *frame, uint8_t *topaz_reader_command, uint16_t *data_len) {
+// record index, one entry per trace record. Built in a single pass over the headers the first
+// time `trace list` needs it and kept until the trace buffer changes, so filtering and paging
+// through a large sniff never has to run the annotators on records that aren't shown.
+typedef struct {
+    uint32_t offset;
+    uint32_t timestamp;
+    uint16_t data_len;
+    bool is_response;
+    uint8_t first;          // first data byte, the command / opcode of reader frames
+} trace_index_t;
+
+static trace_index_t *gs_trace_index = NULL;
+static uint32_t gs_trace_index_cnt = 0;
+static bool gs_trace_index_valid = false;
+
+static void trace_index_reset(void) {
+    free(gs_trace_index);
+    gs_trace_index = NULL;
+    gs_trace_index_cnt = 0;
+    gs_trace_index_valid = false;
+}
+
+static int trace_index_build(void) {
+    if (gs_trace_index_valid) {
+        return PM3_SUCCESS;
+    }
+
+    trace_index_reset();
+
+    uint32_t size = 0;
+    uint32_t tracepos = 0;
+    const tracelog_hdr_t *hdr;
+    while ((hdr = get_record(tracepos, gs_traceLen, gs_trace)) != NULL) {
+
+        if (gs_trace_index_cnt == size) {
+            size = (size == 0) ? 1024 : size * 2;
+            trace_index_t *tmp = realloc(gs_trace_index, size * sizeof(trace_index_t));
+            if (tmp == NULL) {
+                PrintAndLogEx(WARNING, "Failed to allocate memory");
+                trace_index_reset();
+                return PM3_EMALLOC;
+            }
+            gs_trace_index = tmp;
+        }
+
+        trace_index_t *rec = &gs_trace_index[gs_trace_index_cnt++];
+        rec->offset = tracepos;
+        rec->timestamp = hdr->timestamp;
+        rec->data_len = hdr->data_len;
+        rec->is_response = hdr->isResponse;
+        rec->first = (hdr->data_len) ? hdr->frame[0] : 0;
+
+        tracepos += TRACELOG_HDR_LEN + hdr->data_len + TRACELOG_PARITY_LEN(hdr);
+    }
+
+    gs_trace_index_valid = true;
+    return PM3_SUCCESS;
+}
 
 #define MAX_TOPAZ_READER_CMD_LEN 16
 
+static bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, uint32_t *tracepos, uint32_t traceLen,
+                                      uint8_t *trace, const uint8_t *frame, uint8_t *topaz_reader_command, uint16_t *data_len) {
+
     uint32_t last_timestamp = timestamp + *duration;
 
     if ((*data_len != 1) || (frame[0] == TOPAZ_WUPA) || (frame[0] == TOPAZ_REQA)) return false;
@@ -59,7 +132,10 @@ static bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, ui
 
     while (!is_last_record(*tracepos, traceLen) && !next_record_is_response(*tracepos, trace)) {
 
-        const tracelog_hdr_t *hdr = (tracelog_hdr_t *)(trace + *tracepos);
+        const tracelog_hdr_t *hdr = get_record(*tracepos, traceLen, trace);
+        if (hdr == NULL) {
+            break;
+        }
 
         *tracepos += TRACELOG_HDR_LEN + hdr->data_len;
 
@@ -93,8 +169,9 @@ static uint8_t calc_pos(const uint8_t *d) {
 
 // Copy an existing buffer into client trace buffer
 // I think this is cleaner than further globalizing gs_trace, and may lend itself to more modularity later?
-bool ImportTraceBuffer(const uint8_t *trace_src, uint16_t trace_len) {
+bool ImportTraceBuffer(const uint8_t *trace_src, uint32_t trace_len) {
     if (trace_len == 0 || trace_src == NULL) return (false);
+    trace_index_reset();
     if (gs_trace) {
         free(gs_trace);
         gs_traceLen = 0;
@@ -114,7 +191,7 @@ static uint8_t extract_epurse[8] = {0};
 
 #define SKIP_TO_NEXT(a)  (TRACELOG_HDR_LEN + (a)->data_len + TRACELOG_PARITY_LEN((a)))
 
-static uint16_t extractChall_ev2(uint16_t tracepos, uint8_t *trace, uint8_t cmdpos, uint8_t long_jmp) {
+static uint32_t extractChall_ev2(uint32_t tracepos, uint8_t *trace, uint8_t cmdpos, uint8_t long_jmp) {
     tracelog_hdr_t *next_hdr = (tracelog_hdr_t *)(trace + tracepos);
     if (next_hdr->data_len != 21) {
         return 0;
@@ -135,26 +212,17 @@ static uint16_t extractChall_ev2(uint16_t tracepos, uint8_t *trace, uint8_t cmdp
     return tracepos;
 }
 
-static uint16_t extractChallenges(uint16_t tracepos, uint16_t traceLen, uint8_t *trace) {
+static uint32_t extractChallenges(uint32_t tracepos, uint32_t traceLen, uint8_t *trace) {
 
-    // sanity check
-    if (is_last_record(tracepos, traceLen)) {
+    // sanity check, the record fits in the available trace size
+    tracelog_hdr_t *hdr = get_record(tracepos, traceLen, trace);
+    if (hdr == NULL) {
         return traceLen;
     }
 
-    tracelog_hdr_t *hdr = (tracelog_hdr_t *)(trace + tracepos);
     uint16_t data_len = hdr->data_len;
     uint8_t *frame = hdr->frame;
 
-    // sanity check tracking position is less then available trace size
-    if (tracepos + TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr) > traceLen) {
-        PrintAndLogEx(DEBUG, "trace pos offset %"PRIu64 " larger than reported tracelen %u",
-                      tracepos + TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr),
-                      traceLen
-                     );
-        return traceLen;
-    }
-
     // set trace position
     tracepos += SKIP_TO_NEXT(hdr);
 
@@ -404,7 +472,7 @@ static uint16_t extractChallenges(uint16_t tracepos, uint16_t traceLen, uint8_t
             }
             case MFDES_AUTHENTICATE_EV2F: {
                 PrintAndLogEx(INFO, "AUTH EV2 First");
-                uint16_t tmp = extractChall_ev2(tracepos, trace, pos, long_jmp);
+                uint32_t tmp = extractChall_ev2(tracepos, trace, pos, long_jmp);
                 if (tmp == 0)
                     break;
                 else
@@ -413,7 +481,7 @@ static uint16_t extractChallenges(uint16_t tracepos, uint16_t traceLen, uint8_t
             }
             case MFDES_AUTHENTICATE_EV2NF: {
                 PrintAndLogEx(INFO, "AUTH EV2 Non First");
-                uint16_t tmp = extractChall_ev2(tracepos, trace, pos, long_jmp);
+                uint32_t tmp = extractChall_ev2(tracepos, trace, pos, long_jmp);
                 if (tmp == 0)
                     break;
                 else
@@ -425,13 +493,10 @@ static uint16_t extractChallenges(uint16_t tracepos, uint16_t traceLen, uint8_t
     return tracepos;
 }
 
-static uint16_t printHexLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, uint8_t protocol) {
+static uint32_t printHexLine(uint32_t tracepos, uint32_t traceLen, uint8_t *trace, uint8_t protocol) {
     // sanity check
-    if (is_last_record(tracepos, traceLen)) return traceLen;
-
-    tracelog_hdr_t *hdr = (tracelog_hdr_t *)(trace + tracepos);
-
-    if (TRACELOG_HDR_LEN + hdr->data_len + TRACELOG_PARITY_LEN(hdr) > traceLen) {
+    tracelog_hdr_t *hdr = get_record(tracepos, traceLen, trace);
+    if (hdr == NULL) {
         return traceLen;
     }
 
@@ -443,7 +508,7 @@ static uint16_t printHexLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trac
         return tracepos;
     }
 
-    uint16_t ret;
+    uint32_t ret;
 
     switch (protocol) {
         case ISO_14443A: {
@@ -491,7 +556,7 @@ static uint16_t printHexLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trac
     return ret;
 }
 
-static uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes, uint32_t *prev_eot, bool use_us,
+static uint32_t printTraceLine(uint32_t tracepos, uint32_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes, uint32_t *prev_eot, bool use_us,
                                const uint64_t *mfDicKeys, uint32_t mfDicKeysCount) {
     // sanity check
     if (is_last_record(tracepos, traceLen)) {
@@ -500,22 +565,17 @@ static uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *tr
     }
 
     uint32_t end_of_transmission_timestamp = 0;
-    uint8_t topaz_reader_command[9];
+    uint8_t topaz_reader_command[MAX_TOPAZ_READER_CMD_LEN];
     char explanation[60] = {0};
     tracelog_hdr_t *first_hdr = (tracelog_hdr_t *)(trace);
-    tracelog_hdr_t *hdr = (tracelog_hdr_t *)(trace + tracepos);
+    tracelog_hdr_t *hdr = get_record(tracepos, traceLen, trace);
+    if (hdr == NULL) {
+        return traceLen;
+    }
 
     uint32_t duration = hdr->duration;
     uint16_t data_len = hdr->data_len;
 
-    if (tracepos + TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr) > traceLen) {
-        PrintAndLogEx(DEBUG, "trace pos offset %"PRIu64 " larger than reported tracelen %u",
-                      tracepos + TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr),
-                      traceLen
-                     );
-        return traceLen;
-    }
-
     // adjust for different time scales
     if (protocol == ICLASS || protocol == ISO_15693) {
         duration *= 32;
@@ -1074,6 +1134,7 @@ static int download_trace(void) {
     }
 
     // reserve some space.
+    trace_index_reset();
     if (gs_trace) {
         free(gs_trace);
     }
@@ -1119,6 +1180,27 @@ static int download_trace(void) {
     return PM3_SUCCESS;
 }
 
+// hands out the client side trace buffer, optionally refreshed from the device first.
+// The buffer stays owned by cmdtrace and is valid until the next download / load.
+int GetTraceBuffer(bool download, const uint8_t **trace, uint32_t *trace_len) {
+
+    if (download) {
+        int res = download_trace();
+        if (res != PM3_SUCCESS) {
+            return res;
+        }
+    }
+
+    if (gs_trace == NULL || gs_traceLen == 0) {
+        PrintAndLogEx(INFO, "No trace data! Try " _YELLOW_("`trace load`") " or run a sniff first");
+        return PM3_ENODATA;
+    }
+
+    *trace = gs_trace;
+    *trace_len = gs_traceLen;
+    return PM3_SUCCESS;
+}
+
 // sanity check. Don't use proxmark if it is offline and you didn't specify useTraceBuffer
 /*
 static int SanityOfflineCheck( bool useTraceBuffer ){
@@ -1162,7 +1244,7 @@ static int CmdTraceExtract(const char *Cmd) {
         return PM3_SUCCESS;
     }
 
-    uint16_t tracepos = 0;
+    uint32_t tracepos = 0;
 
     while (tracepos < gs_traceLen) {
         tracepos = extractChallenges(tracepos, gs_traceLen, gs_trace);
@@ -1174,40 +1256,106 @@ static int CmdTraceExtract(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+#define TRACE_LOAD_MAX_FILES 32
+
+// the time the last record of a trace part ends at
+static uint32_t trace_end_time(uint8_t *trace, uint32_t len) {
+    uint32_t end = 0;
+    uint32_t tracepos = 0;
+    tracelog_hdr_t *hdr;
+    while ((hdr = get_record(tracepos, len, trace)) != NULL) {
+        end = hdr->timestamp + hdr->duration;
+        tracepos += TRACELOG_HDR_LEN + hdr->data_len + TRACELOG_PARITY_LEN(hdr);
+    }
+    return end;
+}
+
+// move the timestamps of a trace part so its first record starts at `start`
+static void trace_rebase(uint8_t *trace, uint32_t len, uint32_t start) {
+    tracelog_hdr_t *hdr = get_record(0, len, trace);
+    if (hdr == NULL) {
+        return;
+    }
+    uint32_t shift = start - hdr->timestamp;
+    uint32_t tracepos = 0;
+    while ((hdr = get_record(tracepos, len, trace)) != NULL) {
+        hdr->timestamp += shift;
+        tracepos += TRACELOG_HDR_LEN + hdr->data_len + TRACELOG_PARITY_LEN(hdr);
+    }
+}
+
 static int CmdTraceLoad(const char *Cmd) {
 
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "trace load",
                   "Load protocol data from binary file to trace buffer\n"
-                  "File extension is <.trace>",
-                  "trace load -f mytracefile    -> w/o file extension"
+                  "File extension is <.trace>\n"
+                  "Several files are loaded one after the other into one trace, e.g. the parts of a long sniff session.\n"
+                  "The timestamps of each following file continue where the previous file ended",
+                  "trace load -f mytracefile                  -> w/o file extension\n"
+                  "trace load -f sniff_1 -f sniff_2 -f sniff_3 -> concatenate three files"
                  );
 
     void *argtable[] = {
         arg_param_begin,
-        arg_str1("f", "file", "<fn>", "Specify trace file to load"),
+        arg_strn("f", "file", "<fn>", 1, TRACE_LOAD_MAX_FILES, "Specify trace file to load, repeat to concatenate"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, false);
 
-    int fnlen = 0;
-    char filename[FILE_PATH_SIZE] = {0};
-    CLIParamStrToBuf(arg_get_str(ctx, 1), (uint8_t *)filename, FILE_PATH_SIZE, &fnlen);
-    CLIParserFree(ctx);
+    struct arg_str *files = arg_get_str(ctx, 1);
 
-    if (gs_trace) {
-        free(gs_trace); // maybe better to not clobber this until we have successful load?
-        gs_trace = NULL;
-        gs_traceLen = 0;
+    uint8_t *trace = NULL;
+    uint64_t trace_len = 0;
+    uint32_t trace_end = 0;
+    int res = PM3_SUCCESS;
+
+    for (int i = 0; i < files->count; i++) {
+
+        uint8_t *data = NULL;
+        size_t len = 0;
+        if (loadFile_safe(files->sval[i], ".trace", (void **)&data, &len) != PM3_SUCCESS) {
+            PrintAndLogEx(FAILED, "Could not open file " _YELLOW_("%s"), files->sval[i]);
+            res = PM3_EIO;
+            break;
+        }
+
+        if (trace_len + len > UINT32_MAX) {
+            PrintAndLogEx(FAILED, "Trace too large, stopped before " _YELLOW_("%s"), files->sval[i]);
+            free(data);
+            res = PM3_EOVFLOW;
+            break;
+        }
+
+        if (trace == NULL) {
+            trace = data;
+        } else {
+            trace_rebase(data, len, trace_end);
+            uint8_t *tmp = realloc(trace, trace_len + len);
+            if (tmp == NULL) {
+                PrintAndLogEx(WARNING, "Failed to allocate memory");
+                free(data);
+                res = PM3_EMALLOC;
+                break;
+            }
+            trace = tmp;
+            memcpy(trace + trace_len, data, len);
+            free(data);
+        }
+        trace_end = trace_end_time(trace + trace_len, len);
+        trace_len += len;
     }
+    CLIParserFree(ctx);
 
-    size_t len = 0;
-    if (loadFile_safe(filename, ".trace", (void **)&gs_trace, &len) != PM3_SUCCESS) {
-        PrintAndLogEx(FAILED, "Could not open file " _YELLOW_("%s"), filename);
-        return PM3_EIO;
+    if (res != PM3_SUCCESS) {
+        free(trace);
+        return res;
     }
 
-    gs_traceLen = (long)len;
+    trace_index_reset();
+    free(gs_trace);
+    gs_trace = trace;
+    gs_traceLen = (uint32_t)trace_len;
 
     PrintAndLogEx(SUCCESS, "Recorded Activity (TraceLen = " _YELLOW_("%u") " bytes)", gs_traceLen);
     PrintAndLogEx(HINT, "try " _YELLOW_("`trace list -1 -t ...`") " to view trace.  Remember the " _YELLOW_("`-1`") " param");
@@ -1247,6 +1395,172 @@ static int CmdTraceSave(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+// default page size when `--page` is given without `--rows`
+#define TRACE_LIST_PAGE_ROWS 100
+
+typedef struct {
+    uint32_t start;         // time window, relative to the first record, in carrier periods
+    uint32_t end;
+    bool reader_only;
+    bool tag_only;
+    int cmd;                // first byte of reader frames, -1 for any
+    uint8_t uid[10];
+    int uid_len;
+} trace_filter_t;
+
+static bool trace_filter_active(const trace_filter_t *f) {
+    return (f->start || f->end != UINT32_MAX || f->reader_only || f->tag_only || f->cmd != -1 || f->uid_len);
+}
+
+static bool frame_has_uid(const uint8_t *frame, uint16_t len, const uint8_t *uid, int uid_len) {
+    for (int i = 0; i + uid_len <= len; i++) {
+        // ISO15693 and friends send the UID LSByte first
+        bool fwd = true, rev = true;
+        for (int j = 0; j < uid_len && (fwd || rev); j++) {
+            fwd &= (frame[i + j] == uid[j]);
+            rev &= (frame[i + j] == uid[uid_len - 1 - j]);
+        }
+        if (fwd || rev) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Works on the record index only, apart from the UID test which looks at the raw frame.
+// A tag frame passes the command filter when it answers a reader frame that passed it.
+static bool trace_filter_match(const trace_filter_t *f, const trace_index_t *rec, uint32_t first_ts, bool *cmd_hit) {
+
+    if (rec->is_response == false) {
+        *cmd_hit = (f->cmd == -1 || (rec->data_len && rec->first == f->cmd));
+    }
+
+    if (*cmd_hit == false) {
+        return false;
+    }
+
+    if ((f->reader_only && rec->is_response) || (f->tag_only && rec->is_response == false)) {
+        return false;
+    }
+
+    uint32_t t = rec->timestamp - first_ts;
+    if (t < f->start || t > f->end) {
+        return false;
+    }
+
+    if (f->uid_len) {
+        const tracelog_hdr_t *hdr = (tracelog_hdr_t *)(gs_trace + rec->offset);
+        return frame_has_uid(hdr->frame, hdr->data_len, f->uid, f->uid_len);
+    }
+    return true;
+}
+
+// Fills `rows` with the index positions to display. Every record still gets tested so
+// `matched` holds the total over all pages.
+static uint32_t trace_select_rows(const trace_filter_t *f, uint32_t first_row, uint32_t max_rows, uint32_t *rows, uint32_t *matched) {
+    uint32_t first_ts = gs_trace_index[0].timestamp;
+    uint32_t cnt = 0;
+    bool cmd_hit = (f->cmd == -1);
+
+    *matched = 0;
+    for (uint32_t i = 0; i < gs_trace_index_cnt; i++) {
+        if (trace_filter_match(f, &gs_trace_index[i], first_ts, &cmd_hit) == false) {
+            continue;
+        }
+        if (*matched >= first_row && (max_rows == 0 || cnt < max_rows)) {
+            rows[cnt++] = i;
+        }
+        (*matched)++;
+    }
+    return cnt;
+}
+
+// MIFARE crypto1, Ultralight C / NTAG I2C, iCLASS and Hitag2 annotations depend on earlier frames.
+// The Hitag1 and HitagS annotators don't keep any state (yet)
+static bool trace_protocol_has_state(uint8_t protocol) {
+    return (protocol == ISO_14443A || protocol == ISO_7816_4 || protocol == PROTO_MIFARE || protocol == PROTO_MFPLUS
+            || protocol == PROTO_HITAG2 || protocol == ICLASS);
+}
+
+// Plain 14a only keeps the Ultralight C authentication and the NTAG I2C sector select state. While
+// neither is under way only the frames that start one of them can change it
+static bool trace_14a_changes_state(const tracelog_hdr_t *hdr) {
+    if (annotateIso14443a_pending()) {
+        return true;
+    }
+    if (hdr->isResponse || hdr->data_len == 0) {
+        return false;
+    }
+    return (hdr->frame[0] == MIFARE_ULC_AUTH_1
+            || (hdr->frame[0] == MIFARE_CMD_RESTORE && hdr->data_len == 4 && hdr->frame[1] == 0xFF));
+}
+
+// runs a hidden record through the stateful annotators the same way printTraceLine() does, without
+// printing, so the decryption of the records that are shown stays the same as in an unfiltered list
+static void trace_feed_state(const trace_index_t *rec, uint8_t protocol, const uint64_t *dicKeys, uint32_t dicKeysCount) {
+    tracelog_hdr_t *hdr = (tracelog_hdr_t *)(gs_trace + rec->offset);
+    uint8_t *parity = hdr->frame + hdr->data_len;
+    char explanation[60] = {0};
+
+    // DecodeMifareData() reports the keys it finds
+    uint8_t old_printAndLog = g_printAndLog;
+    g_printAndLog = 0;
+
+    switch (protocol) {
+        case ISO_14443A:
+        case ISO_7816_4:
+            if (trace_14a_changes_state(hdr)) {
+                annotateIso14443a(explanation, sizeof(explanation), hdr->frame, hdr->data_len, hdr->isResponse);
+            }
+            break;
+        case PROTO_MIFARE:
+        case PROTO_MFPLUS: {
+            annotateMifare(explanation, sizeof(explanation), hdr->frame, hdr->data_len, parity, TRACELOG_PARITY_LEN(hdr), hdr->isResponse);
+            if (protocol == PROTO_MFPLUS && hdr->isResponse == false) {
+                annotateMfPlus(explanation, sizeof(explanation), hdr->frame, hdr->data_len);
+            }
+
+            uint8_t mfData[32] = {0};
+            size_t mfDataLen = 0;
+            if (DecodeMifareData(hdr->frame, hdr->data_len, parity, hdr->isResponse, mfData, &mfDataLen, dicKeys, dicKeysCount)) {
+                if (protocol == PROTO_MFPLUS) {
+                    annotateMfPlus(explanation, sizeof(explanation), mfData, mfDataLen);
+                } else {
+                    annotateIso14443a(explanation, sizeof(explanation), mfData, mfDataLen, hdr->isResponse);
+                }
+            }
+            break;
+        }
+        case PROTO_HITAG2: {
+            annotateHitag2(explanation, sizeof(explanation), hdr->frame, hdr->data_len, parity[0], hdr->isResponse, dicKeys, dicKeysCount, false);
+
+            uint8_t ht2plain[9] = {0};
+            uint8_t n = 0;
+            if (hitag2_get_plain(ht2plain, &n)) {
+                annotateHitag2(explanation, sizeof(explanation), ht2plain, n, parity[0], hdr->isResponse, NULL, 0, true);
+            }
+            break;
+        }
+        case ICLASS:
+            annotateIclass(explanation, sizeof(explanation), hdr->frame, hdr->data_len, hdr->isResponse);
+            break;
+        default:
+            break;
+    }
+
+    g_printAndLog = old_printAndLog;
+}
+
+// end of transmission of an indexed record, what `-r` measures the next gap from
+static uint32_t trace_record_eot(const trace_index_t *rec, uint8_t protocol) {
+    const tracelog_hdr_t *hdr = (tracelog_hdr_t *)(gs_trace + rec->offset);
+    uint32_t duration = hdr->duration;
+    if (protocol == ICLASS || protocol == ISO_15693) {
+        duration *= 32;
+    }
+    return hdr->timestamp + duration;
+}
+
 int CmdTraceListAlias(const char *Cmd, const char *alias, const char *protocol) {
     CLIParserContext *ctx;
     char desc[500] = {0};
@@ -1258,8 +1572,9 @@ int CmdTraceListAlias(const char *Cmd, const char *alias, const char *protocol)
     char example[200] = {0};
     snprintf(example, sizeof(example) - 1,
              "%s list --frame      -> show frame delay times\n"
-             "%s list -1           -> use trace buffer ",
-             alias, alias);
+             "%s list -1           -> use trace buffer\n"
+             "%s list -1 --page 2  -> second page of 100 rows",
+             alias, alias, alias);
     char fullalias[100] = {0};
     snprintf(fullalias, sizeof(fullalias) - 1, "%s list", alias);
     CLIParserInit(&ctx, fullalias, desc, example);
@@ -1274,12 +1589,20 @@ int CmdTraceListAlias(const char *Cmd, const char *alias, const char *protocol)
         arg_lit0("x", NULL, "show hexdump to convert to pcap(ng)\n"
                  "                                   or to import into Wireshark using encapsulation type \"ISO 14443\""),
         arg_str0("f", "file", "<fn>", "filename of dictionary"),
+        arg_u64_0(NULL, "start", "<dec>", "hide frames before this time (same unit as the start column)"),
+        arg_u64_0(NULL, "end", "<dec>", "hide frames after this time (same unit as the start column)"),
+        arg_lit0(NULL, "rdr", "only show reader frames"),
+        arg_lit0(NULL, "tag", "only show tag frames"),
+        arg_str0(NULL, "cmd", "<hex>", "only show reader frames starting with this raw byte, and their answers"),
+        arg_str0(NULL, "uid", "<hex>", "only show frames carrying this UID"),
+        arg_u64_0(NULL, "page", "<dec>", "show this page of the (filtered) trace"),
+        arg_u64_0(NULL, "rows", "<dec>", "rows per page (def 100 with --page)"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, true);
     CLIParserFree(ctx);
 
-    char args[128] = {0};
+    char args[256] = {0};
     snprintf(args, sizeof(args), "-t %s ", protocol);
     strncat(args, Cmd, sizeof(args) - strlen(args) - 1);
     return CmdTraceList(args);
@@ -1313,7 +1636,12 @@ int CmdTraceList(const char *Cmd) {
                   "\n"
                   "trace list -t mf -f mfc_default_keys.dic     -> use default dictionary file\n"
                   "trace list -t 14a --frame                    -> show frame delay times\n"
-                  "trace list -t 14a -1                         -> use trace buffer "
+                  "trace list -t 14a -1                         -> use trace buffer\n"
+                  "\n"
+                  "trace list -t 14a -1 --cmd 93                 -> only anticollision / select commands and their answers\n"
+                  "trace list -t 14a -1 --uid 04A1B2C3            -> only frames carrying this UID\n"
+                  "trace list -t 14a -1 --start 1000000 --rdr     -> reader frames from 1000000 onwards\n"
+                  "trace list -t 14a -1 --page 3 --rows 50        -> rows 101 - 150"
                  );
 
     void *argtable[] = {
@@ -1327,6 +1655,14 @@ int CmdTraceList(const char *Cmd) {
                  "                                   or to import into Wireshark using encapsulation type \"ISO 14443\""),
         arg_str0("t", "type", NULL, "protocol to annotate the trace"),
         arg_str0("f", "file", "<fn>", "filename of dictionary"),
+        arg_u64_0(NULL, "start", "<dec>", "hide frames before this time (same unit as the start column)"),
+        arg_u64_0(NULL, "end", "<dec>", "hide frames after this time (same unit as the start column)"),
+        arg_lit0(NULL, "rdr", "only show reader frames"),
+        arg_lit0(NULL, "tag", "only show tag frames"),
+        arg_str0(NULL, "cmd", "<hex>", "only show reader frames starting with this raw byte, and their answers"),
+        arg_str0(NULL, "uid", "<hex>", "only show frames carrying this UID"),
+        arg_u64_0(NULL, "page", "<dec>", "show this page of the (filtered) trace"),
+        arg_u64_0(NULL, "rows", "<dec>", "rows per page (def 100 with --page)"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, true);
@@ -1350,8 +1686,54 @@ int CmdTraceList(const char *Cmd) {
         diclen = 0;
     }
 
+    uint64_t start = arg_get_u64_def(ctx, 9, 0);
+    uint64_t end = arg_get_u64_def(ctx, 10, UINT32_MAX);
+
+    trace_filter_t filter = {
+        .reader_only = arg_get_lit(ctx, 11),
+        .tag_only = arg_get_lit(ctx, 12),
+        .cmd = -1,
+    };
+
+    int cmdlen = 0;
+    uint8_t cmd[1] = {0};
+    CLIGetHexWithReturn(ctx, 13, cmd, &cmdlen);
+    if (cmdlen) {
+        filter.cmd = cmd[0];
+    }
+
+    CLIGetHexWithReturn(ctx, 14, filter.uid, &filter.uid_len);
+
+    uint32_t page = arg_get_u32_def(ctx, 15, 0);
+    uint32_t rows = arg_get_u32_def(ctx, 16, 0);
+
     CLIParserFree(ctx);
 
+    if (filter.reader_only && filter.tag_only) {
+        PrintAndLogEx(FAILED, "Use either " _YELLOW_("--rdr") " or " _YELLOW_("--tag") ", not both");
+        return PM3_EINVARG;
+    }
+
+    if (start > end) {
+        PrintAndLogEx(FAILED, "Start time must not be after end time");
+        return PM3_EINVARG;
+    }
+
+    // filter times are given in the unit the list is shown in
+    if (use_us) {
+        start = (uint64_t)(start * 13.56);
+        end = (uint64_t)(end * 13.56);
+    }
+    filter.start = (uint32_t)MIN(start, UINT32_MAX);
+    filter.end = (uint32_t)MIN(end, UINT32_MAX);
+
+    if (page && rows == 0) {
+        rows = TRACE_LIST_PAGE_ROWS;
+    }
+    if (rows && page == 0) {
+        page = 1;
+    }
+
     clearCommandBuffer();
 
     // no crc, no annotations
@@ -1396,7 +1778,35 @@ int CmdTraceList(const char *Cmd) {
         return PM3_SUCCESS;
     }
 
-    uint16_t tracepos = 0;
+    if (trace_index_build() != PM3_SUCCESS) {
+        return PM3_EMALLOC;
+    }
+
+    if (gs_trace_index_cnt == 0) {
+        PrintAndLogEx(WARNING, "No complete record in trace");
+        return PM3_SUCCESS;
+    }
+
+    // a page can't hold more rows than the trace has records
+    if (rows > gs_trace_index_cnt) {
+        rows = gs_trace_index_cnt;
+    }
+
+    uint32_t *show = calloc((rows) ? rows : gs_trace_index_cnt, sizeof(uint32_t));
+    if (show == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+
+    uint32_t matched = 0;
+    uint64_t first_row = (page) ? (uint64_t)(page - 1) * rows : 0;
+    uint32_t show_cnt = trace_select_rows(&filter, (first_row > UINT32_MAX) ? UINT32_MAX : (uint32_t)first_row, rows, show, &matched);
+
+    if (first_row && first_row >= matched) {
+        PrintAndLogEx(WARNING, "Page " _YELLOW_("%u") " is past the end, there are " _YELLOW_("%u") " matching records", page, matched);
+        free(show);
+        return PM3_EINVARG;
+    }
 
     /*
     if (protocol == FELICA) {
@@ -1404,8 +1814,8 @@ int CmdTraceList(const char *Cmd) {
     } */
 
     if (show_hex) {
-        while (tracepos < gs_traceLen) {
-            tracepos = printHexLine(tracepos, gs_traceLen, gs_trace, protocol);
+        for (uint32_t i = 0; i < show_cnt; i++) {
+            printHexLine(gs_trace_index[show[i]].offset, gs_traceLen, gs_trace, protocol);
         }
     } else {
 
@@ -1525,6 +1935,7 @@ int CmdTraceList(const char *Cmd) {
         // clean authentication data used with the mifare classic decrypt fct
         if (protocol == ISO_14443A || protocol == PROTO_MIFARE || protocol == PROTO_MFPLUS) {
             ClearAuthData();
+            ClearTraceKeyCache();
         }
 
         // reset hitag state  machine
@@ -1538,8 +1949,33 @@ int CmdTraceList(const char *Cmd) {
             prev_EOT = &previous_EOT;
         }
 
-        while (tracepos < gs_traceLen) {
-            tracepos = printTraceLine(tracepos, gs_traceLen, gs_trace, protocol, show_wait_cycles, mark_crc, prev_EOT, use_us, dicKeys, dicKeysCount);
+        // Only the shown records get annotated. Hidden records in front of them are fed to the
+        // annotators that keep state, the ones after the last shown record aren't looked at.
+        bool has_state = trace_protocol_has_state(protocol);
+        uint32_t idx = 0;
+        uint32_t tracepos = 0;
+
+        for (uint32_t i = 0; i < show_cnt; i++) {
+            uint32_t n = show[i];
+
+            // a merged topaz reader frame already took this one
+            if (gs_trace_index[n].offset < tracepos) {
+                continue;
+            }
+
+            for (; idx < n; idx++) {
+                if (has_state && gs_trace_index[idx].offset >= tracepos) {
+                    trace_feed_state(&gs_trace_index[idx], protocol, dicKeys, dicKeysCount);
+                }
+            }
+
+            // gap is measured from the previous record in the trace, shown or not
+            if (prev_EOT && n && (i == 0 || show[i - 1] != n - 1)) {
+                previous_EOT = trace_record_eot(&gs_trace_index[n - 1], protocol);
+            }
+
+            tracepos = printTraceLine(gs_trace_index[n].offset, gs_traceLen, gs_trace, protocol, show_wait_cycles, mark_crc, prev_EOT, use_us, dicKeys, dicKeysCount);
+            idx = n + 1;
 
             if (kbd_enter_pressed()) {
                 break;
@@ -1551,6 +1987,20 @@ int CmdTraceList(const char *Cmd) {
         }
     }
 
+    free(show);
+
+    if (page || trace_filter_active(&filter)) {
+        PrintAndLogEx(NORMAL, "");
+        PrintAndLogEx(INFO, "Showing " _YELLOW_("%u") " of " _YELLOW_("%u") " matching records ( %u records in trace )", show_cnt, matched, gs_trace_index_cnt);
+        if (page) {
+            uint32_t pages = (matched + rows - 1) / rows;
+            PrintAndLogEx(INFO, "Page " _YELLOW_("%u") " of " _YELLOW_("%u"), page, pages);
+            if (page < pages) {
+                PrintAndLogEx(HINT, "try " _YELLOW_("`--page %u`") " for the next page", page + 1);
+            }
+        }
+    }
+
     if (show_hex) {
         PrintAndLogEx(HINT, "syntax to use: " _YELLOW_("`text2pcap -t \"%%S.\" -l 264 -n <input-text-file> <output-pcapng-file>`"));
     }
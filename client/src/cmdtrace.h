@@ -24,6 +24,7 @@
 int CmdTrace(const char *Cmd);
 int CmdTraceList(const char *Cmd);
 int CmdTraceListAlias(const char *Cmd, const char *alias, const char *protocol);
-bool ImportTraceBuffer(const uint8_t *trace_src, uint16_t trace_len);
+bool ImportTraceBuffer(const uint8_t *trace_src, uint32_t trace_len);
+int GetTraceBuffer(bool download, const uint8_t **trace, uint32_t *trace_len);
 
 #endif
@@ -22,6 +22,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <sys/time.h>      // gettimeofday
 
 #include "uart/uart.h"
 #include "ui.h"
@@ -34,49 +36,158 @@
 // #define COMMS_DEBUG
 // #define COMMS_DEBUG_RAW
 
-// Serial port that we are communicating with the PM3 on.
-static serial_port sp = NULL;
-
-communication_arg_t g_conn;
-capabilities_t g_pm3_capabilities;
-
-static pthread_t communication_thread;
-static pthread_t reconnect_thread;
-
-static bool reconnect_ok = false;
-
-static bool comm_thread_dead = false;
-static bool comm_raw_mode = false;
-static uint8_t *comm_raw_data = NULL;
-static size_t comm_raw_len = 0;
-static size_t comm_raw_pos = 0;
-
-// Transmit buffer.
-static PacketCommandOLD txBuffer;
-static PacketCommandNGRaw txBufferNG;
-static size_t txBufferNGLen;
-static bool txBuffer_pending = false;
-static pthread_mutex_t txBufferMutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t txBufferSig = PTHREAD_COND_INITIALIZER;
+// waiters wake up at least this often to check timeouts and the communication thread
+#define RX_WAIT_SLICE_MS 100
+
+// Bulk download sink.  While GetFromDevice() runs, the communication thread places the chunks
+// straight into the destination buffer instead of queueing them in rxBuffer.
+// Protected by rxBufferMutex
+typedef struct {
+    uint8_t *dest;
+    uint32_t bytes;
+    uint32_t cmd;
+    uint32_t completed;
+    uint32_t packets;
+    bool active;
+    // out of bounds chunk, reported by dl_it
+    bool failed;
+    uint32_t failed_offset;
+    uint32_t failed_len;
+    // replies dropped on a full rxBuffer during the transfer, the final ACK may be one of them
+    uint32_t dropped;
+} dl_sink_t;
+
+// Communication state of one device, shared by its communication thread and the threads using the device
+struct pm3_comms {
+    // Serial port that we are communicating with the PM3 on.
+    serial_port sp;
+
+    pthread_t communication_thread;
+    pthread_t reconnect_thread;
+
+    bool reconnect_ok;
+
+    bool comm_thread_dead;
+    bool comm_raw_mode;
+    uint8_t *comm_raw_data;
+    size_t comm_raw_len;
+    size_t comm_raw_pos;
+
+    // Transmit buffer.
+    PacketCommandOLD txBuffer;
+    PacketCommandNGRaw txBufferNG;
+    size_t txBufferNGLen;
+    bool txBuffer_pending;
+    pthread_mutex_t txBufferMutex;
+    pthread_cond_t txBufferSig;
+
+    // Used by PacketResponseReceived as a ring buffer for messages that are yet to be
+    // processed by a command handler (WaitForResponse{,Timeout})
+    PacketResponseNG rxBuffer[CMD_BUFFER_SIZE];
+
+    // Points to the next empty position to write to
+    uint16_t cmd_head;
+
+    // Points to the position of the last unread command
+    uint16_t cmd_tail;
+
+    // to lock rxBuffer operations from different threads
+    pthread_mutex_t rxBufferMutex;
+    // signaled when a reply is stored or the communication thread dies
+    pthread_cond_t rxBufferSig;
+
+    // replies dropped because rxBuffer was full, since the last clearCommandBuffer()
+    uint32_t rx_dropped;
+
+    dl_sink_t dl_sink;
+
+    // Start time for WaitForResponseTimeout & dl_it, so we can reset timeout when we get packets
+    // as sending lot of these packets can slow down things wuite a lot on slow links (e.g. hw status or lf read at 9600)
+    uint64_t timeout_start_time;
+
+    uint64_t last_packet_time;
+};
+
+// state used by devices which were never opened, e.g. in offline mode
+static pm3_comms_t offline_comms = {
+    .txBufferMutex = PTHREAD_MUTEX_INITIALIZER,
+    .txBufferSig = PTHREAD_COND_INITIALIZER,
+    .rxBufferMutex = PTHREAD_MUTEX_INITIALIZER,
+    .rxBufferSig = PTHREAD_COND_INITIALIZER,
+};
+
+// session device until one is opened
+static pm3_device_t offline_device;
+
+static __thread pm3_device_t *bound_device = NULL;
+
+pm3_device_t *CurrentProxmark(void) {
+    if (bound_device) {
+        return bound_device;
+    }
+    if (g_session.current_device) {
+        return g_session.current_device;
+    }
+    return &offline_device;
+}
 
-// Used by PacketResponseReceived as a ring buffer for messages that are yet to be
-// processed by a command handler (WaitForResponse{,Timeout})
-static PacketResponseNG rxBuffer[CMD_BUFFER_SIZE];
+// bind a device to the calling thread, NULL for the session device.
+// Returns the previously bound device
+pm3_device_t *BindProxmark(pm3_device_t *dev) {
+    pm3_device_t *prev = bound_device;
+    bound_device = dev;
+    return prev;
+}
 
-// Points to the next empty position to write to
-static uint16_t cmd_head = 0;
+static pm3_comms_t *comms_of(const pm3_device_t *dev) {
+    return (dev->comms) ? dev->comms : &offline_comms;
+}
 
-// Points to the position of the last unread command
-static uint16_t cmd_tail = 0;
+// comms of the device of the calling thread
+static pm3_comms_t *cur_comms(void) {
+    return comms_of(CurrentProxmark());
+}
 
-// to lock rxBuffer operations from different threads
-static pthread_mutex_t rxBufferMutex = PTHREAD_MUTEX_INITIALIZER;
+static pm3_comms_t *comms_new(void) {
+    pm3_comms_t *comms = calloc(1, sizeof(pm3_comms_t));
+    if (comms == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&comms->txBufferMutex, NULL);
+    pthread_cond_init(&comms->txBufferSig, NULL);
+    pthread_mutex_init(&comms->rxBufferMutex, NULL);
+    pthread_cond_init(&comms->rxBufferSig, NULL);
+    return comms;
+}
 
-// Global start time for WaitForResponseTimeout & dl_it, so we can reset timeout when we get packets
-// as sending lot of these packets can slow down things wuite a lot on slow links (e.g. hw status or lf read at 9600)
-static uint64_t timeout_start_time;
+static void comms_free(pm3_comms_t *comms) {
+    if (comms == NULL || comms == &offline_comms) {
+        return;
+    }
+    pthread_mutex_destroy(&comms->txBufferMutex);
+    pthread_cond_destroy(&comms->txBufferSig);
+    pthread_mutex_destroy(&comms->rxBufferMutex);
+    pthread_cond_destroy(&comms->rxBufferSig);
+    free(comms);
+}
 
-static uint64_t last_packet_time;
+// close a device and release its memory, it must not be used by any thread anymore
+void FreeProxmark(pm3_device_t *dev) {
+    if (dev == NULL || dev == &offline_device) {
+        return;
+    }
+    if (dev->present) {
+        CloseProxmark(dev);
+    }
+    if (g_session.current_device == dev) {
+        g_session.current_device = NULL;
+    }
+    if (bound_device == dev) {
+        bound_device = NULL;
+    }
+    comms_free(dev->comms);
+    free(dev);
+}
 
 static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, size_t ms_timeout, bool show_warning, uint32_t rec_cmd);
 
@@ -105,28 +216,33 @@ void SendCommandOLD(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, c
     print_hex_break((uint8_t *)&c.d, sizeof(c.d), 32);
 #endif
 
-    if (!g_session.pm3_present) {
+    if (CurrentProxmark()->present == false) {
         PrintAndLogEx(WARNING, "Sending bytes to Proxmark3 failed ( " _RED_("offline") " )");
         return;
     }
 
-    pthread_mutex_lock(&txBufferMutex);
+    pm3_comms_t *comms = cur_comms();
+    pthread_mutex_lock(&comms->txBufferMutex);
     /**
     This causes hangups at times, when the pm3 unit is unresponsive or disconnected. The main console thread is alive,
     but comm thread just spins here. Not good.../holiman
     **/
-    while (txBuffer_pending) {
+    while (comms->txBuffer_pending) {
         // wait for communication thread to complete sending a previous command
-        pthread_cond_wait(&txBufferSig, &txBufferMutex);
+        pthread_cond_wait(&comms->txBufferSig, &comms->txBufferMutex);
     }
 
-    txBuffer = c;
-    txBuffer_pending = true;
+    comms->txBuffer = c;
+    comms->txBuffer_pending = true;
 
     // tell communication thread that a new command can be send
-    pthread_cond_signal(&txBufferSig);
+    pthread_cond_signal(&comms->txBufferSig);
 
-    pthread_mutex_unlock(&txBufferMutex);
+    // and don't let it sit in its RX wait until the timeout.
+    // The port is only closed with txBufferMutex held
+    uart_notify(comms->sp);
+
+    pthread_mutex_unlock(&comms->txBufferMutex);
 
 //__atomic_test_and_set(&txcmd_pending, __ATOMIC_SEQ_CST);
 }
@@ -136,7 +252,7 @@ static void SendCommandNG_internal(uint16_t cmd, uint8_t *data, size_t len, bool
     PrintAndLogEx(INFO, "Sending %s", ng ? "NG" : "MIX");
 #endif
 
-    if (!g_session.pm3_present) {
+    if (CurrentProxmark()->present == false) {
         PrintAndLogEx(INFO, "Sending bytes to proxmark failed - offline");
         return;
     }
@@ -145,51 +261,56 @@ static void SendCommandNG_internal(uint16_t cmd, uint8_t *data, size_t len, bool
         return;
     }
 
-    PacketCommandNGPostamble *tx_post = (PacketCommandNGPostamble *)((uint8_t *)&txBufferNG + sizeof(PacketCommandNGPreamble) + len);
+    pm3_comms_t *comms = cur_comms();
+    PacketCommandNGPostamble *tx_post = (PacketCommandNGPostamble *)((uint8_t *)&comms->txBufferNG + sizeof(PacketCommandNGPreamble) + len);
 
-    pthread_mutex_lock(&txBufferMutex);
+    pthread_mutex_lock(&comms->txBufferMutex);
     /**
     This causes hangups at times, when the pm3 unit is unresponsive or disconnected. The main console thread is alive,
     but comm thread just spins here. Not good.../holiman
     **/
-    while (txBuffer_pending) {
+    while (comms->txBuffer_pending) {
         // wait for communication thread to complete sending a previous command
-        pthread_cond_wait(&txBufferSig, &txBufferMutex);
+        pthread_cond_wait(&comms->txBufferSig, &comms->txBufferMutex);
     }
 
-    txBufferNG.pre.magic = COMMANDNG_PREAMBLE_MAGIC;
-    txBufferNG.pre.ng = ng;
-    txBufferNG.pre.length = len;
-    txBufferNG.pre.cmd = cmd;
+    comms->txBufferNG.pre.magic = COMMANDNG_PREAMBLE_MAGIC;
+    comms->txBufferNG.pre.ng = ng;
+    comms->txBufferNG.pre.length = len;
+    comms->txBufferNG.pre.cmd = cmd;
     if (len > 0 && data)
-        memcpy(&txBufferNG.data, data, len);
+        memcpy(&comms->txBufferNG.data, data, len);
 
     if ((g_conn.send_via_fpc_usart && g_conn.send_with_crc_on_fpc) || ((!g_conn.send_via_fpc_usart) && g_conn.send_with_crc_on_usb)) {
         uint8_t first = 0, second = 0;
-        compute_crc(CRC_14443_A, (uint8_t *)&txBufferNG, sizeof(PacketCommandNGPreamble) + len, &first, &second);
+        compute_crc(CRC_14443_A, (uint8_t *)&comms->txBufferNG, sizeof(PacketCommandNGPreamble) + len, &first, &second);
         tx_post->crc = (first << 8) + second;
     } else {
         tx_post->crc = COMMANDNG_POSTAMBLE_MAGIC;
     }
 
-    txBufferNGLen = sizeof(PacketCommandNGPreamble) + len + sizeof(PacketCommandNGPostamble);
+    comms->txBufferNGLen = sizeof(PacketCommandNGPreamble) + len + sizeof(PacketCommandNGPostamble);
 
 #ifdef COMMS_DEBUG_RAW
-    print_hex_break((uint8_t *)&txBufferNG.pre, sizeof(PacketCommandNGPreamble), 32);
+    print_hex_break((uint8_t *)&comms->txBufferNG.pre, sizeof(PacketCommandNGPreamble), 32);
     if (ng) {
-        print_hex_break((uint8_t *)&txBufferNG.data, len, 32);
+        print_hex_break((uint8_t *)&comms->txBufferNG.data, len, 32);
     } else {
-        print_hex_break((uint8_t *)&txBufferNG.data, 3 * sizeof(uint64_t), 32);
-        print_hex_break((uint8_t *)&txBufferNG.data + 3 * sizeof(uint64_t), len - 3 * sizeof(uint64_t), 32);
+        print_hex_break((uint8_t *)&comms->txBufferNG.data, 3 * sizeof(uint64_t), 32);
+        print_hex_break((uint8_t *)&comms->txBufferNG.data + 3 * sizeof(uint64_t), len - 3 * sizeof(uint64_t), 32);
     }
     print_hex_break((uint8_t *)tx_post, sizeof(PacketCommandNGPostamble), 32);
 #endif
-    txBuffer_pending = true;
+    comms->txBuffer_pending = true;
 
     // tell communication thread that a new command can be send
-    pthread_cond_signal(&txBufferSig);
+    pthread_cond_signal(&comms->txBufferSig);
+
+    // and don't let it sit in its RX wait until the timeout.
+    // The port is only closed with txBufferMutex held
+    uart_notify(comms->sp);
 
-    pthread_mutex_unlock(&txBufferMutex);
+    pthread_mutex_unlock(&comms->txBufferMutex);
 
 //__atomic_test_and_set(&txcmd_pending, __ATOMIC_SEQ_CST);
 }
@@ -219,65 +340,190 @@ void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, c
  *  operation. Right now we'll just have to live with this.
  */
 void clearCommandBuffer(void) {
+    pm3_comms_t *comms = cur_comms();
     //This is a very simple operation
-    pthread_mutex_lock(&rxBufferMutex);
-    cmd_tail = cmd_head;
-    pthread_mutex_unlock(&rxBufferMutex);
+    pthread_mutex_lock(&comms->rxBufferMutex);
+    comms->cmd_tail = comms->cmd_head;
+    comms->rx_dropped = 0;
+    pthread_mutex_unlock(&comms->rxBufferMutex);
 }
 /**
  * @brief storeCommand stores a USB command in a circular buffer
  * @param UC
  */
 static void storeReply(const PacketResponseNG *packet) {
-    pthread_mutex_lock(&rxBufferMutex);
-    if ((cmd_head + 1) % CMD_BUFFER_SIZE == cmd_tail) {
-        //If these two are equal, we're about to overwrite in the
-        // circular buffer.
-        PrintAndLogEx(FAILED, "WARNING: Command buffer about to overwrite command! This needs to be fixed!");
-        fflush(stdout);
+    pm3_comms_t *comms = cur_comms();
+    pthread_mutex_lock(&comms->rxBufferMutex);
+
+    if ((comms->cmd_head + 1) % CMD_BUFFER_SIZE == comms->cmd_tail) {
+        // full, drop the new reply instead of overwriting the unread ones or stalling the port
+        if (comms->rx_dropped++ == 0) {
+            PrintAndLogEx(FAILED, "WARNING: Command buffer full, dropping replies");
+            fflush(stdout);
+        }
+        if (comms->dl_sink.active) {
+            comms->dl_sink.dropped++;
+        }
+        pthread_mutex_unlock(&comms->rxBufferMutex);
+        return;
     }
+
     //Store the command at the 'head' location
-    PacketResponseNG *destination = &rxBuffer[cmd_head];
+    PacketResponseNG *destination = &comms->rxBuffer[comms->cmd_head];
     memcpy(destination, packet, sizeof(PacketResponseNG));
 
     //increment head and wrap
-    cmd_head = (cmd_head + 1) % CMD_BUFFER_SIZE;
-    pthread_mutex_unlock(&rxBufferMutex);
+    comms->cmd_head = (comms->cmd_head + 1) % CMD_BUFFER_SIZE;
+
+    // wake up the waiting command
+    pthread_cond_broadcast(&comms->rxBufferSig);
+    pthread_mutex_unlock(&comms->rxBufferMutex);
 }
+
+// wake up waiters, they need to notice the communication thread died
+static void signalReplyWaiters(void) {
+    pm3_comms_t *comms = cur_comms();
+    pthread_mutex_lock(&comms->rxBufferMutex);
+    pthread_cond_broadcast(&comms->rxBufferSig);
+    pthread_mutex_unlock(&comms->rxBufferMutex);
+}
+
 /**
- * @brief getCommand gets a command from an internal circular buffer.
+ * @brief getReplyWait gets a command from an internal circular buffer,
+ *  waiting until one is stored if the buffer is empty.
  * @param response location to write command
+ * @param ms_timeout max time to wait, 0 to return immediately
  * @return 1 if response was returned, 0 if nothing has been received
  */
-static int getReply(PacketResponseNG *packet) {
-    pthread_mutex_lock(&rxBufferMutex);
+static int getReplyWait(PacketResponseNG *packet, uint32_t ms_timeout) {
+    pm3_comms_t *comms = cur_comms();
+    pthread_mutex_lock(&comms->rxBufferMutex);
+
+    if (comms->cmd_head == comms->cmd_tail && ms_timeout) {
+        // pthread_cond_timedwait wants an absolute realtime deadline
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        uint64_t nsec = (uint64_t)now.tv_usec * 1000 + (uint64_t)(ms_timeout % 1000) * 1000000;
+        struct timespec deadline = {
+            .tv_sec = now.tv_sec + (ms_timeout / 1000) + (nsec / 1000000000),
+            .tv_nsec = nsec % 1000000000
+        };
+
+        while (comms->cmd_head == comms->cmd_tail && IsCommunicationThreadDead() == false) {
+            if (pthread_cond_timedwait(&comms->rxBufferSig, &comms->rxBufferMutex, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+    }
+
     //If head == tail, there's nothing to read, or if we just got initialized
-    if (cmd_head == cmd_tail)  {
-        pthread_mutex_unlock(&rxBufferMutex);
+    if (comms->cmd_head == comms->cmd_tail)  {
+        pthread_mutex_unlock(&comms->rxBufferMutex);
         return 0;
     }
 
     //Pick out the next unread command
-    memcpy(packet, &rxBuffer[cmd_tail], sizeof(PacketResponseNG));
+    memcpy(packet, &comms->rxBuffer[comms->cmd_tail], sizeof(PacketResponseNG));
 
     //Increment tail - this is a circular buffer, so modulo buffer size
-    cmd_tail = (cmd_tail + 1) % CMD_BUFFER_SIZE;
+    comms->cmd_tail = (comms->cmd_tail + 1) % CMD_BUFFER_SIZE;
 
-    pthread_mutex_unlock(&rxBufferMutex);
+    pthread_mutex_unlock(&comms->rxBufferMutex);
     return 1;
 }
 
+// route the chunks of a bulk download into dest
+static void dlSinkArm(uint8_t *dest, uint32_t bytes, uint32_t rec_cmd) {
+    pm3_comms_t *comms = cur_comms();
+    pthread_mutex_lock(&comms->rxBufferMutex);
+    memset(&comms->dl_sink, 0, sizeof(comms->dl_sink));
+    comms->dl_sink.dest = dest;
+    comms->dl_sink.bytes = bytes;
+    comms->dl_sink.cmd = rec_cmd;
+    comms->dl_sink.active = true;
+    pthread_mutex_unlock(&comms->rxBufferMutex);
+}
+
+// stop routing, returns the final state of the transfer
+static dl_sink_t dlSinkDisarm(void) {
+    pm3_comms_t *comms = cur_comms();
+    pthread_mutex_lock(&comms->rxBufferMutex);
+    comms->dl_sink.active = false;
+    dl_sink_t res = comms->dl_sink;
+    pthread_mutex_unlock(&comms->rxBufferMutex);
+    return res;
+}
+
+/**
+ * @brief dlSinkPlace places a download chunk in the destination of the active transfer.
+ *  Called by the communication thread with the frame payload, before it is copied into a reply.
+ * @param packet the reply header, cmd and oldarg[0..1] = offset, length
+ * @param payload data of the chunk
+ * @return true if the chunk was consumed, false if the packet must go the usual way
+ */
+static bool dlSinkPlace(const PacketResponseNG *packet, const uint8_t *payload) {
+    pm3_comms_t *comms = cur_comms();
+    pthread_mutex_lock(&comms->rxBufferMutex);
+
+    if (comms->dl_sink.active == false || packet->cmd != comms->dl_sink.cmd) {
+        pthread_mutex_unlock(&comms->rxBufferMutex);
+        return false;
+    }
+
+    uint32_t offset = packet->oldarg[0];
+    uint32_t copy_bytes = MIN(comms->dl_sink.bytes - comms->dl_sink.completed, packet->oldarg[1]);
+
+    // extended bounds check1.  upper limit is the frame payload
+    // shouldn't happen
+    copy_bytes = MIN(copy_bytes, packet->length);
+
+    // extended bounds check2.
+    if (offset > comms->dl_sink.bytes || copy_bytes > comms->dl_sink.bytes - offset) {
+        if (comms->dl_sink.failed == false) {
+            comms->dl_sink.failed = true;
+            comms->dl_sink.failed_offset = offset;
+            comms->dl_sink.failed_len = copy_bytes;
+        }
+    } else if (comms->dl_sink.failed == false) {
+        memcpy(comms->dl_sink.dest + offset, payload, copy_bytes);
+        comms->dl_sink.completed += copy_bytes;
+        comms->dl_sink.packets++;
+    }
+
+    // we got a packet, reset WaitForResponseTimeout timeout
+    uint64_t clk = msclock();
+    __atomic_store_n(&comms->timeout_start_time,  clk, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&comms->last_packet_time, clk, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_unlock(&comms->rxBufferMutex);
+    return true;
+}
+
+// how long to wait for the next reply, for a timeout counted from comms->timeout_start_time
+static uint32_t replyWaitSlice(size_t ms_timeout) {
+    pm3_comms_t *comms = cur_comms();
+    if (ms_timeout == (size_t) - 1) {
+        return RX_WAIT_SLICE_MS;
+    }
+    uint64_t elapsed = msclock() - __atomic_load_n(&comms->timeout_start_time, __ATOMIC_SEQ_CST);
+    if (elapsed >= ms_timeout) {
+        return 1;
+    }
+    return MIN(ms_timeout - elapsed + 1, RX_WAIT_SLICE_MS);
+}
+
 //-----------------------------------------------------------------------------
 // Entry point into our code: called whenever we received a packet over USB
 // that we weren't necessarily expecting, for example a debug print.
 //-----------------------------------------------------------------------------
 static void PacketResponseReceived(PacketResponseNG *packet) {
+    pm3_comms_t *comms = cur_comms();
 
     // we got a packet, reset WaitForResponseTimeout timeout
-    uint64_t prev_clk = __atomic_load_n(&last_packet_time, __ATOMIC_SEQ_CST);
+    uint64_t prev_clk = __atomic_load_n(&comms->last_packet_time, __ATOMIC_SEQ_CST);
     uint64_t clk = msclock();
-    __atomic_store_n(&timeout_start_time,  clk, __ATOMIC_SEQ_CST);
-    __atomic_store_n(&last_packet_time, clk, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&comms->timeout_start_time,  clk, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&comms->last_packet_time, clk, __ATOMIC_SEQ_CST);
     (void) prev_clk;
 //    PrintAndLogEx(NORMAL, "[%07"PRIu64"] RECV %s magic %08x length %04x status %04x crc %04x cmd %04x",
 //                clk - prev_clk, packet->ng ? "NG" : "OLD", packet->magic, packet->length, packet->status, packet->crc, packet->cmd);
@@ -350,7 +596,10 @@ static void PacketResponseReceived(PacketResponseNG *packet) {
 // When communication thread is dead,   start up and try to start it again
 void *uart_reconnect(void *targ) {
 
-    const communication_arg_t *connection = (communication_arg_t *)targ;
+    pm3_device_t *dev = (pm3_device_t *)targ;
+    BindProxmark(dev);
+    pm3_comms_t *comms = comms_of(dev);
+    const communication_arg_t *connection = &dev->conn;
 
 #if defined(__MACH__) && defined(__APPLE__)
     disableAppNap("Proxmark3 polling UART");
@@ -364,12 +613,12 @@ void *uart_reconnect(void *targ) {
     while (1) {
         // throttle
         msleep(200);
-        if (OpenProxmarkSilent(&g_session.current_device, connection->serial_port_name, speed) == false) {
+        if (OpenProxmarkSilent(&dev, connection->serial_port_name, speed) == false) {
             continue;
         }
 
-        if (g_session.pm3_present && (TestProxmark(g_session.current_device) != PM3_SUCCESS)) {
-            CloseProxmark(g_session.current_device);
+        if (dev->present && (TestProxmark(dev) != PM3_SUCCESS)) {
+            CloseProxmark(dev);
         } else {
             break;
         }
@@ -380,18 +629,20 @@ void *uart_reconnect(void *targ) {
     enableAppNap();
 #endif
 
-    __atomic_test_and_set(&reconnect_ok, __ATOMIC_SEQ_CST);
+    __atomic_test_and_set(&comms->reconnect_ok, __ATOMIC_SEQ_CST);
 
     pthread_exit(NULL);
     return NULL;
 }
 
 void StartReconnectProxmark(void) {
-    pthread_create(&reconnect_thread, NULL, &uart_reconnect, &g_conn);
+    pm3_comms_t *comms = cur_comms();
+    pthread_create(&comms->reconnect_thread, NULL, &uart_reconnect, CurrentProxmark());
 }
 
 bool IsReconnectedOk(void) {
-    bool ret = __atomic_load_n(&reconnect_ok, __ATOMIC_SEQ_CST);
+    pm3_comms_t *comms = cur_comms();
+    bool ret = __atomic_load_n(&comms->reconnect_ok, __ATOMIC_SEQ_CST);
     return ret;
 }
 
@@ -405,7 +656,11 @@ __attribute__((force_align_arg_pointer))
 #endif
 #endif
 *uart_communication(void *targ) {
-    const communication_arg_t *connection = (communication_arg_t *)targ;
+    // replies, debug prints & co are handled in the context of this device
+    pm3_device_t *dev = (pm3_device_t *)targ;
+    BindProxmark(dev);
+    pm3_comms_t *comms = comms_of(dev);
+    const communication_arg_t *connection = &dev->conn;
     uint32_t rxlen;
     bool commfailed = false;
     PacketResponseNG rx;
@@ -430,26 +685,27 @@ __attribute__((force_align_arg_pointer))
             if (g_conn.last_command != CMD_HARDWARE_RESET) {
                 PrintAndLogEx(WARNING, "\nCommunicating with Proxmark3 device " _RED_("failed"));
             }
-            __atomic_test_and_set(&comm_thread_dead, __ATOMIC_SEQ_CST);
+            __atomic_test_and_set(&comms->comm_thread_dead, __ATOMIC_SEQ_CST);
+            signalReplyWaiters();
             break;
         }
 
-        bool is_receiving_raw = __atomic_load_n(&comm_raw_mode, __ATOMIC_SEQ_CST);
+        bool is_receiving_raw = __atomic_load_n(&comms->comm_raw_mode, __ATOMIC_SEQ_CST);
 
         if (is_receiving_raw) {
-            uint8_t *bufferData = __atomic_load_n(&comm_raw_data, __ATOMIC_SEQ_CST); // read only
-            size_t bufferLen = __atomic_load_n(&comm_raw_len, __ATOMIC_SEQ_CST); // read only
-            size_t bufferPos = __atomic_load_n(&comm_raw_pos, __ATOMIC_SEQ_CST); // read and write
+            uint8_t *bufferData = __atomic_load_n(&comms->comm_raw_data, __ATOMIC_SEQ_CST); // read only
+            size_t bufferLen = __atomic_load_n(&comms->comm_raw_len, __ATOMIC_SEQ_CST); // read only
+            size_t bufferPos = __atomic_load_n(&comms->comm_raw_pos, __ATOMIC_SEQ_CST); // read and write
             if (bufferPos < bufferLen) {
                 size_t rxMaxLen = bufferLen - bufferPos;
 
                 rxMaxLen = MIN(COMM_RAW_RECEIVE_LEN, rxMaxLen);
 
-                res = uart_receive(sp, bufferData + bufferPos, rxMaxLen, &rxlen);
+                res = uart_receive(comms->sp, bufferData + bufferPos, rxMaxLen, &rxlen);
                 if (res == PM3_SUCCESS) {
                     uint64_t clk = msclock();
-                    __atomic_store_n(&timeout_start_time,  clk, __ATOMIC_SEQ_CST);
-                    __atomic_store_n(&comm_raw_pos, bufferPos + rxlen, __ATOMIC_SEQ_CST);
+                    __atomic_store_n(&comms->timeout_start_time,  clk, __ATOMIC_SEQ_CST);
+                    __atomic_store_n(&comms->comm_raw_pos, bufferPos + rxlen, __ATOMIC_SEQ_CST);
                 } else if (res != PM3_ENODATA) {
                     PrintAndLogEx(WARNING, "Error when reading raw data: %zu/%zu, %d", bufferPos, bufferLen, res);
                     //error = true;
@@ -461,17 +717,17 @@ __attribute__((force_align_arg_pointer))
                 // Ignore data when bufferPos >= bufferLen and is_receiving_raw has not been set to false
                 uint8_t dummyData[64];
                 uint32_t dummyLen;
-                uart_receive(sp, dummyData, sizeof(dummyData), &dummyLen);
+                uart_receive(comms->sp, dummyData, sizeof(dummyData), &dummyLen);
             }
         } else {
             if (is_receiving_raw_last) {
                 // is_receiving_raw changed from true to false
 
                 // Set the buffer as undefined
-                // comm_raw_data == NULL is used in SetCommunicationReceiveMode()
-                __atomic_store_n(&comm_raw_data, NULL, __ATOMIC_SEQ_CST);
+                // comms->comm_raw_data == NULL is used in SetCommunicationReceiveMode()
+                __atomic_store_n(&comms->comm_raw_data, NULL, __ATOMIC_SEQ_CST);
             }
-            res = uart_receive(sp, (uint8_t *)&rx_raw.pre, sizeof(PacketResponseNGPreamble), &rxlen);
+            res = uart_receive(comms->sp, (uint8_t *)&rx_raw.pre, sizeof(PacketResponseNGPreamble), &rxlen);
 
             if ((res == PM3_SUCCESS) && (rxlen == sizeof(PacketResponseNGPreamble))) {
                 rx.magic = rx_raw.pre.magic;
@@ -487,7 +743,7 @@ __attribute__((force_align_arg_pointer))
 
                     if ((!error) && (length > 0)) { // Get the variable length payload
 
-                        res = uart_receive(sp, (uint8_t *)&rx_raw.data, length, &rxlen);
+                        res = uart_receive(comms->sp, (uint8_t *)&rx_raw.data, length, &rxlen);
                         if ((res != PM3_SUCCESS) || (rxlen != length)) {
                             PrintAndLogEx(WARNING, "Received packet frame with variable part too short? %d/%d", rxlen, length);
                             error = true;
@@ -510,7 +766,7 @@ __attribute__((force_align_arg_pointer))
                                     rx.oldarg[0] = arg[0];
                                     rx.oldarg[1] = arg[1];
                                     rx.oldarg[2] = arg[2];
-                                    memcpy(&rx.data, ((uint8_t *)&rx_raw.data) + sizeof(arg), length - sizeof(arg));
+                                    // payload is copied once the frame is validated
                                     rx.length = length - sizeof(arg);
                                     if (rx.cmd == CMD_ACK) {
                                         ACK_received = true;
@@ -528,7 +784,7 @@ __attribute__((force_align_arg_pointer))
                     }
 
                     if (!error) {                        // Get the postamble
-                        res = uart_receive(sp, (uint8_t *)&rx_raw.foopost, sizeof(PacketResponseNGPostamble), &rxlen);
+                        res = uart_receive(comms->sp, (uint8_t *)&rx_raw.foopost, sizeof(PacketResponseNGPostamble), &rxlen);
                         if ((res != PM3_SUCCESS) || (rxlen != sizeof(PacketResponseNGPostamble))) {
                             PrintAndLogEx(WARNING, "Received packet frame without postamble");
                             error = true;
@@ -555,13 +811,21 @@ __attribute__((force_align_arg_pointer))
                         print_hex_break((uint8_t *)&rx_raw.data, rx_raw.pre.length, 32);
                         print_hex_break((uint8_t *)&rx_raw.foopost, sizeof(PacketResponseNGPostamble), 32);
 #endif
-                        PacketResponseReceived(&rx);
+                        if (rx.ng) {
+                            PacketResponseReceived(&rx);
+                        } else {
+                            const uint8_t *payload = ((uint8_t *)&rx_raw.data) + (3 * sizeof(uint64_t));
+                            if (dlSinkPlace(&rx, payload) == false) {
+                                memcpy(&rx.data, payload, rx.length);
+                                PacketResponseReceived(&rx);
+                            }
+                        }
                     }
                 } else {                               // Old style reply
                     PacketResponseOLD rx_old;
                     memcpy(&rx_old, &rx_raw.pre, sizeof(PacketResponseNGPreamble));
 
-                    res = uart_receive(sp, ((uint8_t *)&rx_old) + sizeof(PacketResponseNGPreamble), sizeof(PacketResponseOLD) - sizeof(PacketResponseNGPreamble), &rxlen);
+                    res = uart_receive(comms->sp, ((uint8_t *)&rx_old) + sizeof(PacketResponseNGPreamble), sizeof(PacketResponseOLD) - sizeof(PacketResponseNGPreamble), &rxlen);
                     if ((res != PM3_SUCCESS) || (rxlen != sizeof(PacketResponseOLD) - sizeof(PacketResponseNGPreamble))) {
                         PrintAndLogEx(WARNING, "Received packet OLD frame with payload too short? %d/%zu", rxlen, sizeof(PacketResponseOLD) - sizeof(PacketResponseNGPreamble));
                         error = true;
@@ -584,8 +848,10 @@ __attribute__((force_align_arg_pointer))
                         rx.oldarg[1] = rx_old.arg[1];
                         rx.oldarg[2] = rx_old.arg[2];
                         rx.length = PM3_CMD_DATA_SIZE;
-                        memcpy(&rx.data, &rx_old.d, rx.length);
-                        PacketResponseReceived(&rx);
+                        if (dlSinkPlace(&rx, rx_old.d.asBytes) == false) {
+                            memcpy(&rx.data, &rx_old.d, rx.length);
+                            PacketResponseReceived(&rx);
+                        }
                         if (rx.cmd == CMD_ACK) {
                             ACK_received = true;
                         }
@@ -605,7 +871,7 @@ __attribute__((force_align_arg_pointer))
         is_receiving_raw_last = is_receiving_raw;
         // TODO if error, shall we resync ?
 
-        pthread_mutex_lock(&txBufferMutex);
+        pthread_mutex_lock(&comms->txBufferMutex);
 
         if (connection->block_after_ACK) {
             // if we just received an ACK, wait here until a new command is to be transmitted
@@ -614,43 +880,45 @@ __attribute__((force_align_arg_pointer))
 #ifdef COMMS_DEBUG
                 PrintAndLogEx(NORMAL, "Received ACK, fast TX mode: ignoring other RX till TX");
 #endif
-                while (!txBuffer_pending) {
-                    pthread_cond_wait(&txBufferSig, &txBufferMutex);
+                while (!comms->txBuffer_pending) {
+                    pthread_cond_wait(&comms->txBufferSig, &comms->txBufferMutex);
                 }
             }
         }
 
-        if (txBuffer_pending) {
+        if (comms->txBuffer_pending) {
 
-            if (txBufferNGLen) { // NG packet
-                res = uart_send(sp, (uint8_t *) &txBufferNG, txBufferNGLen);
+            if (comms->txBufferNGLen) { // NG packet
+                res = uart_send(comms->sp, (uint8_t *) &comms->txBufferNG, comms->txBufferNGLen);
                 if (res == PM3_EIO) {
                     commfailed = true;
                 }
-                g_conn.last_command = txBufferNG.pre.cmd;
-                txBufferNGLen = 0;
+                g_conn.last_command = comms->txBufferNG.pre.cmd;
+                comms->txBufferNGLen = 0;
             } else {
-                res = uart_send(sp, (uint8_t *) &txBuffer, sizeof(PacketCommandOLD));
+                res = uart_send(comms->sp, (uint8_t *) &comms->txBuffer, sizeof(PacketCommandOLD));
                 if (res == PM3_EIO) {
                     commfailed = true;
                 }
-                g_conn.last_command = txBuffer.cmd;
+                g_conn.last_command = comms->txBuffer.cmd;
             }
 
-            txBuffer_pending = false;
+            comms->txBuffer_pending = false;
 
             // main thread doesn't know send failed...
 
-            // tell main thread that txBuffer is empty
-            pthread_cond_signal(&txBufferSig);
+            // tell main thread that comms->txBuffer is empty
+            pthread_cond_signal(&comms->txBufferSig);
         }
 
-        pthread_mutex_unlock(&txBufferMutex);
+        pthread_mutex_unlock(&comms->txBufferMutex);
     }
 
     // when thread dies, we close the serial port.
-    uart_close(sp);
-    sp = NULL;
+    pthread_mutex_lock(&comms->txBufferMutex);
+    uart_close(comms->sp);
+    comms->sp = NULL;
+    pthread_mutex_unlock(&comms->txBufferMutex);
 
 #if defined(__MACH__) && defined(__APPLE__)
     enableAppNap();
@@ -661,7 +929,8 @@ __attribute__((force_align_arg_pointer))
 }
 
 bool IsCommunicationThreadDead(void) {
-    bool ret = __atomic_load_n(&comm_thread_dead, __ATOMIC_SEQ_CST);
+    pm3_comms_t *comms = cur_comms();
+    bool ret = __atomic_load_n(&comms->comm_thread_dead, __ATOMIC_SEQ_CST);
     return ret;
 }
 
@@ -685,80 +954,119 @@ bool IsCommunicationThreadDead(void) {
 // SetCommunicationRawReceiveBuffer() and GetCommunicationRawReceiveNum()
 
 bool SetCommunicationReceiveMode(bool isRawMode) {
+    pm3_comms_t *comms = cur_comms();
     if (isRawMode) {
-        const uint8_t *buffer = __atomic_load_n(&comm_raw_data, __ATOMIC_SEQ_CST);
+        const uint8_t *buffer = __atomic_load_n(&comms->comm_raw_data, __ATOMIC_SEQ_CST);
         if (buffer == NULL) {
             PrintAndLogEx(ERR, "Buffer for raw data is not set");
             return false;
         }
     }
-    __atomic_store_n(&comm_raw_mode, isRawMode, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&comms->comm_raw_mode, isRawMode, __ATOMIC_SEQ_CST);
     return true;
 }
 
 void SetCommunicationRawReceiveBuffer(uint8_t *buffer, size_t len) {
-    __atomic_store_n(&comm_raw_data,  buffer, __ATOMIC_SEQ_CST);
-    __atomic_store_n(&comm_raw_len,  len, __ATOMIC_SEQ_CST);
-    __atomic_store_n(&comm_raw_pos,  0, __ATOMIC_SEQ_CST);
+    pm3_comms_t *comms = cur_comms();
+    __atomic_store_n(&comms->comm_raw_data,  buffer, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&comms->comm_raw_len,  len, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&comms->comm_raw_pos,  0, __ATOMIC_SEQ_CST);
 }
 
 size_t GetCommunicationRawReceiveNum(void) {
-    return __atomic_load_n(&comm_raw_pos, __ATOMIC_SEQ_CST);
+    pm3_comms_t *comms = cur_comms();
+    return __atomic_load_n(&comms->comm_raw_pos, __ATOMIC_SEQ_CST);
 }
 
-bool OpenProxmarkSilent(pm3_device_t **dev, const char *port, uint32_t speed) {
+// allocates what is missing of a device and its communication state
+static pm3_comms_t *comms_prepare(pm3_device_t **dev) {
+    if (*dev == NULL) {
+        *dev = calloc(1UL, sizeof(pm3_device_t));
+        if (*dev == NULL) {
+            PrintAndLogEx(WARNING, "Failed to allocate memory");
+            return NULL;
+        }
+    }
+    if ((*dev)->comms == NULL) {
+        (*dev)->comms = comms_new();
+        if ((*dev)->comms == NULL) {
+            PrintAndLogEx(WARNING, "Failed to allocate memory");
+            return NULL;
+        }
+    }
+    return (*dev)->comms;
+}
 
-    sp = uart_open(port, speed, true);
+// the settings of the connection are stored in the device, so it is bound while the port is opened
+static serial_port comms_open_port(pm3_device_t *dev, const char *port, uint32_t speed, bool silent) {
+    pm3_device_t *prev = BindProxmark(dev);
+    serial_port sp = uart_open(port, speed, silent);
+    BindProxmark(prev);
+    return sp;
+}
 
-    // check result of uart opening
-    if (sp == INVALID_SERIAL_PORT) {
-        sp = NULL;
-        return false;
-    } else if (sp == CLAIMED_SERIAL_PORT) {
-        sp = NULL;
-        return false;
-    } else {
-        // start the communication thread
-        if (port != g_conn.serial_port_name) {
-            uint16_t len = MIN(strlen(port), FILE_PATH_SIZE - 1);
-            memset(g_conn.serial_port_name, 0, FILE_PATH_SIZE);
-            memcpy(g_conn.serial_port_name, port, len);
-        }
-        g_conn.run = true;
-        g_conn.block_after_ACK = false;
-        // Flags to tell where to add CRC on sent replies
-        g_conn.send_with_crc_on_usb = false;
-        g_conn.send_with_crc_on_fpc = true;
-        // "Session" flag, to tell via which interface next msgs should be sent: USB or FPC USART
-        g_conn.send_via_fpc_usart = false;
+// start the communication thread on an opened port
+static void comms_start(pm3_device_t *dev, serial_port sp, const char *port, bool flash_mode) {
+    pm3_comms_t *comms = dev->comms;
+    communication_arg_t *conn = &dev->conn;
 
-        pthread_create(&communication_thread, NULL, &uart_communication, &g_conn);
-        __atomic_clear(&comm_thread_dead, __ATOMIC_SEQ_CST);
-        __atomic_clear(&reconnect_ok, __ATOMIC_SEQ_CST);
+    if (port != conn->serial_port_name) {
+        uint16_t len = MIN(strlen(port), FILE_PATH_SIZE - 1);
+        memset(conn->serial_port_name, 0, FILE_PATH_SIZE);
+        memcpy(conn->serial_port_name, port, len);
+    }
+    conn->run = true;
+    conn->block_after_ACK = flash_mode;
+    // Flags to tell where to add CRC on sent replies
+    conn->send_with_crc_on_usb = false;
+    conn->send_with_crc_on_fpc = true;
+    // "Session" flag, to tell via which interface next msgs should be sent: USB or FPC USART
+    conn->send_via_fpc_usart = false;
+
+    comms->sp = sp;
+    __atomic_clear(&comms->comm_thread_dead, __ATOMIC_SEQ_CST);
+    pthread_create(&comms->communication_thread, NULL, &uart_communication, dev);
+
+    dev->present = true;
+    fflush(stdout);
+}
 
-        g_session.pm3_present = true; // TODO support for multiple devices
+bool OpenProxmarkSilent(pm3_device_t **dev, const char *port, uint32_t speed) {
 
-        fflush(stdout);
-        if (*dev == NULL) {
-            *dev = calloc(1UL, sizeof(pm3_device_t));
-        }
-        (*dev)->g_conn = &g_conn; // TODO g_conn shouldn't be global
-        return true;
+    pm3_comms_t *comms = comms_prepare(dev);
+    if (comms == NULL) {
+        return false;
+    }
+
+    serial_port sp = comms_open_port(*dev, port, speed, true);
+
+    // check result of uart opening
+    if (sp == INVALID_SERIAL_PORT || sp == CLAIMED_SERIAL_PORT) {
+        return false;
     }
+
+    __atomic_clear(&comms->reconnect_ok, __ATOMIC_SEQ_CST);
+    comms_start(*dev, sp, port, false);
+    return true;
 }
 
 bool OpenProxmark(pm3_device_t **dev, const char *port, bool wait_for_port, int timeout, bool flash_mode, uint32_t speed) {
 
+    if (comms_prepare(dev) == NULL) {
+        return false;
+    }
+
+    serial_port sp;
     if (wait_for_port == false) {
         PrintAndLogEx(SUCCESS, "Using UART port " _GREEN_("%s"), port);
-        sp = uart_open(port, speed, false);
+        sp = comms_open_port(*dev, port, speed, false);
     } else {
         PrintAndLogEx(SUCCESS, "Waiting for Proxmark3 to appear on " _YELLOW_("%s"), port);
         fflush(stdout);
         int openCount = 0;
         PrintAndLogEx(INPLACE, "% 3i", timeout);
         do {
-            sp = uart_open(port, speed, false);
+            sp = comms_open_port(*dev, port, speed, false);
             msleep(500);
             PrintAndLogEx(INPLACE, "% 3i", timeout - openCount - 1);
 
@@ -769,44 +1077,19 @@ bool OpenProxmark(pm3_device_t **dev, const char *port, bool wait_for_port, int
     if (sp == INVALID_SERIAL_PORT) {
         PrintAndLogEx(WARNING, "\n" _RED_("ERROR:") " invalid serial port " _YELLOW_("%s"), port);
         PrintAndLogEx(HINT, "Try the shell script " _YELLOW_("`./pm3 --list`") " to get a list of possible serial ports");
-        sp = NULL;
         return false;
     } else if (sp == CLAIMED_SERIAL_PORT) {
         PrintAndLogEx(WARNING, "\n" _RED_("ERROR:") " serial port " _YELLOW_("%s") " is claimed by another process", port);
         PrintAndLogEx(HINT, "Try the shell script " _YELLOW_("`./pm3 --list`") " to get a list of possible serial ports");
-
-        sp = NULL;
         return false;
-    } else {
-        // start the communication thread
-        if (port != g_conn.serial_port_name) {
-            uint16_t len = MIN(strlen(port), FILE_PATH_SIZE - 1);
-            memset(g_conn.serial_port_name, 0, FILE_PATH_SIZE);
-            memcpy(g_conn.serial_port_name, port, len);
-        }
-        g_conn.run = true;
-        g_conn.block_after_ACK = flash_mode;
-        // Flags to tell where to add CRC on sent replies
-        g_conn.send_with_crc_on_usb = false;
-        g_conn.send_with_crc_on_fpc = true;
-        // "Session" flag, to tell via which interface next msgs should be sent: USB or FPC USART
-        g_conn.send_via_fpc_usart = false;
-
-        pthread_create(&communication_thread, NULL, &uart_communication, &g_conn);
-        __atomic_clear(&comm_thread_dead, __ATOMIC_SEQ_CST);
-        g_session.pm3_present = true; // TODO support for multiple devices
-
-        fflush(stdout);
-        if (*dev == NULL) {
-            *dev = calloc(1UL, sizeof(pm3_device_t));
-        }
-        (*dev)->g_conn = &g_conn; // TODO g_conn shouldn't be global
-        return true;
     }
+
+    comms_start(*dev, sp, port, flash_mode);
+    return true;
 }
 
-// check if we can communicate with Pm3
-int TestProxmark(pm3_device_t *dev) {
+static int comms_test(void) {
+    pm3_comms_t *comms = cur_comms();
 
     uint16_t len = 32;
     uint8_t data[len];
@@ -814,7 +1097,7 @@ int TestProxmark(pm3_device_t *dev) {
         data[i] = i & 0xFF;
     }
 
-    __atomic_store_n(&last_packet_time,  msclock(), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&comms->last_packet_time,  msclock(), __ATOMIC_SEQ_CST);
     clearCommandBuffer();
     SendCommandNG(CMD_PING, data, len);
 
@@ -883,32 +1166,47 @@ int TestProxmark(pm3_device_t *dev) {
     return PM3_SUCCESS;
 }
 
+// check if we can communicate with Pm3
+int TestProxmark(pm3_device_t *dev) {
+    pm3_device_t *prev = BindProxmark(dev);
+    int res = comms_test();
+    BindProxmark(prev);
+    return res;
+}
+
 void CloseProxmark(pm3_device_t *dev) {
-    dev->g_conn->run = false;
+    dev->conn.run = false;
+    if (dev->comms == NULL) {
+        dev->present = false;
+        return;
+    }
+
+    pm3_comms_t *comms = dev->comms;
 
 #ifdef __BIONIC__
-    if (communication_thread != 0) {
-        pthread_join(communication_thread, NULL);
+    if (comms->communication_thread != 0) {
+        pthread_join(comms->communication_thread, NULL);
     }
 #else
-    pthread_join(communication_thread, NULL);
+    pthread_join(comms->communication_thread, NULL);
 #endif
 
-    if (sp) {
-        uart_close(sp);
-    }
-
     // Clean up our state
-    sp = NULL;
+    pthread_mutex_lock(&comms->txBufferMutex);
+    if (comms->sp) {
+        uart_close(comms->sp);
+    }
+    comms->sp = NULL;
+    pthread_mutex_unlock(&comms->txBufferMutex);
 #ifdef __BIONIC__
-    if (communication_thread != 0) {
-        memset(&communication_thread, 0, sizeof(pthread_t));
+    if (comms->communication_thread != 0) {
+        memset(&comms->communication_thread, 0, sizeof(pthread_t));
     }
 #else
-    memset(&communication_thread, 0, sizeof(pthread_t));
+    memset(&comms->communication_thread, 0, sizeof(pthread_t));
 #endif
 
-    g_session.pm3_present = false;
+    dev->present = false;
 }
 
 // Gives a rough estimate of the communication delay based on channel & baudrate
@@ -939,6 +1237,7 @@ static size_t communication_delay(void) {
  * @return the number of received bytes
  */
 size_t WaitForRawDataTimeout(uint8_t *buffer, size_t len, size_t ms_timeout, bool show_process) {
+    pm3_comms_t *comms = cur_comms();
     uint8_t print_counter = 0;
     size_t last_pos = 0;
 
@@ -946,7 +1245,7 @@ size_t WaitForRawDataTimeout(uint8_t *buffer, size_t len, size_t ms_timeout, boo
     if (ms_timeout != (size_t) - 1) {
         ms_timeout += communication_delay();
     }
-    __atomic_store_n(&timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&comms->timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
 
     SetCommunicationRawReceiveBuffer(buffer, len);
     SetCommunicationReceiveMode(true);
@@ -966,11 +1265,11 @@ size_t WaitForRawDataTimeout(uint8_t *buffer, size_t len, size_t ms_timeout, boo
             }
         }
 
-        pos = __atomic_load_n(&comm_raw_pos, __ATOMIC_SEQ_CST);
+        pos = __atomic_load_n(&comms->comm_raw_pos, __ATOMIC_SEQ_CST);
 
         // Check the timeout if pos is not updated
         if (last_pos == pos) {
-            uint64_t tmp_clk = __atomic_load_n(&timeout_start_time, __ATOMIC_SEQ_CST);
+            uint64_t tmp_clk = __atomic_load_n(&comms->timeout_start_time, __ATOMIC_SEQ_CST);
             // If ms_timeout == -1, the loop can only be breaked by pressing Enter or receiving enough data
             if ((ms_timeout != (size_t) - 1) && (msclock() - tmp_clk > ms_timeout)) {
                 break;
@@ -996,7 +1295,7 @@ size_t WaitForRawDataTimeout(uint8_t *buffer, size_t len, size_t ms_timeout, boo
         msleep(ms_timeout);
     }
     SetCommunicationReceiveMode(false);
-    pos = __atomic_load_n(&comm_raw_pos, __ATOMIC_SEQ_CST);
+    pos = __atomic_load_n(&comms->comm_raw_pos, __ATOMIC_SEQ_CST);
     return pos;
 }
 
@@ -1011,6 +1310,7 @@ size_t WaitForRawDataTimeout(uint8_t *buffer, size_t len, size_t ms_timeout, boo
  * @return true if command was returned, otherwise false
  */
 bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms_timeout, bool show_warning) {
+    pm3_comms_t *comms = cur_comms();
 
     PacketResponseNG resp;
     // init to ZERO
@@ -1033,7 +1333,7 @@ bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms
     if (ms_timeout != (size_t) - 1)
         ms_timeout += communication_delay();
 
-    __atomic_store_n(&timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&comms->timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
 
     // Wait until the command is received
     while (true) {
@@ -1043,7 +1343,8 @@ bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms
             break;
         }
 
-        while (getReply(response)) {
+        // sleeps until a reply is stored
+        while (getReplyWait(response, replyWaitSlice(ms_timeout))) {
             if (cmd == CMD_UNKNOWN || response->cmd == cmd) {
                 return true;
             }
@@ -1057,7 +1358,7 @@ bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms
             }
         }
 
-        uint64_t tmp_clk = __atomic_load_n(&timeout_start_time, __ATOMIC_SEQ_CST);
+        uint64_t tmp_clk = __atomic_load_n(&comms->timeout_start_time, __ATOMIC_SEQ_CST);
         if ((ms_timeout != (size_t) - 1) && (msclock() - tmp_clk > ms_timeout)) {
             break;
         }
@@ -1067,8 +1368,6 @@ bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms
             PrintAndLogEx(INFO, "You can cancel this operation by pressing the pm3 button");
             show_warning = false;
         }
-        // just to avoid CPU busy loop:
-        msleep(1);
     }
     return false;
 }
@@ -1125,18 +1424,22 @@ bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint3
 
     switch (memtype) {
         case BIG_BUF: {
+            dlSinkArm(dest, bytes, CMD_DOWNLOADED_TRACE);
             SendCommandMIX(CMD_DOWNLOAD_TRACE, start_index, bytes, 0, NULL, 0);
             return dl_it(dest, bytes, response, ms_timeout, show_warning, CMD_DOWNLOADED_TRACE);
         }
         case BIG_BUF_EML: {
+            dlSinkArm(dest, bytes, CMD_DOWNLOADED_EMULATOR);
             SendCommandMIX(CMD_DOWNLOAD_EMULATOR, start_index, bytes, 0, NULL, 0);
             return dl_it(dest, bytes, response, ms_timeout, show_warning, CMD_DOWNLOADED_EMULATOR);
         }
         case SPIFFS: {
+            dlSinkArm(dest, bytes, CMD_SPIFFS_DOWNLOADED);
             SendCommandMIX(CMD_SPIFFS_DOWNLOAD, start_index, bytes, 0, data, datalen);
             return dl_it(dest, bytes, response, ms_timeout, show_warning, CMD_SPIFFS_DOWNLOADED);
         }
         case FLASH_MEM: {
+            dlSinkArm(dest, bytes, CMD_FLASHMEM_DOWNLOADED);
             SendCommandMIX(CMD_FLASHMEM_DOWNLOAD, start_index, bytes, 0, NULL, 0);
             return dl_it(dest, bytes, response, ms_timeout, show_warning, CMD_FLASHMEM_DOWNLOADED);
         }
@@ -1146,12 +1449,14 @@ bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint3
             return false;
         }
         case FPGA_MEM: {
+            dlSinkArm(dest, bytes, CMD_FPGAMEM_DOWNLOADED);
             SendCommandNG(CMD_FPGAMEM_DOWNLOAD, NULL, 0);
             return dl_it(dest, bytes, response, ms_timeout, show_warning, CMD_FPGAMEM_DOWNLOADED);
         }
         case MCU_FLASH:
         case MCU_MEM: {
             uint32_t flags = (memtype == MCU_MEM) ? READ_MEM_DOWNLOAD_FLAG_RAW : 0;
+            dlSinkArm(dest, bytes, CMD_READ_MEM_DOWNLOADED);
             SendCommandBL(CMD_READ_MEM_DOWNLOAD, start_index, bytes, flags, NULL, 0);
             return dl_it(dest, bytes, response, ms_timeout, show_warning, CMD_READ_MEM_DOWNLOADED);
         }
@@ -1160,49 +1465,38 @@ bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint3
 }
 
 static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, size_t ms_timeout, bool show_warning, uint32_t rec_cmd) {
+    pm3_comms_t *comms = cur_comms();
+
+    // the chunks (rec_cmd) are placed into dest by the communication thread, see dlSinkPlace()
+    (void) dest;
+    (void) rec_cmd;
 
-    uint32_t bytes_completed = 0;
-    __atomic_store_n(&timeout_start_time,  msclock(), __ATOMIC_SEQ_CST);
+    uint64_t dl_start = msclock();
+    __atomic_store_n(&comms->timeout_start_time,  dl_start, __ATOMIC_SEQ_CST);
 
     // Add delay depending on the communication channel & speed
     if (ms_timeout != (size_t) - 1)
         ms_timeout += communication_delay();
 
+    bool res = false;
     while (true) {
 
-        if (getReply(response)) {
+        // sleeps until a reply is stored
+        if (getReplyWait(response, replyWaitSlice(ms_timeout))) {
 
-            if (response->cmd == CMD_ACK)
-                return true;
+            if (response->cmd == CMD_ACK) {
+                res = true;
+                break;
+            }
             if (response->cmd == CMD_SPIFFS_DOWNLOAD && response->status == PM3_EMALLOC)
-                return false;
+                break;
             // Spiffs // fpgamem-plot download is converted to NG,
-            if (response->cmd == CMD_SPIFFS_DOWNLOAD || response->cmd == CMD_FPGAMEM_DOWNLOAD)
-                return true;
-
-            // sample_buf is a array pointer, located in data.c
-            // arg0 = offset in transfer. Startindex of this chunk
-            // arg1 = length bytes to transfer
-            // arg2 = bigbuff tracelength (?)
-            if (response->cmd == rec_cmd) {
-
-                uint32_t offset = response->oldarg[0];
-                uint32_t copy_bytes = MIN(bytes - bytes_completed, response->oldarg[1]);
-                //uint32_t tracelen = response->oldarg[2];
-
-                // extended bounds check1.  upper limit is PM3_CMD_DATA_SIZE
-                // shouldn't happen
-                copy_bytes = MIN(copy_bytes, PM3_CMD_DATA_SIZE);
-
-                // extended bounds check2.
-                if (offset + copy_bytes > bytes) {
-                    PrintAndLogEx(FAILED, "ERROR: Out of bounds when downloading from device,  offset %u | len %u | total len %u > buf_size %u", offset, copy_bytes,  offset + copy_bytes,  bytes);
-                    break;
-                }
+            if (response->cmd == CMD_SPIFFS_DOWNLOAD || response->cmd == CMD_FPGAMEM_DOWNLOAD) {
+                res = true;
+                break;
+            }
 
-                memcpy(dest + offset, response->data.asBytes, copy_bytes);
-                bytes_completed += copy_bytes;
-            } else if (response->cmd == CMD_WTX && response->length == sizeof(uint16_t)) {
+            if (response->cmd == CMD_WTX && response->length == sizeof(uint16_t)) {
                 uint16_t wtx = response->data.asDwords[0] & 0xFFFF;
                 PrintAndLogEx(DEBUG, "Got Waiting Time eXtension request %i ms", wtx);
                 if (ms_timeout != (size_t) - 1)
@@ -1210,7 +1504,14 @@ static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, siz
             }
         }
 
-        uint64_t tmp_clk = __atomic_load_n(&timeout_start_time, __ATOMIC_SEQ_CST);
+        pthread_mutex_lock(&comms->rxBufferMutex);
+        bool failed = comms->dl_sink.failed || comms->dl_sink.dropped;
+        pthread_mutex_unlock(&comms->rxBufferMutex);
+        if (failed) {
+            break;
+        }
+
+        uint64_t tmp_clk = __atomic_load_n(&comms->timeout_start_time, __ATOMIC_SEQ_CST);
         if (msclock() - tmp_clk > ms_timeout) {
             PrintAndLogEx(FAILED, "Timed out while trying to download data from device");
             break;
@@ -1223,5 +1524,29 @@ static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, siz
             show_warning = false;
         }
     }
-    return false;
+
+    dl_sink_t sink = dlSinkDisarm();
+    if (sink.failed) {
+        PrintAndLogEx(FAILED, "ERROR: Out of bounds when downloading from device,  offset %u | len %u | total len %u > buf_size %u"
+                      , sink.failed_offset
+                      , sink.failed_len
+                      , sink.failed_offset + sink.failed_len
+                      , bytes
+                     );
+        return false;
+    }
+    if (sink.dropped) {
+        PrintAndLogEx(FAILED, "ERROR: Command buffer overrun while downloading from device, %u replies dropped", sink.dropped);
+        return false;
+    }
+
+    uint64_t dl_time = msclock() - dl_start;
+    PrintAndLogEx(DEBUG, "Downloaded %u / %u bytes in %u packets, %" PRIu64 " ms ( %.1f kB/s )"
+                  , sink.completed
+                  , bytes
+                  , sink.packets
+                  , dl_time
+                  , (dl_time) ? (double)sink.completed / dl_time : 0.0
+                 );
+    return res;
 }
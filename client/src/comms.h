@@ -41,6 +41,7 @@ extern "C" {
 #endif
 
 //For storing command that are received from the device
+//When it is full new replies are dropped, the communication thread never waits for a reader
 #ifndef CMD_BUFFER_SIZE
 #define CMD_BUFFER_SIZE 100
 #endif
@@ -84,13 +85,31 @@ typedef struct {
     char serial_port_name[FILE_PATH_SIZE];
 } communication_arg_t;
 
-extern communication_arg_t g_conn;
+// state of the communication thread of a device, see comms.c
+typedef struct pm3_comms pm3_comms_t;
+
+struct lf_signal_ctx;
 
 typedef struct pm3_device {
-    communication_arg_t *g_conn;
+    communication_arg_t conn;
+    capabilities_t capabilities;
+    bool present;
+    pm3_comms_t *comms;
+    // LF signal buffers of the commands run on this device, NULL for the default ones. See pm3_console()
+    struct lf_signal_ctx *lf_ctx;
     int script_embedded;
 } pm3_device_t;
 
+// Each thread talks to the device bound to it with BindProxmark(), the session device if none.
+// SendCommand*, WaitForResponse*, GetFromDevice & co, g_conn and g_pm3_capabilities all
+// act on the device of the calling thread.
+pm3_device_t *CurrentProxmark(void);
+pm3_device_t *BindProxmark(pm3_device_t *dev);
+void FreeProxmark(pm3_device_t *dev);
+
+#define g_conn              (CurrentProxmark()->conn)
+#define g_pm3_capabilities  (CurrentProxmark()->capabilities)
+
 
 void *uart_reconnect(void *targ);
 
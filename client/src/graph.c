@@ -24,12 +24,11 @@
 #include "lfdemod.h"
 #include "cmddata.h"        // for g_debugmode
 #include "commonutil.h"     // Uint4bytetomemle
+#include "lfctx.h"
 
-int32_t g_GraphBuffer[MAX_GRAPH_TRACE_LEN];
 int32_t g_OperationBuffer[MAX_GRAPH_TRACE_LEN];
 int32_t g_OverlayBuffer[MAX_GRAPH_TRACE_LEN];
 bool    g_useOverlays = false;
-size_t  g_GraphTraceLen;
 buffer_savestate_t g_saveState_gb;
 marker_t g_MarkerA, g_MarkerB, g_MarkerC, g_MarkerD;
 marker_t *g_TempMarkers;
@@ -20,6 +20,7 @@
 #define GRAPH_H__
 
 #include "common.h"
+#include "lfdemod.h"        // signal_t
 
 #ifdef __cplusplus
 extern "C" {
@@ -71,6 +72,36 @@ size_t restore_buffer8(buffer_savestate_t saveState, uint8_t *dest);
 #define GRAPH_SAVE 1
 #define GRAPH_RESTORE 0
 
+// autocovariance per lag of the last correlated signal, see AutoCorrelate()
+typedef struct {
+    uint64_t hash;
+    size_t   len;
+    size_t   computed;   // lags 0 .. computed - 1 are valid
+    double   *autocv;
+} lf_autocorr_cache_t;
+
+// LF signal context, the graph / demod buffers of one signal and what was computed on them.
+// Each thread works on the context bound to it with lf_signal_ctx_bind(), the default context if none.
+// The default context holds the g_GraphBuffer / g_DemodBuffer globals, the ones the plot window shows.
+// LF demod code includes lfctx.h to work on the bound context through the same names.
+typedef struct lf_signal_ctx {
+    int32_t  *GraphBuffer;
+    size_t   *GraphTraceLen;
+    uint8_t  *DemodBuffer;
+    size_t   *DemodBufferLen;
+    int32_t  *DemodStartIdx;
+    int      *DemodClock;
+    signal_t signal;
+    lf_autocorr_cache_t autocorr;
+} lf_signal_ctx_t;
+
+lf_signal_ctx_t *lf_signal_ctx_new(void);
+void lf_signal_ctx_free(lf_signal_ctx_t *ctx);
+lf_signal_ctx_t *lf_signal_ctx_bind(lf_signal_ctx_t *ctx);
+bool lf_signal_ctx_is_default(void);
+
+extern __thread lf_signal_ctx_t *g_lf_ctx;
+
 extern int32_t g_GraphBuffer[MAX_GRAPH_TRACE_LEN];
 extern int32_t g_OperationBuffer[MAX_GRAPH_TRACE_LEN];
 extern int32_t g_OverlayBuffer[MAX_GRAPH_TRACE_LEN];
@@ -0,0 +1,542 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// Hitag2 key recovery from two nR/aR pairs, bitsliced CPU search
+//
+// In-client version of tools/hitag2crack/crack5, itself based on the HiTag2 Hell
+// CPU implementation from https://github.com/factoritbv/hitag2hell by FactorIT B.V.
+// Searches for states producing the first aR, reconstructs the key candidates and
+// tests them against the second nR/aR pair (ht2_try_state).
+//-----------------------------------------------------------------------------
+#include "hitag2_crack5.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "ui.h"                     // PrintAndLogEx
+#include "utils/util.h"             // num_CPUs, kbd_enter_pressed
+#include "util_posix.h"             // msclock, msleep
+#include "hitag2/hitag2_crypto.h"   // ht2_try_state
+
+#define HT2_BITSLICES    256
+#define HT2_VECTOR_SIZE  (HT2_BITSLICES / 8)
+
+// a layer 0 candidate fixes 20 state bits, the remaining 28 are searched per candidate
+#define HT2_LAYER0_BITS  20
+
+typedef unsigned int __attribute__((aligned(HT2_VECTOR_SIZE))) __attribute__((vector_size(HT2_VECTOR_SIZE))) bitslice_value_t;
+typedef union {
+    bitslice_value_t value;
+    uint64_t bytes64[HT2_BITSLICES / 64];
+    uint8_t bytes[HT2_BITSLICES / 8];
+} bitslice_t;
+
+#define i4(x,a,b,c,d) ((uint32_t)((((x)>>(a))&1)<<3)|(((x)>>(b))&1)<<2|(((x)>>(c))&1)<<1|(((x)>>(d))&1))
+#define ht2_layer0_f(state) ((0xdd3929b >> ( (((0x3c65 >> i4(state, 2, 3, 5, 6) ) & 1) <<4) \
+                                | ((( 0xee5 >> i4(state, 8,12,14,15) ) & 1) <<3) \
+                                | ((( 0xee5 >> i4(state,17,21,23,26) ) & 1) <<2) \
+                                | ((( 0xee5 >> i4(state,28,29,31,33) ) & 1) <<1) \
+                                | (((0x3c65 >> i4(state,34,43,44,46) ) & 1) ))) & 1)
+
+#define f_a_bs(a,b,c,d)       (~(((a|b)&c)^(a|d)^b)) // 6 ops
+#define f_b_bs(a,b,c,d)       (~(((d|c)&(a^b))^(d|a|b))) // 7 ops
+#define f_c_bs(a,b,c,d,e)     (~((((((c^e)|d)&a)^b)&(c^b))^(((d^e)|a)&((d^b)|c)))) // 13 ops
+
+// we never actually set or use the lowest 2 bits the initial state, so we save 2 bitslices everywhere
+#define S(n) (state[-2 + (n)].value)
+#define lfsr_bs(i) (S(i +  0) ^ S(i +  2) ^ S(i +  3) ^ S(i +  6) ^ S(i +  7) ^ S(i +  8) ^ S(i + 16) ^ S(i + 22) ^ \
+                    S(i + 23) ^ S(i + 26) ^ S(i + 30) ^ S(i + 41) ^ S(i + 42) ^ S(i + 43) ^ S(i + 46) ^ S(i + 47))
+#define bs_bit(i, on) ((on) ? bs_ones.value : bs_zeroes.value)
+#define bs_none(r) (((r).bytes64[0] | (r).bytes64[1] | (r).bytes64[2] | (r).bytes64[3]) == 0)
+
+static const uint8_t bits[9] = {20, 14, 4, 3, 1, 1, 1, 1, 1};
+static const size_t filter_pos[8] = {4, 7, 9, 13, 16, 18, 22, 24};
+
+typedef struct {
+    uint32_t uid;
+    uint32_t nR1;
+    uint32_t nR2;
+    uint32_t aR2;
+
+    bitslice_t keystream[32];
+    bitslice_t initial_bitslices[8];
+
+    uint64_t *candidates;
+    uint32_t count;
+    uint32_t limit;
+
+    uint32_t next;          // next layer 0 candidate to hand out
+    uint32_t searched;      // layer 0 candidates finished
+    uint32_t running;       // worker threads still running
+    bool stop;
+    bool found;
+    uint64_t key;
+} ht2_crack5_ctx_t;
+
+static bitslice_t bs_zeroes, bs_ones;
+
+static uint64_t expand(uint64_t mask, uint64_t value) {
+    uint64_t fill = 0;
+    for (uint64_t bit_index = 0; bit_index < 48; bit_index++) {
+        if (mask & 1) {
+            fill |= (value & 1) << bit_index;
+            value >>= 1;
+        }
+        mask >>= 1;
+    }
+    return fill;
+}
+
+static void bitslice(const uint64_t value, bitslice_t *restrict bitsliced_value, const size_t bit_len, bool reverse) {
+    for (size_t bit_idx = 0; bit_idx < bit_len; bit_idx++) {
+        bool bit;
+        if (reverse) {
+            bit = (value >> (bit_len - 1 - bit_idx)) & 1;
+        } else {
+            bit = (value >> bit_idx) & 1;
+        }
+        bitsliced_value[bit_idx].value = bs_bit(bit_idx, bit);
+    }
+}
+
+static uint64_t unbitslice(const bitslice_t *restrict b, const uint8_t s, const uint8_t n) {
+    uint64_t result = 0;
+    for (uint8_t i = 0; i < n; ++i) {
+        result <<= 1;
+        result |= (b[n - 1 - i].bytes64[s >> 6] >> (s & 0x3f)) & 1;
+    }
+    return result;
+}
+
+// search the 2^28 states of one layer 0 candidate
+static bool ht2_crack5_candidate(ht2_crack5_ctx_t *ctx, uint64_t state0) {
+
+    bitslice_t state[-2 + 32 + 48];
+    const bitslice_t *keystream = ctx->keystream;
+
+    bitslice(state0 >> 2, &state[0], 46, false);
+
+    for (size_t bit = 0; bit < 8; bit++) {
+        state[-2 + filter_pos[bit]] = ctx->initial_bitslices[bit];
+    }
+
+    for (uint16_t i1 = 0; i1 < (1 << (bits[1] + 1) >> 8); i1++) {
+        S(27) = bs_bit(27, i1 & 0x1);
+        S(30) = bs_bit(30, i1 & 0x2);
+        S(32) = bs_bit(32, i1 & 0x4);
+        S(35) = bs_bit(35, i1 & 0x8);
+        S(45) = bs_bit(45, i1 & 0x10);
+        S(47) = bs_bit(47, i1 & 0x20);
+        S(48) = bs_bit(48, i1 & 0x40); // guess lfsr output 0
+        // 0xfc07fef3f9fe
+        const bitslice_value_t filter1_0 = f_a_bs(S(3), S(4), S(6), S(7));
+        const bitslice_value_t filter1_1 = f_b_bs(S(9), S(13), S(15), S(16));
+        const bitslice_value_t filter1_2 = f_b_bs(S(18), S(22), S(24), S(27));
+        const bitslice_value_t filter1_3 = f_b_bs(S(29), S(30), S(32), S(34));
+        const bitslice_value_t filter1_4 = f_a_bs(S(35), S(44), S(45), S(47));
+        const bitslice_value_t filter1 = f_c_bs(filter1_0, filter1_1, filter1_2, filter1_3, filter1_4);
+        bitslice_t results1;
+        results1.value = filter1 ^ keystream[1].value;
+        if (bs_none(results1)) {
+            continue;
+        }
+
+        const bitslice_value_t filter2_0 = f_a_bs(S(4), S(5), S(7), S(8));
+        const bitslice_value_t filter2_3 = f_b_bs(S(30), S(31), S(33), S(35));
+        const bitslice_value_t filter3_0 = f_a_bs(S(5), S(6), S(8), S(9));
+        const bitslice_value_t filter5_2 = f_b_bs(S(22), S(26), S(28), S(31));
+        const bitslice_value_t filter6_2 = f_b_bs(S(23), S(27), S(29), S(32));
+        const bitslice_value_t filter7_2 = f_b_bs(S(24), S(28), S(30), S(33));
+        const bitslice_value_t filter9_1 = f_b_bs(S(17), S(21), S(23), S(24));
+        const bitslice_value_t filter9_2 = f_b_bs(S(26), S(30), S(32), S(35));
+        const bitslice_value_t filter10_0 = f_a_bs(S(12), S(13), S(15), S(16));
+        const bitslice_value_t filter11_0 = f_a_bs(S(13), S(14), S(16), S(17));
+        const bitslice_value_t filter12_0 = f_a_bs(S(14), S(15), S(17), S(18));
+
+        for (uint16_t i2 = 0; i2 < (1 << (bits[2] + 1)); i2++) {
+            S(10) = bs_bit(10, i2 & 0x1);
+            S(19) = bs_bit(19, i2 & 0x2);
+            S(25) = bs_bit(25, i2 & 0x4);
+            S(36) = bs_bit(36, i2 & 0x8);
+            S(49) = bs_bit(49, i2 & 0x10); // guess lfsr output 1
+            // 0xfe07fffbfdff
+            const bitslice_value_t filter2_1 = f_b_bs(S(10), S(14), S(16), S(17));
+            const bitslice_value_t filter2_2 = f_b_bs(S(19), S(23), S(25), S(28));
+            const bitslice_value_t filter2_4 = f_a_bs(S(36), S(45), S(46), S(48));
+            const bitslice_value_t filter2 = f_c_bs(filter2_0, filter2_1, filter2_2, filter2_3, filter2_4);
+            bitslice_t results2;
+            results2.value = results1.value & (filter2 ^ keystream[2].value);
+            if (bs_none(results2)) {
+                continue;
+            }
+
+            S(50) = lfsr_bs(2);
+            const bitslice_value_t filter3_3 = f_b_bs(S(31), S(32), S(34), S(36));
+            const bitslice_value_t filter4_0 = f_a_bs(S(6), S(7), S(9), S(10));
+            const bitslice_value_t filter4_1 = f_b_bs(S(12), S(16), S(18), S(19));
+            const bitslice_value_t filter4_2 = f_b_bs(S(21), S(25), S(27), S(30));
+            const bitslice_value_t filter7_0 = f_a_bs(S(9), S(10), S(12), S(13));
+            const bitslice_value_t filter7_1 = f_b_bs(S(15), S(19), S(21), S(22));
+            const bitslice_value_t filter8_2 = f_b_bs(S(25), S(29), S(31), S(34));
+            const bitslice_value_t filter10_1 = f_b_bs(S(18), S(22), S(24), S(25));
+            const bitslice_value_t filter10_2 = f_b_bs(S(27), S(31), S(33), S(36));
+            const bitslice_value_t filter11_1 = f_b_bs(S(19), S(23), S(25), S(26));
+
+            for (uint8_t i3 = 0; i3 < (1 << bits[3]); i3++) {
+                S(11) = bs_bit(11, i3 & 0x1);
+                S(20) = bs_bit(20, i3 & 0x2);
+                S(37) = bs_bit(37, i3 & 0x4);
+                // 0xff07ffffffff
+                const bitslice_value_t filter3_1 = f_b_bs(S(11), S(15), S(17), S(18));
+                const bitslice_value_t filter3_2 = f_b_bs(S(20), S(24), S(26), S(29));
+                const bitslice_value_t filter3_4 = f_a_bs(S(37), S(46), S(47), S(49));
+                const bitslice_value_t filter3 = f_c_bs(filter3_0, filter3_1, filter3_2, filter3_3, filter3_4);
+                bitslice_t results3;
+                results3.value = results2.value & (filter3 ^ keystream[3].value);
+                if (bs_none(results3)) {
+                    continue;
+                }
+
+                S(51) = lfsr_bs(3);
+                S(52) = lfsr_bs(4);
+                S(53) = lfsr_bs(5);
+                S(54) = lfsr_bs(6);
+                S(55) = lfsr_bs(7);
+                const bitslice_value_t filter4_3 = f_b_bs(S(32), S(33), S(35), S(37));
+                const bitslice_value_t filter5_0 = f_a_bs(S(7), S(8), S(10), S(11));
+                const bitslice_value_t filter5_1 = f_b_bs(S(13), S(17), S(19), S(20));
+                const bitslice_value_t filter6_0 = f_a_bs(S(8), S(9), S(11), S(12));
+                const bitslice_value_t filter6_1 = f_b_bs(S(14), S(18), S(20), S(21));
+                const bitslice_value_t filter8_0 = f_a_bs(S(10), S(11), S(13), S(14));
+                const bitslice_value_t filter8_1 = f_b_bs(S(16), S(20), S(22), S(23));
+                const bitslice_value_t filter9_0 = f_a_bs(S(11), S(12), S(14), S(15));
+                const bitslice_value_t filter9_4 = f_a_bs(S(43), S(52), S(53), S(55));
+                const bitslice_value_t filter11_2 = f_b_bs(S(28), S(32), S(34), S(37));
+                const bitslice_value_t filter12_1 = f_b_bs(S(20), S(24), S(26), S(27));
+
+                for (uint8_t i4 = 0; i4 < (1 << bits[4]); i4++) {
+                    S(38) = bs_bit(38, i4 & 0x1);
+                    // 0xff87ffffffff
+                    const bitslice_value_t filter4_4 = f_a_bs(S(38), S(47), S(48), S(50));
+                    const bitslice_value_t filter4 = f_c_bs(filter4_0, filter4_1, filter4_2, filter4_3, filter4_4);
+                    bitslice_t results4;
+                    results4.value = results3.value & (filter4 ^ keystream[4].value);
+                    if (bs_none(results4)) {
+                        continue;
+                    }
+
+                    S(56) = lfsr_bs(8);
+                    const bitslice_value_t filter5_3 = f_b_bs(S(33), S(34), S(36), S(38));
+                    const bitslice_value_t filter10_4 = f_a_bs(S(44), S(53), S(54), S(56));
+                    const bitslice_value_t filter12_2 = f_b_bs(S(29), S(33), S(35), S(38));
+
+                    for (uint8_t i5 = 0; i5 < (1 << bits[5]); i5++) {
+                        S(39) = bs_bit(39, i5 & 0x1);
+                        // 0xffc7ffffffff
+                        const bitslice_value_t filter5_4 = f_a_bs(S(39), S(48), S(49), S(51));
+                        const bitslice_value_t filter5 = f_c_bs(filter5_0, filter5_1, filter5_2, filter5_3, filter5_4);
+                        bitslice_t results5;
+                        results5.value = results4.value & (filter5 ^ keystream[5].value);
+                        if (bs_none(results5)) {
+                            continue;
+                        }
+
+                        S(57) = lfsr_bs(9);
+                        const bitslice_value_t filter6_3 = f_b_bs(S(34), S(35), S(37), S(39));
+                        const bitslice_value_t filter11_4 = f_a_bs(S(45), S(54), S(55), S(57));
+
+                        for (uint8_t i6 = 0; i6 < (1 << bits[6]); i6++) {
+                            S(40) = bs_bit(40, i6 & 0x1);
+                            // 0xffe7ffffffff
+                            const bitslice_value_t filter6_4 = f_a_bs(S(40), S(49), S(50), S(52));
+                            const bitslice_value_t filter6 = f_c_bs(filter6_0, filter6_1, filter6_2, filter6_3, filter6_4);
+                            bitslice_t results6;
+                            results6.value = results5.value & (filter6 ^ keystream[6].value);
+                            if (bs_none(results6)) {
+                                continue;
+                            }
+
+                            S(58) = lfsr_bs(10);
+                            const bitslice_value_t filter7_3 = f_b_bs(S(35), S(36), S(38), S(40));
+                            const bitslice_value_t filter12_4 = f_a_bs(S(46), S(55), S(56), S(58));
+
+                            for (uint8_t i7 = 0; i7 < (1 << bits[7]); i7++) {
+                                S(41) = bs_bit(41, i7 & 0x1);
+                                // 0xfff7ffffffff
+                                const bitslice_value_t filter7_4 = f_a_bs(S(41), S(50), S(51), S(53));
+                                const bitslice_value_t filter7 = f_c_bs(filter7_0, filter7_1, filter7_2, filter7_3, filter7_4);
+                                bitslice_t results7;
+                                results7.value = results6.value & (filter7 ^ keystream[7].value);
+                                if (bs_none(results7)) {
+                                    continue;
+                                }
+
+                                S(59) = lfsr_bs(11);
+                                const bitslice_value_t filter8_3 = f_b_bs(S(36), S(37), S(39), S(41));
+                                const bitslice_value_t filter10_3 = f_b_bs(S(38), S(39), S(41), S(43));
+                                const bitslice_value_t filter12_3 = f_b_bs(S(40), S(41), S(43), S(45));
+
+                                for (uint8_t i8 = 0; i8 < (1 << bits[8]); i8++) {
+                                    S(42) = bs_bit(42, i8 & 0x1);
+                                    // 0xffffffffffff
+                                    const bitslice_value_t filter8_4 = f_a_bs(S(42), S(51), S(52), S(54));
+                                    const bitslice_value_t filter8 = f_c_bs(filter8_0, filter8_1, filter8_2, filter8_3, filter8_4);
+                                    bitslice_t results8;
+                                    results8.value = results7.value & (filter8 ^ keystream[8].value);
+                                    if (bs_none(results8)) {
+                                        continue;
+                                    }
+
+                                    const bitslice_value_t filter9_3 = f_b_bs(S(37), S(38), S(40), S(42));
+                                    const bitslice_value_t filter9 = f_c_bs(filter9_0, filter9_1, filter9_2, filter9_3, filter9_4);
+                                    results8.value &= (filter9 ^ keystream[9].value);
+                                    if (bs_none(results8)) {
+                                        continue;
+                                    }
+
+                                    const bitslice_value_t filter10 = f_c_bs(filter10_0, filter10_1, filter10_2, filter10_3, filter10_4);
+                                    results8.value &= (filter10 ^ keystream[10].value);
+                                    if (bs_none(results8)) {
+                                        continue;
+                                    }
+
+                                    const bitslice_value_t filter11_3 = f_b_bs(S(39), S(40), S(42), S(44));
+                                    const bitslice_value_t filter11 = f_c_bs(filter11_0, filter11_1, filter11_2, filter11_3, filter11_4);
+                                    results8.value &= (filter11 ^ keystream[11].value);
+                                    if (bs_none(results8)) {
+                                        continue;
+                                    }
+
+                                    const bitslice_value_t filter12 = f_c_bs(filter12_0, filter12_1, filter12_2, filter12_3, filter12_4);
+                                    results8.value &= (filter12 ^ keystream[12].value);
+                                    if (bs_none(results8)) {
+                                        continue;
+                                    }
+
+                                    // from here on all state bits are known, every filter has the same shape
+                                    bool alive = true;
+                                    for (uint8_t i = 13; i < 32; i++) {
+                                        if (i > 13) {
+                                            S(i + 46) = lfsr_bs(i - 2);
+                                        }
+                                        const bitslice_value_t filter = f_c_bs(
+                                                                            f_a_bs(S(i + 2), S(i + 3), S(i + 5), S(i + 6)),
+                                                                            f_b_bs(S(i + 8), S(i + 12), S(i + 14), S(i + 15)),
+                                                                            f_b_bs(S(i + 17), S(i + 21), S(i + 23), S(i + 26)),
+                                                                            f_b_bs(S(i + 28), S(i + 29), S(i + 31), S(i + 33)),
+                                                                            f_a_bs(S(i + 34), S(i + 43), S(i + 44), S(i + 46))
+                                                                        );
+                                        results8.value &= (filter ^ keystream[i].value);
+                                        if (bs_none(results8)) {
+                                            alive = false;
+                                            break;
+                                        }
+                                    }
+
+                                    if (alive == false) {
+                                        continue;
+                                    }
+
+                                    for (size_t r = 0; r < HT2_BITSLICES; r++) {
+                                        if (((results8.bytes64[r >> 6] >> (r & 0x3f)) & 1) == 0) {
+                                            continue;
+                                        }
+
+                                        // take the state from layer 2, ht2_try_state recovers the lowest 2 bits by inverting the LFSR
+                                        uint64_t state31 = unbitslice(&state[-2 + 2], r, 48);
+                                        uint64_t key = 0;
+                                        if (ht2_try_state(state31, ctx->uid, ctx->aR2, ctx->nR1, ctx->nR2, &key) == PM3_SUCCESS) {
+                                            ctx->key = key;
+                                            return true;
+                                        }
+                                    }
+                                } // 8
+                            } // 7
+                        } // 6
+                    } // 5
+                } // 4
+            } // 3
+        } // 2
+    } // 1
+    return false;
+}
+
+static void *ht2_crack5_worker(void *arg) {
+    ht2_crack5_ctx_t *ctx = (ht2_crack5_ctx_t *)arg;
+
+    uint32_t idx;
+    while ((idx = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED)) < ctx->limit) {
+
+        if (__atomic_load_n(&ctx->stop, __ATOMIC_RELAXED)) {
+            break;
+        }
+
+        if (ht2_crack5_candidate(ctx, ctx->candidates[idx])) {
+            __atomic_store_n(&ctx->found, true, __ATOMIC_SEQ_CST);
+            __atomic_store_n(&ctx->stop, true, __ATOMIC_SEQ_CST);
+        }
+
+        __atomic_fetch_add(&ctx->searched, 1, __ATOMIC_RELAXED);
+    }
+
+    __atomic_fetch_sub(&ctx->running, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+int ht2_crack5(uint32_t uid, const uint32_t nr[2], const uint32_t ar[2], const ht2_crack5_opt_t *opt, uint8_t *key, ht2_crack5_stats_t *stats) {
+
+    ht2_crack5_ctx_t *ctx = calloc(1, sizeof(ht2_crack5_ctx_t));
+    if (ctx == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+
+    ctx->candidates = calloc(1 << HT2_LAYER0_BITS, sizeof(uint64_t));
+    if (ctx->candidates == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        free(ctx);
+        return PM3_EMALLOC;
+    }
+
+    memset(bs_ones.bytes, 0xff, HT2_VECTOR_SIZE);
+    memset(bs_zeroes.bytes, 0x00, HT2_VECTOR_SIZE);
+
+    ctx->uid = uid;
+    ctx->nR1 = nr[0];
+    ctx->nR2 = nr[1];
+    ctx->aR2 = ar[1];
+
+    // bitslice inverse target bits
+    uint32_t target = ~ar[0];
+    bitslice(~target, ctx->keystream, 32, true);
+
+    // bitslice all possible 256 values in the lowest 8 bits
+    memset(ctx->initial_bitslices[0].bytes, 0xaa, HT2_VECTOR_SIZE);
+    memset(ctx->initial_bitslices[1].bytes, 0xcc, HT2_VECTOR_SIZE);
+    memset(ctx->initial_bitslices[2].bytes, 0xf0, HT2_VECTOR_SIZE);
+    size_t interval = 1;
+    for (size_t bit = 3; bit < 8; bit++) {
+        for (size_t byte = 0; byte < HT2_VECTOR_SIZE;) {
+            for (size_t length = 0; length < interval; length++) {
+                ctx->initial_bitslices[bit].bytes[byte++] = 0x00;
+            }
+            for (size_t length = 0; length < interval; length++) {
+                ctx->initial_bitslices[bit].bytes[byte++] = 0xff;
+            }
+        }
+        interval <<= 1;
+    }
+
+    // compute layer 0 output
+    for (uint32_t i0 = 0; i0 < (1 << HT2_LAYER0_BITS); i0++) {
+        uint64_t state0 = expand(0x5806b4a2d16c, i0);
+        if (ht2_layer0_f(state0) == (target >> 31)) {
+            ctx->candidates[ctx->count++] = state0;
+        }
+    }
+
+    ctx->limit = ctx->count;
+    if (opt->limit && opt->limit < ctx->count) {
+        ctx->limit = opt->limit;
+    }
+
+    uint32_t thread_count = (opt->threads) ? opt->threads : num_CPUs();
+    pthread_t *threads = calloc(thread_count, sizeof(pthread_t));
+    if (threads == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        free(ctx->candidates);
+        free(ctx);
+        return PM3_EMALLOC;
+    }
+
+    if (opt->verbose) {
+        PrintAndLogEx(INFO, "Searching " _YELLOW_("%u") " layer 0 candidates using " _YELLOW_("%u") " threads", ctx->limit, thread_count);
+        PrintAndLogEx(INFO, "press " _GREEN_("<Enter>") " to abort");
+    }
+
+    uint64_t t1 = msclock();
+
+    uint32_t started = 0;
+    ctx->running = thread_count;
+    for (; started < thread_count; started++) {
+        if (pthread_create(&threads[started], NULL, ht2_crack5_worker, (void *)ctx)) {
+            PrintAndLogEx(WARNING, "Failed to create pthreads. Quitting");
+            __atomic_fetch_sub(&ctx->running, thread_count - started, __ATOMIC_SEQ_CST);
+            __atomic_store_n(&ctx->stop, true, __ATOMIC_SEQ_CST);
+            break;
+        }
+    }
+
+    bool aborted = false;
+    uint64_t last = t1;
+    while (__atomic_load_n(&ctx->running, __ATOMIC_SEQ_CST)) {
+
+        msleep(50);
+
+        if (opt->verbose == false) {
+            continue;
+        }
+
+        if (kbd_enter_pressed()) {
+            aborted = true;
+            __atomic_store_n(&ctx->stop, true, __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        uint64_t now = msclock();
+        if (now - last >= 1000) {
+            last = now;
+            uint32_t searched = __atomic_load_n(&ctx->searched, __ATOMIC_RELAXED);
+            uint64_t elapsed = now - t1;
+            uint64_t eta = (searched) ? ((uint64_t)(ctx->limit - searched) * elapsed / searched) / 1000 : 0;
+            PrintAndLogEx(INPLACE, "%5.1f%%  %u / %u candidates  " _YELLOW_("%.0f") " M states/s  worst case %" PRIu64 "s left"
+                          , (float)searched * 100 / ctx->limit
+                          , searched
+                          , ctx->limit
+                          , (double)searched * (1 << (48 - HT2_LAYER0_BITS)) / elapsed / 1000
+                          , eta
+                         );
+        }
+    }
+
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    if (opt->verbose) {
+        PrintAndLogEx(NORMAL, "");
+    }
+
+    if (stats) {
+        stats->candidates = ctx->count;
+        stats->searched = ctx->searched;
+        stats->ms = msclock() - t1;
+    }
+
+    int res = PM3_ESOFT;
+    if (ctx->found) {
+        for (int i = 0; i < 6; i++) {
+            key[i] = (ctx->key >> (8 * i)) & 0xFF;
+        }
+        res = PM3_SUCCESS;
+    } else if (aborted) {
+        res = PM3_EOPABORTED;
+    }
+
+    free(threads);
+    free(ctx->candidates);
+    free(ctx);
+    return res;
+}
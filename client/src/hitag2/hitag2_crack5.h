@@ -0,0 +1,40 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// Hitag2 key recovery from two nR/aR pairs, bitsliced CPU search
+//-----------------------------------------------------------------------------
+#ifndef HITAG2_CRACK5_H__
+#define HITAG2_CRACK5_H__
+
+#include "common.h"
+
+typedef struct {
+    uint32_t threads;       // worker threads, 0 = one per CPU
+    uint32_t limit;         // stop after this many layer 0 candidates, 0 = search all (benchmark)
+    bool verbose;           // show progress and allow aborting with <Enter>
+} ht2_crack5_opt_t;
+
+typedef struct {
+    uint32_t candidates;    // layer 0 candidates in the search space
+    uint32_t searched;      // layer 0 candidates searched
+    uint64_t ms;            // time spent searching
+} ht2_crack5_stats_t;
+
+// uid, nR and aR use the same bit order as `lf hitag lookup`.
+// Returns PM3_SUCCESS and the key as 6 bytes (same order as dictionaries) when found,
+// PM3_ESOFT when the search space was exhausted, PM3_EOPABORTED when aborted.
+int ht2_crack5(uint32_t uid, const uint32_t nr[2], const uint32_t ar[2], const ht2_crack5_opt_t *opt, uint8_t *key, ht2_crack5_stats_t *stats);
+
+#endif
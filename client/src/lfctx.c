@@ -0,0 +1,92 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// LF signal contexts
+//-----------------------------------------------------------------------------
+#include "graph.h"
+#include <stdlib.h>
+#include "lfdemod.h"
+#include "cmddata.h"        // MAX_DEMOD_BUF_LEN
+
+// the buffers of the default context
+int32_t g_GraphBuffer[MAX_GRAPH_TRACE_LEN];
+size_t  g_GraphTraceLen;
+uint8_t g_DemodBuffer[MAX_DEMOD_BUF_LEN] = { 0x00 };
+size_t  g_DemodBufferLen = 0;
+int32_t g_DemodStartIdx = 0;
+int     g_DemodClock = 0;
+
+static lf_signal_ctx_t lf_default_ctx = {
+    .GraphBuffer = g_GraphBuffer,
+    .GraphTraceLen = &g_GraphTraceLen,
+    .DemodBuffer = g_DemodBuffer,
+    .DemodBufferLen = &g_DemodBufferLen,
+    .DemodStartIdx = &g_DemodStartIdx,
+    .DemodClock = &g_DemodClock,
+};
+
+__thread lf_signal_ctx_t *g_lf_ctx = &lf_default_ctx;
+
+// a context made by lf_signal_ctx_new() carries its own buffers
+typedef struct {
+    lf_signal_ctx_t ctx;
+    int32_t GraphBuffer[MAX_GRAPH_TRACE_LEN];
+    size_t  GraphTraceLen;
+    uint8_t DemodBuffer[MAX_DEMOD_BUF_LEN];
+    size_t  DemodBufferLen;
+    int32_t DemodStartIdx;
+    int     DemodClock;
+} lf_signal_ctx_storage_t;
+
+lf_signal_ctx_t *lf_signal_ctx_new(void) {
+    lf_signal_ctx_storage_t *s = calloc(1, sizeof(lf_signal_ctx_storage_t));
+    if (s == NULL) {
+        return NULL;
+    }
+    s->ctx.GraphBuffer = s->GraphBuffer;
+    s->ctx.GraphTraceLen = &s->GraphTraceLen;
+    s->ctx.DemodBuffer = s->DemodBuffer;
+    s->ctx.DemodBufferLen = &s->DemodBufferLen;
+    s->ctx.DemodStartIdx = &s->DemodStartIdx;
+    s->ctx.DemodClock = &s->DemodClock;
+    s->ctx.signal = (signal_t) { 255, -255, 0, 0, true };
+    return &s->ctx;
+}
+
+void lf_signal_ctx_free(lf_signal_ctx_t *ctx) {
+    if (ctx == NULL || ctx == &lf_default_ctx) {
+        return;
+    }
+    if (g_lf_ctx == ctx) {
+        lf_signal_ctx_bind(NULL);
+    }
+    free(ctx->autocorr.autocv);
+    free(ctx);
+}
+
+// bind a signal context to the calling thread, NULL for the default context.
+// Returns the previously bound context
+lf_signal_ctx_t *lf_signal_ctx_bind(lf_signal_ctx_t *ctx) {
+    lf_signal_ctx_t *prev = g_lf_ctx;
+    g_lf_ctx = (ctx) ? ctx : &lf_default_ctx;
+    // the default context uses the signal properties of lfdemod
+    setSignalProperties((g_lf_ctx != &lf_default_ctx) ? &g_lf_ctx->signal : NULL);
+    return prev;
+}
+
+// only the default context is shown in the graph window
+bool lf_signal_ctx_is_default(void) {
+    return g_lf_ctx == &lf_default_ctx;
+}
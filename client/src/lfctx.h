@@ -0,0 +1,36 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// Graph / demod buffers of the LF signal context bound to the calling thread
+//
+// Only for .c files with demod code that can run on another context than the
+// default one, e.g. in `lf search --dir` workers. Include it last, after
+// graph.h and cmddata.h, and keep it out of headers.
+//-----------------------------------------------------------------------------
+
+#ifndef LFCTX_H__
+#define LFCTX_H__
+
+#include "graph.h"
+#include "cmddata.h"
+
+#define g_GraphBuffer    (g_lf_ctx->GraphBuffer)
+#define g_GraphTraceLen  (*g_lf_ctx->GraphTraceLen)
+#define g_DemodBuffer    (g_lf_ctx->DemodBuffer)
+#define g_DemodBufferLen (*g_lf_ctx->DemodBufferLen)
+#define g_DemodStartIdx  (*g_lf_ctx->DemodStartIdx)
+#define g_DemodClock     (*g_lf_ctx->DemodClock)
+
+#endif
@@ -0,0 +1,455 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// Precomputed iCLASS dictionary key tables
+//
+// Diversifying a dictionary key for a CSN is, for every key,
+//   standard:  DES key schedule of the key, DES(CSN), hash0
+//   elite:     hash2 of the key (16 DES and 9 key schedules), hash1(CSN) selection,
+//              then the standard diversification of the selected key
+// The parts that only depend on the key (the DES key schedule, the hash2 key table)
+// are kept per dictionary in one file, which later runs memory map.
+//
+// layout:  header | entries[count], in dictionary order
+//-----------------------------------------------------------------------------
+#include "iclass_keycache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mbedtls/des.h"
+#include "crc64.h"
+#include "proxmark3.h"          // get_my_user_directory
+#include "ui.h"
+#include "utils/util.h"         // num_CPUs
+#include "loclass/cipherutils.h"
+#include "loclass/elite_crack.h"
+#include "loclass/ikeys.h"
+
+#define KEYCACHE_MAGIC          "PM3ICKT"
+#define KEYCACHE_VERSION        1
+#define KEYCACHE_SUFFIX         ".keytable"
+#define KEYCACHE_DATA_SIZE      128
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t elite;
+    uint32_t entry_size;
+    uint32_t count;
+    uint64_t dict_crc;
+    uint64_t file_size;
+} PACKED keycache_header_t;
+
+// standard: DES encryption subkeys (mbedtls_des_context.sk), elite: hash2 key table
+typedef struct {
+    uint8_t key[8];
+    uint8_t data[KEYCACHE_DATA_SIZE];
+} PACKED keycache_entry_t;
+
+struct iclass_keycache {
+    uint8_t *data;
+    size_t size;
+    bool mapped;
+    bool elite;
+    uint32_t count;
+    const keycache_entry_t *entries;
+};
+
+typedef struct {
+    uint8_t key[8];
+    uint32_t idx;
+} keycache_index_t;
+
+typedef struct {
+    size_t thread_idx;
+    size_t thread_cnt;
+    bool elite;
+    const uint32_t *todo;
+    uint32_t todo_cnt;
+    keycache_entry_t *entries;
+} keycache_thread_arg_t;
+
+static int cmp_index(const void *a, const void *b) {
+    return memcmp(((const keycache_index_t *)a)->key, ((const keycache_index_t *)b)->key, 8);
+}
+
+static void keycache_free_data(iclass_keycache_t *kc) {
+    if (kc->data == NULL) {
+        return;
+    }
+#if !defined(_WIN32)
+    if (kc->mapped) {
+        munmap(kc->data, kc->size);
+    } else
+#endif
+        free(kc->data);
+    kc->data = NULL;
+    kc->size = 0;
+}
+
+static bool keycache_check(const iclass_keycache_t *kc) {
+    if (kc->size < sizeof(keycache_header_t)) {
+        return false;
+    }
+    const keycache_header_t *hdr = (const keycache_header_t *)kc->data;
+    return (memcmp(hdr->magic, KEYCACHE_MAGIC, sizeof(hdr->magic)) == 0) &&
+           (hdr->version == KEYCACHE_VERSION) &&
+           (hdr->elite == kc->elite) &&
+           (hdr->entry_size == sizeof(keycache_entry_t)) &&
+           (hdr->file_size == kc->size) &&
+           (sizeof(keycache_header_t) + (uint64_t)hdr->count * sizeof(keycache_entry_t) == kc->size);
+}
+
+static int keycache_map(const char *path, iclass_keycache_t *kc) {
+#if defined(_WIN32)
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return PM3_EFILE;
+    }
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    rewind(f);
+    if (fsize <= 0) {
+        fclose(f);
+        return PM3_EFILE;
+    }
+
+    kc->data = calloc(fsize, sizeof(uint8_t));
+    if (kc->data == NULL) {
+        fclose(f);
+        return PM3_EMALLOC;
+    }
+    kc->size = fsize;
+    kc->mapped = false;
+
+    if (fread(kc->data, 1, fsize, f) != (size_t)fsize) {
+        fclose(f);
+        keycache_free_data(kc);
+        return PM3_EFILE;
+    }
+    fclose(f);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return PM3_EFILE;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size <= 0) {
+        close(fd);
+        return PM3_EFILE;
+    }
+
+    uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return PM3_EFILE;
+    }
+    kc->data = data;
+    kc->size = st.st_size;
+    kc->mapped = true;
+#endif
+
+    if (keycache_check(kc) == false) {
+        keycache_free_data(kc);
+        return PM3_ESOFT;
+    }
+    return PM3_SUCCESS;
+}
+
+static void keycache_compute(bool elite, keycache_entry_t *e) {
+    if (elite) {
+        hash2(e->key, e->data);
+    } else {
+        mbedtls_des_context ctx;
+        mbedtls_des_setkey_enc(&ctx, e->key);
+        memcpy(e->data, ctx.sk, KEYCACHE_DATA_SIZE);
+    }
+}
+
+static void *keycache_thread(void *thread_arg) {
+    keycache_thread_arg_t *targ = (keycache_thread_arg_t *)thread_arg;
+    for (uint32_t i = targ->thread_idx; i < targ->todo_cnt; i += targ->thread_cnt) {
+        keycache_compute(targ->elite, &targ->entries[targ->todo[i]]);
+    }
+    return NULL;
+}
+
+static int keycache_build(const iclass_keycache_t *old, const uint8_t *keys, uint32_t keycnt, uint64_t dict_crc, bool elite, uint8_t **pdata, size_t *psize) {
+
+    size_t size = sizeof(keycache_header_t) + (size_t)keycnt * sizeof(keycache_entry_t);
+    uint8_t *data = calloc(size, sizeof(uint8_t));
+    uint32_t *todo = calloc(keycnt, sizeof(uint32_t));
+    keycache_index_t *index = NULL;
+    uint32_t oldcnt = (old != NULL) ? old->count : 0;
+    if (oldcnt) {
+        index = calloc(oldcnt, sizeof(keycache_index_t));
+    }
+
+    if (data == NULL || todo == NULL || (oldcnt && index == NULL)) {
+        free(data);
+        free(todo);
+        free(index);
+        return PM3_EMALLOC;
+    }
+
+    keycache_header_t *hdr = (keycache_header_t *)data;
+    memcpy(hdr->magic, KEYCACHE_MAGIC, sizeof(hdr->magic));
+    hdr->version = KEYCACHE_VERSION;
+    hdr->elite = elite;
+    hdr->entry_size = sizeof(keycache_entry_t);
+    hdr->count = keycnt;
+    hdr->dict_crc = dict_crc;
+    hdr->file_size = size;
+
+    // entries of the previous table, sorted on the key
+    for (uint32_t i = 0; i < oldcnt; i++) {
+        memcpy(index[i].key, old->entries[i].key, 8);
+        index[i].idx = i;
+    }
+    if (oldcnt) {
+        qsort(index, oldcnt, sizeof(keycache_index_t), cmp_index);
+    }
+
+    keycache_entry_t *entries = (keycache_entry_t *)(data + sizeof(keycache_header_t));
+    uint32_t todo_cnt = 0;
+    for (uint32_t i = 0; i < keycnt; i++) {
+        memcpy(entries[i].key, keys + (8 * i), 8);
+
+        keycache_index_t lookup;
+        memcpy(lookup.key, entries[i].key, 8);
+        keycache_index_t *item = (oldcnt) ? bsearch(&lookup, index, oldcnt, sizeof(keycache_index_t), cmp_index) : NULL;
+        if (item != NULL) {
+            memcpy(entries[i].data, old->entries[item->idx].data, KEYCACHE_DATA_SIZE);
+        } else {
+            todo[todo_cnt++] = i;
+        }
+    }
+    free(index);
+
+    PrintAndLogEx(INFO, "Building key table, " _YELLOW_("%u") " keys reused, " _YELLOW_("%u") " keys to compute", keycnt - todo_cnt, todo_cnt);
+
+    size_t tc = num_CPUs();
+    pthread_t threads[tc];
+    keycache_thread_arg_t args[tc];
+    size_t started = 0;
+    for (size_t i = 0; i < tc; i++) {
+        args[i].thread_idx = i;
+        args[i].thread_cnt = tc;
+        args[i].elite = elite;
+        args[i].todo = todo;
+        args[i].todo_cnt = todo_cnt;
+        args[i].entries = entries;
+        if (pthread_create(&threads[i], NULL, keycache_thread, (void *)&args[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // threads that could not be started, do their share here
+    for (size_t i = started; i < tc; i++) {
+        keycache_thread(&args[i]);
+    }
+
+    free(todo);
+    *pdata = data;
+    *psize = size;
+    return PM3_SUCCESS;
+}
+
+static int keycache_write(const char *path, const uint8_t *data, size_t size) {
+
+    size_t tmplen = strlen(path) + 5;
+    char *tmppath = calloc(tmplen, sizeof(char));
+    if (tmppath == NULL) {
+        return PM3_EMALLOC;
+    }
+    snprintf(tmppath, tmplen, "%s.tmp", path);
+
+    FILE *f = fopen(tmppath, "wb");
+    if (f == NULL) {
+        free(tmppath);
+        return PM3_EFILE;
+    }
+
+    int res = PM3_SUCCESS;
+    if (fwrite(data, 1, size, f) != size) {
+        res = PM3_EFILE;
+    }
+    if (fclose(f) != 0) {
+        res = PM3_EFILE;
+    }
+
+    // replace atomically, processes still mapping an older table keep their pages
+    if (res == PM3_SUCCESS) {
+#if defined(_WIN32)
+        remove(path);
+#endif
+        if (rename(tmppath, path) != 0) {
+            res = PM3_EFILE;
+        }
+    }
+
+    if (res != PM3_SUCCESS) {
+        remove(tmppath);
+    }
+    free(tmppath);
+    return res;
+}
+
+// <user dir>/.proxmark3/<dictionary name>.<std|elite>.keytable
+static char *keycache_path(const char *dictname, bool elite) {
+
+    const char *user_path = get_my_user_directory();
+    if (user_path == NULL) {
+        return NULL;
+    }
+
+    const char *base = dictname;
+    for (const char *p = dictname; *p; p++) {
+        if (*p == '/' || *p == '\\') {
+            base = p + 1;
+        }
+    }
+
+    size_t baselen = strlen(base);
+    const char *ext = strrchr(base, '.');
+    if (ext != NULL && ext != base) {
+        baselen = ext - base;
+    }
+
+    size_t pathlen = strlen(user_path) + strlen(PM3_USER_DIRECTORY) + baselen + strlen(".elite" KEYCACHE_SUFFIX) + 1;
+    char *path = calloc(pathlen, sizeof(char));
+    if (path == NULL) {
+        return NULL;
+    }
+    snprintf(path, pathlen, "%s%s%.*s%s" KEYCACHE_SUFFIX, user_path, PM3_USER_DIRECTORY, (int)baselen, base, elite ? ".elite" : ".std");
+    return path;
+}
+
+int iclass_keycache_open(const char *dictname, const uint8_t *keys, uint32_t keycnt, bool use_elite, iclass_keycache_t **kc) {
+
+    *kc = NULL;
+    if (dictname == NULL || keys == NULL || keycnt == 0) {
+        return PM3_EINVARG;
+    }
+
+    iclass_keycache_t *c = calloc(1, sizeof(iclass_keycache_t));
+    if (c == NULL) {
+        return PM3_EMALLOC;
+    }
+    c->elite = use_elite;
+
+    uint64_t dict_crc = 0;
+    crc64(keys, (size_t)keycnt * 8, &dict_crc);
+
+    char *path = keycache_path(dictname, use_elite);
+    if (path != NULL && keycache_map(path, c) == PM3_SUCCESS) {
+        const keycache_header_t *hdr = (const keycache_header_t *)c->data;
+        c->count = hdr->count;
+        c->entries = (const keycache_entry_t *)(c->data + sizeof(keycache_header_t));
+
+        if (hdr->count == keycnt && hdr->dict_crc == dict_crc) {
+            PrintAndLogEx(INFO, "Using key table " _YELLOW_("%s"), path);
+            free(path);
+            *kc = c;
+            return PM3_SUCCESS;
+        }
+        PrintAndLogEx(INFO, "Dictionary changed, updating key table");
+    }
+
+    uint8_t *data = NULL;
+    size_t size = 0;
+    int res = keycache_build((c->data) ? c : NULL, keys, keycnt, dict_crc, use_elite, &data, &size);
+    keycache_free_data(c);
+    if (res != PM3_SUCCESS) {
+        free(path);
+        free(c);
+        return res;
+    }
+
+    c->data = data;
+    c->size = size;
+    c->mapped = false;
+    c->count = keycnt;
+    c->entries = (const keycache_entry_t *)(data + sizeof(keycache_header_t));
+
+    // not being able to save it only costs the rebuild next time
+    if (path != NULL) {
+        if (keycache_write(path, data, size) == PM3_SUCCESS) {
+            PrintAndLogEx(INFO, "Saved key table " _YELLOW_("%s"), path);
+        } else {
+            PrintAndLogEx(WARNING, "Could not save key table " _YELLOW_("%s"), path);
+        }
+    }
+
+    free(path);
+    *kc = c;
+    return PM3_SUCCESS;
+}
+
+void iclass_keycache_close(iclass_keycache_t *kc) {
+    if (kc == NULL) {
+        return;
+    }
+    keycache_free_data(kc);
+    free(kc);
+}
+
+void iclass_keycache_divkeys(const iclass_keycache_t *kc, const uint8_t *csn, uint32_t start, uint32_t n, uint8_t *div_keys) {
+
+    uint8_t csn_cpy[8];
+    memcpy(csn_cpy, csn, sizeof(csn_cpy));
+
+    if (kc->elite) {
+        uint8_t key_index[8];
+        hash1(csn_cpy, key_index);
+
+        for (uint32_t i = 0; i < n; i++) {
+            const uint8_t *keytable = kc->entries[start + i].data;
+            uint8_t key_sel[8], key_sel_p[8];
+            for (uint8_t j = 0; j < 8; j++) {
+                key_sel[j] = keytable[key_index[j]];
+            }
+
+            // Permute from iclass format to standard format
+            permutekey_rev(key_sel, key_sel_p);
+            diversifyKey(csn_cpy, key_sel_p, div_keys + (8 * i));
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        mbedtls_des_context ctx;
+        memcpy(ctx.sk, kc->entries[start + i].data, KEYCACHE_DATA_SIZE);
+
+        uint8_t crypted_csn[8];
+        mbedtls_des_crypt_ecb(&ctx, csn_cpy, crypted_csn);
+        hash0(x_bytes_to_num(crypted_csn, sizeof(crypted_csn)), div_keys + (8 * i));
+    }
+}
@@ -0,0 +1,34 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// Precomputed iCLASS dictionary key tables
+//-----------------------------------------------------------------------------
+#ifndef ICLASS_KEYCACHE_H
+#define ICLASS_KEYCACHE_H
+
+#include "common.h"
+
+typedef struct iclass_keycache iclass_keycache_t;
+
+// Opens the key table of a dictionary, in the user .proxmark3 directory.
+// It is (re)built when missing or when the dictionary changed, keys that were
+// already in the table are reused. Raw mode needs no table, returns PM3_EINVARG.
+int iclass_keycache_open(const char *dictname, const uint8_t *keys, uint32_t keycnt, bool use_elite, iclass_keycache_t **kc);
+void iclass_keycache_close(iclass_keycache_t *kc);
+
+// diversified keys of the dictionary keys [start, start + n) for one CSN
+void iclass_keycache_divkeys(const iclass_keycache_t *kc, const uint8_t *csn, uint32_t start, uint32_t n, uint8_t *div_keys);
+
+#endif // ICLASS_KEYCACHE_H
@@ -18,7 +18,12 @@
 //-----------------------------------------------------------------------------
 #include "mfkey.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "pm3_cmd.h"
 #include "crapto1/crapto1.h"
+#include "utils/util.h"         // num_CPUs
 
 // MIFARE
 int inline compare_uint64(const void *a, const void *b) {
@@ -180,3 +185,309 @@ int mfkey64(nonces_t *data, uint64_t *outputkey) {
     *outputkey = key;
     return 0;
 }
+
+//-----------------------------------------------------------------------------
+// batch solver
+//-----------------------------------------------------------------------------
+
+#define MFKEY_MAX_THREADS   32
+// a group with many authentications is solved from its first few, the others only verify the key
+#define MFKEY_MAX_BASES     4
+
+typedef struct {
+    const mfkey_nonce_t *nonces;
+    const size_t *group_start;      // first nonce of each group, group_start[ngroups] = n
+    size_t ngroups;
+    mfkey_result_t *results;
+    size_t *next_group;
+} mfkey_batch_ctx_t;
+
+typedef struct {
+    mfkey_batch_ctx_t *ctx;
+    crapto1_arena_t arena;          // lfsr_recovery32 arena, allocated by the first group that needs it
+    bool arena_ready;
+    bool arena_failed;              // could not be allocated, this worker only runs mfkey64
+} mfkey_worker_arg_t;
+
+static int mfkey_nonce_cmp(const void *a, const void *b) {
+    const mfkey_nonce_t *x = a;
+    const mfkey_nonce_t *y = b;
+    if (x->cuid != y->cuid) return (x->cuid < y->cuid) ? -1 : 1;
+    if (x->sector != y->sector) return (x->sector < y->sector) ? -1 : 1;
+    if (x->keytype != y->keytype) return (x->keytype < y->keytype) ? -1 : 1;
+    if (x->nt != y->nt) return (x->nt < y->nt) ? -1 : 1;
+    if (x->nr != y->nr) return (x->nr < y->nr) ? -1 : 1;
+    if (x->ar != y->ar) return (x->ar < y->ar) ? -1 : 1;
+    // keep the copy with a tag answer first
+    return (int)y->has_at - (int)x->has_at;
+}
+
+static bool mfkey_same_group(const mfkey_nonce_t *x, const mfkey_nonce_t *y) {
+    return x->cuid == y->cuid && x->sector == y->sector && x->keytype == y->keytype;
+}
+
+// does the key, loaded in state, produce the reader answer of this authentication
+static bool mfkey_check(const struct Crypto1State *state, const mfkey_nonce_t *n) {
+    struct Crypto1State s = *state;
+    crypto1_word(&s, n->cuid ^ n->nt, 0);
+    crypto1_word(&s, n->nr, 1);
+    return n->ar == (crypto1_word(&s, 0, 0) ^ prng_successor(n->nt, 64));
+}
+
+// number of authentications in the group, other than base, the key answers correctly
+static uint32_t mfkey_score(const struct Crypto1State *state, const mfkey_nonce_t *g, size_t len, size_t base) {
+    uint32_t score = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (i != base && mfkey_check(state, &g[i])) {
+            score++;
+        }
+    }
+    return score;
+}
+
+// Picks the key among the candidates of one base authentication. The key has to answer the most
+// of the other authentications in the group, ties are rejected. A lone authentication needs a single candidate.
+typedef struct {
+    uint64_t key;
+    uint32_t score;
+    uint32_t ties;
+    uint32_t candidates;
+} mfkey_pick_t;
+
+// state is the cipher rolled back to the key
+static void mfkey_pick(mfkey_pick_t *p, struct Crypto1State *state, const mfkey_nonce_t *g, size_t len, size_t base) {
+    p->candidates++;
+    if (len == 1) {
+        crypto1_get_lfsr(state, &p->key);
+        return;
+    }
+
+    // cheap reject on the next two authentications before scoring all of them
+    bool hit = mfkey_check(state, &g[(base + 1) % len]);
+    if (hit == false && len > 2) {
+        hit = mfkey_check(state, &g[(base + 2) % len]);
+    }
+    if (hit == false) {
+        return;
+    }
+
+    uint64_t key = 0;
+    crypto1_get_lfsr(state, &key);
+
+    uint32_t score = mfkey_score(state, g, len, base);
+    if (score < p->score) {
+        return;
+    }
+    if (score == p->score) {
+        if (key != p->key) {
+            p->ties++;
+        }
+        return;
+    }
+    p->score = score;
+    p->key = key;
+    p->ties = 0;
+}
+
+static bool mfkey_picked(const mfkey_pick_t *p, size_t len, uint64_t *key) {
+    bool ok = (len == 1) ? (p->candidates == 1) : (p->score > 0 && p->ties == 0);
+    if (ok) {
+        *key = p->key;
+    }
+    return ok;
+}
+
+// mfkey64 on every authentication with a tag answer
+static bool mfkey_solve64(const mfkey_nonce_t *g, size_t len, uint64_t *key) {
+
+    for (size_t i = 0; i < len; i++) {
+        if (g[i].has_at == false) {
+            continue;
+        }
+
+        uint32_t ks2 = g[i].ar ^ prng_successor(g[i].nt, 64);
+        uint32_t ks3 = g[i].at ^ prng_successor(g[i].nt, 96);
+        struct Crypto1State *states = lfsr_recovery64(ks2, ks3);
+        if (states == NULL) {
+            continue;
+        }
+
+        mfkey_pick_t pick = {0};
+        for (struct Crypto1State *t = states; t->odd | t->even; ++t) {
+            lfsr_rollback_word(t, 0, 0);
+            lfsr_rollback_word(t, 0, 0);
+            lfsr_rollback_word(t, g[i].nr, 1);
+            lfsr_rollback_word(t, g[i].cuid ^ g[i].nt, 0);
+            mfkey_pick(&pick, t, g, len, i);
+        }
+        crypto1_destroy(states);
+
+        if (mfkey_picked(&pick, len, key)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// mfkey32v2 (moebius): states from the reader answer of one authentication, checked against the others
+static bool mfkey_solve32(const mfkey_nonce_t *g, size_t len, crapto1_arena_t *arena, uint64_t *key) {
+
+    if (len < 2) {
+        return false;
+    }
+
+    lfsr_recovery32_part_t part;
+    for (size_t i = 0; i < len && i < MFKEY_MAX_BASES; i++) {
+
+        lfsr_recovery32_part(g[i].ar ^ prng_successor(g[i].nt, 64), 0, 0, 1, arena, &part);
+        struct Crypto1State *sl = arena->sl;
+        for (uint32_t bucket = 0; bucket <= 0xff; bucket++) {
+            sl = lfsr_recovery32_bucket(&part, 1, bucket, arena, sl);
+        }
+
+        mfkey_pick_t pick = {0};
+        for (struct Crypto1State *t = arena->sl; t < sl; ++t) {
+            lfsr_rollback_word(t, 0, 0);
+            lfsr_rollback_word(t, g[i].nr, 1);
+            lfsr_rollback_word(t, g[i].cuid ^ g[i].nt, 0);
+            mfkey_pick(&pick, t, g, len, i);
+        }
+
+        if (mfkey_picked(&pick, len, key)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *mfkey_worker(void *arg) {
+    mfkey_worker_arg_t *w = arg;
+    mfkey_batch_ctx_t *ctx = w->ctx;
+
+    size_t gi;
+    while ((gi = __atomic_fetch_add(ctx->next_group, 1, __ATOMIC_RELAXED)) < ctx->ngroups) {
+
+        const mfkey_nonce_t *g = ctx->nonces + ctx->group_start[gi];
+        size_t len = ctx->group_start[gi + 1] - ctx->group_start[gi];
+        mfkey_result_t *r = &ctx->results[gi];
+
+        if (mfkey_solve64(g, len, &r->key)) {
+            r->found = true;
+            r->mfkey64 = true;
+            continue;
+        }
+
+        if (len < 2 || w->arena_failed) {
+            continue;
+        }
+
+        if (w->arena_ready == false) {
+            w->arena_ready = crapto1_arena_alloc(&w->arena);
+            w->arena_failed = (w->arena_ready == false);
+            if (w->arena_failed) {
+                continue;
+            }
+        }
+
+        if (mfkey_solve32(g, len, &w->arena, &r->key)) {
+            r->found = true;
+        }
+    }
+    return NULL;
+}
+
+int mfkey_batch(mfkey_nonce_t *nonces, size_t n, uint32_t threads, mfkey_result_t **results, size_t *nresults) {
+
+    *results = NULL;
+    *nresults = 0;
+    if (n == 0) {
+        return PM3_SUCCESS;
+    }
+
+    // group by uid / sector / key type and drop duplicates
+    qsort(nonces, n, sizeof(mfkey_nonce_t), mfkey_nonce_cmp);
+    size_t m = 1;
+    for (size_t i = 1; i < n; i++) {
+        const mfkey_nonce_t *p = &nonces[m - 1];
+        if (mfkey_same_group(p, &nonces[i]) && p->nt == nonces[i].nt && p->nr == nonces[i].nr && p->ar == nonces[i].ar) {
+            continue;
+        }
+        nonces[m++] = nonces[i];
+    }
+
+    size_t *group_start = calloc(m + 1, sizeof(size_t));
+    mfkey_result_t *res = calloc(m, sizeof(mfkey_result_t));
+    if (group_start == NULL || res == NULL) {
+        free(group_start);
+        free(res);
+        return PM3_EMALLOC;
+    }
+
+    size_t ngroups = 0;
+    for (size_t i = 0; i < m; i++) {
+        if (i == 0 || mfkey_same_group(&nonces[i - 1], &nonces[i]) == false) {
+            group_start[ngroups] = i;
+            res[ngroups].cuid = nonces[i].cuid;
+            res[ngroups].sector = nonces[i].sector;
+            res[ngroups].keytype = nonces[i].keytype;
+            ngroups++;
+        }
+        res[ngroups - 1].nonces++;
+    }
+    group_start[ngroups] = m;
+
+    if (threads == 0) {
+        threads = num_CPUs();
+    }
+    if (threads > MFKEY_MAX_THREADS) {
+        threads = MFKEY_MAX_THREADS;
+    }
+    if (threads > ngroups) {
+        threads = ngroups;
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    size_t next_group = 0;
+    mfkey_batch_ctx_t ctx = {
+        .nonces = nonces,
+        .group_start = group_start,
+        .ngroups = ngroups,
+        .results = res,
+        .next_group = &next_group,
+    };
+
+    // groups without a tag answer need an arena, a worker allocates it for the first one it gets
+    mfkey_worker_arg_t args[MFKEY_MAX_THREADS];
+    memset(args, 0, sizeof(args));
+    for (uint32_t i = 0; i < threads; i++) {
+        args[i].ctx = &ctx;
+    }
+
+    pthread_t thread_id[MFKEY_MAX_THREADS];
+    uint32_t started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&thread_id[started], NULL, mfkey_worker, &args[started])) {
+            break;
+        }
+    }
+    // no thread could start, solve here
+    if (started == 0) {
+        mfkey_worker(&args[0]);
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(thread_id[i], NULL);
+    }
+
+    for (uint32_t i = 0; i < threads; i++) {
+        if (args[i].arena_ready) {
+            crapto1_arena_free(&args[i].arena);
+        }
+    }
+
+    free(group_start);
+    *results = res;
+    *nresults = ngroups;
+    return PM3_SUCCESS;
+}
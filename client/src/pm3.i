@@ -1,4 +1,4 @@
-%module pm3
+%module(threads="1") pm3
 %{
 /* Include the header in the wrapper code */
 #include "pm3.h"
@@ -19,7 +19,9 @@ typedef struct {
         pm3(char *port) {
 //            printf("SWIG pm3 constructor with port, open pm3\n");
             pm3_device_t * p = pm3_open(port);
-            p->script_embedded = 0;
+            if (p != NULL) {
+                p->script_embedded = 0;
+            }
             return p;
         }
         ~pm3() {
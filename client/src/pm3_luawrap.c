@@ -2684,7 +2684,9 @@ SWIGINTERN int SWIG_lua_isnilstring(lua_State *L, int idx) {
 SWIGINTERN pm3 *new_pm3__SWIG_1(char *port) {
 //            printf("SWIG pm3 constructor with port, open pm3\n");
     pm3_device_t *p = pm3_open(port);
-    p->script_embedded = 0;
+    if (p != NULL) {
+        p->script_embedded = 0;
+    }
     return p;
 }
 SWIGINTERN void delete_pm3(pm3 *self) {
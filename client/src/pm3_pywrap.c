@@ -9,6 +9,7 @@
 
 #define SWIG_VERSION 0x040201
 #define SWIGPYTHON
+#define SWIG_PYTHON_THREADS
 #define SWIG_PYTHON_DIRECTOR_NO_VTABLE
 
 /* -----------------------------------------------------------------------------
@@ -3258,7 +3259,9 @@ SWIG_AsCharPtrAndSize(PyObject *obj, char **cptr, size_t *psize, int *alloc) {
 SWIGINTERN pm3 *new_pm3__SWIG_1(char *port) {
 //            printf("SWIG pm3 constructor with port, open pm3\n");
     pm3_device_t *p = pm3_open(port);
-    p->script_embedded = 0;
+    if (p != NULL) {
+        p->script_embedded = 0;
+    }
     return p;
 }
 SWIGINTERN void delete_pm3(pm3 *self) {
@@ -3314,7 +3317,11 @@ SWIGINTERN PyObject *_wrap_new_pm3__SWIG_0(PyObject *self, Py_ssize_t nobjs, PyO
 
     (void)self;
     if ((nobjs < 0) || (nobjs > 0)) SWIG_fail;
-    result = (pm3 *)new_pm3__SWIG_0();
+    {
+        SWIG_PYTHON_THREAD_BEGIN_ALLOW;
+        result = (pm3 *)new_pm3__SWIG_0();
+        SWIG_PYTHON_THREAD_END_ALLOW;
+    }
     resultobj = SWIG_NewPointerObj(SWIG_as_voidptr(result), SWIGTYPE_p_pm3, SWIG_POINTER_NEW |  0);
     return resultobj;
 fail:
@@ -3337,7 +3344,11 @@ SWIGINTERN PyObject *_wrap_new_pm3__SWIG_1(PyObject *self, Py_ssize_t nobjs, PyO
         SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "new_pm3" "', argument " "1"" of type '" "char *""'");
     }
     arg1 = (char *)(buf1);
-    result = (pm3 *)new_pm3__SWIG_1(arg1);
+    {
+        SWIG_PYTHON_THREAD_BEGIN_ALLOW;
+        result = (pm3 *)new_pm3__SWIG_1(arg1);
+        SWIG_PYTHON_THREAD_END_ALLOW;
+    }
     resultobj = SWIG_NewPointerObj(SWIG_as_voidptr(result), SWIGTYPE_p_pm3, SWIG_POINTER_NEW |  0);
     if (alloc1 == SWIG_NEWOBJ) free((char *)buf1);
     return resultobj;
@@ -3391,7 +3402,11 @@ SWIGINTERN PyObject *_wrap_delete_pm3(PyObject *self, PyObject *args) {
         SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "delete_pm3" "', argument " "1"" of type '" "pm3 *""'");
     }
     arg1 = (pm3 *)(argp1);
-    delete_pm3(arg1);
+    {
+        SWIG_PYTHON_THREAD_BEGIN_ALLOW;
+        delete_pm3(arg1);
+        SWIG_PYTHON_THREAD_END_ALLOW;
+    }
     resultobj = SWIG_Py_Void();
     return resultobj;
 fail:
@@ -3423,7 +3438,11 @@ SWIGINTERN PyObject *_wrap_pm3_console(PyObject *self, PyObject *args) {
         SWIG_exception_fail(SWIG_ArgError(res2), "in method '" "pm3_console" "', argument " "2"" of type '" "char *""'");
     }
     arg2 = (char *)(buf2);
-    result = (int)pm3_console(arg1, arg2);
+    {
+        SWIG_PYTHON_THREAD_BEGIN_ALLOW;
+        result = (int)pm3_console(arg1, arg2);
+        SWIG_PYTHON_THREAD_END_ALLOW;
+    }
     resultobj = SWIG_From_int((int)(result));
     if (alloc2 == SWIG_NEWOBJ) free((char *)buf2);
     return resultobj;
@@ -3449,7 +3468,11 @@ SWIGINTERN PyObject *_wrap_pm3_name_get(PyObject *self, PyObject *args) {
         SWIG_exception_fail(SWIG_ArgError(res1), "in method '" "pm3_name_get" "', argument " "1"" of type '" "pm3 *""'");
     }
     arg1 = (pm3 *)(argp1);
-    result = (char *)pm3_name_get(arg1);
+    {
+        SWIG_PYTHON_THREAD_BEGIN_ALLOW;
+        result = (char *)pm3_name_get(arg1);
+        SWIG_PYTHON_THREAD_END_ALLOW;
+    }
     resultobj = SWIG_FromCharPtr((const char *)result);
     return resultobj;
 fail:
@@ -3962,6 +3985,9 @@ SWIG_init(void) {
 
     SWIG_InstallConstants(d, swig_const_table);
 
+    /* Initialize threading */
+    SWIG_PYTHON_INITIALIZE_THREADS;
+
 #if PY_VERSION_HEX >= 0x03000000
     return m;
 #else
@@ -31,6 +31,7 @@
 #include "pm3_cmd.h"
 #include "ui.h"                          // g_session
 #include "utils/util.h"                        // str_ndup
+#include "cmdparser.h"                  // IfPm3Present
 
 #if defined(HAVE_READLINE)
 
@@ -50,7 +51,7 @@ static char *rl_command_generator(const char *text, int state) {
         // When no pm3 device present
         // and the command is not available offline,
         // we skip it.
-        if ((g_session.pm3_present == false) && (vocabulary[index].offline == false))  {
+        if ((IfPm3Present() == false) && (vocabulary[index].offline == false))  {
             index++;
             continue;
         }
@@ -87,7 +88,7 @@ static void ln_command_completion(const char *text, linenoiseCompletions *lc) {
         // When no pm3 device present
         // and the command is not available offline,
         // we skip it.
-        if ((g_session.pm3_present == false) && (vocabulary[index].offline == false))  {
+        if ((IfPm3Present() == false) && (vocabulary[index].offline == false))  {
             index++;
             continue;
         }
@@ -803,7 +803,7 @@ static int setCmdDeviceDebug (const char *Cmd)
         showDeviceDebugState (prefShowNone);
     }
 
-    if (g_session.pm3_present) {
+    if (IfPm3Present()) {
         PrintAndLogEx (INFO,"setting device debug loglevel");
         SendCommandNG(CMD_SET_DBGMODE, &g_session.device_debug_level, 1);
         PacketResponseNG resp;
@@ -815,7 +815,7 @@ static int setCmdDeviceDebug (const char *Cmd)
 */
 
 int getDeviceDebugLevel(uint8_t *dbg_level) {
-    if (!g_session.pm3_present)
+    if (!IfPm3Present())
         return PM3_EFAILED;
 
     clearCommandBuffer();
@@ -833,7 +833,7 @@ int getDeviceDebugLevel(uint8_t *dbg_level) {
 }
 
 int setDeviceDebugLevel(uint8_t dbg_level, bool verbose) {
-    if (!g_session.pm3_present) {
+    if (!IfPm3Present()) {
         return PM3_EFAILED;
     }
 
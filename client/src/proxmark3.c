@@ -34,6 +34,7 @@
 #include "cmdhw.h"
 #include "whereami.h"
 #include "comms.h"
+#include "cmdparser.h"     // IfPm3Present
 #include "utils/fileutils.h"
 #include "flash.h"
 #include "preferences.h"
@@ -242,7 +243,7 @@ static const char *prompt_net = "";
 
 
 static void prompt_set(void) {
-    if (g_session.pm3_present) {
+    if (IfPm3Present()) {
 
         switch (g_conn.send_via_ip) {
             case PM3_TCPv4:
@@ -287,7 +288,7 @@ static bool c_update_reconnect_prompt = false;
 // This function is hooked via RL_EVENT_HOOK.
 static int check_comm(void) {
     // If communications thread goes down. Device disconnected then this should hook up PM3 again.
-    if (IsCommunicationThreadDead() && g_session.pm3_present) {
+    if (IsCommunicationThreadDead() && IfPm3Present()) {
 
 #ifndef HAVE_READLINE
         PrintAndLogEx(INFO, _YELLOW_("OFFLINE") " mode. Use "_YELLOW_("\"hw connect\"") " to reconnect\n");
@@ -303,7 +304,7 @@ static int check_comm(void) {
         c_update_reconnect_prompt = true;
     }
     // its alive again
-    if (c_update_reconnect_prompt && IsReconnectedOk() && g_session.pm3_present) {
+    if (c_update_reconnect_prompt && IsReconnectedOk() && IfPm3Present()) {
 
         prompt_set();
 
@@ -591,7 +592,7 @@ check_script:
         }
     } // end while
 
-    if (g_session.pm3_present) {
+    if (IfPm3Present()) {
         clearCommandBuffer();
         SendCommandNG(CMD_QUIT_SESSION, NULL, 0);
         msleep(100); // Make sure command is sent before killing client
@@ -853,7 +854,7 @@ static int dumpmem_pm3(char *serial_port_name, const char *filename, uint32_t ad
 finish2:
     clearCommandBuffer();
     if (in_bootloader) {
-        g_session.current_device->g_conn->run = false;
+        g_session.current_device->conn.run = false;
         SendCommandOLD(CMD_PING, 0, 0, 0, NULL, 0);
     } else {
         SendCommandNG(CMD_QUIT_SESSION, NULL, 0);
@@ -986,7 +987,6 @@ static int reboot_bootloader_pm3(char *serial_port_name) {
 void pm3_init(void) {
     srand(time(0));
 
-    g_session.pm3_present = false;
     g_session.help_dump_mode = false;
     g_session.incognito = false;
     g_session.supports_colors = false;
@@ -1393,16 +1393,16 @@ int main(int argc, char *argv[]) {
         OpenProxmark(&g_session.current_device, port, waitCOMPort, 20, false, speed);
     }
 
-    if (g_session.pm3_present && (TestProxmark(g_session.current_device) != PM3_SUCCESS)) {
+    if (IfPm3Present() && (TestProxmark(g_session.current_device) != PM3_SUCCESS)) {
         PrintAndLogEx(ERR, _RED_("ERROR:") " cannot communicate with the Proxmark3\n");
         CloseProxmark(g_session.current_device);
     }
 
-    if ((port != NULL) && (!g_session.pm3_present)) {
+    if ((port != NULL) && (!IfPm3Present())) {
         exit(EXIT_FAILURE);
     }
 
-    if (!g_session.pm3_present) {
+    if (!IfPm3Present()) {
         PrintAndLogEx(INFO, _YELLOW_("OFFLINE") " mode. Check " _YELLOW_("\"%s -h\"") " if it's not what you want.\n", exec_name);
     }
 
@@ -1421,7 +1421,7 @@ int main(int argc, char *argv[]) {
     } /* else {
         // Set device debug level
         PrintAndLogEx(INFO,"setting device debug loglevel");
-        if (g_session.pm3_present) {
+        if (IfPm3Present()) {
            SendCommandNG(CMD_SET_DBGMODE, &g_session.device_debug_level, 1);
            PacketResponseNG resp;
             if (WaitForResponseTimeout(CMD_SET_DBGMODE, &resp, 2000) == false)
@@ -1453,7 +1453,7 @@ int main(int argc, char *argv[]) {
 #endif
 
     // Clean up the port
-    if (g_session.pm3_present) {
+    if (IfPm3Present()) {
         CloseProxmark(g_session.current_device);
     }
 
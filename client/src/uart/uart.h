@@ -84,6 +84,11 @@ int uart_reconfigure_timeouts(uint32_t value);
  */
 uint32_t uart_get_timeouts(void);
 
+/* Wake up a pending uart_receive() on the given port which didn't receive
+ * anything yet, e.g. when there is a command to send. Safe to call from any thread.
+ */
+void uart_notify(const serial_port sp);
+
 /* Specify the outbound address and port for TCP/UDP connections
  */
 bool uart_bind(void *socket, const char *bindAddrStr, const char *bindPortStr, bool isBindingIPv6);
@@ -59,6 +59,8 @@ typedef struct {
     term_info tiOld;  // Terminal info before using the port
     term_info tiNew;  // Terminal info during the transaction
     RingBuffer *udpBuffer;
+    int wakeup_pipe[2]; // self pipe, lets uart_notify() wake up the select() of uart_receive()
+    uint8_t rx_empty_counter;
 } serial_port_unix_t_t;
 
 // see pm3_cmd.h
@@ -69,7 +71,6 @@ struct timeval timeout = {
 
 static uint32_t newtimeout_value = 0;
 static bool newtimeout_pending = false;
-static uint8_t rx_empty_counter = 0;
 
 int uart_reconfigure_timeouts(uint32_t value) {
     newtimeout_value = value;
@@ -81,7 +82,16 @@ uint32_t uart_get_timeouts(void) {
     return newtimeout_value;
 }
 
-serial_port uart_open(const char *pcPortName, uint32_t speed, bool slient) {
+void uart_notify(const serial_port sp) {
+    const serial_port_unix_t_t *spu = (serial_port_unix_t_t *)sp;
+    if (spu && spu->wakeup_pipe[1] >= 0) {
+        uint8_t b = 1;
+        // pipe full means a wake up is pending already
+        if (write(spu->wakeup_pipe[1], &b, sizeof(b)) < 0) {}
+    }
+}
+
+static serial_port uart_open_port(const char *pcPortName, uint32_t speed, bool slient) {
     //serial_port_unix_t_t *sp = calloc(sizeof(serial_port_unix_t_t), sizeof(uint8_t));
     serial_port_unix_t_t *sp = calloc(1, sizeof(serial_port_unix_t_t));
 
@@ -91,7 +101,8 @@ serial_port uart_open(const char *pcPortName, uint32_t speed, bool slient) {
     }
 
     sp->udpBuffer = NULL;
-    rx_empty_counter = 0;
+    sp->wakeup_pipe[0] = -1;
+    sp->wakeup_pipe[1] = -1;
     // init timeouts
     timeout.tv_usec = UART_FPC_CLIENT_RX_TIMEOUT_MS * 1000;
     g_conn.send_via_local_ip = false;
@@ -427,6 +438,24 @@ serial_port uart_open(const char *pcPortName, uint32_t speed, bool slient) {
     return sp;
 }
 
+serial_port uart_open(const char *pcPortName, uint32_t speed, bool slient) {
+    serial_port sp = uart_open_port(pcPortName, speed, slient);
+    if (sp == INVALID_SERIAL_PORT || sp == CLAIMED_SERIAL_PORT) {
+        return sp;
+    }
+
+    // each port has its own wake up pipe, so several ports can be served at once
+    serial_port_unix_t_t *spu = (serial_port_unix_t_t *)sp;
+    if (pipe(spu->wakeup_pipe) == 0) {
+        fcntl(spu->wakeup_pipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(spu->wakeup_pipe[1], F_SETFL, O_NONBLOCK);
+    } else {
+        spu->wakeup_pipe[0] = -1;
+        spu->wakeup_pipe[1] = -1;
+    }
+    return sp;
+}
+
 void uart_close(const serial_port sp) {
     serial_port_unix_t_t *spu = (serial_port_unix_t_t *)sp;
     tcflush(spu->fd, TCIOFLUSH);
@@ -446,6 +475,10 @@ void uart_close(const serial_port sp) {
     }
     RingBuf_destroy(spu->udpBuffer);
     close(spu->fd);
+    if (spu->wakeup_pipe[0] >= 0) {
+        close(spu->wakeup_pipe[0]);
+        close(spu->wakeup_pipe[1]);
+    }
     free(sp);
 }
 
@@ -453,7 +486,7 @@ int uart_receive(const serial_port sp, uint8_t *pbtRx, uint32_t pszMaxRxLen, uin
     uint32_t byteCount;  // FIONREAD returns size on 32b
     fd_set rfds;
     struct timeval tv;
-    const serial_port_unix_t_t *spu = (serial_port_unix_t_t *)sp;
+    serial_port_unix_t_t *spu = (serial_port_unix_t_t *)sp;
 
     if (newtimeout_pending) {
         timeout.tv_usec = newtimeout_value * 1000;
@@ -484,14 +517,31 @@ int uart_receive(const serial_port sp, uint8_t *pbtRx, uint32_t pszMaxRxLen, uin
         // Reset file descriptor
         FD_ZERO(&rfds);
         FD_SET(spu->fd, &rfds);
+        int nfds = spu->fd;
+        if (spu->wakeup_pipe[0] >= 0) {
+            FD_SET(spu->wakeup_pipe[0], &rfds);
+            nfds = MAX(nfds, spu->wakeup_pipe[0]);
+        }
         tv = timeout;
-        res = select(spu->fd + 1, &rfds, NULL, NULL, &tv);
+        res = select(nfds + 1, &rfds, NULL, NULL, &tv);
 
         // Read error
         if (res < 0) {
             return PM3_EIO;
         }
 
+        // Woken up by uart_notify(), only stop if no frame is half received
+        if (res > 0 && spu->wakeup_pipe[0] >= 0 && FD_ISSET(spu->wakeup_pipe[0], &rfds)) {
+            uint8_t drain[16];
+            while (read(spu->wakeup_pipe[0], drain, sizeof(drain)) > 0) {};
+            if (FD_ISSET(spu->fd, &rfds) == false) {
+                if (*pszRxLen == 0) {
+                    return PM3_ENODATA;
+                }
+                continue;
+            }
+        }
+
         // Read time-out
         if (res == 0) {
             if (*pszRxLen == 0) {
@@ -514,12 +564,12 @@ int uart_receive(const serial_port sp, uint8_t *pbtRx, uint32_t pszMaxRxLen, uin
             // select() > 0 && byteCount > 0 ===> data available
             // select() > 0 && byteCount always equals to 0 ===> maybe disconnected
             // This happens when TCP connection is lost
-            rx_empty_counter++;
-            if (rx_empty_counter > 3) {
+            spu->rx_empty_counter++;
+            if (spu->rx_empty_counter > 3) {
                 return PM3_ENOTTY;
             }
         } else {
-            rx_empty_counter = 0;
+            spu->rx_empty_counter = 0;
         }
 
         // For UDP connection, put the incoming data into the buffer and handle them in the next round
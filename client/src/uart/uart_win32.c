@@ -61,6 +61,11 @@ uint32_t uart_get_timeouts(void) {
     return newtimeout_value;
 }
 
+// ReadFile waits for the configured timeouts, nothing to wake up here
+void uart_notify(const serial_port sp) {
+    (void) sp;
+}
+
 static int uart_reconfigure_timeouts_polling(serial_port sp) {
     if (newtimeout_pending == false)
         return PM3_SUCCESS;
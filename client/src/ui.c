@@ -299,6 +299,9 @@ void PrintAndLogEx(logLevel_t level, const char *fmt, ...) {
     } else {
         snprintf(buffer2, sizeof(buffer2), "%s%s", prefix, buffer);
         if (level == INPLACE) {
+            if ((g_printAndLog & PRINTANDLOG_PRINT) == 0) {
+                return;
+            }
             char buffer3[sizeof(buffer2)] = {0};
             char buffer4[sizeof(buffer2)] = {0};
             memcpy_filter_ansi(buffer3, buffer2, sizeof(buffer2), !g_session.supports_colors);
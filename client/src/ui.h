@@ -46,7 +46,6 @@ typedef struct {
     bool stdoutOnTTY;
     bool supports_colors;
     emojiMode_t emoji_mode;
-    bool pm3_present;
     bool help_dump_mode;
     bool show_hints;
     bool dense_output;
@@ -862,6 +862,71 @@ out:
     return retval;
 }
 
+// Signal trace file, PM3. One sample per line
+int loadFilePM3(const char *fn, int *data, size_t maxdatalen, size_t *datalen) {
+
+    if (fn == NULL || data == NULL || datalen == NULL) {
+        return PM3_EINVARG;
+    }
+
+    FILE *f = fopen(fn, "r");
+    if (f == NULL) {
+        PrintAndLogEx(WARNING, "file not found or locked `" _YELLOW_("%s") "`", fn);
+        return PM3_EFILE;
+    }
+
+    *datalen = 0;
+    char line[80];
+    while (*datalen < maxdatalen && fgets(line, sizeof(line), f)) {
+        data[(*datalen)++] = atoi(line);
+    }
+    fclose(f);
+    return PM3_SUCCESS;
+}
+
+// Signal trace file, WAVE. 8 bit mono PCM as written by saveFileWAVE, 16 bit samples are scaled down
+int loadFileWAVE(const char *fn, int *data, size_t maxdatalen, size_t *datalen) {
+
+    if (fn == NULL || data == NULL || datalen == NULL) {
+        return PM3_EINVARG;
+    }
+
+    FILE *f = fopen(fn, "rb");
+    if (f == NULL) {
+        PrintAndLogEx(WARNING, "file not found or locked `" _YELLOW_("%s") "`", fn);
+        return PM3_EFILE;
+    }
+
+    int retval = PM3_SUCCESS;
+    struct wave_info_t wave_info;
+    if (fread(&wave_info, sizeof(wave_info), 1, f) != 1
+            || memcmp(wave_info.signature, "RIFF", 4) || memcmp(wave_info.type, "WAVE", 4)
+            || memcmp(wave_info.format.tag, "fmt ", 4) || memcmp(wave_info.audio_data.tag, "data", 4)
+            || wave_info.format.codec != 1 || wave_info.format.nb_channel != 1
+            || (wave_info.format.bit_per_sample != 8 && wave_info.format.bit_per_sample != 16)) {
+        PrintAndLogEx(WARNING, "unsupported wave file `" _YELLOW_("%s") "`, expected mono 8/16 bit PCM", fn);
+        retval = PM3_EFILE;
+        goto out;
+    }
+
+    *datalen = 0;
+    if (wave_info.format.bit_per_sample == 8) {
+        uint8_t sample;
+        while (*datalen < maxdatalen && *datalen < wave_info.audio_data.size && fread(&sample, 1, 1, f) == 1) {
+            data[(*datalen)++] = sample - 128;
+        }
+    } else {
+        uint8_t sample[2];
+        while (*datalen < maxdatalen && *datalen < wave_info.audio_data.size / 2 && fread(sample, 2, 1, f) == 1) {
+            data[(*datalen)++] = (int8_t)sample[1];
+        }
+    }
+
+out:
+    fclose(f);
+    return retval;
+}
+
 // key file dump
 int createMfcKeyDump(const char *preferredName, uint8_t sectorsCnt, const sector_t *e_sector) {
 
@@ -234,6 +234,28 @@ int loadFileJSON(const char *preferredName, void *data, size_t maxdatalen, size_
 int loadFileJSONex(const char *preferredName, void *data, size_t maxdatalen, size_t *datalen, bool verbose, void (*callback)(json_t *));
 int loadFileJSONroot(const char *preferredName, void **proot, bool verbose);
 
+/**
+ * @brief Utility function to load signal samples from a PM3 trace file, one sample per line.
+ *
+ * @param fn the file name, used as is
+ * @param data the signal samples
+ * @param maxdatalen max number of samples
+ * @param datalen the number of loaded samples
+ * @return PM3_SUCCESS for ok
+ */
+int loadFilePM3(const char *fn, int *data, size_t maxdatalen, size_t *datalen);
+
+/**
+ * @brief Utility function to load signal samples from a mono PCM WAVE file, like the ones saveFileWAVE writes.
+ *
+ * @param fn the file name, used as is
+ * @param data the signal samples
+ * @param maxdatalen max number of samples
+ * @param datalen the number of loaded samples
+ * @return PM3_SUCCESS for ok
+ */
+int loadFileWAVE(const char *fn, int *data, size_t maxdatalen, size_t *datalen);
+
 /**
  * @brief  Utility function to load data from a DICTIONARY textfile. This method takes a preferred name.
  * E.g. mfc_default_keys.dic
@@ -399,14 +399,14 @@ void print_blocks(uint32_t *data, size_t len) {
 }
 
 char *sprint_hex(const uint8_t *data, const size_t len) {
-    static char buf[UTIL_BUFFER_SIZE_SPRINT] = {0};
+    static __thread char buf[UTIL_BUFFER_SIZE_SPRINT] = {0};
     memset(buf, 0x00, sizeof(buf));
     hex_to_buffer((uint8_t *)buf, data, len, sizeof(buf) - 1, 0, 1, true);
     return buf;
 }
 
 char *sprint_hex_inrow_ex(const uint8_t *data, const size_t len, const size_t min_str_len) {
-    static char buf[UTIL_BUFFER_SIZE_SPRINT] = {0};
+    static __thread char buf[UTIL_BUFFER_SIZE_SPRINT] = {0};
     memset(buf, 0x00, sizeof(buf));
     hex_to_buffer((uint8_t *)buf, data, len, sizeof(buf) - 1, min_str_len, 0, true);
     return buf;
@@ -417,7 +417,7 @@ char *sprint_hex_inrow(const uint8_t *data, const size_t len) {
 }
 
 char *sprint_hex_inrow_spaces(const uint8_t *data, const size_t len, size_t spaces_between) {
-    static char buf[UTIL_BUFFER_SIZE_SPRINT] = {0};
+    static __thread char buf[UTIL_BUFFER_SIZE_SPRINT] = {0};
     memset(buf, 0x00, sizeof(buf));
     hex_to_buffer((uint8_t *)buf, data, len, sizeof(buf) - 1, 0, spaces_between, true);
     return buf;
@@ -429,7 +429,7 @@ char *sprint_bytebits_bin_break(const uint8_t *data, const size_t len, const uin
     size_t rowlen = (len > MAX_BIN_BREAK_LENGTH) ? MAX_BIN_BREAK_LENGTH : len;
 
     // 3072 + end of line characters if broken at 8 bits
-    static char buf[MAX_BIN_BREAK_LENGTH] = {0};
+    static __thread char buf[MAX_BIN_BREAK_LENGTH] = {0};
     memset(buf, 0, sizeof(buf));
 
     char *tmp = buf;
@@ -505,13 +505,13 @@ char *sprint_bytebits_bin(const uint8_t *data, const size_t len) {
 
 char *sprint_bin(const uint8_t *data, const size_t len) {
     size_t binlen = (len * 8 > MAX_BIN_BREAK_LENGTH) ? MAX_BIN_BREAK_LENGTH : len * 8;
-    static uint8_t buf[MAX_BIN_BREAK_LENGTH] = {0};
+    static __thread uint8_t buf[MAX_BIN_BREAK_LENGTH] = {0};
     bytes_to_bytebits(data, binlen / 8, buf);
     return sprint_bytebits_bin_break(buf, binlen, 0);
 }
 
 char *sprint_hex_ascii(const uint8_t *data, const size_t len) {
-    static char buf[UTIL_BUFFER_SIZE_SPRINT + 20] = {0};
+    static __thread char buf[UTIL_BUFFER_SIZE_SPRINT + 20] = {0};
     memset(buf, 0x00, sizeof(buf));
 
     char *tmp = buf;
@@ -535,7 +535,7 @@ out:
 }
 
 char *sprint_ascii_ex(const uint8_t *data, const size_t len, const size_t min_str_len) {
-    static char buf[UTIL_BUFFER_SIZE_SPRINT] = {0};
+    static __thread char buf[UTIL_BUFFER_SIZE_SPRINT] = {0};
     memset(buf, 0x00, sizeof(buf));
 
     char *tmp = buf;
@@ -566,7 +566,7 @@ char *sprint_breakdown_bin(color_t color, const char *bs, int width, int padn, i
 
     const char *prepad     = "................................";
     const char *postmarker = " ................................";
-    static char buf[32 + 120] = {0};
+    static __thread char buf[32 + 120] = {0};
     memset(buf, 0, sizeof(buf));
 
     int8_t end = (width - padn - bits);
@@ -698,7 +698,7 @@ void bytes_to_bytebits(const void *src, const size_t srclen, void *dest) {
 // hh,gg,ff,ee,dd,cc,bb,aa, pp,oo,nn,mm,ll,kk,jj,ii
 // up to 64 bytes or 512 bits
 uint8_t *SwapEndian64(const uint8_t *src, const size_t len, const uint8_t blockSize) {
-    static uint8_t buf[64] = {0};
+    static __thread uint8_t buf[64] = {0};
     memset(buf, 0x00, 64);
     uint8_t *tmp = buf;
     for (uint8_t block = 0; block < (uint8_t)(len / blockSize); block++) {
@@ -0,0 +1,107 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Bitsliced Crypto1, runs up to 64 keys at the time (one key per bit lane)
+//
+// In crapto1 terms the state after t steps is
+//     odd bit j  = x[t + 47 - 2j]
+//     even bit j = x[t + 46 - 2j]
+// and a step computes x[t + 48] from the LF_POLY_ODD / LF_POLY_EVEN taps.
+//-----------------------------------------------------------------------------
+
+#include "crapto1/bs_crypto1.h"
+#include "crapto1/crapto1.h"
+
+#define BS_ONES     (~(bitslice_t)0)
+
+static inline bitslice_t bs_mux(bitslice_t sel, bitslice_t one, bitslice_t zero) {
+    return zero ^ ((zero ^ one) & sel);
+}
+
+// truth table lookup, in[0] is the least significant input.
+// Called with constant tables only, the compiler folds the constant branches of the mux tree.
+static inline bitslice_t bs_lut4(uint16_t tt, bitslice_t a, bitslice_t b, bitslice_t c, bitslice_t d) {
+    bitslice_t v[16];
+    for (int i = 0; i < 16; i++) {
+        v[i] = (tt >> i & 1) ? BS_ONES : 0;
+    }
+    for (int i = 0; i < 8; i++) v[i] = bs_mux(a, v[2 * i + 1], v[2 * i]);
+    for (int i = 0; i < 4; i++) v[i] = bs_mux(b, v[2 * i + 1], v[2 * i]);
+    for (int i = 0; i < 2; i++) v[i] = bs_mux(c, v[2 * i + 1], v[2 * i]);
+    return bs_mux(d, v[1], v[0]);
+}
+
+static inline bitslice_t bs_lut5(uint32_t tt, bitslice_t a, bitslice_t b, bitslice_t c, bitslice_t d, bitslice_t e) {
+    return bs_mux(e, bs_lut4(tt >> 16, a, b, c, d), bs_lut4(tt & 0xFFFF, a, b, c, d));
+}
+
+// filter() on the odd bits 0..19
+static inline bitslice_t bs_filter(const bitslice_t *x) {
+#define ODD(j) x[47 - 2 * (j)]
+    bitslice_t f4 = bs_lut4(0xf22c, ODD(0), ODD(1), ODD(2), ODD(3));
+    bitslice_t f3 = bs_lut4(0xd938, ODD(4), ODD(5), ODD(6), ODD(7));
+    bitslice_t f2 = bs_lut4(0xf22c, ODD(8), ODD(9), ODD(10), ODD(11));
+    bitslice_t f1 = bs_lut4(0xf22c, ODD(12), ODD(13), ODD(14), ODD(15));
+    bitslice_t f0 = bs_lut4(0xd938, ODD(16), ODD(17), ODD(18), ODD(19));
+#undef ODD
+    return bs_lut5(0xEC57E80A, f0, f1, f2, f3, f4);
+}
+
+static inline bitslice_t bs_feedback(const bitslice_t *x) {
+    bitslice_t fb = 0;
+    for (int j = 0; j < 24; j++) {
+        if (BIT(LF_POLY_ODD, j)) {
+            fb ^= x[47 - 2 * j];
+        }
+        if (BIT(LF_POLY_EVEN, j)) {
+            fb ^= x[46 - 2 * j];
+        }
+    }
+    return fb;
+}
+
+static inline bitslice_t bs_crypto1_bit(bs_crypto1_t *s, bool in, bool is_encrypted) {
+    bitslice_t *x = s->x + s->t;
+    bitslice_t ks = bs_filter(x);
+    bitslice_t fb = bs_feedback(x);
+    if (is_encrypted) {
+        fb ^= ks;
+    }
+    x[48] = fb ^ (in ? BS_ONES : 0);
+    s->t++;
+    return ks;
+}
+
+void bs_crypto1_init(bs_crypto1_t *s, const uint64_t *keys, uint8_t n) {
+    s->t = 0;
+    // crypto1_init() puts key bit (47 - k) ^ 7 at stream position k
+    for (int k = 0; k < 48; k++) {
+        int kb = (47 - k) ^ 7;
+        bitslice_t w = 0;
+        for (uint8_t l = 0; l < BS_LANES; l++) {
+            uint64_t key = keys[(l < n) ? l : 0];
+            w |= (bitslice_t)(key >> kb & 1) << l;
+        }
+        s->x[k] = w;
+    }
+}
+
+void bs_crypto1_word(bs_crypto1_t *s, uint32_t in, bool is_encrypted) {
+    for (int i = 0; i < 32; i++) {
+        bs_crypto1_bit(s, BEBIT(in, i), is_encrypted);
+    }
+}
+
+void bs_crypto1_word_ks(bs_crypto1_t *s, uint32_t in, bool is_encrypted, bitslice_t ks[32]) {
+    for (int i = 0; i < 32; i++) {
+        ks[24 ^ i] = bs_crypto1_bit(s, BEBIT(in, i), is_encrypted);
+    }
+}
+
+void bs_crypto1_byte(bs_crypto1_t *s, bitslice_t ks[8]) {
+    for (int i = 0; i < 8; i++) {
+        ks[i] = bs_crypto1_bit(s, false, false);
+    }
+}
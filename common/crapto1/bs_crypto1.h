@@ -0,0 +1,48 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Bitsliced Crypto1, runs up to 64 keys at the time (one key per bit lane)
+//-----------------------------------------------------------------------------
+
+#ifndef BS_CRYPTO1_H__
+#define BS_CRYPTO1_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BS_LANES            64
+#define BS_CRYPTO1_STEPS    256
+
+typedef uint64_t bitslice_t;
+
+// The LFSR is kept as the stream of bits it produces, x[t .. t + 47] is the 48 bit state
+// after t steps.  Nothing is shifted, every step only appends one new bit.
+typedef struct {
+    bitslice_t x[48 + BS_CRYPTO1_STEPS];
+    uint32_t t;
+} bs_crypto1_t;
+
+// loads n (<= BS_LANES) keys, unused lanes get the first key
+void bs_crypto1_init(bs_crypto1_t *s, const uint64_t *keys, uint8_t n);
+
+// same as crypto1_word(), the keystream is dropped
+void bs_crypto1_word(bs_crypto1_t *s, uint32_t in, bool is_encrypted);
+
+// same as crypto1_word(), ks[b] holds bit b of the returned keystream word of every lane
+void bs_crypto1_word_ks(bs_crypto1_t *s, uint32_t in, bool is_encrypted, bitslice_t ks[32]);
+
+// same as crypto1_byte(s, 0, 0), ks[i] holds keystream bit i of every lane
+void bs_crypto1_byte(bs_crypto1_t *s, bitslice_t ks[8]);
+
+// lanes where the byte b[] equals v
+static inline bitslice_t bs_byte_eq(const bitslice_t b[8], uint8_t v) {
+    bitslice_t eq = ~(bitslice_t)0;
+    for (int i = 0; i < 8; i++) {
+        eq &= (v >> i & 1) ? b[i] : ~b[i];
+    }
+    return eq;
+}
+
+#endif
@@ -19,6 +19,7 @@
 #include "bucketsort.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include "parity.h"
 
 
@@ -228,6 +229,221 @@ out:
     return statelist;
 }
 
+/** counting_sort_intersect
+ * same result as bucket_sort_intersect(), but counts the bucket sizes first and sorts through one
+ * scratch list instead of 2 x 256 fixed size buckets. Needs no memory besides the arena.
+ */
+static void counting_sort_intersect(uint32_t *const estart, uint32_t *const estop,
+                                    uint32_t *const ostart, uint32_t *const ostop,
+                                    bucket_info_t *bucket_info, uint32_t *scratch) {
+    uint32_t *start[2] = {estart, ostart};
+    uint32_t *stop[2] = {estop, ostop};
+    uint32_t count[2][0x100] = {{0}};
+
+    for (uint32_t i = 0; i < 2; i++) {
+        for (uint32_t *p = start[i]; p <= stop[i]; p++) {
+            count[i][*p >> 24]++;
+        }
+    }
+
+    for (uint32_t i = 0; i < 2; i++) {
+        uint32_t offset[0x100];
+        uint32_t pos = 0;
+        uint32_t nonempty_bucket = 0;
+        for (uint32_t j = 0; j <= 0xff; j++) {
+            if (count[0][j] && count[1][j]) { // non-empty intersecting buckets only
+                offset[j] = pos;
+                bucket_info->bucket_info[i][nonempty_bucket].head = start[i] + pos;
+                pos += count[i][j];
+                bucket_info->bucket_info[i][nonempty_bucket].tail = start[i] + pos - 1;
+                nonempty_bucket++;
+            } else {
+                offset[j] = UINT32_MAX;
+            }
+        }
+        for (uint32_t *p = start[i]; p <= stop[i]; p++) {
+            uint32_t j = *p >> 24;
+            if (offset[j] != UINT32_MAX) {
+                scratch[offset[j]++] = *p;
+            }
+        }
+        memcpy(start[i], scratch, pos * sizeof(uint32_t));
+        bucket_info->numbuckets = nonempty_bucket;
+    }
+}
+
+/** recover_arena
+ * recover() working in a crapto1_arena_t
+ */
+static struct Crypto1State *
+recover_arena(uint32_t *o_head, uint32_t *o_tail, uint32_t oks,
+              uint32_t *e_head, uint32_t *e_tail, uint32_t eks, int rem,
+              struct Crypto1State *sl, uint32_t in, uint32_t *scratch) {
+    bucket_info_t bucket_info;
+
+    if (rem == -1) {
+        for (uint32_t *e = e_head; e <= e_tail; ++e) {
+            *e = *e << 1 ^ (even32(*e & LF_POLY_EVEN)) ^ (!!(in & 4));
+            for (uint32_t *o = o_head; o <= o_tail; ++o, ++sl) {
+                sl->even = *o;
+                sl->odd = *e ^ (even32(*o & LF_POLY_ODD));
+                sl[1].odd = sl[1].even = 0;
+            }
+        }
+        return sl;
+    }
+
+    for (uint32_t i = 0; i < 4 && rem--; i++) {
+        oks >>= 1;
+        eks >>= 1;
+        in >>= 2;
+        extend_table(o_head, &o_tail, oks & 1, LF_POLY_EVEN << 1 | 1, LF_POLY_ODD << 1, 0);
+        if (o_head > o_tail)
+            return sl;
+
+        extend_table(e_head, &e_tail, eks & 1, LF_POLY_ODD, LF_POLY_EVEN << 1 | 1, in & 3);
+        if (e_head > e_tail)
+            return sl;
+    }
+
+    counting_sort_intersect(e_head, e_tail, o_head, o_tail, &bucket_info, scratch);
+
+    for (int i = bucket_info.numbuckets - 1; i >= 0; i--) {
+        sl = recover_arena(bucket_info.bucket_info[1][i].head, bucket_info.bucket_info[1][i].tail, oks,
+                           bucket_info.bucket_info[0][i].head, bucket_info.bucket_info[0][i].tail, eks,
+                           rem, sl, in, scratch);
+    }
+
+    return sl;
+}
+
+bool crapto1_arena_alloc(crapto1_arena_t *arena) {
+    // same table sizes lfsr_recovery32() uses. Pages only get touched as far as the tables grow.
+    arena->odd = calloc(1, sizeof(uint32_t) << 21);
+    arena->even = calloc(1, sizeof(uint32_t) << 21);
+    arena->job_odd = calloc(1, sizeof(uint32_t) << 21);
+    arena->job_even = calloc(1, sizeof(uint32_t) << 21);
+    arena->scratch = calloc(1, sizeof(uint32_t) << 21);
+    arena->sl = calloc(1, sizeof(struct Crypto1State) << 18);
+    if (!arena->odd || !arena->even || !arena->job_odd || !arena->job_even || !arena->scratch || !arena->sl) {
+        crapto1_arena_free(arena);
+        return false;
+    }
+    return true;
+}
+
+void crapto1_arena_free(crapto1_arena_t *arena) {
+    free(arena->odd);
+    free(arena->even);
+    free(arena->job_odd);
+    free(arena->job_even);
+    free(arena->scratch);
+    free(arena->sl);
+    memset(arena, 0, sizeof(crapto1_arena_t));
+}
+
+/** lfsr_recovery32_part
+ * first half of lfsr_recovery32() for one slice of the initial 2^20 states. Every table entry is extended
+ * independently, so the slices can be built in parallel, each in its own arena. The extended
+ * tables are left grouped by their contribution bits (MSB), ready for lfsr_recovery32_bucket().
+ */
+void lfsr_recovery32_part(uint32_t ks2, uint32_t in, uint32_t part, uint32_t num_parts, crapto1_arena_t *arena, lfsr_recovery32_part_t *out) {
+    uint32_t *odd_head = arena->odd, *odd_tail = arena->odd - 1, oks = 0;
+    uint32_t *even_head = arena->even, *even_tail = arena->even - 1, eks = 0;
+    int i;
+
+    // split the keystream into an odd and even part
+    for (i = 31; i >= 0; i -= 2)
+        oks = oks << 1 | BEBIT(ks2, i);
+    for (i = 30; i >= 0; i -= 2)
+        eks = eks << 1 | BEBIT(ks2, i);
+
+    // initialize statelists: add all possible states which would result into the rightmost 2 bits of the keystream
+    uint32_t lo = (uint32_t)(((uint64_t)((1 << 20) + 1) * part) / num_parts);
+    uint32_t hi = (uint32_t)(((uint64_t)((1 << 20) + 1) * (part + 1)) / num_parts);
+    uint8_t oks_b1 = oks & 1;
+    uint8_t eks_b1 = eks & 1;
+    for (uint32_t j = lo; j < hi; j++) {
+        uint8_t tbl_filter = filter(j);
+        if (tbl_filter == oks_b1)
+            *++odd_tail = j;
+        if (tbl_filter == eks_b1)
+            *++even_tail = j;
+    }
+
+    // extend the statelists. Look at the next 8 Bits of the keystream (4 Bit each odd and even):
+    for (i = 0; i < 4; i++) {
+        extend_table_simple(odd_head,  &odd_tail, (oks >>= 1) & 1);
+        extend_table_simple(even_head, &even_tail, (eks >>= 1) & 1);
+    }
+
+    // first level of recover(). An empty table here doesn't end the recovery, other parts
+    // still pair their states with this part's other table.
+    in = (in >> 16 & 0xff) | (in << 16) | (in & 0xff00); // Byte swapping
+    in <<= 1;
+    for (i = 0; i < 4; i++) {
+        oks >>= 1;
+        eks >>= 1;
+        in >>= 2;
+        extend_table(odd_head, &odd_tail, oks & 1, LF_POLY_EVEN << 1 | 1, LF_POLY_ODD << 1, 0);
+        extend_table(even_head, &even_tail, eks & 1, LF_POLY_ODD, LF_POLY_EVEN << 1 | 1, in & 3);
+    }
+
+    out->oks = oks;
+    out->eks = eks;
+    out->in = in;
+    out->odd = arena->odd;
+    out->even = arena->even;
+
+    // group both tables by contribution bits
+    uint32_t *head[2] = {odd_head, even_head};
+    uint32_t *tail[2] = {odd_tail, even_tail};
+    uint32_t *start[2] = {out->odd_start, out->even_start};
+    for (uint32_t t = 0; t < 2; t++) {
+        uint32_t count[0x100] = {0};
+        for (uint32_t *p = head[t]; p <= tail[t]; p++) {
+            count[*p >> 24]++;
+        }
+        uint32_t offset[0x100];
+        start[t][0] = 0;
+        for (uint32_t j = 0; j <= 0xff; j++) {
+            offset[j] = start[t][j];
+            start[t][j + 1] = start[t][j] + count[j];
+        }
+        for (uint32_t *p = head[t]; p <= tail[t]; p++) {
+            arena->scratch[offset[*p >> 24]++] = *p;
+        }
+        memcpy(head[t], arena->scratch, start[t][0x100] * sizeof(uint32_t));
+    }
+}
+
+/** lfsr_recovery32_bucket
+ * second half of lfsr_recovery32(): recover all states with the given contribution bits, collecting
+ * them from all parts. Buckets are independent and can be recovered in parallel, each worker using
+ * its own arena. Writes to sl and returns the end of the written states, followed by a zero state.
+ */
+struct Crypto1State *lfsr_recovery32_bucket(const lfsr_recovery32_part_t *parts, uint32_t num_parts, uint8_t bucket,
+                                            crapto1_arena_t *arena, struct Crypto1State *sl) {
+    size_t olen = 0, elen = 0;
+    for (uint32_t p = 0; p < num_parts; p++) {
+        size_t n = parts[p].odd_start[bucket + 1] - parts[p].odd_start[bucket];
+        memcpy(arena->job_odd + olen, parts[p].odd + parts[p].odd_start[bucket], n * sizeof(uint32_t));
+        olen += n;
+        n = parts[p].even_start[bucket + 1] - parts[p].even_start[bucket];
+        memcpy(arena->job_even + elen, parts[p].even + parts[p].even_start[bucket], n * sizeof(uint32_t));
+        elen += n;
+    }
+
+    sl->odd = sl->even = 0;
+    if (olen == 0 || elen == 0) {
+        return sl;
+    }
+
+    return recover_arena(arena->job_odd, arena->job_odd + olen - 1, parts[0].oks,
+                         arena->job_even, arena->job_even + elen - 1, parts[0].eks,
+                         7, sl, parts[0].in, arena->scratch);
+}
+
 static const uint32_t S1[] = {     0x62141, 0x310A0, 0x18850, 0x0C428, 0x06214,
                                    0x0310A, 0x85E30, 0xC69AD, 0x634D6, 0xB5CDE, 0xDE8DA, 0x6F46D, 0xB3C83,
                                    0x59E41, 0xA8995, 0xD027F, 0x6813F, 0x3409F, 0x9E6FA
@@ -36,6 +36,29 @@ uint32_t prng_successor(uint32_t x, uint32_t n);
 
 #if !defined(__arm__) || defined(__linux__) || defined(_WIN32) || defined(__APPLE__) // bare metal ARM Proxmark lacks malloc()/free()
 struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in);
+
+// lfsr_recovery32() split in two parallel phases for multi threaded callers:
+// build the tables in parts (lfsr_recovery32_part), then recover the 256 buckets (lfsr_recovery32_bucket).
+// Each thread needs its own arena. Arenas can be reused for any number of recoveries.
+typedef struct {
+    uint32_t *odd, *even;           // a part's tables
+    uint32_t *job_odd, *job_even;   // a bucket's tables
+    uint32_t *scratch;
+    struct Crypto1State *sl;
+} crapto1_arena_t;
+
+typedef struct {
+    uint32_t oks, eks, in;
+    uint32_t *odd, *even;
+    uint32_t odd_start[0x101];      // tables grouped by contribution bits
+    uint32_t even_start[0x101];
+} lfsr_recovery32_part_t;
+
+bool crapto1_arena_alloc(crapto1_arena_t *arena);
+void crapto1_arena_free(crapto1_arena_t *arena);
+void lfsr_recovery32_part(uint32_t ks2, uint32_t in, uint32_t part, uint32_t num_parts, crapto1_arena_t *arena, lfsr_recovery32_part_t *out);
+struct Crypto1State *lfsr_recovery32_bucket(const lfsr_recovery32_part_t *parts, uint32_t num_parts, uint8_t bucket,
+                                            crapto1_arena_t *arena, struct Crypto1State *sl);
 struct Crypto1State *lfsr_recovery64(uint32_t ks2, uint32_t ks3);
 struct Crypto1State *
 lfsr_common_prefix(uint32_t pfx, uint32_t rr, uint8_t ks[8], uint8_t par[8][8], uint32_t no_par);
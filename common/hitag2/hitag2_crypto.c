@@ -297,40 +297,18 @@ int ht2_try_state(uint64_t s, uint32_t uid, uint32_t aR2, uint32_t nR1, uint32_t
     hstate.shiftreg = (uint64_t)(((hstate.shiftreg << 1) & 0xffffffffffff) | (uint64_t)ht2_fnR(hstate.shiftreg));
     hstate.shiftreg = (uint64_t)(((hstate.shiftreg << 1) & 0xffffffffffff) | (uint64_t)ht2_fnR(hstate.shiftreg));
 
-#ifndef ON_DEVICE
-    hitag_state_t hs2;
-    hs2.shiftreg = s;
-    hs2.lfsr = 0;
-    ht2_rollback(&hs2, 2);
-
-    PrintAndLogEx(INFO, "hstate shiftreg.... %" PRIx64 " lfsr... %" PRIx64, hstate.shiftreg, hstate.lfsr);
-    PrintAndLogEx(INFO, "hstate shiftreg.... %" PRIx64 " lfsr... %" PRIx64, hs2.shiftreg, hs2.lfsr);
-#endif
-
     // recover key
     uint64_t keyrev = hstate.shiftreg & 0xffff;
     uint64_t nR1xk = (hstate.shiftreg >> 16) & 0xffffffff;
 
-#ifndef ON_DEVICE
-    PrintAndLogEx(INFO, "keyrev...... %012" PRIx64 " nR1xk... %08" PRIx64, keyrev, nR1xk);
-#endif
-
     uint32_t b = 0;
     for (uint8_t i = 0; i < 32; i++) {
         hstate.shiftreg = ((hstate.shiftreg) << 1) | ((uid >> (31 - i)) & 0x1);
         b = (b << 1) | (unsigned int) ht2_fnf(hstate.shiftreg);
     }
 
-#ifndef ON_DEVICE
-    PrintAndLogEx(INFO, "b..... %08" PRIx32 "  %08" PRIx32 "  %012" PRIx64, b, nR1, hstate.shiftreg);
-#endif
-
     keyrev |= (nR1xk ^ nR1 ^ b) << 16;
 
-#ifndef ON_DEVICE
-    PrintAndLogEx(INFO, "key... %012" PRIx64 " %012" PRIx64, keyrev, REV64(keyrev));
-#endif
-
     // test key
     ht2_hitag2_init_ex(&hstate, keyrev, uid, nR2);
 
@@ -341,7 +319,6 @@ int ht2_try_state(uint64_t s, uint32_t uid, uint32_t aR2, uint32_t nR1, uint32_t
     return PM3_ESOFT;
 }
 
-
 // "MIKRON"             =  O  N  M  I  K  R
 // Key                  = 4F 4E 4D 49 4B 52             - Secret 48-bit key
 // Serial               = 49 43 57 69                   - Serial number of the tag, transmitted in clear
@@ -68,11 +68,110 @@ uint8_t g_debugMode = 0;
 # define prnt Dbprintf
 #endif
 
-static signal_t signalprop = { 255, -255, 0, 0, true };
+static signal_t signalprop_default = { 255, -255, 0, 0, true };
+#ifndef ON_DEVICE
+// client threads can work on their own signal, see setSignalProperties()
+static __thread signal_t *signalprop_ptr = &signalprop_default;
+#else
+static signal_t *signalprop_ptr = &signalprop_default;
+#endif
+#define signalprop (*signalprop_ptr)
+
 signal_t *getSignalProperties(void) {
-    return &signalprop;
+    return signalprop_ptr;
+}
+
+// use `sp` as signal properties for the calling thread, NULL for the default ones
+void setSignalProperties(signal_t *sp) {
+    signalprop_ptr = (sp) ? sp : &signalprop_default;
+}
+
+#ifndef ON_DEVICE
+// clock detections of the calling thread are looked up here first, see setDemodCache()
+static __thread demod_cache_t *demod_cache = NULL;
+
+void demodCacheInit(demod_cache_t *cache) {
+    memset(cache, 0, sizeof(demod_cache_t));
+    pthread_mutex_init(&cache->lock, NULL);
+}
+
+void demodCacheFree(demod_cache_t *cache) {
+    pthread_mutex_destroy(&cache->lock);
+}
+
+// use `cache` for the clock detections of the calling thread, NULL to always detect
+void setDemodCache(demod_cache_t *cache) {
+    demod_cache = cache;
+}
+
+typedef enum {
+    DEMOD_CACHE_ASK_CLOCK,
+    DEMOD_CACHE_NRZ_CLOCK,
+    DEMOD_CACHE_PSK_CLOCK,
+    DEMOD_CACHE_FC,
+    DEMOD_CACHE_FSK_CLOCK,
+} demod_cache_kind_t;
+
+// the detections leave some outputs alone when they fail, those are stored as not set
+#define DEMOD_CACHE_UNSET   INT32_MIN
+
+static uint64_t fnv1a_mix(uint64_t h, uint64_t v) {
+    return (h ^ v) * 0x100000001b3ULL;
+}
+
+// samples, the signal properties the detections look at, the detection and its in parameters
+static uint64_t demod_cache_key(demod_cache_kind_t kind, const uint8_t *samples, size_t size, int p1, int p2) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t v;
+        memcpy(&v, samples + i, sizeof(v));
+        h = fnv1a_mix(h, v);
+    }
+    for (; i < size; i++) {
+        h = fnv1a_mix(h, samples[i]);
+    }
+    h = fnv1a_mix(h, size);
+    h = fnv1a_mix(h, (uint32_t)signalprop.low);
+    h = fnv1a_mix(h, (uint32_t)signalprop.high);
+    h = fnv1a_mix(h, (uint32_t)signalprop.mean);
+    h = fnv1a_mix(h, (uint32_t)signalprop.amplitude);
+    h = fnv1a_mix(h, signalprop.isnoise);
+    h = fnv1a_mix(h, kind);
+    h = fnv1a_mix(h, (uint32_t)p1);
+    return fnv1a_mix(h, (uint32_t)p2);
+}
+
+static bool demod_cache_get(uint64_t key, int *res, int out[3]) {
+    bool hit = false;
+    pthread_mutex_lock(&demod_cache->lock);
+    for (uint8_t i = 0; i < demod_cache->cnt; i++) {
+        demod_cache_entry_t *e = &demod_cache->entries[i];
+        if (e->key == key) {
+            *res = e->res;
+            memcpy(out, e->out, sizeof(e->out));
+            hit = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&demod_cache->lock);
+    return hit;
 }
 
+static void demod_cache_put(uint64_t key, int res, const int out[3]) {
+    pthread_mutex_lock(&demod_cache->lock);
+    demod_cache_entry_t *e = &demod_cache->entries[demod_cache->next];
+    e->key = key;
+    e->res = res;
+    memcpy(e->out, out, sizeof(e->out));
+    demod_cache->next = (demod_cache->next + 1) % DEMOD_CACHE_ENTRIES;
+    if (demod_cache->cnt < DEMOD_CACHE_ENTRIES) {
+        demod_cache->cnt++;
+    }
+    pthread_mutex_unlock(&demod_cache->lock);
+}
+#endif
+
 static void resetSignal(void) {
     signalprop.low = 255;
     signalprop.high = -255;
@@ -741,7 +840,7 @@ int DetectStrongAskClock(uint8_t *dest, size_t size, int high, int low, int *clo
 // not perfect especially with lower clocks or VERY good antennas (heavy wave clipping)
 // maybe somehow adjust peak trimming value based on samples to fix?
 // return start index of best starting position for that clock and return clock (by reference)
-int DetectASKClock(uint8_t *dest, size_t size, int *clock, int maxErr) {
+static int rawDetectASKClock(uint8_t *dest, size_t size, int *clock, int maxErr) {
 
     //don't need to loop through entire array. (cotag has clock of 384)
     uint16_t loopCnt = 1000;
@@ -940,7 +1039,7 @@ int DetectStrongNRZClk(const uint8_t *dest, size_t size, int peak, int low, bool
 }
 
 // detect nrz clock by reading #peaks vs no peaks(or errors)
-int DetectNRZClock(uint8_t *dest, size_t size, int clock, size_t *clockStartIdx) {
+static int rawDetectNRZClock(uint8_t *dest, size_t size, int clock, size_t *clockStartIdx) {
     size_t i = 0;
     uint16_t clk[] = {8, 16, 32, 40, 50, 64, 100, 128, 255, 272, 384};
     size_t loopCnt = 4096;  //don't need to loop through entire array...
@@ -1069,7 +1168,7 @@ int DetectNRZClock(uint8_t *dest, size_t size, int clock, size_t *clockStartIdx)
 // countFC is to detect the field clock lengths.
 // counts and returns the 2 most common wave lengths
 // mainly used for FSK field clock detection
-uint16_t countFC(const uint8_t *bits, size_t size, bool fskAdj) {
+static uint16_t rawCountFC(const uint8_t *bits, size_t size, bool fskAdj) {
     uint8_t fcLens[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
     uint16_t fcCnts[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
     uint8_t fcLensFnd = 0;
@@ -1160,7 +1259,7 @@ uint16_t countFC(const uint8_t *bits, size_t size, bool fskAdj) {
 
 // detect psk clock by reading each phase shift
 // a phase shift is determined by measuring the sample length of each wave
-int DetectPSKClock(uint8_t *dest, size_t size, int clock, size_t *firstPhaseShift, uint8_t *curPhase, uint8_t *fc) {
+static int rawDetectPSKClock(uint8_t *dest, size_t size, int clock, size_t *firstPhaseShift, uint8_t *curPhase, uint8_t *fc) {
     uint16_t clk[] = {255, 16, 32, 40, 50, 64, 100, 128, 256, 272, 384}; // 255 is not a valid clock
     uint16_t loopCnt = 4096;  // don't need to loop through entire array...
 
@@ -1257,7 +1356,7 @@ int DetectPSKClock(uint8_t *dest, size_t size, int clock, size_t *firstPhaseShif
 }
 
 // detects the bit clock for FSK given the high and low Field Clocks
-uint8_t detectFSKClk(const uint8_t *bits, size_t size, uint8_t fcHigh, uint8_t fcLow, int *firstClockEdge) {
+static uint8_t rawDetectFSKClk(const uint8_t *bits, size_t size, uint8_t fcHigh, uint8_t fcLow, int *firstClockEdge) {
 
     if (size == 0)
         return 0;
@@ -1365,6 +1464,109 @@ uint8_t detectFSKClk(const uint8_t *bits, size_t size, uint8_t fcHigh, uint8_t f
 }
 
 
+// The clock detections, answered from the demod cache of the calling thread when it has one
+int DetectASKClock(uint8_t *dest, size_t size, int *clock, int maxErr) {
+#ifndef ON_DEVICE
+    if (demod_cache) {
+        uint64_t key = demod_cache_key(DEMOD_CACHE_ASK_CLOCK, dest, size, *clock, maxErr);
+        int res, out[3] = {0};
+        if (demod_cache_get(key, &res, out) == false) {
+            res = rawDetectASKClock(dest, size, clock, maxErr);
+            out[0] = *clock;
+            demod_cache_put(key, res, out);
+        }
+        *clock = out[0];
+        return res;
+    }
+#endif
+    return rawDetectASKClock(dest, size, clock, maxErr);
+}
+
+int DetectNRZClock(uint8_t *dest, size_t size, int clock, size_t *clockStartIdx) {
+#ifndef ON_DEVICE
+    if (demod_cache) {
+        uint64_t key = demod_cache_key(DEMOD_CACHE_NRZ_CLOCK, dest, size, clock, 0);
+        int res, out[3] = {0};
+        if (demod_cache_get(key, &res, out) == false) {
+            size_t start = SIZE_MAX;
+            res = rawDetectNRZClock(dest, size, clock, &start);
+            out[0] = (start == SIZE_MAX) ? DEMOD_CACHE_UNSET : (int)start;
+            demod_cache_put(key, res, out);
+        }
+        if (out[0] != DEMOD_CACHE_UNSET) {
+            *clockStartIdx = out[0];
+        }
+        return res;
+    }
+#endif
+    return rawDetectNRZClock(dest, size, clock, clockStartIdx);
+}
+
+uint16_t countFC(const uint8_t *bits, size_t size, bool fskAdj) {
+#ifndef ON_DEVICE
+    if (demod_cache) {
+        uint64_t key = demod_cache_key(DEMOD_CACHE_FC, bits, size, fskAdj, 0);
+        int res, out[3] = {0};
+        if (demod_cache_get(key, &res, out) == false) {
+            res = rawCountFC(bits, size, fskAdj);
+            demod_cache_put(key, res, out);
+        }
+        return res;
+    }
+#endif
+    return rawCountFC(bits, size, fskAdj);
+}
+
+int DetectPSKClock(uint8_t *dest, size_t size, int clock, size_t *firstPhaseShift, uint8_t *curPhase, uint8_t *fc) {
+#ifndef ON_DEVICE
+    if (demod_cache) {
+        // the phase is counted on from the one given
+        uint64_t key = demod_cache_key(DEMOD_CACHE_PSK_CLOCK, dest, size, clock, *curPhase);
+        int res, out[3] = {0};
+        if (demod_cache_get(key, &res, out) == false) {
+            size_t shift = SIZE_MAX;
+            uint8_t phase = *curPhase;
+            uint8_t carrier = 0;
+            res = rawDetectPSKClock(dest, size, clock, &shift, &phase, &carrier);
+            out[0] = (shift == SIZE_MAX) ? DEMOD_CACHE_UNSET : (int)shift;
+            out[1] = phase;
+            // the carrier is set unless there are too few samples
+            out[2] = (size < 160 + 20) ? DEMOD_CACHE_UNSET : carrier;
+            demod_cache_put(key, res, out);
+        }
+        if (out[0] != DEMOD_CACHE_UNSET) {
+            *firstPhaseShift = out[0];
+        }
+        *curPhase = out[1];
+        if (out[2] != DEMOD_CACHE_UNSET) {
+            *fc = out[2];
+        }
+        return res;
+    }
+#endif
+    return rawDetectPSKClock(dest, size, clock, firstPhaseShift, curPhase, fc);
+}
+
+uint8_t detectFSKClk(const uint8_t *bits, size_t size, uint8_t fcHigh, uint8_t fcLow, int *firstClockEdge) {
+#ifndef ON_DEVICE
+    if (demod_cache) {
+        uint64_t key = demod_cache_key(DEMOD_CACHE_FSK_CLOCK, bits, size, fcHigh, fcLow);
+        int res, out[3] = {0};
+        if (demod_cache_get(key, &res, out) == false) {
+            int edge = DEMOD_CACHE_UNSET;
+            res = rawDetectFSKClk(bits, size, fcHigh, fcLow, &edge);
+            out[0] = edge;
+            demod_cache_put(key, res, out);
+        }
+        if (out[0] != DEMOD_CACHE_UNSET) {
+            *firstClockEdge = out[0];
+        }
+        return res;
+    }
+#endif
+    return rawDetectFSKClk(bits, size, fcHigh, fcLow, firstClockEdge);
+}
+
 // **********************************************************************************************
 // --------------------Modulation Demods &/or Decoding Section-----------------------------------
 // **********************************************************************************************
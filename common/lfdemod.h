@@ -42,6 +42,31 @@ typedef struct {
     bool isnoise;
 } signal_t;
 signal_t *getSignalProperties(void);
+void setSignalProperties(signal_t *sp);
+
+#ifndef ON_DEVICE
+#include <pthread.h>
+
+// Clock / field clock detection results, looked up again when the same samples are detected on
+// with the same signal properties and parameters. Can be shared by threads working on one signal
+#define DEMOD_CACHE_ENTRIES 32
+typedef struct {
+    uint64_t key;
+    int res;
+    int out[3];
+} demod_cache_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    demod_cache_entry_t entries[DEMOD_CACHE_ENTRIES];
+    uint8_t cnt;
+    uint8_t next;
+} demod_cache_t;
+
+void demodCacheInit(demod_cache_t *cache);
+void demodCacheFree(demod_cache_t *cache);
+void setDemodCache(demod_cache_t *cache);
+#endif
 
 void computeSignalProperties(const uint8_t *samples, uint32_t size);
 void removeSignalOffset(uint8_t *samples, uint32_t size);
@@ -254,12 +254,155 @@ void doMAC(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4]) {
     memcpy(cc_nr, cc_nr_p, 12);
     memcpy(div_key, div_key_p, 8);
 
-    reverse_arraybytes(cc_nr, 12);
+    // opt_suc() consumes the bits lsb first, no need to reverse them
     uint8_t dest [] = {0, 0, 0, 0, 0, 0, 0, 0};
     opt_MAC(div_key, cc_nr, dest);
     memcpy(mac, dest, 4);
 }
 
+/*
+ * Bitsliced MAC engine.
+ *
+ * Each uint64_t holds the same state bit of 64 independent ciphers, one per key. The cipher is
+ * the opt_successor() above, rewritten as boolean logic:
+ *  - opt_select_LUT[] becomes three small expressions of the r bits
+ *  - k[opt_select] becomes a 3 level multiplexer over the eight key bytes
+ *  - the two byte additions become ripple carry adders
+ * The CC NR is the same for all keys, so the input bits are plain constants.
+ */
+typedef struct {
+    uint64_t l[8];
+    uint64_t r[8];
+    uint64_t b[8];
+    uint64_t t[16];
+} bs_cipher_state_t;
+
+typedef struct {
+    // k0, k2, k4, k6 and the xor with their odd neighbour, per bit
+    uint64_t even[4][8];
+    uint64_t diff[4][8];
+} bs_key_t;
+
+// sum = a + b mod 256
+static inline void bs_add8(const uint64_t *a, const uint64_t *b, uint64_t *sum) {
+    uint64_t carry = 0;
+    for (int i = 0; i < 8; i++) {
+        uint64_t axb = a[i] ^ b[i];
+        sum[i] = axb ^ carry;
+        carry = (a[i] & b[i]) | (carry & axb);
+    }
+}
+
+static inline void bs_successor(const bs_key_t *k, bs_cipher_state_t *s, uint64_t y) {
+    const uint64_t *r = s->r;
+
+    // parity of t & 0xc533
+    uint64_t Tt = s->t[0] ^ s->t[1] ^ s->t[4] ^ s->t[5] ^ s->t[8] ^ s->t[10] ^ s->t[14] ^ s->t[15];
+    uint64_t t15 = Tt ^ r[7] ^ r[3];
+    for (int i = 0; i < 15; i++) {
+        s->t[i] = s->t[i + 1];
+    }
+    s->t[15] = t15;
+
+    uint64_t b7 = s->b[0] ^ s->b[4] ^ s->b[5] ^ s->b[6] ^ r[0];
+    for (int i = 0; i < 7; i++) {
+        s->b[i] = s->b[i + 1];
+    }
+    s->b[7] = b7;
+
+    // opt_select_LUT[r], bit 2..0
+    uint64_t sel2 = (r[7] & r[5]) ^ (r[6] & ~r[4]) ^ (r[5] | r[3]);
+    uint64_t sel1 = (r[7] | r[5]) ^ (r[2] | r[0]) ^ r[6] ^ r[1] ^ Tt ^ y;
+    uint64_t sel0 = (r[4] & ~r[2]) ^ (r[3] & r[1]) ^ r[0] ^ Tt;
+
+    uint64_t kb[8];
+    for (int i = 0; i < 8; i++) {
+        uint64_t m0 = k->even[0][i] ^ (sel0 & k->diff[0][i]);
+        uint64_t m1 = k->even[1][i] ^ (sel0 & k->diff[1][i]);
+        uint64_t m2 = k->even[2][i] ^ (sel0 & k->diff[2][i]);
+        uint64_t m3 = k->even[3][i] ^ (sel0 & k->diff[3][i]);
+        m0 ^= sel1 & (m0 ^ m1);
+        m2 ^= sel1 & (m2 ^ m3);
+        kb[i] = (m0 ^ (sel2 & (m0 ^ m2))) ^ s->b[i];
+    }
+
+    uint64_t new_r[8];
+    bs_add8(kb, s->l, new_r);
+    bs_add8(new_r, s->r, s->l);
+    memcpy(s->r, new_r, sizeof(new_r));
+}
+
+// spread one byte per lane into bit slices
+static void bs_load8(const uint8_t *bytes, size_t stride, size_t lanes, uint64_t *slices) {
+    memset(slices, 0, 8 * sizeof(uint64_t));
+    for (size_t n = 0; n < lanes; n++) {
+        uint8_t v = bytes[n * stride];
+        for (int i = 0; i < 8; i++) {
+            slices[i] |= (uint64_t)((v >> i) & 1) << n;
+        }
+    }
+}
+
+static void bs_MAC(const uint8_t *div_keys, size_t lanes, const uint8_t *cc_nr, uint8_t *macs) {
+
+    bs_key_t k;
+    uint64_t odd[8];
+    for (int j = 0; j < 4; j++) {
+        bs_load8(div_keys + (2 * j), 8, lanes, k.even[j]);
+        bs_load8(div_keys + (2 * j) + 1, 8, lanes, odd);
+        for (int i = 0; i < 8; i++) {
+            k.diff[j][i] = k.even[j][i] ^ odd[i];
+        }
+    }
+
+    // same init as opt_MAC(), l and r depend on k[0]
+    uint8_t init_l[ICLASS_MAC_BATCH_SIZE];
+    uint8_t init_r[ICLASS_MAC_BATCH_SIZE];
+    for (size_t n = 0; n < lanes; n++) {
+        init_l[n] = ((div_keys[n * 8] ^ 0x4c) + 0xEC) & 0xFF;
+        init_r[n] = ((div_keys[n * 8] ^ 0x4c) + 0x21) & 0xFF;
+    }
+
+    bs_cipher_state_t s;
+    bs_load8(init_l, 1, lanes, s.l);
+    bs_load8(init_r, 1, lanes, s.r);
+    for (int i = 0; i < 8; i++) {
+        s.b[i] = ((0x4c >> i) & 1) ? UINT64_MAX : 0;
+    }
+    for (int i = 0; i < 16; i++) {
+        s.t[i] = ((0xE012 >> i) & 1) ? UINT64_MAX : 0;
+    }
+
+    for (int i = 0; i < 12; i++) {
+        for (int j = 0; j < 8; j++) {
+            bs_successor(&k, &s, ((cc_nr[i] >> j) & 1) ? UINT64_MAX : 0);
+        }
+    }
+
+    uint64_t out[32];
+    for (int i = 0; i < 32; i++) {
+        out[i] = s.r[2];
+        bs_successor(&k, &s, 0);
+    }
+
+    for (size_t n = 0; n < lanes; n++) {
+        for (int i = 0; i < 4; i++) {
+            uint8_t bout = 0;
+            for (int j = 0; j < 8; j++) {
+                bout |= ((out[(i * 8) + j] >> n) & 1) << j;
+            }
+            macs[(n * 4) + i] = bout;
+        }
+    }
+}
+
+void doMAC_batch(const uint8_t *cc_nr_p, const uint8_t *div_keys, size_t n, uint8_t *macs) {
+    for (size_t i = 0; i < n; i += ICLASS_MAC_BATCH_SIZE) {
+        size_t lanes = MIN(n - i, ICLASS_MAC_BATCH_SIZE);
+        bs_MAC(div_keys + (i * 8), lanes, cc_nr_p, macs + (i * 4));
+    }
+}
+
 int testMAC(void) {
     PrintAndLogEx(SUCCESS, "Testing MAC calculation...");
 
@@ -280,6 +423,31 @@ int testMAC(void) {
         printarr("    Correct_MAC   ", correct_MAC, 4);
         return PM3_ESOFT;
     }
+
+    // the batch engine must agree with doMAC() in every lane
+    PrintAndLogEx(SUCCESS, "Testing batch MAC calculation...");
+    // one full pass and a partial one
+    const size_t cnt = ICLASS_MAC_BATCH_SIZE + 3;
+    uint8_t keys[ICLASS_MAC_BATCH_SIZE + 3][8];
+    uint8_t macs[ICLASS_MAC_BATCH_SIZE + 3][4];
+    uint32_t seed = 0x1d49c9da;
+    for (size_t i = 0; i < cnt; i++) {
+        for (size_t j = 0; j < 8; j++) {
+            seed = seed * 1103515245 + 12345;
+            keys[i][j] = seed >> 24;
+        }
+    }
+    memcpy(keys[5], div_key, sizeof(div_key));
+    doMAC_batch(cc_nr, (uint8_t *)keys, cnt, (uint8_t *)macs);
+
+    for (size_t i = 0; i < cnt; i++) {
+        doMAC(cc_nr, keys[i], calculated_mac);
+        if (memcmp(calculated_mac, macs[i], 4) != 0) {
+            PrintAndLogEx(FAILED, "    batch MAC calculation ( %s ) key %zu", _RED_("fail"), i);
+            return PM3_ESOFT;
+        }
+    }
+    PrintAndLogEx(SUCCESS, "    batch MAC calculation ( %s )", _GREEN_("ok"));
     return PM3_SUCCESS;
 }
 #else
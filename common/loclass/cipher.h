@@ -59,6 +59,19 @@ void doMAC_N(uint8_t *address_data_p, uint8_t address_data_size, uint8_t *div_ke
 
 void doMAC(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4]);
 
+// number of keys doMAC_batch() evaluates in one pass
+#define ICLASS_MAC_BATCH_SIZE 64
+
+/**
+ * @brief Bitsliced doMAC() over many diversified keys and the same CC NR
+ *
+ * @param cc_nr_p The CC NR, 12 bytes
+ * @param div_keys n diversified keys, 8 bytes each
+ * @param n number of keys, any value. Best a multiple of ICLASS_MAC_BATCH_SIZE
+ * @param macs where to put the n MACs, 4 bytes each
+ */
+void doMAC_batch(const uint8_t *cc_nr_p, const uint8_t *div_keys, size_t n, uint8_t *macs);
+
 int testMAC(void);
 
 #define opt_doTagMAC_1(cc_p, div_key_p) (cipher_state_t){0,0,0,0}
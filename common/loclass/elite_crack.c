@@ -48,8 +48,6 @@
 #include "util_posix.h"
 #endif
 
-static mbedtls_des_context ctx_enc;
-static mbedtls_des_context ctx_dec;
 
 /**
  * Helper function for hash1
@@ -100,9 +98,11 @@ static void rk(uint8_t *key, uint8_t n, uint8_t *outp_key) {
     }
 }
 
+// DES contexts are kept on the stack, hash2() runs in several threads at once
 static void desdecrypt_iclass(uint8_t *iclass_key, uint8_t *input, uint8_t *output) {
     uint8_t key_std_format[8] = {0};
     permutekey_rev(iclass_key, key_std_format);
+    mbedtls_des_context ctx_dec;
     mbedtls_des_setkey_dec(&ctx_dec, key_std_format);
     mbedtls_des_crypt_ecb(&ctx_dec, input, output);
 }
@@ -110,10 +110,22 @@ static void desdecrypt_iclass(uint8_t *iclass_key, uint8_t *input, uint8_t *outp
 static void desencrypt_iclass(uint8_t *iclass_key, uint8_t *input, uint8_t *output) {
     uint8_t key_std_format[8] = {0};
     permutekey_rev(iclass_key, key_std_format);
+    mbedtls_des_context ctx_enc;
     mbedtls_des_setkey_enc(&ctx_enc, key_std_format);
     mbedtls_des_crypt_ecb(&ctx_enc, input, output);
 }
 
+// one key schedule for both directions, the decryption one is the reversed encryption one
+static void desschedule_iclass(uint8_t *iclass_key, mbedtls_des_context *ctx_enc, mbedtls_des_context *ctx_dec) {
+    uint8_t key_std_format[8] = {0};
+    permutekey_rev(iclass_key, key_std_format);
+    mbedtls_des_setkey_enc(ctx_enc, key_std_format);
+    for (int i = 0; i < 32; i += 2) {
+        ctx_dec->sk[i] = ctx_enc->sk[30 - i];
+        ctx_dec->sk[i + 1] = ctx_enc->sk[31 - i];
+    }
+}
+
 /**
  * @brief Permutes a key from standard NIST format to Iclass specific format
  *  from http://www.proxmark.org/forum/viewtopic.php?pid=11220#p11220
@@ -236,8 +248,10 @@ void hash2(uint8_t *key64, uint8_t *outp_keytable) {
 
     for (i = 1; i < 8; i++) {
         rk(key64, i, temp_output);
-        desdecrypt_iclass(temp_output, z[i - 1], z[i]);
-        desencrypt_iclass(temp_output, y[i - 1], y[i]);
+        mbedtls_des_context ctx_enc, ctx_dec;
+        desschedule_iclass(temp_output, &ctx_enc, &ctx_dec);
+        mbedtls_des_crypt_ecb(&ctx_dec, z[i - 1], z[i]);
+        mbedtls_des_crypt_ecb(&ctx_enc, y[i - 1], y[i]);
     }
 
     if (outp_keytable != NULL) {
@@ -292,69 +306,80 @@ static void *bf_thread(void *thread_arg) {
     memcpy(bytes_to_recover, targ->bytes_to_recover, sizeof(bytes_to_recover));
     memcpy(keytable, targ->keytable, sizeof(keytable));
 
+    // candidates are diversified one by one, and their MACs checked a batch at the time
+    uint8_t div_keys[ICLASS_MAC_BATCH_SIZE * 8];
+    uint8_t calculated_MACs[ICLASS_MAC_BATCH_SIZE * 4];
+    uint32_t brutes[ICLASS_MAC_BATCH_SIZE];
+
     while (!(brute & endmask)) {
 
         int found = __atomic_load_n(&loclass_found, __ATOMIC_SEQ_CST);
 
         if (found != 0xFF) return NULL;
 
-        //Update the keytable with the brute-values
-        for (uint8_t i = 0; i < numbytes_to_recover; i++) {
-            keytable[bytes_to_recover[i]] &= 0xFF00;
-            keytable[bytes_to_recover[i]] |= (brute >> (i * 8) & 0xFF);
-        }
+        size_t n = 0;
+        while (n < ICLASS_MAC_BATCH_SIZE && !(brute & endmask)) {
 
-        uint8_t key_sel[8] = {0};
+            //Update the keytable with the brute-values
+            for (uint8_t i = 0; i < numbytes_to_recover; i++) {
+                keytable[bytes_to_recover[i]] &= 0xFF00;
+                keytable[bytes_to_recover[i]] |= (brute >> (i * 8) & 0xFF);
+            }
 
-        // Piece together the key
-        key_sel[0] = keytable[key_index[0]] & 0xFF;
-        key_sel[1] = keytable[key_index[1]] & 0xFF;
-        key_sel[2] = keytable[key_index[2]] & 0xFF;
-        key_sel[3] = keytable[key_index[3]] & 0xFF;
-        key_sel[4] = keytable[key_index[4]] & 0xFF;
-        key_sel[5] = keytable[key_index[5]] & 0xFF;
-        key_sel[6] = keytable[key_index[6]] & 0xFF;
-        key_sel[7] = keytable[key_index[7]] & 0xFF;
+            uint8_t key_sel[8] = {0};
 
-        // Permute from iclass format to standard format
+            // Piece together the key
+            key_sel[0] = keytable[key_index[0]] & 0xFF;
+            key_sel[1] = keytable[key_index[1]] & 0xFF;
+            key_sel[2] = keytable[key_index[2]] & 0xFF;
+            key_sel[3] = keytable[key_index[3]] & 0xFF;
+            key_sel[4] = keytable[key_index[4]] & 0xFF;
+            key_sel[5] = keytable[key_index[5]] & 0xFF;
+            key_sel[6] = keytable[key_index[6]] & 0xFF;
+            key_sel[7] = keytable[key_index[7]] & 0xFF;
 
-        uint8_t key_sel_p[8] = {0};
-        permutekey_rev(key_sel, key_sel_p);
+            // Permute from iclass format to standard format
 
-        // Diversify
-        uint8_t div_key[8] = {0};
-        diversifyKey(csn, key_sel_p, div_key);
+            uint8_t key_sel_p[8] = {0};
+            permutekey_rev(key_sel, key_sel_p);
 
-        // Calc mac
-        uint8_t calculated_MAC[4] = {0};
-        doMAC(cc_nr, div_key, calculated_MAC);
+            // Diversify
+            diversifyKey(csn, key_sel_p, div_keys + (n * 8));
+            brutes[n++] = brute;
 
-        // success
-        if (memcmp(calculated_MAC, mac, 4) == 0) {
+            brute += loclass_tc;
 
-            loclass_thread_ret_t *r = (loclass_thread_ret_t *)calloc(sizeof(loclass_thread_ret_t), sizeof(uint8_t));
+#define _CLR_ "\x1b[0K"
 
-            for (uint8_t i = 0 ; i < numbytes_to_recover; i++) {
-                r->values[i] = keytable[bytes_to_recover[i]] & 0xFF;
+            if (numbytes_to_recover == 3) {
+                if ((brute > 0) && ((brute & 0xFFFF) == 0)) {
+                    PrintAndLogEx(INPLACE, "[ %02x %02x %02x ] %8u / %u", bytes_to_recover[0], bytes_to_recover[1], bytes_to_recover[2], brute, 0xFFFFFF);
+                }
+            } else if (numbytes_to_recover == 2) {
+                if ((brute > 0) && ((brute & 0x3F) == 0))
+                    PrintAndLogEx(INPLACE, "[ %02x %02x ] %5u / %u" _CLR_, bytes_to_recover[0], bytes_to_recover[1], brute, 0xFFFF);
+            } else {
+                if ((brute > 0) && ((brute & 0x1F) == 0))
+                    PrintAndLogEx(INPLACE, "[ %02x ] %3u / %u" _CLR_, bytes_to_recover[0], brute, 0xFF);
             }
-            __atomic_store_n(&loclass_found, targ->thread_idx, __ATOMIC_SEQ_CST);
-            pthread_exit((void *)r);
         }
 
-        brute += loclass_tc;
+        // Calc macs
+        doMAC_batch(cc_nr, div_keys, n, calculated_MACs);
 
-#define _CLR_ "\x1b[0K"
+        for (size_t j = 0; j < n; j++) {
+
+            // success
+            if (memcmp(calculated_MACs + (j * 4), mac, 4) == 0) {
+
+                loclass_thread_ret_t *r = (loclass_thread_ret_t *)calloc(sizeof(loclass_thread_ret_t), sizeof(uint8_t));
 
-        if (numbytes_to_recover == 3) {
-            if ((brute > 0) && ((brute & 0xFFFF) == 0)) {
-                PrintAndLogEx(INPLACE, "[ %02x %02x %02x ] %8u / %u", bytes_to_recover[0], bytes_to_recover[1], bytes_to_recover[2], brute, 0xFFFFFF);
+                for (uint8_t i = 0 ; i < numbytes_to_recover; i++) {
+                    r->values[i] = (brutes[j] >> (i * 8)) & 0xFF;
+                }
+                __atomic_store_n(&loclass_found, targ->thread_idx, __ATOMIC_SEQ_CST);
+                pthread_exit((void *)r);
             }
-        } else if (numbytes_to_recover == 2) {
-            if ((brute > 0) && ((brute & 0x3F) == 0))
-                PrintAndLogEx(INPLACE, "[ %02x %02x ] %5u / %u" _CLR_, bytes_to_recover[0], bytes_to_recover[1], brute, 0xFFFF);
-        } else {
-            if ((brute > 0) && ((brute & 0x1F) == 0))
-                PrintAndLogEx(INPLACE, "[ %02x ] %3u / %u" _CLR_, bytes_to_recover[0], brute, 0xFF);
         }
     }
     pthread_exit(NULL);
@@ -177,21 +177,21 @@ static uint64_t check(uint64_t z) {
     return ck1 | ck2 >> 24;
 }
 
-static void permute(input_stream_t *p_in, uint64_t z, int l, int r, output_stream_t *out) {
-    if (bitsLeft(p_in) == 0)
-        return;
-
-    bool pn = tailBit(p_in);
-    if (pn) { // pn = 1
-        uint8_t zl = getSixBitByte(z, l);
-
-        push6bits(out, zl + 1);
-        permute(p_in, z, l + 1, r, out);
-    } else { // otherwise
-        uint8_t zr = getSixBitByte(z, r);
-
-        push6bits(out, zr);
-        permute(p_in, z, l, r + 1, out);
+/**
+ * @brief Picks the six-bit bytes of z in the order given by the bits of p, lsb first.
+ * A set bit takes z[l] + 1 from the left half, a cleared bit z[r] from the right half.
+ * @param p
+ * @param z
+ * @param out the eight picked six-bit bytes
+ */
+static void permute(uint8_t p, uint64_t z, uint8_t out[8]) {
+    int l = 0, r = 4;
+    for (int i = 0; i < 8; i++) {
+        if ((p >> i) & 1) {
+            out[i] = (getSixBitByte(z, l++) + 1) & 0x3F;
+        } else {
+            out[i] = getSixBitByte(z, r++);
+        }
     }
 }
 
@@ -232,18 +232,8 @@ void hash0(uint64_t c, uint8_t k[8]) {
     if (x & 1) //Check if x7 is 1
         p = ~p;
 
-    input_stream_t p_in = { &p, 8, 0 };
-    uint8_t outbuffer[] = {0, 0, 0, 0, 0, 0, 0, 0};
-    output_stream_t out = {outbuffer, 0, 0};
-    permute(&p_in, zCaret, 0, 4, &out); //returns 48 bits? or 6 8-bytes
-
-    //Out is now a buffer containing six-bit bytes, should be 48 bits
-    // if all went well
-    //Shift z-values down onto the lower segment
-
-    uint64_t zTilde = x_bytes_to_num(outbuffer, sizeof(outbuffer));
-
-    zTilde >>= 16;
+    uint8_t zTilde[8];
+    permute(p, zCaret, zTilde);
 
     for (int i = 0; i < 8; i++) {
         // the key on index i is first a bit from y
@@ -258,7 +248,7 @@ void hash0(uint64_t c, uint8_t k[8]) {
         // First, place y(7-i) leftmost in k
         k[i] |= (y  << (7 - i)) & 0x80 ;
 
-        uint8_t zTilde_i = getSixBitByte(zTilde, i);
+        uint8_t zTilde_i = zTilde[i];
         // zTildeI is now on the form 00XXXXXX
         // with one leftshift, it'll be
         // 0XXXXXX0
@@ -290,13 +280,14 @@ void hash0(uint64_t c, uint8_t k[8]) {
  * @param div_key
  */
 void diversifyKey(uint8_t *csn, uint8_t *key, uint8_t *div_key) {
-    // Prepare the DES key
-    mbedtls_des_setkey_enc(&ctx_enc, key);
+    // Prepare the DES key, own context so threads can diversify in parallel
+    mbedtls_des_context ctx;
+    mbedtls_des_setkey_enc(&ctx, key);
 
     uint8_t crypted_csn[8] = {0};
 
     // Calculate DES(CSN, KEY)
-    mbedtls_des_crypt_ecb(&ctx_enc, csn, crypted_csn);
+    mbedtls_des_crypt_ecb(&ctx, csn, crypted_csn);
 
     //Calculate HASH0(DES))
     uint64_t c_csn = x_bytes_to_num(crypted_csn, sizeof(crypted_csn));
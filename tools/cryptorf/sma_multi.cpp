@@ -26,12 +26,12 @@
 #include <inttypes.h>
 #include <iostream>
 #include <vector>
-#include <map>
 #include <algorithm>   // sort, max_element, random_shuffle, remove_if, lower_bound
 #include <functional>  // greater, bind2nd
 #include <thread>      // std::thread
 #include <atomic>
 #include <mutex>
+#include <chrono>
 #include "cryptolib.h"
 #include "util.h"
 
@@ -124,50 +124,11 @@ const uint64_t left_candidates[43] = {
 };
 */
 
-typedef struct {
-    uint64_t l;
-    uint64_t m;
-    uint64_t r;
-    nibble b0;
-    nibble b1;
-    nibble b1l;
-    nibble b1r;
-    nibble b1s;
-    bool invalid;
-    uint8_t Gc[8];
-} cs_t;
-typedef cs_t *pcs;
-
 typedef struct {
     uint8_t addition;
     uint8_t out;
 } lookup_entry;
 
-enum cipher_state_side {
-    CSS_LEFT,
-    CSS_RIGHT
-};
-
-void print_cs(const char *text, pcs s) {
-    int pos;
-
-    printf("%s", text);
-
-    for (pos = 6; pos >= 0; pos--)
-        printf(" %02x", (uint8_t)(s->l >> (pos * 5)) & 0x1f);
-
-    printf(" |");
-    for (pos = 6; pos >= 0; pos--)
-        printf(" %02x", (uint8_t)(s->m >> (pos * 7)) & 0x7f);
-
-    printf(" |");
-
-    for (pos = 4; pos >= 0; pos--)
-        printf(" %02x", (uint8_t)(s->r >> (pos * 5)) & 0x1f);
-
-    printf("\n");
-}
-
 static inline uint8_t mod(uint8_t a, uint8_t m) {
     if (m == 0) {
         return 0; // Actually, divide by zero error
@@ -252,75 +213,58 @@ static void init_lookup_right_subtraction() {
     }
 }
 
-static inline void previous_left(uint8_t in, vector<cs_t> *candidate_states) {
-    pcs state;
-    size_t size = candidate_states->size();
-    for (size_t pos = 0; pos < size; pos++)  {
-        state = &((*candidate_states)[pos]);
-
-        uint8_t bx = (uint8_t)((state->l >> 30) & 0x1f);
-        unsigned b3 = (unsigned)(state->l >> 5) & 0x3e0;
-        state->l = (state->l << 5);
-
-        //Ignore impossible states
-        if (bx == 0) {
-            // Are we dealing with an impossible state?
-            if (b3 != 0) {
-                state->invalid = true;
-            } else {
-                // We only need to consider b6=0
-                state->l &= 0x7ffffffe0ull;
-                state->l ^= (((uint64_t)in & 0x1f) << 20);
-            }
-        } else {
-            uint8_t b6 = lookup_left_subtraction[b3 | bx];
-            state->l = (state->l & 0x7ffffffe0ull) | b6;
-            state->l ^= (((uint64_t)in & 0x1f) << 20);
-
-            // Check if we have a second candidate
-            if (b6 == 0x1f) {
-                cs_t nstate = *state;
-                nstate.l &= 0x7ffffffe0ull;
-                candidate_states->push_back(nstate);
-            }
+// One step back on the left register, writes the 0, 1 or 2 possible previous states
+static inline int previous_left(uint8_t in, uint64_t l, uint64_t *prev) {
+    uint8_t bx = (uint8_t)((l >> 30) & 0x1f);
+    unsigned b3 = (unsigned)(l >> 5) & 0x3e0;
+    l = (l << 5);
+
+    // Ignore impossible states
+    if (bx == 0) {
+        if (b3 != 0) {
+            return 0;
         }
+        // We only need to consider b6=0
+        prev[0] = (l & 0x7ffffffe0ull) ^ (((uint64_t)in & 0x1f) << 20);
+        return 1;
+    }
+
+    uint8_t b6 = lookup_left_subtraction[b3 | bx];
+    prev[0] = ((l & 0x7ffffffe0ull) | b6) ^ (((uint64_t)in & 0x1f) << 20);
+
+    // Check if we have a second candidate
+    if (b6 == 0x1f) {
+        prev[1] = prev[0] & 0x7ffffffe0ull;
+        return 2;
     }
+    return 1;
 }
 
-static inline void previous_right(uint8_t in, vector<cs_t> *candidate_states) {
-    pcs state;
-    size_t size = candidate_states->size();
-    for (size_t pos = 0; pos < size; pos++) {
-        state = &((*candidate_states)[pos]);
-
-        uint8_t bx = (uint8_t)((state->r >> 20) & 0x1f);
-        unsigned b16 = (unsigned)(state->r & 0x3e0);//(state->buffer_r >> 10) & 0x1f;
-
-        state->r = (state->r << 5);
-
-        // Ignore impossible states
-        if (bx == 0) {
-            if (b16 != 0) {
-                state->invalid = true;
-            } else {
-                // We only need to consider b18=0
-                state->r &= 0x1ffffe0ull;
-                state->r ^= (((uint64_t)in & 0xf8) << 12);
-            }
-        } else {
-            uint8_t b18 = lookup_right_subtraction[b16 | bx];
-            state->r = (state->r & 0x1ffffe0ull) | b18;
-            state->r ^= (((uint64_t)in & 0xf8) << 12);
-            //state->b_right  = ((b14^b17) & 0x0f);
-
-            // Check if we have a second candidate
-            if (b18 == 0x1f) {
-                cs_t nstate = *state;
-                nstate.r &= 0x1ffffe0ull;
-                candidate_states->push_back(nstate);
-            }
+// One step back on the right register, writes the 0, 1 or 2 possible previous states
+static inline int previous_right(uint8_t in, uint64_t r, uint64_t *prev) {
+    uint8_t bx = (uint8_t)((r >> 20) & 0x1f);
+    unsigned b16 = (unsigned)(r & 0x3e0);
+    r = (r << 5);
+
+    // Ignore impossible states
+    if (bx == 0) {
+        if (b16 != 0) {
+            return 0;
         }
+        // We only need to consider b18=0
+        prev[0] = (r & 0x1ffffe0ull) ^ (((uint64_t)in & 0xf8) << 12);
+        return 1;
     }
+
+    uint8_t b18 = lookup_right_subtraction[b16 | bx];
+    prev[0] = ((r & 0x1ffffe0ull) | b18) ^ (((uint64_t)in & 0xf8) << 12);
+
+    // Check if we have a second candidate
+    if (b18 == 0x1f) {
+        prev[1] = prev[0] & 0x1ffffe0ull;
+        return 2;
+    }
+    return 1;
 }
 
 static inline uint8_t next_left_fast(uint8_t in, uint64_t *left) {
@@ -355,461 +299,511 @@ static inline void sm_left_mask(const uint8_t *ks, uint8_t *mask, uint64_t rstat
 }
 
 
-std::atomic<bool> key_found{0};
-std::atomic<uint64_t> key{0};
-std::atomic<size_t> g_topbits{0};
-std::mutex g_ice_mtx;
-static uint32_t g_num_cpus = std::thread::hardware_concurrency();
 
-static void ice_sm_right_thread(
-    uint8_t offset,
-    uint8_t skips,
-    const uint8_t *ks,
-    map<uint64_t, uint64_t> *bincstates,
-    uint8_t *mask
-) {
+/*
+ * Recovery pipeline
+ *
+ * Work is handed out in fixed size chunks from an atomic counter, so all threads stay busy
+ * until the end of a stage and the run time scales with the number of cores.  Candidates
+ * never go into a growing container, every thread collects them in a small fixed size
+ * arena and hands a full arena to a preallocated sink (one atomic add, no lock) or checks
+ * it right away.
+ *
+ *  1. right scan     all 2^25 right states are scored against the keystream, every thread
+ *                    keeps its best SMA_RIGHT_BINS states
+ *  2. for every right state, best first
+ *     right rollback the last four Gc bytes are rolled back depth first and met with a
+ *                    sorted table of the states reached with the first four.  Matches go
+ *                    to a fixed size table, indexed on the two bits per Gc byte the left
+ *                    and right side share.
+ *     left scan      all 2^35 left states are filtered with the mask of the right state.
+ *                    Every hit is rolled back the same way, the left halves of Gc are
+ *                    looked up in the right index and verified with sm_auth().  The first
+ *                    thread to verify a key stops the others.
+ *
+ * The memory use does not depend on the trace, see sma_memory().
+ */
+
+#define SMA_MAX_THREADS     256
+#define SMA_RIGHT_STATES    0x2000000ull
+#define SMA_LEFT_STATES     0x800000000ull
+#define SMA_RIGHT_CHUNK     0x10000ull          // right states per work item
+#define SMA_LEFT_CHUNK      0x1000000ull        // left states per work item
+#define SMA_RIGHT_BINS      1024                // right states kept per thread and in total
+#define SMA_RIGHT_MIN_BITS  90
+#define SMA_RIGHT_CANDS     0x40000             // right Gc candidates per right state, ~2^15 expected
+#define SMA_ARENA_SIZE      1024                // entries in a thread arena
+#define SMA_MATCH_SIZE      0x100000            // 2^20 values for Gc[0..3]
 
-    uint8_t tmp_mask[16];
-    uint8_t bt;
+// the bits of Gc byte pos in a packed (big endian) Gc value
+#define SMA_GC_SHIFT(pos)   ((7 - (pos)) * 8)
+
+typedef struct {
+    uint64_t state;
+    uint32_t counter;
+} sma_match_t;
 
-    for (uint64_t counter = offset; counter < 0x2000000; counter += skips) {
-        // Reset the current bitcount of correct bits
-        size_t bits = 0;
+// Preallocated output shared by all threads, a push reserves its slots with one atomic add
+typedef struct sma_sink {
+    vector<uint64_t> items;
+    std::atomic<size_t> used{0};
+    std::atomic<size_t> dropped{0};
 
-        // Copy the state we are going to test
-        uint64_t rstate = counter;
+    explicit sma_sink(size_t capacity) : items(capacity) {}
 
-        for (uint8_t pos = 0; pos < 16; pos++) {
+    void reset(void) {
+        used = 0;
+        dropped = 0;
+    }
 
-            next_right_fast(0, &rstate);
+    void push(const uint64_t *src, size_t n) {
+        size_t at = used.fetch_add(n, std::memory_order_relaxed);
+        if (at >= items.size()) {
+            dropped += n;
+            return;
+        }
+        size_t room = items.size() - at;
+        if (n > room) {
+            dropped += n - room;
+            n = room;
+        }
+        memcpy(&items[at], src, n * sizeof(uint64_t));
+    }
 
-            bt = next_right_fast(0, &rstate) << 4;
+    size_t size(void) const {
+        return min(used.load(), items.size());
+    }
+} sma_sink_t;
 
-            next_right_fast(0, &rstate);
+typedef struct {
+    const uint8_t *ks;
+    const uint8_t *Ci;
+    const uint8_t *Q;
+    const uint8_t *Ch;
+    const uint8_t *Ci_1;
+    uint8_t mask[16];
+    uint64_t rstate_after_gc;
+    size_t topbits;
+    uint64_t topstate;
+
+    vector<sma_match_t> lbox;           // left state after Gc[0..3] -> Gc[0..3], sorted on state
+    vector<sma_match_t> rbox;           // same for the right state
+    sma_sink_t rbins{SMA_RIGHT_BINS *SMA_MAX_THREADS};
+    sma_sink_t rcands{SMA_RIGHT_CANDS};
+    vector<uint64_t> ridx;              // right candidates, grouped on the shared bits
+    vector<uint32_t> ridx_start;
+
+    std::atomic<uint64_t> next{0};      // next work item
+    std::atomic<uint64_t> done{0};      // finished work items
+    std::atomic<uint64_t> left_states{0};
+    std::atomic<uint64_t> left_cands{0};
+    std::atomic<uint64_t> combined{0};
+} sma_ctx_t;
+
+typedef void (*sma_emit_t)(void *arg, uint64_t gc);
 
-            bt |= next_right_fast(0, &rstate);
+typedef struct {
+    bool right;
+    const uint8_t *Q;
+    const vector<sma_match_t> *box;
+    sma_emit_t emit;
+    void *arg;
+} sma_rollback_t;
 
-            // xor the bits with the keystream and count the "correct" bits
-            bt ^= ks[pos];
+typedef struct {
+    uint64_t items[SMA_ARENA_SIZE];
+    size_t n;
+    sma_ctx_t *ctx;
+} sma_arena_t;
+
+std::atomic<bool> key_found{0};
+std::atomic<uint64_t> key{0};
+std::mutex g_ice_mtx;
+static uint32_t g_num_cpus = std::thread::hardware_concurrency();
+
+static bool sma_match_less(const sma_match_t &a, const sma_match_t &b) {
+    return (a.state < b.state) || ((a.state == b.state) && (a.counter < b.counter));
+}
+
+// Gc[0..3] as packed by the match table counter
+static inline uint64_t sma_gc_head(uint32_t c, bool right) {
+    uint64_t gc;
+    if (right) {
+        gc  = (uint64_t)((c >> 12) & 0xf8) << SMA_GC_SHIFT(0);
+        gc |= (uint64_t)((c >>  7) & 0xf8) << SMA_GC_SHIFT(1);
+        gc |= (uint64_t)((c >>  2) & 0xf8) << SMA_GC_SHIFT(2);
+        gc |= (uint64_t)((c <<  3) & 0xf8) << SMA_GC_SHIFT(3);
+    } else {
+        gc  = (uint64_t)((c >> 15) & 0x1f) << SMA_GC_SHIFT(0);
+        gc |= (uint64_t)((c >> 10) & 0x1f) << SMA_GC_SHIFT(1);
+        gc |= (uint64_t)((c >>  5) & 0x1f) << SMA_GC_SHIFT(2);
+        gc |= (uint64_t)(c & 0x1f) << SMA_GC_SHIFT(3);
+    }
+    return gc;
+}
 
-            // Save the mask for the left produced bits
-            tmp_mask[pos] = bt;
+// The two bits of every Gc byte that both the left and the right side know (0x18)
+static inline uint16_t sma_shared_bits(uint64_t gc) {
+    uint16_t sig = 0;
+    for (int pos = 0; pos < 8; pos++) {
+        sig = (sig << 2) | ((gc >> (SMA_GC_SHIFT(pos) + 3)) & 0x03);
+    }
+    return sig;
+}
 
-            // When the bit is xored away (=zero), it was the same, so correct ;)
-            if ((bt & 0x01) == 0) bits++;
-            if (((bt >> 1) & 0x01) == 0) bits++;
-            if (((bt >> 2) & 0x01) == 0) bits++;
-            if (((bt >> 3) & 0x01) == 0) bits++;
-            if (((bt >> 4) & 0x01) == 0) bits++;
-            if (((bt >> 5) & 0x01) == 0) bits++;
-            if (((bt >> 6) & 0x01) == 0) bits++;
-            if (((bt >> 7) & 0x01) == 0) bits++;
+// Generate 2^20 different (5 bits) values for the first 4 Gc bytes (0,1,2,3), sorted on the state they lead to
+static void sma_build_box(uint64_t state_before_gc, const uint8_t *Q, bool right, vector<sma_match_t> *box) {
+    box->resize(SMA_MATCH_SIZE);
+    for (uint32_t counter = 0; counter < SMA_MATCH_SIZE; counter++) {
+        uint64_t s = state_before_gc;
+        if (right) {
+            next_right_fast((counter >> 12) & 0xf8, &s);
+            next_right_fast((counter >> 7)  & 0xf8, &s);
+            next_right_fast(Q[4], &s);
+            next_right_fast((counter >> 2) & 0xf8, &s);
+            next_right_fast((counter << 3) & 0xf8, &s);
+            next_right_fast(Q[5], &s);
+        } else {
+            next_left_fast((counter >> 15) & 0x1f, &s);
+            next_left_fast((counter >> 10) & 0x1f, &s);
+            next_left_fast(Q[4], &s);
+            next_left_fast((counter >> 5) & 0x1f, &s);
+            next_left_fast(counter & 0x1f, &s);
+            next_left_fast(Q[5], &s);
         }
+        (*box)[counter].state = s;
+        (*box)[counter].counter = counter;
+    }
+    sort(box->begin(), box->end(), sma_match_less);
+}
 
-        g_ice_mtx.lock();
-        if (bits > g_topbits.load(std::memory_order_relaxed)) {
-            // Copy the winning mask
-            g_topbits = bits;
-            memcpy(mask, tmp_mask, 16);
+static inline int sma_previous(const sma_rollback_t *rb, uint8_t in, uint64_t state, uint64_t *prev) {
+    return rb->right ? previous_right(in, state, prev) : previous_left(in, state, prev);
+}
+
+// Rolls the state back over Q[7], Gc[7], Gc[6], Q[6], Gc[5], Gc[4] (steps 0..5), depth first so
+// only the current path is kept, and meets it with the states reached after Gc[0..3]
+static void sma_rollback(const sma_rollback_t *rb, int step, uint64_t state, uint64_t gc) {
+    uint64_t prev[2];
+    int n;
+
+    if (step == 6) {
+        sma_match_t m = { state, 0 };
+        vector<sma_match_t>::const_iterator it = lower_bound(rb->box->begin(), rb->box->end(), m, sma_match_less);
+        for (; it != rb->box->end() && it->state == state; ++it) {
+            rb->emit(rb->arg, gc | sma_gc_head(it->counter, rb->right));
         }
-        g_ice_mtx.unlock();
+        return;
+    }
 
-        // Ignore states under 90
-        if (bits >= 90) {
-            //  Make sure the bits are used for ordering
-            g_ice_mtx.lock();
-            if (bincstates->find((((uint64_t)bits) << 56) | counter) != bincstates->end())
-                bincstates->at((((uint64_t)bits) << 56) | counter) = counter;
-            else
-                bincstates->insert(std::pair<uint64_t, uint64_t>((((uint64_t)bits) << 56) | counter, counter));
-            g_ice_mtx.unlock();
+    if (step == 0 || step == 3) {
+        n = sma_previous(rb, rb->Q[(step == 0) ? 7 : 6], state, prev);
+        for (int i = 0; i < n; i++) {
+            sma_rollback(rb, step + 1, prev[i], gc);
         }
+        return;
+    }
 
-        if ((counter & 0xfffff) == 0) {
-            g_ice_mtx.lock();
-            printf(".");
-            fflush(stdout);
-            g_ice_mtx.unlock();
+    // Loop through the complete entropy of 5 bits for Gc byte 7, 6, 5, 4
+    int gcpos = (step < 3) ? 8 - step : 9 - step;
+    for (uint8_t btGc = 0; btGc < 0x20; btGc++) {
+        uint8_t in = rb->right ? (btGc << 3) : btGc;
+        n = sma_previous(rb, in, state, prev);
+        for (int i = 0; i < n; i++) {
+            sma_rollback(rb, step + 1, prev[i], gc | ((uint64_t)in << SMA_GC_SHIFT(gcpos)));
         }
     }
 }
-static uint32_t ice_sm_right(const uint8_t *ks, uint8_t *mask, vector<uint64_t> *pcrstates) {
 
-    map<uint64_t, uint64_t> bincstates;
-    g_topbits = 0;
+// Runs fn on all threads until the work items are done or a key is found, shows the progress
+static double sma_run(void (*fn)(sma_ctx_t *), sma_ctx_t *ctx, uint64_t items, const char *what) {
+
+    ctx->next = 0;
+    ctx->done = 0;
 
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     std::vector<std::thread> threads(g_num_cpus);
     for (uint32_t m = 0; m < g_num_cpus; m++) {
-        threads[m] = std::thread(ice_sm_right_thread, m, g_num_cpus, ks, &bincstates, mask);
+        threads[m] = std::thread(fn, ctx);
     }
-    for (auto &t : threads) {
-        t.join();
-    }
-
-    printf("\n");
 
-    // Clear the candidate state vector
-    pcrstates->clear();
-
-    // Copy the order the states from lowest-bin to highest-bin
-    map<uint64_t, uint64_t>::iterator it;
-    for (it = bincstates.begin(); it != bincstates.end(); ++it) {
-        pcrstates->push_back(it->second);
+    uint64_t done;
+    while (((done = ctx->done.load()) < items) && (key_found.load() == false)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (done) {
+            printf("\r\x1b[2K%s... %5.1f%%, eta %.0f s", what, (100.0 * done) / items, (elapsed * (items - done)) / done);
+        } else {
+            printf("\r\x1b[2K%s... %5.1f%%", what, 0.0);
+        }
+        fflush(stdout);
     }
 
-    // Reverse the vector order (so the highest bin comes first)
-    reverse(pcrstates->begin(), pcrstates->end());
-
-    return g_topbits;
+    for (auto &t : threads) {
+        t.join();
+    }
+    printf("\r\x1b[2K");
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 }
 
-static void ice_sm_left_thread(
-    uint8_t offset,
-    uint8_t skips,
-    const uint8_t *ks,
-    map<uint64_t, cs_t> *bincstates,
-    const uint8_t *mask
-) {
-
-    size_t pos, bits;
-    uint8_t correct_bits[16];
-    uint8_t bt;
-    lookup_entry *lookup;
+static void ice_sm_right_thread(sma_ctx_t *ctx) {
 
-    // Reset and initialize the cryptostate and vector
-    cs_t state;
-    memset(&state, 0x00, sizeof(cs_t));
-    state.invalid = false;
+    // bounded arena, min-heap of (bits << 56 | state) so the weakest bin is dropped first
+    vector<uint64_t> bins;
+    bins.reserve(SMA_RIGHT_BINS);
 
-    for (uint64_t counter = offset; counter < 0x800000000ull; counter += skips) {
-        uint64_t lstate = counter;
+    size_t topbits = 0;
+    uint64_t topstate = 0;
+    uint8_t bt;
 
-        for (pos = 0; pos < 16; pos++) {
+    uint64_t chunk;
+    while ((chunk = ctx->next.fetch_add(1)) < (SMA_RIGHT_STATES / SMA_RIGHT_CHUNK)) {
 
-            lstate = (((lstate) >> 5) | ((uint64_t)left_addition[((lstate) & 0xf801f)] << 30));
-            lookup = &(lookup_left[((lstate) & 0xf801f)]);
-            lstate = (((lstate) >> 5) | ((uint64_t)lookup->addition << 30));
-            bt = lookup->out << 4;
-            lstate = (((lstate) >> 5) | ((uint64_t)left_addition[((lstate) & 0xf801f)] << 30));
-            lookup = &(lookup_left[((lstate) & 0xf801f)]);
-            lstate = (((lstate) >> 5) | ((uint64_t)lookup->addition << 30));
-            bt |= lookup->out;
+        uint64_t end = (chunk + 1) * SMA_RIGHT_CHUNK;
+        for (uint64_t counter = chunk * SMA_RIGHT_CHUNK; counter < end; counter++) {
+            // Reset the current bitcount of correct bits
+            size_t bits = 128;
 
-            // xor the bits with the keystream and count the "correct" bits
-            bt ^= ks[pos];
+            // Copy the state we are going to test
+            uint64_t rstate = counter;
 
-            // When the REQUIRED bits are NOT xored away (=zero), ignore this wrong state
-            if ((bt & mask[pos]) != 0) break;
+            for (uint8_t pos = 0; pos < 16; pos++) {
+                next_right_fast(0, &rstate);
+                bt = next_right_fast(0, &rstate) << 4;
+                next_right_fast(0, &rstate);
+                bt |= next_right_fast(0, &rstate);
 
-            // Save the correct bits for statistical information
-            correct_bits[pos] = bt;
-        }
+                // xor the bits with the keystream, when the bit is xored away (=zero), it was the same, so correct ;)
+                bits -= __builtin_popcount(bt ^ ctx->ks[pos]);
+            }
 
-        // If we have parsed all 16 bytes of keystream, we have a valid CANDIDATE!
-        if (pos == 16) {
-            // Count the total correct bits
-            bits = 0;
-            for (pos = 0; pos < 16; pos++) {
-                // Get the next byte-value with correct bits
-                bt = correct_bits[pos];
-
-                // Count all the (correct) bits
-                // When the bit is xored away (=zero), it was the same, so correct ;)
-                if ((bt & 0x01) == 0) bits++;
-                if (((bt >> 1) & 0x01) == 0) bits++;
-                if (((bt >> 2) & 0x01) == 0) bits++;
-                if (((bt >> 3) & 0x01) == 0) bits++;
-                if (((bt >> 4) & 0x01) == 0) bits++;
-                if (((bt >> 5) & 0x01) == 0) bits++;
-                if (((bt >> 6) & 0x01) == 0) bits++;
-                if (((bt >> 7) & 0x01) == 0) bits++;
+            if (bits > topbits) {
+                topbits = bits;
+                topstate = counter;
             }
 
-            state.l = counter;
+            // Ignore states under 90
+            if (bits < SMA_RIGHT_MIN_BITS) {
+                continue;
+            }
 
             //  Make sure the bits are used for ordering
-            g_ice_mtx.lock();
-            printf(".");
-            fflush(stdout);
-            if (bincstates->find((((uint64_t)bits) << 56) | counter) != bincstates->end())
-                bincstates->at((((uint64_t)bits) << 56) | counter) = state;
-            else
-                bincstates->insert(std::pair<uint64_t, cs_t>((((uint64_t)bits) << 56) | counter, state));
-            g_ice_mtx.unlock();
-
-        }
-
-        if ((counter & 0xffffffffull) == 0) {
-            g_ice_mtx.lock();
-            printf("%02.1f%%.", ((float)100 / 8) * (counter >> 32));
-            fflush(stdout);
-            g_ice_mtx.unlock();
+            uint64_t bin = (((uint64_t)bits) << 56) | counter;
+            if (bins.size() < SMA_RIGHT_BINS) {
+                bins.push_back(bin);
+                push_heap(bins.begin(), bins.end(), greater<uint64_t>());
+            } else if (bin > bins.front()) {
+                pop_heap(bins.begin(), bins.end(), greater<uint64_t>());
+                bins.back() = bin;
+                push_heap(bins.begin(), bins.end(), greater<uint64_t>());
+            }
         }
+        ctx->done++;
     }
-}
 
-static void ice_sm_left(const uint8_t *ks, uint8_t *mask, vector<cs_t> *pcstates) {
+    ctx->rbins.push(bins.data(), bins.size());
 
-    map<uint64_t, cs_t> bincstates;
-    std::vector<std::thread> threads(g_num_cpus);
-    for (uint32_t m = 0; m < g_num_cpus; m++) {
-        threads[m] = std::thread(ice_sm_left_thread, m, g_num_cpus, ks, &bincstates, mask);
+    // lowest state wins a tie, so the top bin does not depend on the thread timing
+    g_ice_mtx.lock();
+    if ((topbits > ctx->topbits) || ((topbits == ctx->topbits) && (topstate < ctx->topstate))) {
+        ctx->topbits = topbits;
+        ctx->topstate = topstate;
     }
+    g_ice_mtx.unlock();
+}
 
-    for (auto &t : threads) {
-        t.join();
-    }
+static uint32_t ice_sm_right(sma_ctx_t *ctx, vector<uint64_t> *pcrstates, double *elapsed) {
 
-    printf("100%%\n");
+    ctx->rbins.reset();
+    ctx->topbits = 0;
+    ctx->topstate = 0;
 
-    // Clear the candidate state vector
-    pcstates->clear();
+    *elapsed = sma_run(ice_sm_right_thread, ctx, SMA_RIGHT_STATES / SMA_RIGHT_CHUNK, "Scanning right states");
 
-    // Copy the order the states from lowest-bin to highest-bin
-    map<uint64_t, cs_t>::iterator it;
-    for (it = bincstates.begin(); it != bincstates.end(); ++it) {
-        pcstates->push_back(it->second);
+    // Order the states from the highest bin to the lowest, keep the best ones
+    pcrstates->assign(ctx->rbins.items.begin(), ctx->rbins.items.begin() + ctx->rbins.size());
+    sort(pcrstates->begin(), pcrstates->end(), greater<uint64_t>());
+    if (pcrstates->size() > SMA_RIGHT_BINS) {
+        pcrstates->resize(SMA_RIGHT_BINS);
+    }
+    for (auto &s : *pcrstates) {
+        s &= 0xffffffffffffffull;
     }
-    // Reverse the vector order (so the highest bin comes first)
-    reverse(pcstates->begin(), pcstates->end());
+    return ctx->topbits;
 }
 
-static inline void previous_all_input(vector<cs_t> *pcstates, uint32_t gc_byte_index, cipher_state_side css) {
-    uint8_t btGc, in;
-    vector<cs_t> ncstates;
-    vector<cs_t> prev_ncstates;
-    vector<cs_t>::iterator itnew;
-
-    // Loop through the complete entryphy of 5 bits for each candidate
-    // We ignore zero (xor 0x00) to avoid duplicates
-    for (btGc = 0; btGc < 0x20; btGc++)  {
-        // Copy the original candidates that are supplied
-        ncstates = *pcstates;
-
-        // Rollback the (candidate) cipher states with this input
-        if (css == CSS_RIGHT) {
-            in = btGc << 3;
-            previous_right(in, &ncstates);
-        } else {
-            in = btGc;
-            previous_left(in, &ncstates);
-        }
+static void sma_arena_emit(void *arg, uint64_t gc) {
+    sma_arena_t *arena = (sma_arena_t *)arg;
+    arena->items[arena->n++] = gc;
+    if (arena->n == SMA_ARENA_SIZE) {
+        arena->ctx->rcands.push(arena->items, arena->n);
+        arena->n = 0;
+    }
+}
 
-        for (itnew = ncstates.begin(); itnew != ncstates.end(); ++itnew)  {
-            // Wipe away the invalid states
-            if (itnew->invalid == false) {
-                itnew->Gc[gc_byte_index] = in;
-                prev_ncstates.push_back(*itnew);
+// work item = one value of Gc[7]
+static void search_gc_candidates_right_thread(sma_ctx_t *ctx) {
+
+    sma_arena_t *arena = new sma_arena_t;
+    arena->n = 0;
+    arena->ctx = ctx;
+    sma_rollback_t rb = { true, ctx->Q, &ctx->rbox, sma_arena_emit, arena };
+
+    uint64_t q7[2];
+    int nq7 = previous_right(ctx->Q[7], ctx->rstate_after_gc, q7);
+
+    uint64_t btGc;
+    while ((btGc = ctx->next.fetch_add(1)) < 0x20) {
+        uint8_t in = btGc << 3;
+        for (int i = 0; i < nq7; i++) {
+            uint64_t prev[2];
+            int n = previous_right(in, q7[i], prev);
+            for (int j = 0; j < n; j++) {
+                sma_rollback(&rb, 2, prev[j], (uint64_t)in << SMA_GC_SHIFT(7));
             }
         }
+        ctx->done++;
     }
 
-    // Copy the previous states into the vector
-    *pcstates = prev_ncstates;
+    ctx->rcands.push(arena->items, arena->n);
+    delete arena;
 }
 
-static inline void search_gc_candidates_right(const uint64_t rstate_before_gc, const uint64_t rstate_after_gc, const uint8_t *Q, vector<cs_t> *pcstates) {
-    vector<cs_t>::iterator it;
-    vector<cs_t> csl_cand;
-    map<uint64_t, uint64_t> matchbox;
-    map<uint64_t, uint64_t>::iterator itmatch;
-    uint64_t rstate;
-    size_t counter;
-    cs_t state;
-
-    // Generate 2^20 different (5 bits) values for the first 4 Gc bytes (0,1,2,3)
-    for (counter = 0; counter < 0x100000; counter++) {
-        rstate  = rstate_before_gc;
-        next_right_fast((counter >> 12) & 0xf8, &rstate);
-        next_right_fast((counter >> 7)  & 0xf8, &rstate);
-        next_right_fast(Q[4], &rstate);
-        next_right_fast((counter >> 2) & 0xf8, &rstate);
-        next_right_fast((counter << 3) & 0xf8, &rstate);
-        next_right_fast(Q[5], &rstate);
-        matchbox[rstate] = counter;
-    }
-
-    // Reset and initialize the cryptostate and vecctor
-    memset(&state, 0x00, sizeof(cs_t));
-    state.invalid = false;
-    state.r = rstate_after_gc;
-    csl_cand.clear();
-    csl_cand.push_back(state);
-
-    // Generate 2^20(+splitting) different (5 bits) values for the last 4 Gc bytes (4,5,6,7)
-    previous_right(Q[7], &csl_cand);
-    previous_all_input(&csl_cand, 7, CSS_RIGHT);
-    previous_all_input(&csl_cand, 6, CSS_RIGHT);
-    previous_right(Q[6], &csl_cand);
-    previous_all_input(&csl_cand, 5, CSS_RIGHT);
-    previous_all_input(&csl_cand, 4, CSS_RIGHT);
-
-    pcstates->clear();
-
-    // Take the intersection of the corresponding states ~2^15 values (40-25 = 15 bits)
-    for (it = csl_cand.begin(); it != csl_cand.end(); ++it) {
-        itmatch = matchbox.find(it->r);
-        if (itmatch != matchbox.end()) {
-            it->Gc[0] = (itmatch->second >> 12) & 0xf8;
-            it->Gc[1] = (itmatch->second >>  7) & 0xf8;
-            it->Gc[2] = (itmatch->second >>  2) & 0xf8;
-            it->Gc[3] = (itmatch->second <<  3) & 0xf8;
-
-            pcstates->push_back(*it);
-        }
+static size_t search_gc_candidates_right(sma_ctx_t *ctx) {
+
+    ctx->rcands.reset();
+    sma_run(search_gc_candidates_right_thread, ctx, 0x20, "Rolling back right states");
+
+    // Group the candidates on the bits they share with the left side (counting sort)
+    size_t n = ctx->rcands.size();
+    ctx->ridx.resize(SMA_RIGHT_CANDS);
+    ctx->ridx_start.assign(0x10001, 0);
+    for (size_t i = 0; i < n; i++) {
+        ctx->ridx_start[sma_shared_bits(ctx->rcands.items[i]) + 1]++;
+    }
+    for (size_t sig = 0; sig < 0x10000; sig++) {
+        ctx->ridx_start[sig + 1] += ctx->ridx_start[sig];
+    }
+    vector<uint32_t> fill(ctx->ridx_start.begin(), ctx->ridx_start.end() - 1);
+    for (size_t i = 0; i < n; i++) {
+        uint64_t gc = ctx->rcands.items[i];
+        ctx->ridx[fill[sma_shared_bits(gc)]++] = gc;
     }
+    return n;
 }
 
-static inline void search_gc_candidates_left(const uint64_t lstate_before_gc, const uint8_t *Q, vector<cs_t> *pcstates) {
-    vector<cs_t> csl_cand, csl_search;
-    vector<cs_t>::iterator itsearch, itcand;
-    map<uint64_t, uint64_t> matchbox;
-    map<uint64_t, uint64_t>::iterator itmatch;
-    uint64_t lstate;
-    size_t counter;
-
-    // Generate 2^20 different (5 bits) values for the first 4 Gc bytes (0,1,2,3)
-    for (counter = 0; counter < 0x100000; counter++) {
-        lstate  = lstate_before_gc;
-        next_left_fast((counter >> 15) & 0x1f, &lstate);
-        next_left_fast((counter >> 10) & 0x1f, &lstate);
-        next_left_fast(Q[4], &lstate);
-        next_left_fast((counter >> 5) & 0x1f, &lstate);
-        next_left_fast(counter & 0x1f, &lstate);
-        next_left_fast(Q[5], &lstate);
-        matchbox[lstate] = counter;
-    }
-
-    // Copy the input candidate states and clean the output vector
-    csl_cand = *pcstates;
-    pcstates->clear();
-
-    for (itcand = csl_cand.begin(); itcand != csl_cand.end(); ++itcand) {
-        csl_search.clear();
-        csl_search.push_back(*itcand);
-
-        // Generate 2^20(+splitting) different (5 bits) values for the last 4 Gc bytes (4,5,6,7)
-        previous_left(Q[7], &csl_search);
-        previous_all_input(&csl_search, 7, CSS_LEFT);
-        previous_all_input(&csl_search, 6, CSS_LEFT);
-        previous_left(Q[6], &csl_search);
-        previous_all_input(&csl_search, 5, CSS_LEFT);
-        previous_all_input(&csl_search, 4, CSS_LEFT);
-
-        // Take the intersection of the corresponding states ~2^15 values (40-25 = 15 bits)
-        for (itsearch = csl_search.begin(); itsearch != csl_search.end(); ++itsearch) {
-            itmatch = matchbox.find(itsearch->l);
-            if (itmatch != matchbox.end()) {
-                itsearch->Gc[0] = (itmatch->second >> 15) & 0x1f;
-                itsearch->Gc[1] = (itmatch->second >> 10) & 0x1f;
-                itsearch->Gc[2] = (itmatch->second >>  5) & 0x1f;
-                itsearch->Gc[3] = itmatch->second & 0x1f;
-
-                pcstates->push_back(*itsearch);
+// Combine the left halves in the arena with the right candidates that share the overlapping bits
+static void sma_combine(sma_arena_t *arena) {
+    sma_ctx_t *ctx = arena->ctx;
+    uint8_t Gc_chk[8], Ch_chk[8], Ci_1_chk[8];
+    crypto_state_t ls;
+
+    for (size_t i = 0; i < arena->n; i++) {
+        uint64_t lgc = arena->items[i];
+        uint16_t sig = sma_shared_bits(lgc);
+        uint32_t end = ctx->ridx_start[sig + 1];
+
+        ctx->combined += end - ctx->ridx_start[sig];
+        for (uint32_t r = ctx->ridx_start[sig]; r < end; r++) {
+            uint64_t tkey = lgc | ctx->ridx[r];
+            num_to_bytes(tkey, 8, Gc_chk);
+
+            sm_auth(Gc_chk, ctx->Ci, ctx->Q, Ch_chk, Ci_1_chk, &ls);
+            if ((memcmp(Ch_chk, ctx->Ch, 8) == 0) && (memcmp(Ci_1_chk, ctx->Ci_1, 8) == 0)) {
+                bool expected = false;
+                if (key_found.compare_exchange_strong(expected, true)) {
+                    key = tkey;
+                }
+                break;
             }
         }
-        printf(".");
-        fflush(stdout);
     }
-    printf("\n");
+    ctx->left_cands += arena->n;
+    arena->n = 0;
 }
 
-void combine_valid_left_right_states(vector<cs_t> *plcstates, vector<cs_t> *prcstates, vector<uint64_t> *pgc_candidates) {
-    vector<cs_t>::iterator itl, itr;
+static void sma_combine_emit(void *arg, uint64_t gc) {
+    sma_arena_t *arena = (sma_arena_t *)arg;
+    arena->items[arena->n++] = gc;
+    if (arena->n == SMA_ARENA_SIZE) {
+        sma_combine(arena);
+    }
+}
+
+static void ice_sm_left_thread(sma_ctx_t *ctx) {
+
     size_t pos;
-    uint64_t gc;
-    bool valid;
+    uint8_t bt;
+    lookup_entry *lookup;
+    const uint8_t *ks = ctx->ks;
+    const uint8_t *mask = ctx->mask;
 
-    vector<cs_t> outer, inner;
-    if (plcstates->size() > prcstates->size()) {
-        outer = *plcstates;
-        inner = *prcstates;
-    } else {
-        outer = *prcstates;
-        inner = *plcstates;
-    }
-
-    printf("Outer  " _YELLOW_("%zu")" , inner " _YELLOW_("%zu") "\n", outer.size(), inner.size());
-
-    // Clean up the candidate list
-    pgc_candidates->clear();
-    for (itl = outer.begin(); itl != outer.end(); ++itl) {
-        for (itr = inner.begin(); itr != inner.end(); ++itr) {
-            valid = true;
-            // Check for left and right candidates that share the overlapping bits (8 x 2bits of Gc)
-            for (pos = 0; pos < 8; pos++) {
-                if ((itl->Gc[pos] & 0x18) != (itr->Gc[pos] & 0x18)) {
-                    valid = false;
-                    break;
-                }
-            }
+    sma_arena_t *arena = new sma_arena_t;
+    arena->n = 0;
+    arena->ctx = ctx;
+    sma_rollback_t rb = { false, ctx->Q, &ctx->lbox, sma_combine_emit, arena };
 
-            if (valid) {
-                gc = 0;
-                for (pos = 0; pos < 8; pos++) {
-                    gc <<= 8;
-                    gc |= (itl->Gc[pos] | itr->Gc[pos]);
-                }
+    uint64_t chunk;
+    while ((key_found.load(std::memory_order_relaxed) == false) &&
+            ((chunk = ctx->next.fetch_add(1)) < (SMA_LEFT_STATES / SMA_LEFT_CHUNK))) {
 
-                pgc_candidates->push_back(gc);
-            }
-        }
-    }
-    printf("Found a total of " _YELLOW_("%llu")" combinations, ", ((unsigned long long)plcstates->size()) * prcstates->size());
-    printf("but only " _GREEN_("%zu")" were valid!\n", pgc_candidates->size());
-}
+        uint64_t end = (chunk + 1) * SMA_LEFT_CHUNK;
+        for (uint64_t counter = chunk * SMA_LEFT_CHUNK; counter < end; counter++) {
+            uint64_t lstate = counter;
 
-static void ice_compare(
-    uint8_t offset,
-    uint8_t skips,
-    vector<uint64_t> *candidates,
-    crypto_state_t *ostate,
-    uint8_t *Ci,
-    uint8_t *Q,
-    uint8_t *Ch,
-    uint8_t *Ci_1
-) {
-    uint8_t Gc_chk[8] = {0};
-    uint8_t Ch_chk[8] = {0};
-    uint8_t Ci_1_chk[8] = {0};
+            for (pos = 0; pos < 16; pos++) {
 
-    crypto_state_t ls;
-    ls.b0 = ostate->b0;
-    ls.b1 = ostate->b1;
-    ls.b1l = ostate->b1l;
-    ls.b1r = ostate->b1r;
-    ls.b1s = ostate->b1s;
-    ls.l = ostate->l;
-    ls.m = ostate->m;
-    ls.r = ostate->r;
-
-    for (std::size_t i = offset; i < candidates->size(); i += skips) {
-        if (key_found.load(std::memory_order_relaxed))
-            break;
+                lstate = (((lstate) >> 5) | ((uint64_t)left_addition[((lstate) & 0xf801f)] << 30));
+                lookup = &(lookup_left[((lstate) & 0xf801f)]);
+                lstate = (((lstate) >> 5) | ((uint64_t)lookup->addition << 30));
+                bt = lookup->out << 4;
+                lstate = (((lstate) >> 5) | ((uint64_t)left_addition[((lstate) & 0xf801f)] << 30));
+                lookup = &(lookup_left[((lstate) & 0xf801f)]);
+                lstate = (((lstate) >> 5) | ((uint64_t)lookup->addition << 30));
+                bt |= lookup->out;
 
-        uint64_t tkey = candidates->at(i);
-        num_to_bytes(tkey, 8, Gc_chk);
+                // xor the bits with the keystream and count the "correct" bits
+                bt ^= ks[pos];
 
-        sm_auth(Gc_chk, Ci, Q, Ch_chk, Ci_1_chk, &ls);
-        if ((memcmp(Ch_chk, Ch, 8) == 0) && (memcmp(Ci_1_chk, Ci_1, 8) == 0)) {
-            g_ice_mtx.lock();
-            key_found = true;
-            key = tkey;
-            g_ice_mtx.unlock();
-            break;
+                // When the REQUIRED bits are NOT xored away (=zero), ignore this wrong state
+                if ((bt & mask[pos]) != 0) break;
+            }
+
+            // If we have parsed all 16 bytes of keystream, we have a valid CANDIDATE!
+            if (pos < 16) {
+                continue;
+            }
+
+            ctx->left_states++;
+            sma_rollback(&rb, 0, counter, 0);
+            sma_combine(arena);
+
+            if (key_found.load(std::memory_order_relaxed)) {
+                break;
+            }
         }
+        ctx->done++;
     }
-    return;
+
+    delete arena;
+}
+
+static size_t sma_memory(void) {
+    return (2 * SMA_MATCH_SIZE * sizeof(sma_match_t))
+           + (SMA_RIGHT_BINS * SMA_MAX_THREADS * sizeof(uint64_t))
+           + (2 * SMA_RIGHT_CANDS * sizeof(uint64_t)) + (0x10001 * sizeof(uint32_t))
+           + (g_num_cpus * (sizeof(sma_arena_t) + (SMA_RIGHT_BINS * sizeof(uint64_t))));
 }
 
 int main(int argc, const char *argv[]) {
     size_t pos;
     crypto_state_t ostate;
     uint64_t rstate_before_gc, lstate_before_gc;
-    vector<uint64_t> rstates, pgc_candidates;
+    vector<uint64_t> rstates;
     vector<uint64_t>::iterator itrstates;
-    vector<cs_t> crstates, clstates;
     uint32_t rbits;
+    double right_time, left_time = 0;
+    uint64_t left_scanned = 0;
 
     //  uint8_t   Gc[ 8] = {0x4f,0x79,0x4a,0x46,0x3f,0xf8,0x1d,0x81};
     //  uint8_t   Gc[ 8] = {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
@@ -826,17 +820,24 @@ int main(int argc, const char *argv[]) {
     //  uint8_t mask[16] = {0x04,0xb0,0xe1,0x10,0xc0,0x33,0x44,0x20,0x20,0x00,0x70,0x8c,0x22,0x04,0x10,0x80};
 
     uint8_t   ks[16];
-    uint8_t mask[16];
 
     uint64_t nCi;   // Card random
     uint64_t nQ;    // Reader random
     uint64_t nCh;   // Reader challenge
     uint64_t nCi_1; // Card answer
 
-    if ((argc != 2) && (argc != 5)) {
+    // optional thread count
+    if ((argc > 2) && (strcmp(argv[1], "-t") == 0)) {
+        g_num_cpus = atoi(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+
+    if (((argc != 2) && (argc != 5)) || (g_num_cpus == 0) || (g_num_cpus > SMA_MAX_THREADS)) {
         printf("SecureMemory recovery - (c) Radboud University Nijmegen\n\n");
-        printf("syntax: sma_multi simulate\n");
-        printf("        sma_multi <Ci> <Q> <Ch> <Ci+1>\n\n");
+        printf("syntax: sma_multi [-t <threads>] simulate\n");
+        printf("        sma_multi [-t <threads>] <Ci> <Q> <Ch> <Ci+1>\n\n");
+        printf("  -t    number of threads, 1..%u (default: all cores)\n\n", SMA_MAX_THREADS);
         return 1;
     }
 
@@ -885,6 +886,7 @@ int main(int argc, const char *argv[]) {
     printf("\n");
 
     printf("\nMultithreaded, will use " _YELLOW_("%u") " threads\n", g_num_cpus);
+    printf("Memory needed " _YELLOW_("%zu") " MB, does not depend on the trace\n", (sma_memory() + 0xfffff) >> 20);
     printf("Initializing lookup tables for increasing cipher speed\n");
 
     std::thread foo_left(init_lookup_left);
@@ -897,6 +899,13 @@ int main(int argc, const char *argv[]) {
     foo_leftsub.join();
     foo_rightsub.join();
 
+    sma_ctx_t *ctx = new sma_ctx_t;
+    ctx->ks = ks;
+    ctx->Ci = Ci;
+    ctx->Q = Q;
+    ctx->Ch = Ch;
+    ctx->Ci_1 = Ci_1;
+
     // Load in the ci (tag-nonce), together with the first half of Q (reader-nonce)
     rstate_before_gc = 0;
     lstate_before_gc = 0;
@@ -911,9 +920,12 @@ int main(int argc, const char *argv[]) {
         next_left_fast(Q[pos], &lstate_before_gc);
     }
 
+    // The meet-in-the-middle tables only depend on the state before Gc, build them once
+    sma_build_box(rstate_before_gc, Q, true, &ctx->rbox);
+    sma_build_box(lstate_before_gc, Q, false, &ctx->lbox);
+
     printf("Determing the right states that correspond to the keystream\n");
-    //rbits = sm_right(ks, mask, &rstates);
-    rbits = ice_sm_right(ks, mask, &rstates);
+    rbits = ice_sm_right(ctx, &rstates, &right_time);
 
     printf("Top-bin for the right state contains " _GREEN_("%u")" correct bits\n", rbits);
     printf("Total count of right bins: " _YELLOW_("%zu") "\n", rstates.size());
@@ -922,43 +934,31 @@ int main(int argc, const char *argv[]) {
         printf("\n" _RED_("WARNING!!!") ", better find another trace, the right top-bin is smaller than 96 bits\n\n");
     }
 
-    for (itrstates = rstates.begin(); itrstates != rstates.end(); ++itrstates) {
-        uint64_t rstate_after_gc = *itrstates;
-        sm_left_mask(ks, mask, rstate_after_gc);
-        printf("Using the state from the top-right bin: " _YELLOW_("0x%07" PRIx64)"\n", rstate_after_gc);
+    key_found = false;
+    key = 0;
 
-        search_gc_candidates_right(rstate_before_gc, rstate_after_gc, Q, &crstates);
-        printf("Found " _YELLOW_("%zu")" right candidates using the meet-in-the-middle attack\n", crstates.size());
-        if (crstates.size() == 0) continue;
+    for (itrstates = rstates.begin(); itrstates != rstates.end(); ++itrstates) {
+        ctx->rstate_after_gc = *itrstates;
+        sm_left_mask(ks, ctx->mask, ctx->rstate_after_gc);
+        printf("Using the state from the top-right bin: " _YELLOW_("0x%07" PRIx64)"\n", ctx->rstate_after_gc);
+
+        size_t nright = search_gc_candidates_right(ctx);
+        printf("Found " _YELLOW_("%zu")" right candidates using the meet-in-the-middle attack\n", nright);
+        if (ctx->rcands.dropped) {
+            printf(_RED_("WARNING!!!") ", right candidate table is full, " _YELLOW_("%zu") " candidates dropped\n", ctx->rcands.dropped.load());
+        }
+        if (nright == 0) continue;
 
         printf("Calculating left states using the (unknown bits) mask from the top-right state\n");
-        //sm_left(ks, mask, &clstates);
-        ice_sm_left(ks, mask, &clstates);
-
-        printf("Found a total of " _YELLOW_("%zu")" left cipher states, recovering left candidates...\n", clstates.size());
-        if (clstates.size() == 0) continue;
-        search_gc_candidates_left(lstate_before_gc, Q, &clstates);
+        printf("Every left state is rolled back and combined with the right candidates on the spot\n");
+        ctx->left_states = 0;
+        ctx->left_cands = 0;
+        ctx->combined = 0;
+        left_time += sma_run(ice_sm_left_thread, ctx, SMA_LEFT_STATES / SMA_LEFT_CHUNK, "Scanning left states");
+        left_scanned += min<uint64_t>(ctx->done.load(), SMA_LEFT_STATES / SMA_LEFT_CHUNK) * SMA_LEFT_CHUNK;
 
-
-        printf("The meet-in-the-middle attack returned " _YELLOW_("%zu")" left cipher candidates\n", clstates.size());
-        if (clstates.size() == 0) continue;
-
-        printf("Combining left and right states, disposing invalid combinations\n");
-        combine_valid_left_right_states(&clstates, &crstates, &pgc_candidates);
-
-        printf("Filtering the correct one using the middle part\n");
-
-
-        key_found = false;
-        key = 0;
-        std::vector<std::thread> threads(g_num_cpus);
-        for (uint32_t m = 0; m < g_num_cpus; m++) {
-            threads[m] =  std::thread(ice_compare, m, g_num_cpus, &pgc_candidates, &ostate, ref(Ci), ref(Q), ref(Ch), ref(Ci_1));
-        }
-
-        for (auto &t : threads) {
-            t.join();
-        }
+        printf("Found a total of " _YELLOW_("%" PRIu64)" left cipher states, " _YELLOW_("%" PRIu64) " left candidates\n", ctx->left_states.load(), ctx->left_cands.load());
+        printf("Checked " _YELLOW_("%" PRIu64) " combinations that share the overlapping bits\n", ctx->combined.load());
 
         if (key_found) {
             printf("\nValid key found [ " _GREEN_("%016" PRIx64)" ]\n\n", key.load());
@@ -967,7 +967,12 @@ int main(int argc, const char *argv[]) {
 
         printf(_RED_("\nCould not find key using this right cipher state.\n\n"));
     }
-    return 0;
+
+    printf("Timing: right scan %.1f s, left scan %.1f s, %.1f M left states/s on %u threads\n",
+           right_time, left_time, (left_time > 0) ? (left_scanned / left_time) / 1e6 : 0.0, g_num_cpus);
+
+    delete ctx;
+    return (key_found) ? 0 : 1;
 }
 
 #if defined(__cplusplus)
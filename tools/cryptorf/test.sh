@@ -1,5 +1,26 @@
 #!/bin/sh
 
+# usage: ./test.sh          run the vectors with sma and sma_multi
+#        ./test.sh bench    run the vectors with sma_multi on 1, 2, 4 .. all cores
+
+if [ "$1" = "bench" ]; then
+    CORES=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)
+    for VECTOR in "c2fa94a5231d14e1 d291eeef5f76e6df 586385693a9b0f2c ec9aba404505b0fa" \
+                  "ffffffffffffffff 1234567812345678 88c9d4466a501a87 dec2ee1b1c9276e9"; do
+        T=1
+        while [ "$T" -le "$CORES" ]; do
+            echo "== $VECTOR, $T threads"
+            ./sma_multi -t $T $VECTOR | grep -E "Valid key|Timing|Memory needed"
+            if [ "$T" -lt "$CORES" ] && [ $((T * 2)) -gt "$CORES" ]; then
+                T=$CORES
+            else
+                T=$((T * 2))
+            fi
+        done
+    done
+    exit 0
+fi
+
 # harder test
 time ./sma c2fa94a5231d14e1 d291eeef5f76e6df 586385693a9b0f2c ec9aba404505b0fa
 time ./sma_multi c2fa94a5231d14e1 d291eeef5f76e6df 586385693a9b0f2c ec9aba404505b0fa
@@ -0,0 +1,362 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// Standalone brute forcer for hardnested work units.
+//
+//  hf mf hardnested -r --export <dir>     writes <dir>/hardnested_unit_NNNNN.bin
+//  hardnested_worker <unit files>         writes <dir>/hardnested_unit_NNNNN.res
+//  hf mf hardnested --merge <dir>         collects the results
+//
+// Units are independent of each other and can be cracked on any number of machines.
+//-----------------------------------------------------------------------------
+#define __STDC_FORMAT_MACROS
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "ui.h"
+#include "util_posix.h"
+#include "hardnested_bruteforce.h"
+#include "hardnested_bf_core.h"
+
+#define EVEN_STATE 0
+#define ODD_STATE  1
+
+typedef struct {
+    uint32_t unit;
+    uint32_t guess;
+    uint32_t cuid;
+    uint8_t best_first_bytes[256];
+    uint32_t nonces_to_bruteforce;
+    uint32_t bf_test_nonce[256];
+    uint8_t bf_test_nonce_par[256];
+    uint8_t bf_test_nonce_2nd_byte[256];
+    noncelist_t nonces[256];
+    noncelistentry_t *entries;
+    uint32_t num_buckets;
+    statelist_t *buckets;
+} work_unit_t;
+
+static pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+static work_unit_t *g_unit;
+static uint32_t keys_found = 0;
+static uint64_t num_keys_tested = 0;
+static uint64_t found_key = 0;
+static uint32_t next_bucket = 0;
+
+// the cores only report errors and debug output, keep it simple
+void PrintAndLogEx(logLevel_t level, const char *fmt, ...) {
+    char buffer[MAX_PRINT_BUFFER] = {0};
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+
+    pthread_mutex_lock(&print_lock);
+    FILE *out = (level == ERR || level == WARNING || level == FAILED) ? stderr : stdout;
+    fprintf(out, "%s%s", buffer, (level == INPLACE) ? "" : "\n");
+    fflush(out);
+    pthread_mutex_unlock(&print_lock);
+}
+
+static void free_unit(work_unit_t *u) {
+    if (u->buckets) {
+        for (uint32_t i = 0; i < u->num_buckets; i++) {
+            free(u->buckets[i].states[EVEN_STATE]);
+            free(u->buckets[i].states[ODD_STATE]);
+        }
+    }
+    free(u->buckets);
+    free(u->entries);
+    free(u);
+}
+
+static bool read_u32(FILE *f, uint32_t *v) {
+    return fread(v, sizeof(uint32_t), 1, f) == 1;
+}
+
+static work_unit_t *load_unit(const char *fn) {
+
+    FILE *f = fopen(fn, "rb");
+    if (f == NULL) {
+        PrintAndLogEx(ERR, "Could not open " _YELLOW_("%s"), fn);
+        return NULL;
+    }
+
+    work_unit_t *u = calloc(1, sizeof(work_unit_t));
+    if (u == NULL) {
+        PrintAndLogEx(ERR, "Failed to allocate memory");
+        fclose(f);
+        return NULL;
+    }
+
+    char magic[8] = {0};
+    uint32_t version = 0;
+    bool ok = (fread(magic, 1, sizeof(magic), f) == sizeof(magic));
+    ok &= read_u32(f, &version);
+    if (ok == false || memcmp(magic, HN_UNIT_MAGIC, sizeof(magic)) != 0 || version != HN_UNIT_VERSION) {
+        PrintAndLogEx(ERR, _YELLOW_("%s") " is not a hardnested work unit (or was written by another version)", fn);
+        goto fail;
+    }
+
+    ok &= read_u32(f, &u->unit);
+    ok &= read_u32(f, &u->guess);
+    ok &= read_u32(f, &u->cuid);
+    ok &= (fread(u->best_first_bytes, 1, 256, f) == 256);
+    ok &= read_u32(f, &u->nonces_to_bruteforce);
+    if (ok == false || u->nonces_to_bruteforce > 256) {
+        goto truncated;
+    }
+    ok &= (fread(u->bf_test_nonce, sizeof(uint32_t), u->nonces_to_bruteforce, f) == u->nonces_to_bruteforce);
+    ok &= (fread(u->bf_test_nonce_par, 1, u->nonces_to_bruteforce, f) == u->nonces_to_bruteforce);
+    for (uint32_t i = 0; i < u->nonces_to_bruteforce; i++) {
+        u->bf_test_nonce_2nd_byte[i] = (u->bf_test_nonce[i] >> 16) & 0xff;
+    }
+
+    // rebuild the per first byte nonce lists used by verify_key()
+    uint32_t counts[256] = {0};
+    uint32_t total = 0;
+    long nonces_start = ftell(f);
+    for (uint16_t i = 0; i < 256 && ok; i++) {
+        ok &= read_u32(f, &counts[i]);
+        ok &= (fseek(f, (long)counts[i] * 5, SEEK_CUR) == 0);
+        total += counts[i];
+    }
+    if (ok == false || fseek(f, nonces_start, SEEK_SET) != 0) {
+        goto truncated;
+    }
+
+    u->entries = calloc(total + 1, sizeof(noncelistentry_t));
+    if (u->entries == NULL) {
+        PrintAndLogEx(ERR, "Failed to allocate memory");
+        goto fail;
+    }
+
+    noncelistentry_t *e = u->entries;
+    for (uint16_t i = 0; i < 256 && ok; i++) {
+        uint32_t count = 0;
+        ok &= read_u32(f, &count);
+        u->nonces[i].num = count;
+        noncelistentry_t **link = &u->nonces[i].first;
+        for (uint32_t j = 0; j < count && ok; j++, e++) {
+            ok &= read_u32(f, &e->nonce_enc);
+            ok &= (fread(&e->par_enc, 1, 1, f) == 1);
+            *link = e;
+            link = (noncelistentry_t **)&e->next;
+        }
+    }
+
+    ok &= read_u32(f, &u->num_buckets);
+    if (ok == false) {
+        goto truncated;
+    }
+
+    // one extra, zeroed, entry terminates the list like in the client
+    u->buckets = calloc(u->num_buckets + 1, sizeof(statelist_t));
+    if (u->buckets == NULL) {
+        PrintAndLogEx(ERR, "Failed to allocate memory");
+        goto fail;
+    }
+
+    for (uint32_t i = 0; i < u->num_buckets && ok; i++) {
+        statelist_t *b = &u->buckets[i];
+        ok &= read_u32(f, &b->len[EVEN_STATE]);
+        ok &= read_u32(f, &b->len[ODD_STATE]);
+        if (ok == false) {
+            break;
+        }
+        for (uint8_t oe = EVEN_STATE; oe <= ODD_STATE; oe++) {
+            b->states[oe] = calloc(b->len[oe] + 1, sizeof(uint32_t));
+            if (b->states[oe] == NULL) {
+                PrintAndLogEx(ERR, "Failed to allocate memory");
+                goto fail;
+            }
+        }
+        ok &= (fread(b->states[EVEN_STATE], sizeof(uint32_t), b->len[EVEN_STATE], f) == b->len[EVEN_STATE]);
+        ok &= (fread(b->states[ODD_STATE], sizeof(uint32_t), b->len[ODD_STATE], f) == b->len[ODD_STATE]);
+        b->next = &u->buckets[i + 1];
+    }
+
+    if (ok == false) {
+        goto truncated;
+    }
+
+    fclose(f);
+    return u;
+
+truncated:
+    PrintAndLogEx(ERR, _YELLOW_("%s") " is truncated", fn);
+fail:
+    fclose(f);
+    free_unit(u);
+    return NULL;
+}
+
+static void *crack_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        uint32_t i = __atomic_fetch_add(&next_bucket, 1, __ATOMIC_SEQ_CST);
+        if (i >= g_unit->num_buckets || __atomic_load_n(&keys_found, __ATOMIC_SEQ_CST)) {
+            break;
+        }
+
+        statelist_t *b = &g_unit->buckets[i];
+        if (b->len[EVEN_STATE] == 0 || b->len[ODD_STATE] == 0) {
+            continue;
+        }
+
+        const uint64_t key = crack_states_bitsliced(g_unit->cuid, g_unit->best_first_bytes, b, &keys_found, &num_keys_tested,
+                                                    g_unit->nonces_to_bruteforce, g_unit->bf_test_nonce_2nd_byte, g_unit->nonces);
+        if (key != -1) {
+            __atomic_store_n(&found_key, key, __ATOMIC_SEQ_CST);
+            __atomic_fetch_add(&keys_found, 1, __ATOMIC_SEQ_CST);
+            break;
+        }
+    }
+    return NULL;
+}
+
+static bool write_result(const char *unit_fn, work_unit_t *u) {
+    char fn[1024];
+    size_t len = strlen(unit_fn);
+    if (len >= 4 && strcmp(unit_fn + len - 4, ".bin") == 0) {
+        snprintf(fn, sizeof(fn), "%.*s.res", (int)(len - 4), unit_fn);
+    } else {
+        snprintf(fn, sizeof(fn), "%s.res", unit_fn);
+    }
+
+    char tmp[1040];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", fn);
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) {
+        PrintAndLogEx(ERR, "Could not create " _YELLOW_("%s"), tmp);
+        return false;
+    }
+
+    fprintf(f, "unit %u\nstates %" PRIu64 "\n", u->unit, num_keys_tested);
+    if (keys_found) {
+        fprintf(f, "key %012" PRIx64 "\n", found_key);
+    } else {
+        fprintf(f, "key none\n");
+    }
+
+    if (fclose(f) != 0 || rename(tmp, fn) != 0) {
+        PrintAndLogEx(ERR, "Could not write " _YELLOW_("%s"), fn);
+        return false;
+    }
+    return true;
+}
+
+static int usage(void) {
+    printf("\n");
+    printf("syntax:  hardnested_worker [-t <threads>] <unit file> [<unit file> ...]\n\n");
+    printf("Cracks work units written by " _YELLOW_("hf mf hardnested -r --export <dir>") " and stores\n");
+    printf("the result next to each unit. Collect the results with " _YELLOW_("hf mf hardnested --merge <dir>") "\n\n");
+    printf("samples:\n");
+    printf("\n");
+    printf("  ./hardnested_worker work/hardnested_unit_00000.bin\n");
+    printf("  ./hardnested_worker -t 8 work/hardnested_unit_000*.bin\n");
+    printf("\n");
+    return 1;
+}
+
+int main(int argc, char *const argv[]) {
+
+    int thread_count = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:h")) != -1) {
+        switch (opt) {
+            case 't':
+                thread_count = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                return usage();
+        }
+    }
+
+    if (optind >= argc) {
+        return usage();
+    }
+
+#if !defined(_WIN32)
+    if (thread_count < 1) {
+        thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+#endif
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+
+    bool found_any = false;
+    int ret = 0;
+
+    for (int a = optind; a < argc; a++) {
+        const char *fn = argv[a];
+        work_unit_t *u = load_unit(fn);
+        if (u == NULL) {
+            ret = 1;
+            continue;
+        }
+
+        uint64_t total = 0;
+        for (uint32_t i = 0; i < u->num_buckets; i++) {
+            total += (uint64_t)u->buckets[i].len[EVEN_STATE] * u->buckets[i].len[ODD_STATE];
+        }
+        printf("[=] unit " _YELLOW_("%u") " ( guess %u, cuid %08x ) - %u buckets, %" PRIu64 " states, %d threads\n",
+               u->unit, u->guess, u->cuid, u->num_buckets, total, thread_count);
+
+        g_unit = u;
+        keys_found = 0;
+        num_keys_tested = 0;
+        found_key = 0;
+        next_bucket = 0;
+
+        uint64_t t1 = msclock();
+        bitslice_test_nonces(u->nonces_to_bruteforce, u->bf_test_nonce, u->bf_test_nonce_par);
+
+        pthread_t threads[thread_count];
+        for (int i = 0; i < thread_count; i++) {
+            pthread_create(&threads[i], NULL, crack_thread, NULL);
+        }
+        for (int i = 0; i < thread_count; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        t1 = msclock() - t1;
+
+        if (keys_found) {
+            printf("[+] Key found [ " _GREEN_("%012" PRIx64) " ]\n", found_key);
+            found_any = true;
+        } else {
+            printf("[-] no key in this unit\n");
+        }
+        printf("[=] time in brute force %.1f s, %.0f states/s\n", (float)t1 / 1000.0, t1 ? (float)num_keys_tested * 1000.0 / t1 : 0.0);
+
+        if (write_result(fn, u) == false) {
+            ret = 1;
+        }
+        free_unit(u);
+
+        if (found_any) {
+            break;
+        }
+    }
+
+    return ret;
+}
@@ -1,10 +1,22 @@
 /*
  * ht2crack2buildtable.c
  * This builds the 1.2TB table and sorts it.
+ *
+ * The build runs as a pipeline:
+ *  - build threads generate keystream/state entries into a private staging area, partition
+ *    it by bucket and append each run to the shared bucket under a single lock;
+ *  - sort threads pull buckets from a shared work queue, radix sort them in memory (falling
+ *    back to sorted runs and a streaming merge when a bucket is bigger than SORTMAX) and
+ *    record the per-bucket offsets for the index;
+ *  - the index is written to sorted/index.bin for ht2crack2search to mmap.
+ *
+ * './ht2crack2buildtable index' only (re)creates the index for an existing sorted/ tree.
  */
 
 #include "ht2crackutils.h"
+#include "ht2crack2index.h"
 #include <stdlib.h>
+#include <errno.h>
 
 // DATAMAX is the size of each bucket (bytes).  There are 65536 buckets so choose a value such that
 // DATAMAX * 65536 < RAM available.  For ex, if you want to use 12GB of RAM (for a 16GB machine
@@ -21,15 +33,32 @@
 // threads.  This will most likely only be a problem with network disks; SATA should be okay;
 // USB2/3 should keep up.
 //
-// These MUST be a power of 2 for the maths to work - you have been warned!
-// Also, sort threads MUST be <= build threads or a horrible buffer overflow will happen!
+// NUM_BUILD_THREADS MUST be a power of 2 for the maths to work - you have been warned!
+// Sort threads take buckets from a work queue, so NUM_SORT_THREADS can be any value.
 #define NUM_BUILD_THREADS 8
 #define NUM_SORT_THREADS 8
 
+// STAGE_ENTRIES is the number of entries each build thread generates before handing them to the
+// buckets.  Each build thread uses STAGE_ENTRIES * 22 bytes.
+#define STAGE_ENTRIES (1 << 20)
+
+// SORTMAX is the largest bucket (bytes) a sort thread sorts in one go; each sort thread uses twice
+// this much RAM.  Buckets are ~20MB, bigger ones are sorted in runs and merged from disk.
+#define SORTMAX (6710886UL * DATASIZE) // ~64MB
+
+// MERGEBUF is the read buffer (bytes) per run while merging
+#define MERGEBUF (104857UL * DATASIZE) // ~1MB
+
+// TABLE_BITS sets the table size to 2^TABLE_BITS entries.  Only lower it to make a test table.
+#define TABLE_BITS 37
+
 // DATASIZE is the number of bytes in an entry.  This is 10; 4 bytes of keystream (2 are in the filepath) +
 // 6 bytes of PRNG state.
 #define DATASIZE 10
 
+// staged entries carry the two bucket bytes in front of the stored data
+#define STAGESIZE (DATASIZE + 2)
+
 int debug = 0;
 
 // table entry for a bucket
@@ -40,10 +69,25 @@ struct table {
     unsigned char *ptr;
 };
 
+// per build thread staging area
+struct stage {
+    unsigned char *raw;     // generated entries, STAGESIZE each
+    unsigned char *part;    // entries partitioned by bucket, DATASIZE each
+    uint32_t *start;        // first entry of each bucket in part, plus end marker
+    uint32_t *fill;         // scatter position of each bucket
+    uint32_t n;
+};
 
 // actual table
 struct table *t;
 
+// per bucket offsets for the index, HT2INDEX_SPAN values per bucket
+uint32_t *tindex;
+
+// work queue for the sort threads
+pthread_mutex_t sortmutex = PTHREAD_MUTEX_INITIALIZER;
+int nextbucket = 0;
+
 // jump table 1
 uint64_t d[48];
 int nsteps;
@@ -112,6 +156,33 @@ static void free_tables(struct table *tt) {
 }
 
 
+// write all of buf, retrying short writes
+static void writeall(int fd, const unsigned char *buf, uint64_t len, const char *name) {
+    while (len) {
+        ssize_t ret = write(fd, buf, len);
+        if (ret <= 0) {
+            printf("cannot write all of the data to %s\n", name);
+            exit(1);
+        }
+        buf += ret;
+        len -= ret;
+    }
+}
+
+// read all of len into buf from offset, retrying short reads
+static void readall(int fd, unsigned char *buf, uint64_t len, uint64_t offset, const char *name) {
+    while (len) {
+        ssize_t ret = pread(fd, buf, len, offset);
+        if (ret <= 0) {
+            printf("cannot read all of the data from %s\n", name);
+            exit(1);
+        }
+        buf += ret;
+        len -= ret;
+        offset += ret;
+    }
+}
+
 
 // write (partial) table to file
 static void writetable(struct table *t1) {
@@ -120,17 +191,14 @@ static void writetable(struct table *t1) {
     if (debug) printf("writetable %s\n", t1->path);
 
     fd = open(t1->path, O_WRONLY | O_CREAT | O_APPEND, 0644);
-    if (fd <= 0) {
+    if (fd < 0) {
         printf("writetable cannot open file %s for appending\n", t1->path);
         exit(1);
     }
 
     if (debug) printf("writetable %s opened\n", t1->path);
 
-    if (write(fd, t1->data, t1->ptr - t1->data) < (t1->ptr - t1->data)) {
-        printf("writetable cannot write all of the data\n");
-        exit(1);
-    }
+    writeall(fd, t1->data, t1->ptr - t1->data, t1->path);
 
     if (debug) printf("writetable %s written\n", t1->path);
 
@@ -138,69 +206,103 @@ static void writetable(struct table *t1) {
 }
 
 
-// store value in table
-static void store(unsigned char *data) {
-    unsigned char d_1, d_2;
-    int offset;
-    struct table *t1;
+// append a run of entries to a bucket, taking its lock once for the whole run
+static void store(struct table *t1, const unsigned char *data, uint64_t len) {
+
+    if (pthread_mutex_lock(&(t1->mutex))) {
+        printf("store: cannot lock mutex for %s\n", t1->path);
+        exit(1);
+    }
 
-    // use the first two bytes as an index
-    d_1 = data[0];
-    d_2 = data[1];
-    offset = (d_1 * 0x100) + d_2;
+    while (len) {
+        uint64_t room = DATAMAX - (t1->ptr - t1->data);
+        uint64_t n = (len < room) ? len : room;
 
-    if (debug) printf("store, d1=%02X, d2=%02X, offset = %d\n", d_1, d_2, offset);
+        memcpy(t1->ptr, data, n);
+        t1->ptr += n;
+        data += n;
+        len -= n;
 
-    // get pointer to table entry
-    t1 = t + offset;
+        // check if table is full
+        if ((t1->ptr - t1->data) >= DATAMAX) {
+            // write the table to disk
+            writetable(t1);
+            // reset ptr
+            t1->ptr = t1->data;
+        }
+    }
 
-    // wait for a lock on this entry
-    if (pthread_mutex_lock(&(t1->mutex))) {
-        printf("store: cannot lock mutex at offset %d\n", offset);
+    if (pthread_mutex_unlock(&(t1->mutex))) {
+        printf("store: cannot unlock mutex for %s\n", t1->path);
         exit(1);
     }
+}
+
 
-    if (debug) printf("store, offset = %d, got lock\n", offset);
+static void create_stage(struct stage *st) {
+    st->raw = (unsigned char *)malloc((uint64_t)STAGE_ENTRIES * STAGESIZE);
+    st->part = (unsigned char *)malloc((uint64_t)STAGE_ENTRIES * DATASIZE);
+    st->start = (uint32_t *)calloc(0x10001, sizeof(uint32_t));
+    st->fill = (uint32_t *)calloc(0x10000, sizeof(uint32_t));
+    if (!st->raw || !st->part || !st->start || !st->fill) {
+        printf("create_stage: cannot alloc staging area\n");
+        exit(1);
+    }
+    st->n = 0;
+}
 
-    // store the entry
-    memcpy(t1->ptr, data + 2, 10);
+static void free_stage(struct stage *st) {
+    free(st->raw);
+    free(st->part);
+    free(st->start);
+    free(st->fill);
+}
 
-    if (debug) printf("store, offset = %d, copied data\n", offset);
+// partition the staged entries by bucket and hand each run to its bucket
+static void flush_stage(struct stage *st) {
+    uint32_t i, b;
 
-    // update the ptr
-    t1->ptr += 10;
+    memset(st->start, 0, 0x10001 * sizeof(uint32_t));
 
-    // check if table is full
-    if ((t1->ptr - t1->data) >= DATAMAX) {
-        // write the table to disk
-        writetable(t1);
-        // reset ptr
-        t1->ptr = t1->data;
+    for (i = 0; i < st->n; i++) {
+        const unsigned char *e = st->raw + (i * STAGESIZE);
+        st->start[((e[0] << 8) | e[1]) + 1]++;
     }
 
-    if (debug) printf("store, offset = %d, after possible write\n", offset);
+    for (b = 0; b < 0x10000; b++) {
+        st->start[b + 1] += st->start[b];
+        st->fill[b] = st->start[b];
+    }
 
-    // release the lock
-    if (pthread_mutex_unlock(&(t1->mutex))) {
-        printf("store: cannot unlock mutex at offset %d\n", offset);
-        exit(1);
+    for (i = 0; i < st->n; i++) {
+        const unsigned char *e = st->raw + (i * STAGESIZE);
+        b = (e[0] << 8) | e[1];
+        memcpy(st->part + ((uint64_t)st->fill[b]++ * DATASIZE), e + 2, DATASIZE);
     }
 
-    if (debug) printf("store, offset = %d, unlocked\n", offset);
+    for (b = 0; b < 0x10000; b++) {
+        uint32_t n = st->start[b + 1] - st->start[b];
+        if (n) {
+            store(t + b, st->part + ((uint64_t)st->start[b] * DATASIZE), (uint64_t)n * DATASIZE);
+        }
+    }
 
+    st->n = 0;
 }
 
-// writes the ks (keystream) and s (state)
-static void write_ks_s(uint32_t ks1, uint32_t ks2, uint64_t shiftreg) {
-    unsigned char buf[16];
+// stages the ks (keystream) and s (state)
+static void write_ks_s(struct stage *st, uint32_t ks1, uint32_t ks2, uint64_t shiftreg) {
+    unsigned char *buf = st->raw + (st->n * STAGESIZE);
 
     // create buffer
     writebuf(buf, ks1, 3);
     writebuf(buf + 3, ks2, 3);
     writebuf(buf + 6, shiftreg, 6);
 
-    // store buffer
-    store(buf);
+    st->n++;
+    if (st->n == STAGE_ENTRIES) {
+        flush_stage(st);
+    }
 }
 
 
@@ -276,10 +378,13 @@ static void jumpnsteps(Hitag_State *hstate, int table) {
 static void *buildtable(void *dd) {
     Hitag_State hstate;
     Hitag_State hstate2;
+    struct stage st;
     unsigned long maxentries = 1;
     int index = (int)(long)dd;
     int tnum = NUM_BUILD_THREADS;
 
+    create_stage(&st);
+
     /* set random state */
     hstate.shiftreg = 0x123456789abc;
     buildlfsr(&hstate);
@@ -296,7 +401,7 @@ static void *buildtable(void *dd) {
        8 threads = 2^34
        etc
     */
-    maxentries = maxentries << 37;
+    maxentries = maxentries << TABLE_BITS;
     while (!(tnum & 0x1)) {
         maxentries = maxentries >> 1;
         tnum = tnum >> 1;
@@ -314,7 +419,7 @@ static void *buildtable(void *dd) {
         uint32_t ks1 = hitag2_nstep(&hstate2, 24);
         uint32_t ks2 = hitag2_nstep(&hstate2, 24);
 
-        write_ks_s(ks1, ks2, hstate.shiftreg);
+        write_ks_s(&st, ks1, ks2, hstate.shiftreg);
 
         // jump hstate forward 2048 * NUM_BUILD_THREADS states using di table
         // this is because we're running NUM_BUILD_THREADS threads at once, from NUM_BUILD_THREADS
@@ -322,6 +427,9 @@ static void *buildtable(void *dd) {
         jumpnsteps(&hstate, 1);
     }
 
+    flush_stage(&st);
+    free_stage(&st);
+
     return NULL;
 }
 
@@ -354,103 +462,382 @@ static void makedirs(void) {
     }
 }
 
-static int datacmp(const void *p1, const void *p2, void *dummy) {
-    unsigned char *d_1 = (unsigned char *)p1;
-    unsigned char *d_2 = (unsigned char *)p2;
 
-    return memcmp(d_1, d_2, DATASIZE);
+// LSD radix sort on the 4 keystream bytes, then order equal keys by state so the
+// result is the same as sorting on all DATASIZE bytes
+static void radixsort(unsigned char *data, unsigned char *tmp, uint64_t numentries) {
+    uint64_t count[0x100];
+    unsigned char *src = data;
+    unsigned char *dst = tmp;
+    uint64_t i, j;
+
+    if (numentries < 2) {
+        return;
+    }
+
+    for (int byte = DATASIZE - 7; byte >= 0; byte--) {
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < numentries; i++) {
+            count[src[(i * DATASIZE) + byte]]++;
+        }
+
+        // skip the pass if every entry has the same byte here
+        if (count[src[byte]] == numentries) {
+            continue;
+        }
+
+        uint64_t sum = 0;
+        for (i = 0; i < 0x100; i++) {
+            uint64_t c = count[i];
+            count[i] = sum;
+            sum += c;
+        }
+
+        for (i = 0; i < numentries; i++) {
+            const unsigned char *e = src + (i * DATASIZE);
+            memcpy(dst + (count[e[byte]]++ * DATASIZE), e, DATASIZE);
+        }
+
+        unsigned char *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != data) {
+        memcpy(data, src, numentries * DATASIZE);
+    }
+
+    // equal keys are rare and short, insertion sort them on the state
+    for (i = 1; i < numentries; i++) {
+        unsigned char *e = data + (i * DATASIZE);
+        if (memcmp(e - DATASIZE, e, DATASIZE - 6) || (memcmp(e - DATASIZE, e, DATASIZE) <= 0)) {
+            continue;
+        }
+
+        unsigned char item[DATASIZE];
+        memcpy(item, e, DATASIZE);
+        j = i;
+        while ((j > 0) && (memcmp(data + ((j - 1) * DATASIZE), item, DATASIZE) > 0)) {
+            memcpy(data + (j * DATASIZE), data + ((j - 1) * DATASIZE), DATASIZE);
+            j--;
+        }
+        memcpy(data + (j * DATASIZE), item, DATASIZE);
+    }
+}
+
+
+// count entries per first byte into the index row for this bucket
+static void countindex(uint32_t *row, const unsigned char *data, uint64_t numentries) {
+    for (uint64_t i = 0; i < numentries; i++) {
+        row[data[i * DATASIZE] + 1]++;
+    }
 }
 
-static void *sorttable(void *dd) {
-    int i, j;
+static void finishindex(uint32_t *row) {
+    for (int i = 0; i < 0x100; i++) {
+        row[i + 1] += row[i];
+    }
+}
+
+
+// merge the sorted runs in tmpfile into fdout
+static void mergeruns(int fdtmp, const char *tmpfile, int fdout, const char *outfile, uint64_t size, uint32_t *row) {
+    uint64_t nruns = (size + SORTMAX - 1) / SORTMAX;
+    uint64_t *pos = (uint64_t *)calloc(nruns, sizeof(uint64_t));
+    uint64_t *end = (uint64_t *)calloc(nruns, sizeof(uint64_t));
+    uint64_t *bufpos = (uint64_t *)calloc(nruns, sizeof(uint64_t));
+    uint64_t *buflen = (uint64_t *)calloc(nruns, sizeof(uint64_t));
+    unsigned char *bufs = (unsigned char *)malloc(nruns * MERGEBUF);
+    unsigned char *out = (unsigned char *)malloc(MERGEBUF);
+    uint64_t outlen = 0;
+    uint64_t r;
+
+    if (!pos || !end || !bufpos || !buflen || !bufs || !out) {
+        printf("mergeruns: cannot alloc merge buffers\n");
+        exit(1);
+    }
+
+    for (r = 0; r < nruns; r++) {
+        pos[r] = r * SORTMAX;
+        end[r] = ((r + 1) * SORTMAX < size) ? (r + 1) * SORTMAX : size;
+    }
+
+    while (1) {
+        unsigned char *best = NULL;
+        uint64_t bestrun = 0;
+
+        for (r = 0; r < nruns; r++) {
+            // refill this run's buffer
+            if (bufpos[r] == buflen[r]) {
+                if (pos[r] == end[r]) {
+                    continue;
+                }
+                buflen[r] = ((end[r] - pos[r]) < MERGEBUF) ? (end[r] - pos[r]) : MERGEBUF;
+                readall(fdtmp, bufs + (r * MERGEBUF), buflen[r], pos[r], tmpfile);
+                pos[r] += buflen[r];
+                bufpos[r] = 0;
+            }
+
+            unsigned char *e = bufs + (r * MERGEBUF) + bufpos[r];
+            if (!best || (memcmp(e, best, DATASIZE) < 0)) {
+                best = e;
+                bestrun = r;
+            }
+        }
+
+        if (!best) {
+            break;
+        }
+
+        row[best[0] + 1]++;
+        memcpy(out + outlen, best, DATASIZE);
+        outlen += DATASIZE;
+        bufpos[bestrun] += DATASIZE;
+
+        if (outlen == MERGEBUF) {
+            writeall(fdout, out, outlen, outfile);
+            outlen = 0;
+        }
+    }
+
+    writeall(fdout, out, outlen, outfile);
+
+    free(pos);
+    free(end);
+    free(bufpos);
+    free(buflen);
+    free(bufs);
+    free(out);
+}
+
+
+// sort one bucket from table/ into sorted/ and fill in its index row
+static void sortbucket(int bucket, unsigned char *table, unsigned char *tmp) {
     int fdin;
     int fdout;
     char infile[64];
     char outfile[64];
-    unsigned char *data = NULL;
+    char tmpfile[64];
     struct stat filestat;
-    int index = (int)(long)dd;
-    int space = 0x100 / NUM_SORT_THREADS;
+    uint32_t *row = tindex + ((uint64_t)bucket * HT2INDEX_SPAN);
+    int i = bucket >> 8;
+    int j = bucket & 0xff;
+
+    if ((j == 0) || debug) {
+        printf("sorttable: processing bytes 0x%02x/0x%02x\n", i, j);
+    }
 
-    // create table - 50MB should be enough
-    unsigned char *table = (unsigned char *)calloc(1, 50UL * 1024UL * 1024UL);
-    if (!table) {
-        printf("sorttable: cannot calloc table\n");
+    snprintf(infile, sizeof(infile), "table/%02x/%02x.bin", i, j);
+    snprintf(outfile, sizeof(outfile), "sorted/%02x/%02x.bin", i, j);
+    snprintf(tmpfile, sizeof(tmpfile), "sorted/%02x/%02x.tmp", i, j);
+
+    memset(row, 0, HT2INDEX_SPAN * sizeof(uint32_t));
+
+    fdout = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fdout < 0) {
+        printf("cannot create outfile %s\n", outfile);
         exit(1);
     }
 
-    // loop over our first byte values
-    for (i = (index * space); i < ((index + 1) * space); i++) {
-        // loop over all second byte values
-        for (j = 0; j < 0x100; j++) {
+    fdin = open(infile, O_RDONLY);
+    if (fdin < 0) {
+        // nothing landed in this bucket (only happens with small test tables)
+        if (errno == ENOENT) {
+            close(fdout);
+            return;
+        }
+        printf("cannot open file %s\n", infile);
+        exit(1);
+    }
 
-            printf("sorttable: processing bytes 0x%02x/0x%02x\n", i, j);
+    if (fstat(fdin, &filestat)) {
+        printf("cannot stat file %s\n", infile);
+        exit(1);
+    }
 
-            // open file, stat it and mmap it
-            snprintf(infile, sizeof(infile), "table/%02x/%02x.bin", i, j);
+    uint64_t size = filestat.st_size;
+    if (size % DATASIZE) {
+        printf("file %s is not a whole number of entries\n", infile);
+        exit(1);
+    }
 
-            fdin = open(infile, O_RDONLY);
-            if (fdin <= 0) {
-                printf("cannot open file %s\n", infile);
-                exit(1);
-            }
+    if (size <= SORTMAX) {
+        // the common case, sort it in memory
+        uint64_t numentries = size / DATASIZE;
+        readall(fdin, table, size, 0, infile);
+        radixsort(table, tmp, numentries);
+        countindex(row, table, numentries);
+        writeall(fdout, table, size, outfile);
+    } else {
+        // too big, sort in runs and merge them
+        int fdtmp = open(tmpfile, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fdtmp < 0) {
+            printf("cannot create tmpfile %s\n", tmpfile);
+            exit(1);
+        }
 
-            if (fstat(fdin, &filestat)) {
-                printf("cannot stat file %s\n", infile);
-                exit(1);
-            }
+        for (uint64_t offset = 0; offset < size; offset += SORTMAX) {
+            uint64_t len = ((size - offset) < SORTMAX) ? (size - offset) : SORTMAX;
+            readall(fdin, table, len, offset, infile);
+            radixsort(table, tmp, len / DATASIZE);
+            writeall(fdtmp, table, len, tmpfile);
+        }
 
-            data = mmap((caddr_t)0, filestat.st_size, PROT_READ, MAP_PRIVATE, fdin, 0);
-            if (data == MAP_FAILED) {
-                printf("cannot mmap file %s\n", infile);
-                exit(1);
-            }
+        mergeruns(fdtmp, tmpfile, fdout, outfile, size, row);
+
+        close(fdtmp);
+        if (unlink(tmpfile)) {
+            printf("cannot remove file %s\n", tmpfile);
+            exit(1);
+        }
+    }
 
-            // copy data into table
-            memcpy(table, data, filestat.st_size);
+    finishindex(row);
 
-            uint64_t numentries = filestat.st_size / DATASIZE;
+    close(fdout);
+    close(fdin);
 
-            // unmap file and close it
-            if (munmap(data, filestat.st_size)) {
-                printf("cannot munmap %s\n", infile);
-                exit(1);
-            }
+    // remove input file
+    if (unlink(infile)) {
+        printf("cannot remove file %s\n", infile);
+        exit(1);
+    }
+}
 
-            close(fdin);
+// take the next bucket off the work queue, -1 when there are none left
+static int nextsortbucket(void) {
+    int bucket;
 
-            // sort it
-            void *dummy = NULL; // clang
-            qsort_r(table, numentries, DATASIZE, datacmp, dummy);
+    if (pthread_mutex_lock(&sortmutex)) {
+        printf("nextsortbucket: cannot lock mutex\n");
+        exit(1);
+    }
 
-            // write to file
-            snprintf(outfile, sizeof(outfile), "sorted/%02x/%02x.bin", i, j);
-            fdout = open(outfile, O_WRONLY | O_CREAT, 0644);
-            if (fdout <= 0) {
-                printf("cannot create outfile %s\n", outfile);
-                exit(1);
-            }
-            if (write(fdout, table, numentries * DATASIZE)) {
-                printf("writetable cannot write all of the data\n");
-                exit(1);
-            }
-            close(fdout);
+    bucket = (nextbucket < 0x10000) ? nextbucket++ : -1;
+
+    if (pthread_mutex_unlock(&sortmutex)) {
+        printf("nextsortbucket: cannot unlock mutex\n");
+        exit(1);
+    }
+
+    return bucket;
+}
+
+static void *sorttable(void *dd) {
+    int bucket;
+    (void)dd;
+
+    unsigned char *table = (unsigned char *)malloc(SORTMAX);
+    unsigned char *tmp = (unsigned char *)malloc(SORTMAX);
+    if (!table || !tmp) {
+        printf("sorttable: cannot alloc table\n");
+        exit(1);
+    }
+
+    while ((bucket = nextsortbucket()) >= 0) {
+        sortbucket(bucket, table, tmp);
+    }
 
-            // remove input file
-            if (unlink(infile)) {
-                printf("cannot remove file %s\n", infile);
-                exit(1);
+    free(table);
+    free(tmp);
+
+    return NULL;
+}
+
+
+// rebuild the index row of a sorted bucket by searching for each first byte
+static void indexbucket(int bucket) {
+    int fd;
+    char file[64];
+    struct stat filestat;
+    unsigned char *data;
+    uint32_t *row = tindex + ((uint64_t)bucket * HT2INDEX_SPAN);
+
+    memset(row, 0, HT2INDEX_SPAN * sizeof(uint32_t));
+
+    snprintf(file, sizeof(file), "sorted/%02x/%02x.bin", bucket >> 8, bucket & 0xff);
+
+    fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        printf("cannot open file %s\n", file);
+        exit(1);
+    }
+
+    if (fstat(fd, &filestat)) {
+        printf("cannot stat file %s\n", file);
+        exit(1);
+    }
+
+    uint64_t numentries = filestat.st_size / DATASIZE;
+    if (numentries == 0) {
+        close(fd);
+        return;
+    }
+
+    data = mmap((caddr_t)0, filestat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        printf("cannot mmap file %s\n", file);
+        exit(1);
+    }
+
+    // row[c] is the first entry whose first byte is >= c
+    uint64_t lo = 0;
+    for (int c = 1; c < 0x100; c++) {
+        uint64_t hi = numentries;
+        while (lo < hi) {
+            uint64_t mid = lo + ((hi - lo) / 2);
+            if (data[mid * DATASIZE] < c) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
             }
         }
+        row[c] = lo;
     }
+    row[0x100] = numentries;
 
-    return NULL;
+    munmap(data, filestat.st_size);
+    close(fd);
+}
+
+// write sorted/index.bin
+static void writeindex(void) {
+    int fd;
+
+    fd = open(HT2INDEX_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("cannot create index %s\n", HT2INDEX_FILE);
+        exit(1);
+    }
+
+    writeall(fd, (const unsigned char *)HT2INDEX_MAGIC, HT2INDEX_MAGICLEN, HT2INDEX_FILE);
+    writeall(fd, (const unsigned char *)tindex, (uint64_t)HT2INDEX_BUCKETS * HT2INDEX_SPAN * sizeof(uint32_t), HT2INDEX_FILE);
+
+    close(fd);
+
+    printf("index written to %s\n", HT2INDEX_FILE);
 }
 
 int main(int argc, char *argv[]) {
-    pthread_t threads[NUM_BUILD_THREADS];
+    pthread_t threads[NUM_BUILD_THREADS > NUM_SORT_THREADS ? NUM_BUILD_THREADS : NUM_SORT_THREADS];
     void *status;
 
+    tindex = (uint32_t *)calloc((uint64_t)HT2INDEX_BUCKETS * HT2INDEX_SPAN, sizeof(uint32_t));
+    if (!tindex) {
+        printf("malloc failed\n");
+        exit(1);
+    }
+
+    // only (re)build the index of an existing sorted table
+    if ((argc > 1) && !strcmp(argv[1], "index")) {
+        for (int i = 0; i < HT2INDEX_BUCKETS; i++) {
+            indexbucket(i);
+        }
+        writeindex();
+        free(tindex);
+        return 0;
+    }
+
     // make the table of tables
     t = (struct table *)calloc(sizeof(struct table) * 65536, sizeof(uint8_t));
     if (!t) {
@@ -529,11 +916,8 @@ int main(int argc, char *argv[]) {
         printf("sorttable thread %ld finished\n", i);
     }
 
-    pthread_exit(NULL);
+    writeindex();
+    free(tindex);
 
     return 0;
 }
-
-
-
-
@@ -0,0 +1,22 @@
+/*
+ * ht2crack2index.h
+ * Layout of the sorted table index shared by ht2crack2buildtable and ht2crack2search.
+ *
+ * sorted/index.bin starts with an 8 byte magic followed by HT2INDEX_BUCKETS rows of
+ * HT2INDEX_SPAN uint32_t values (host byte order).  Row (b1 * 0x100 + b2) belongs to
+ * sorted/b1/b2.bin; value n is the number of entries in that file whose first stored
+ * byte (keystream byte 3) is less than n, so entries starting with byte c live in
+ * [row[c], row[c + 1]) and row[256] is the total number of entries in the file.
+ */
+
+#ifndef HT2CRACK2INDEX_H
+#define HT2CRACK2INDEX_H
+
+#define HT2INDEX_FILE    "sorted/index.bin"
+#define HT2INDEX_MAGIC   "HT2IDX01"
+#define HT2INDEX_MAGICLEN 8
+#define HT2INDEX_BUCKETS 0x10000
+#define HT2INDEX_SPAN    257
+#define HT2INDEX_SIZE    (HT2INDEX_MAGICLEN + (HT2INDEX_BUCKETS * HT2INDEX_SPAN * sizeof(uint32_t)))
+
+#endif /* HT2CRACK2INDEX_H */
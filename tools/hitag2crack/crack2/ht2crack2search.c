@@ -5,6 +5,7 @@
  */
 
 #include "ht2crackutils.h"
+#include "ht2crack2index.h"
 
 #define INPUTFILE "sorted/%02x/%02x.bin"
 #define DATASIZE 10
@@ -14,6 +15,43 @@ struct rngdata {
     int len;
 };
 
+// per bucket offsets from sorted/index.bin, NULL if there is no index
+static const uint32_t *tindex = NULL;
+
+// mmap the table index if one was built
+static void loadindex(void) {
+    int fd;
+    struct stat filestat;
+    unsigned char *data;
+
+    fd = open(HT2INDEX_FILE, O_RDONLY);
+    if (fd < 0) {
+        printf("no index %s, searching whole table files\n", HT2INDEX_FILE);
+        return;
+    }
+
+    if (fstat(fd, &filestat) || (filestat.st_size != HT2INDEX_SIZE)) {
+        printf("index %s has the wrong size, ignoring it\n", HT2INDEX_FILE);
+        close(fd);
+        return;
+    }
+
+    data = mmap((caddr_t)0, filestat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("cannot mmap index %s\n", HT2INDEX_FILE);
+        return;
+    }
+
+    if (memcmp(data, HT2INDEX_MAGIC, HT2INDEX_MAGICLEN)) {
+        printf("index %s has a bad magic, ignoring it\n", HT2INDEX_FILE);
+        munmap(data, filestat.st_size);
+        return;
+    }
+
+    tindex = (const uint32_t *)(data + HT2INDEX_MAGICLEN);
+}
+
 static int datacmp(const void *p1, const void *p2) {
     unsigned char *d1 = (unsigned char *)p1;
     unsigned char *d2 = (unsigned char *)p2;
@@ -187,7 +225,18 @@ static int searchcand(unsigned char *c, unsigned char *rt, int fwd, unsigned cha
 
     memcpy(item, c + 2, 4);
 
-    found = (unsigned char *)bsearch(item, data, filestat.st_size / DATASIZE, DATASIZE, datacmp);
+    // narrow the search to the entries sharing our first byte if the index matches this file
+    uint64_t lo = 0;
+    uint64_t hi = filestat.st_size / DATASIZE;
+    if (tindex) {
+        const uint32_t *row = tindex + (((c[0] << 8) | c[1]) * HT2INDEX_SPAN);
+        if (row[0x100] == hi) {
+            lo = row[item[0]];
+            hi = row[item[0] + 1];
+        }
+    }
+
+    found = (unsigned char *)bsearch(item, data + (lo * DATASIZE), hi - lo, DATASIZE, datacmp);
 
     if (found) {
 
@@ -385,6 +434,8 @@ int main(int argc, char *argv[]) {
     }
 
 
+    loadindex();
+
     if (!findmatch(&rng, rngmatch, rngstate, &bitoffset)) {
         printf("couldn't find a match\n");
         exit(1);
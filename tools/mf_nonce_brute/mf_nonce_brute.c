@@ -11,6 +11,7 @@
 #include "crapto1/crapto1.h"
 #include "protocol.h"
 #include "iso14443crc.h"
+#include "crapto1/bs_crypto1.h"
 #include "../common/util_posix.h"
 
 #define AEND  "\x1b[0m"
@@ -37,17 +38,35 @@ uint32_t nt_par_err = 0;
 uint32_t ar_par_err = 0;
 uint32_t at_par_err = 0;
 
+// The search spaces are split in chunks handed out from a shared counter, a thread that is done
+// with its chunk takes the next one instead of idling until the slowest thread finishes.
+#define NONCE_CHUNK     256
+#define KEY_CHUNK       1024
+#define MAX_CHUNKS      256
+
+typedef struct {
+    const char *unit;           // what is searched, for the progress line
+    uint32_t total;             // items in the search space
+    uint32_t chunk_size;
+    uint32_t chunks;
+    uint32_t start_chunk;       // first chunk when resuming from a checkpoint
+    uint32_t next_chunk;        // next chunk to hand out
+    uint64_t searched;          // items searched so far
+    int running;                // threads still searching
+    uint8_t done[MAX_CHUNKS];   // chunks searched completely
+} sched_t;
+
 typedef struct thread_args {
     uint16_t xored;
     int thread;
-    int idx;
+    sched_t *sched;
     bool ev1;
 } targs;
 
 #define ENC_LEN  (200)
 typedef struct thread_key_args {
     int thread;
-    int idx;
+    sched_t *sched;
     uint32_t uid;
     uint32_t part_key;
     uint32_t nt_enc;
@@ -135,6 +154,10 @@ static int global_found_candidate = 0;
 static uint64_t global_candidate_key = 0;
 static int thread_count = 2;
 
+static bool progress_shown = false;
+static const char *checkpoint_fn = NULL;   // -c <file>
+static char run_id[256] = {0};             // the trace data, a checkpoint only resumes the same run
+
 static int param_getptr(const char *line, int *bg, int *en, int paramnum) {
     int i;
     int len = strlen(line);
@@ -439,51 +462,276 @@ static bool checkCRC(uint32_t decrypted) {
     return CheckCrc14443(CRC_14443_A, data, sizeof(data));
 }
 
-static void *check_default_keys(void *arguments) {
-    struct thread_key_args *args = (struct thread_key_args *) arguments;
-    uint8_t local_enc[args->enc_len];
-    memcpy(local_enc, args->enc, args->enc_len);
+//------------------------------------------------------------------
+// work sharing, progress and checkpoints
+
+static void sched_init(sched_t *s, const char *unit, uint32_t total, uint32_t chunk_size, uint32_t start_chunk) {
+    memset(s, 0, sizeof(sched_t));
+    s->unit = unit;
+    s->total = total;
+    s->chunk_size = chunk_size;
+    s->chunks = (total + chunk_size - 1) / chunk_size;
+    if (start_chunk > s->chunks) {
+        start_chunk = s->chunks;
+    }
+    s->start_chunk = start_chunk;
+    s->next_chunk = start_chunk;
+    s->searched = (uint64_t)start_chunk * chunk_size;
+    memset(s->done, 1, start_chunk);
+}
+
+// hands out the next chunk [first, last) to a thread, false when the space is exhausted
+static bool sched_next(sched_t *s, uint32_t *chunk, uint32_t *first, uint32_t *last) {
+    uint32_t c = __atomic_fetch_add(&s->next_chunk, 1, __ATOMIC_RELAXED);
+    if (c >= s->chunks) {
+        return false;
+    }
+    *chunk = c;
+    *first = c * s->chunk_size;
+    *last = *first + s->chunk_size;
+    if (*last > s->total) {
+        *last = s->total;
+    }
+    return true;
+}
 
-    for (uint8_t i = 0; i < ARRAYLEN(g_mifare_default_keys); i++) {
+static void sched_done(sched_t *s, uint32_t chunk) {
+    uint32_t n = s->chunk_size;
+    if ((chunk + 1) * s->chunk_size > s->total) {
+        n = s->total - (chunk * s->chunk_size);
+    }
+    __atomic_fetch_add(&s->searched, n, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->done[chunk], 1, __ATOMIC_RELEASE);
+}
 
-        uint64_t key = g_mifare_default_keys[i];
+// chunks are handed out in order, everything below the first unfinished chunk is searched
+static uint32_t sched_watermark(sched_t *s) {
+    uint32_t c = s->start_chunk;
+    while (c < s->chunks && __atomic_load_n(&s->done[c], __ATOMIC_ACQUIRE)) {
+        c++;
+    }
+    return c;
+}
 
-        // Init cipher with key
-        struct Crypto1State *pcs = crypto1_create(key);
+// call with print_lock held
+static void progress_clear(void) {
+    if (progress_shown) {
+        printf("\r\x1b[2K");
+        progress_shown = false;
+    }
+}
 
-        // NESTED decrypt nt with help of new key
-        crypto1_word(pcs, args->nt_enc ^ args->uid, 1);
-        crypto1_word(pcs, args->nr_enc, 1);
-        crypto1_word(pcs, 0, 0);
-        crypto1_word(pcs, 0, 0);
+static void progress_show(sched_t *s, uint64_t start_ms, uint64_t start_searched) {
+    uint64_t searched = __atomic_load_n(&s->searched, __ATOMIC_RELAXED);
+    uint64_t ms = msclock() - start_ms;
+    double rate = (ms) ? (double)(searched - start_searched) * 1000.0 / ms : 0;
+
+    pthread_mutex_lock(&print_lock);
+    printf("\r\x1b[2K%3u%%  %u / %u %s  " _YELLOW_("%.0f") " %s/s",
+           (uint32_t)(searched * 100 / s->total),
+           (uint32_t)searched,
+           s->total,
+           s->unit,
+           rate,
+           s->unit
+          );
+    if (rate > 0) {
+        uint32_t eta = (uint32_t)((s->total - searched) / rate);
+        printf("  ETA " _YELLOW_("%um%02us"), eta / 60, eta % 60);
+    }
+    fflush(stdout);
+    progress_shown = true;
+    pthread_mutex_unlock(&print_lock);
+}
 
-        // decrypt bytes
-        uint8_t dec[args->enc_len];
-        for (int j = 0; j < args->enc_len; j++) {
-            dec[j] = crypto1_byte(pcs, 0x00, 0) ^ local_enc[j];
+static void checkpoint_save(int stage, uint32_t chunk) {
+    if (checkpoint_fn == NULL) {
+        return;
+    }
+
+    // write a new file and rename it, an interrupted write never destroys the last checkpoint
+    char tmp[FILENAME_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", checkpoint_fn);
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) {
+        return;
+    }
+    fprintf(f, "# mf_nonce_brute checkpoint\n");
+    fprintf(f, "run %s\n", run_id);
+    fprintf(f, "stage %d\n", stage);
+    fprintf(f, "chunk %u\n", chunk);
+    fclose(f);
+    rename(tmp, checkpoint_fn);
+}
+
+static bool checkpoint_load(int *stage, uint32_t *chunk) {
+    if (checkpoint_fn == NULL) {
+        return false;
+    }
+
+    FILE *f = fopen(checkpoint_fn, "r");
+    if (f == NULL) {
+        return false;
+    }
+
+    bool same_run = false, has_stage = false, has_chunk = false;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = 0;
+        if (strncmp(line, "run ", 4) == 0) {
+            same_run = (strcmp(line + 4, run_id) == 0);
+        } else if (sscanf(line, "stage %d", stage) == 1) {
+            has_stage = true;
+        } else if (sscanf(line, "chunk %u", chunk) == 1) {
+            has_chunk = true;
         }
-        crypto1_destroy(pcs);
+    }
+    fclose(f);
 
-        // check if cmd exists
-        bool res = checkValidCmdByte(dec, args->enc_len);
-        if (args->enc_len > 4) {
-            res |= checkValidCmdByte(dec + 4,  args->enc_len - 4);
+    if (same_run == false) {
+        printf("Checkpoint " _YELLOW_("%s") " is from another run, starting over\n", checkpoint_fn);
+        return false;
+    }
+    return has_stage && has_chunk && (*stage == 0 || *stage == 1);
+}
+
+static void checkpoint_remove(void) {
+    if (checkpoint_fn) {
+        remove(checkpoint_fn);
+    }
+}
+
+// shows progress and saves checkpoints while the threads search, stage < 0 disables checkpoints
+static void sched_wait(sched_t *s, pthread_t *threads, int stage) {
+    uint64_t start_ms = msclock();
+    uint64_t start_searched = s->searched;
+    uint64_t last_ms = start_ms;
+
+    while (__atomic_load_n(&s->running, __ATOMIC_ACQUIRE) > 0) {
+        msleep(50);
+        if (msclock() - last_ms < 1000) {
+            continue;
         }
+        last_ms = msclock();
+        progress_show(s, start_ms, start_searched);
+        if (stage >= 0) {
+            checkpoint_save(stage, sched_watermark(s));
+        }
+    }
 
-        if (res == false) {
+    for (int i = 0; i < thread_count; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_lock(&print_lock);
+    progress_clear();
+    pthread_mutex_unlock(&print_lock);
+}
+
+//------------------------------------------------------------------
+
+// decrypts the data following a nested authentication with key
+static void nested_decrypt(uint64_t key, uint32_t nt_uid, uint32_t nr, const uint8_t *enc, uint16_t enc_len, uint8_t *dec) {
+
+    // Init cipher with key
+    struct Crypto1State pcs;
+    crypto1_init(&pcs, key);
+
+    // NESTED decrypt nt with help of new key
+    crypto1_word(&pcs, nt_uid, 1);
+    crypto1_word(&pcs, nr, 1);
+    crypto1_word(&pcs, 0, 0);
+    crypto1_word(&pcs, 0, 0);
+
+    for (int i = 0; i < enc_len; i++) {
+        dec[i] = crypto1_byte(&pcs, 0x00, 0) ^ enc[i];
+    }
+}
+
+// Same as nested_decrypt() for up to 64 keys at the time, only looking at the first byte
+// (and the fifth with also_at_4).  Returns the lanes decrypting to a known command, these
+// keys still need the full check.
+static bitslice_t nested_cmd_lanes(const uint64_t *keys, uint8_t n, uint32_t nt_uid, uint32_t nr, const uint8_t *enc, bool also_at_4) {
+
+    bs_crypto1_t s;
+    bs_crypto1_init(&s, keys, n);
+    bs_crypto1_word(&s, nt_uid, true);
+    bs_crypto1_word(&s, nr, true);
+    bs_crypto1_word(&s, 0, false);
+    bs_crypto1_word(&s, 0, false);
+
+    bitslice_t lanes = 0;
+    bitslice_t dec[8];
+    for (int i = 0; i <= ((also_at_4) ? 4 : 0); i++) {
+
+        bs_crypto1_byte(&s, dec);
+        if (i != 0 && i != 4) {
             continue;
         }
 
-        __sync_fetch_and_add(&global_found, 1);
+        for (int b = 0; b < 8; b++) {
+            if ((enc[i] >> b) & 1) {
+                dec[b] = ~dec[b];
+            }
+        }
 
-        pthread_mutex_lock(&print_lock);
-        printf("\nFound a default key!\n");
-        printf("enc:  %s\n", sprint_hex_inrow_ex(local_enc, args->enc_len, 0));
-        printf("dec:  %s\n", sprint_hex_inrow_ex(dec, args->enc_len, 0));
-        printf("\nValid Key found [ " _GREEN_("%012" PRIx64) " ]\n\n", key);
-        pthread_mutex_unlock(&print_lock);
-        break;
+        for (int c = 0; c < ARRAYLEN(cmds); c++) {
+            lanes |= bs_byte_eq(dec, cmds[c][0]);
+        }
     }
+
+    if (n < BS_LANES) {
+        lanes &= ((bitslice_t)1 << n) - 1;
+    }
+    return lanes;
+}
+
+static void *check_default_keys(void *arguments) {
+    struct thread_key_args *args = (struct thread_key_args *) arguments;
+    uint8_t local_enc[args->enc_len];
+    memcpy(local_enc, args->enc, args->enc_len);
+
+    uint32_t nt_uid = args->nt_enc ^ args->uid;
+
+    for (uint32_t i = 0; i < ARRAYLEN(g_mifare_default_keys); i += BS_LANES) {
+
+        uint8_t n = MIN(ARRAYLEN(g_mifare_default_keys) - i, BS_LANES);
+        bitslice_t lanes = nested_cmd_lanes(g_mifare_default_keys + i, n, nt_uid, args->nr_enc, local_enc, (args->enc_len > 4));
+
+        for (uint8_t l = 0; lanes; l++, lanes >>= 1) {
+
+            if ((lanes & 1) == 0) {
+                continue;
+            }
+
+            uint64_t key = g_mifare_default_keys[i + l];
+
+            // decrypt bytes
+            uint8_t dec[args->enc_len];
+            nested_decrypt(key, nt_uid, args->nr_enc, local_enc, args->enc_len, dec);
+
+            // check if cmd exists
+            bool res = checkValidCmdByte(dec, args->enc_len);
+            if (args->enc_len > 4) {
+                res |= checkValidCmdByte(dec + 4,  args->enc_len - 4);
+            }
+
+            if (res == false) {
+                continue;
+            }
+
+            __sync_fetch_and_add(&global_found, 1);
+
+            pthread_mutex_lock(&print_lock);
+            printf("\nFound a default key!\n");
+            printf("enc:  %s\n", sprint_hex_inrow_ex(local_enc, args->enc_len, 0));
+            printf("dec:  %s\n", sprint_hex_inrow_ex(dec, args->enc_len, 0));
+            printf("\nValid Key found [ " _GREEN_("%012" PRIx64) " ]\n\n", key);
+            pthread_mutex_unlock(&print_lock);
+            goto out;
+        }
+    }
+out:
     free(args);
     return NULL;
 }
@@ -500,93 +748,101 @@ static void *brute_thread(void *arguments) {
     uint32_t nt;      // current tag nonce
 
     uint32_t p64 = 0;
-    // TC == 4  (
-    // threads calls 0 ev1 == false
-    // threads calls 0,1,2  ev1 == true
-    for (uint32_t count = args->idx; count <= 0xFFFF; count += thread_count) {
-
-        if (__atomic_load_n(&global_found, __ATOMIC_ACQUIRE) == 1) {
-            break;
-        }
+    uint32_t chunk, first, last;
 
-        nt = count << 16 | prng_successor(count, 16);
+    while (sched_next(args->sched, &chunk, &first, &last)) {
 
-        if (candidate_nonce(args->xored, nt, args->ev1) == false) {
-            continue;
-        }
+        for (uint32_t count = first; count < last; count++) {
 
-        p64 = prng_successor(nt, 64);
-        ks2 = ar_enc ^ p64;
-        ks3 = at_enc ^ prng_successor(p64, 32);
-        revstate = lfsr_recovery64(ks2, ks3);
-        ks4 = crypto1_word(revstate, 0, 0);
+            if (__atomic_load_n(&global_found, __ATOMIC_ACQUIRE) == 1) {
+                goto out;
+            }
 
-        if (ks4 == 0) {
-            free(revstate);
-            continue;
-        }
+            nt = count << 16 | prng_successor(count, 16);
 
-        // lock this section to avoid interlacing prints from different threats
-        pthread_mutex_lock(&print_lock);
-        if (args->ev1) {
-            printf("\n---> " _YELLOW_(" Possible key candidate")"  <---\n");
-        }
+            if (candidate_nonce(args->xored, nt, args->ev1) == false) {
+                continue;
+            }
 
-#if 0
-        printf("thread #%d idx %d %s\n", args->thread, args->idx, (args->ev1) ? "(Ev1)" : "");
-        printf("current nt(%08x)  ar_enc(%08x)  at_enc(%08x)\n", nt, ar_enc, at_enc);
-        printf("ks2:%08x\n", ks2);
-        printf("ks3:%08x\n", ks3);
-        printf("ks4:%08x\n", ks4);
-#endif
-        if (cmd_enc) {
-            uint32_t decrypted = ks4 ^ cmd_enc;
-            printf("CMD enc( %08x )\n", cmd_enc);
-            printf("    dec( %08x )    ", decrypted);
+            p64 = prng_successor(nt, 64);
+            ks2 = ar_enc ^ p64;
+            ks3 = at_enc ^ prng_successor(p64, 32);
+            revstate = lfsr_recovery64(ks2, ks3);
+            ks4 = crypto1_word(revstate, 0, 0);
 
-            // check if cmd exists
-            uint8_t isOK = checkValidCmd(decrypted);
-            if (isOK == false) {
-                printf(_RED_("<-- not a valid cmd\n"));
-                pthread_mutex_unlock(&print_lock);
+            if (ks4 == 0) {
                 free(revstate);
                 continue;
             }
 
-            // Add a crc-check.
-            isOK = checkCRC(decrypted);
-            if (isOK == false) {
-                printf(_RED_("<-- not a valid crc\n"));
-                pthread_mutex_unlock(&print_lock);
-                free(revstate);
-                continue;
+            // lock this section to avoid interlacing prints from different threats
+            pthread_mutex_lock(&print_lock);
+            progress_clear();
+            if (args->ev1) {
+                printf("\n---> " _YELLOW_(" Possible key candidate")"  <---\n");
+            }
+
+#if 0
+            printf("thread #%d chunk %u %s\n", args->thread, chunk, (args->ev1) ? "(Ev1)" : "");
+            printf("current nt(%08x)  ar_enc(%08x)  at_enc(%08x)\n", nt, ar_enc, at_enc);
+            printf("ks2:%08x\n", ks2);
+            printf("ks3:%08x\n", ks3);
+            printf("ks4:%08x\n", ks4);
+#endif
+            if (cmd_enc) {
+                uint32_t decrypted = ks4 ^ cmd_enc;
+                printf("CMD enc( %08x )\n", cmd_enc);
+                printf("    dec( %08x )    ", decrypted);
+
+                // check if cmd exists
+                uint8_t isOK = checkValidCmd(decrypted);
+                if (isOK == false) {
+                    printf(_RED_("<-- not a valid cmd\n"));
+                    pthread_mutex_unlock(&print_lock);
+                    free(revstate);
+                    continue;
+                }
+
+                // Add a crc-check.
+                isOK = checkCRC(decrypted);
+                if (isOK == false) {
+                    printf(_RED_("<-- not a valid crc\n"));
+                    pthread_mutex_unlock(&print_lock);
+                    free(revstate);
+                    continue;
+                } else {
+                    printf("<-- " _GREEN_("valid cmd") "\n");
+                }
+            }
+
+            lfsr_rollback_word(revstate, 0, 0);
+            lfsr_rollback_word(revstate, 0, 0);
+            lfsr_rollback_word(revstate, 0, 0);
+            lfsr_rollback_word(revstate, nr_enc, 1);
+            lfsr_rollback_word(revstate, uid ^ nt, 0);
+            crypto1_get_lfsr(revstate, &key);
+            free(revstate);
+
+            if (args->ev1) {
+                // if it was EV1,  we know for sure xxxAAAAAAAA recovery
+                printf("\nKey candidate [ " _YELLOW_("....%08" PRIx64)" ]\n\n", key & 0xFFFFFFFF);
+                __sync_fetch_and_add(&global_found_candidate, 1);
             } else {
-                printf("<-- " _GREEN_("valid cmd") "\n");
+                printf("\nKey candidate [ " _GREEN_("....%08" PRIx64) " ]", key & 0xFFFFFFFF);
+                printf("\nKey candidate [ " _GREEN_("%12" PRIx64) " ]\n\n", key);
+                __sync_fetch_and_add(&global_found, 1);
             }
+            // release lock
+            pthread_mutex_unlock(&print_lock);
+            __sync_fetch_and_add(&global_candidate_key, key);
+            goto out;
         }
 
-        lfsr_rollback_word(revstate, 0, 0);
-        lfsr_rollback_word(revstate, 0, 0);
-        lfsr_rollback_word(revstate, 0, 0);
-        lfsr_rollback_word(revstate, nr_enc, 1);
-        lfsr_rollback_word(revstate, uid ^ nt, 0);
-        crypto1_get_lfsr(revstate, &key);
-        free(revstate);
-
-        if (args->ev1) {
-            // if it was EV1,  we know for sure xxxAAAAAAAA recovery
-            printf("\nKey candidate [ " _YELLOW_("....%08" PRIx64)" ]\n\n", key & 0xFFFFFFFF);
-            __sync_fetch_and_add(&global_found_candidate, 1);
-        } else {
-            printf("\nKey candidate [ " _GREEN_("....%08" PRIx64) " ]", key & 0xFFFFFFFF);
-            printf("\nKey candidate [ " _GREEN_("%12" PRIx64) " ]\n\n", key);
-            __sync_fetch_and_add(&global_found, 1);
-        }
-        // release lock
-        pthread_mutex_unlock(&print_lock);
-        __sync_fetch_and_add(&global_candidate_key, key);
-        break;
+        sched_done(args->sched, chunk);
     }
+
+out:
+    __atomic_fetch_sub(&args->sched->running, 1, __ATOMIC_RELEASE);
     free(args);
     return NULL;
 }
@@ -594,57 +850,92 @@ static void *brute_thread(void *arguments) {
 static void *brute_key_thread(void *arguments) {
 
     struct thread_key_args *args = (struct thread_key_args *) arguments;
-    uint64_t key;
     uint8_t local_enc[args->enc_len];
     memcpy(local_enc, args->enc, args->enc_len);
 
-    for (uint64_t count = args->idx; count <= 0xFFFF; count += thread_count) {
+    uint32_t nt_uid = args->nt_enc ^ args->uid;
+    uint32_t chunk, first, last;
 
-        if (__atomic_load_n(&global_found, __ATOMIC_ACQUIRE) == 1) {
-            break;
-        }
+    while (sched_next(args->sched, &chunk, &first, &last)) {
 
-        key = args->part_key | (count << 32);
+        // 64 keys at the time, only the keys decrypting to a known command get the full check
+        for (uint32_t count = first; count < last; count += BS_LANES) {
 
-        // Init cipher with key
-        struct Crypto1State *pcs = crypto1_create(key);
+            if (__atomic_load_n(&global_found, __ATOMIC_ACQUIRE) == 1) {
+                goto out;
+            }
 
-        // NESTED decrypt nt with help of new key
-        crypto1_word(pcs, args->nt_enc ^ args->uid, 1);
-        crypto1_word(pcs, args->nr_enc, 1);
-        crypto1_word(pcs, 0, 0);
-        crypto1_word(pcs, 0, 0);
+            uint64_t keys[BS_LANES];
+            uint8_t n = MIN(last - count, BS_LANES);
+            for (uint8_t l = 0; l < n; l++) {
+                keys[l] = args->part_key | ((uint64_t)(count + l) << 32);
+            }
 
-        // decrypt 22 bytes
-        uint8_t dec[args->enc_len];
-        for (int i = 0; i < args->enc_len; i++) {
-            dec[i] = crypto1_byte(pcs, 0x00, 0) ^ local_enc[i];
-        }
+            bitslice_t lanes = nested_cmd_lanes(keys, n, nt_uid, args->nr_enc, local_enc, false);
 
-        crypto1_destroy(pcs);
+            for (uint8_t l = 0; lanes; l++, lanes >>= 1) {
 
-        // check if cmd exists
-        if (checkValidCmdByte(dec, args->enc_len) == false) {
-            continue;
-        }
+                if ((lanes & 1) == 0) {
+                    continue;
+                }
+
+                // decrypt 22 bytes
+                uint8_t dec[args->enc_len];
+                nested_decrypt(keys[l], nt_uid, args->nr_enc, local_enc, args->enc_len, dec);
+
+                // check if cmd exists
+                if (checkValidCmdByte(dec, args->enc_len) == false) {
+                    continue;
+                }
 
-        __sync_fetch_and_add(&global_found, 1);
+                __sync_fetch_and_add(&global_found, 1);
+
+                // lock this section to avoid interlacing prints from different threats
+                pthread_mutex_lock(&print_lock);
+                progress_clear();
+                printf("\nenc:  %s\n", sprint_hex_inrow_ex(local_enc, args->enc_len, 0));
+                printf("dec:  %s\n", sprint_hex_inrow_ex(dec, args->enc_len, 0));
+                printf("\nValid Key found [ " _GREEN_("%012" PRIx64) " ]\n\n", keys[l]);
+                pthread_mutex_unlock(&print_lock);
+                goto out;
+            }
+        }
 
-        // lock this section to avoid interlacing prints from different threats
-        pthread_mutex_lock(&print_lock);
-        printf("\nenc:  %s\n", sprint_hex_inrow_ex(local_enc, args->enc_len, 0));
-        printf("dec:  %s\n", sprint_hex_inrow_ex(dec, args->enc_len, 0));
-        printf("\nValid Key found [ " _GREEN_("%012" PRIx64) " ]\n\n", key);
-        pthread_mutex_unlock(&print_lock);
-        break;
+        sched_done(args->sched, chunk);
     }
+
+out:
+    __atomic_fetch_sub(&args->sched->running, 1, __ATOMIC_RELEASE);
     free(args);
     return NULL;
 }
 
+// searches the 16 bit tag nonce space, old MFC (stage 0) or EV1 (stage 1)
+static void brute_nonce(uint16_t xored, bool ev1, uint32_t start_chunk) {
+
+    static sched_t sched;
+    sched_init(&sched, "nonces", 0x10000, NONCE_CHUNK, start_chunk);
+    sched.running = thread_count;
+
+    pthread_t threads[thread_count];
+    for (int i = 0; i < thread_count; ++i) {
+        struct thread_args *a = calloc(1, sizeof(struct thread_args));
+        a->xored = xored;
+        a->thread = i;
+        a->sched = &sched;
+        a->ev1 = ev1;
+        pthread_create(&threads[i], NULL, brute_thread, (void *)a);
+    }
+
+    // wait for threads to terminate:
+    sched_wait(&sched, threads, (ev1) ? 1 : 0);
+}
+
 static int usage(void) {
     printf("\n");
-    printf("syntax:  mf_nonce_brute <uid> <nt> <nt_par_err> <nr> <ar> <ar_par_err> <at> <at_par_err> [<next_command>]\n\n");
+    printf("syntax:  mf_nonce_brute [-c <checkpoint>] <uid> <nt> <nt_par_err> <nr> <ar> <ar_par_err> <at> <at_par_err> [<next_command>]\n\n");
+    printf("    -c <checkpoint>  save the search position to this file every second,\n");
+    printf("                     an interrupted run started again with the same arguments resumes from it\n\n");
     printf("how to convert trace data to needed input:\n");
     printf("    nt in trace = 8c! 42 e6! 4e!\n");
     printf("             nt = 8c42e64e\n");
@@ -668,8 +959,24 @@ static int usage(void) {
 int main(int argc, const char *argv[]) {
     printf("\nMifare classic nested auth key recovery\n\n");
 
+    // options go before the trace data
+    while (argc > 1 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-c") == 0 && argc > 2) {
+            checkpoint_fn = argv[2];
+            argc -= 2;
+            argv += 2;
+            continue;
+        }
+        return usage();
+    }
+
     if (argc < 9) return usage();
 
+    for (int i = 1; i < argc; i++) {
+        size_t len = strlen(run_id);
+        snprintf(run_id + len, sizeof(run_id) - len, "%s%s", (i > 1) ? " " : "", argv[i]);
+    }
+
     sscanf(argv[1], "%x", &uid);
     sscanf(argv[2], "%x", &nt_enc);
     sscanf(argv[3], "%x", &nt_par_err);
@@ -728,7 +1035,6 @@ int main(int argc, const char *argv[]) {
         printf("Testing default keys using NESTED authentication...\n");
         struct thread_key_args *def = calloc(1, sizeof(struct thread_key_args));
         def->thread = 0;
-        def->idx = 0;
         def->uid = uid;
         def->nt_enc = nt_enc;
         def->nr_enc = nr_enc;
@@ -741,45 +1047,28 @@ int main(int argc, const char *argv[]) {
         }
     }
 
+    int resume_stage = 0;
+    uint32_t resume_chunk = 0;
+    if (checkpoint_load(&resume_stage, &resume_chunk)) {
+        printf("\nResuming from checkpoint " _YELLOW_("%s") ", %s chunk %u\n", checkpoint_fn, (resume_stage) ? "MFC Ev1" : "old MFC", resume_chunk);
+    }
+
     printf("\n----------- " _CYAN_("Phase 2 examine") " -------------------------------\n");
     printf("Looking for the last bytes of the encrypted tagnonce\n");
-    printf("\nTarget old MFC...\n");
-    // the rest of available threads to EV1 scenario
-    for (int i = 0; i < thread_count; ++i) {
-        struct thread_args *a = calloc(1, sizeof(struct thread_args));
-        a->xored = xored;
-        a->thread = i;
-        a->idx = i;
-        a->ev1 = false;
-        pthread_create(&threads[i], NULL, brute_thread, (void *)a);
-    }
 
-    // wait for threads to terminate:
-    for (int i = 0; i < thread_count; ++i) {
-        pthread_join(threads[i], NULL);
-    }
+    if (resume_stage == 0) {
+        printf("\nTarget old MFC...\n");
+        brute_nonce(xored, false, resume_chunk);
 
-    t1 = msclock() - t1;
-    printf("execution time " _YELLOW_("%.2f") " sec\n", (float)t1 / 1000.0);
+        t1 = msclock() - t1;
+        printf("execution time " _YELLOW_("%.2f") " sec\n", (float)t1 / 1000.0);
+    }
 
     if (!global_found && !global_found_candidate) {
         printf("\nTarget MFC Ev1...\n");
 
         t1 = msclock();
-        // the rest of available threads to EV1 scenario
-        for (int i = 0; i < thread_count; ++i) {
-            struct thread_args *a = calloc(1, sizeof(struct thread_args));
-            a->xored = xored;
-            a->thread = i;
-            a->idx = i;
-            a->ev1 = true;
-            pthread_create(&threads[i], NULL, brute_thread, (void *)a);
-        }
-
-        // wait for threads to terminate:
-        for (int i = 0; i < thread_count; ++i) {
-            pthread_join(threads[i], NULL);
-        }
+        brute_nonce(xored, true, (resume_stage == 1) ? resume_chunk : 0);
 
         t1 = msclock() - t1;
         printf("execution time " _YELLOW_("%.2f") " sec\n", (float)t1 / 1000.0);
@@ -810,10 +1099,14 @@ int main(int argc, const char *argv[]) {
     fflush(stdout);
 
     // threads
+    static sched_t sched;
+    sched_init(&sched, "keys", 0x10000, KEY_CHUNK, 0);
+    sched.running = thread_count;
+
     for (int i = 0; i < thread_count; ++i) {
         struct thread_key_args *b = calloc(1, sizeof(struct thread_key_args));
         b->thread = i;
-        b->idx = i;
+        b->sched = &sched;
         b->uid = uid;
         b->part_key = (uint32_t)(global_candidate_key & 0xFFFFFFFF);
         b->nt_enc = nt_enc;
@@ -824,15 +1117,16 @@ int main(int argc, const char *argv[]) {
     }
 
     // wait for threads to terminate:
-    for (int i = 0; i < thread_count; ++i) {
-        pthread_join(threads[i], NULL);
-    }
+    sched_wait(&sched, threads, -1);
 
     if (!global_found && !global_found_candidate) {
         printf("\nfailed to find a key\n\n");
     }
 
 out:
+    // the search ran to the end, nothing left to resume
+    checkpoint_remove();
+
     // clean up mutex
     pthread_mutex_destroy(&print_lock);
     return 0;
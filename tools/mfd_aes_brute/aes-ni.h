@@ -1,157 +1,131 @@
 #ifndef __AES_NI_H__
 #define __AES_NI_H__
 
-#include "aes-ni.h"
-// #include <stdint.h>     //for int8_t
-// #include <string.h>     //for memcmp
-// #include <wmmintrin.h>  //for intrinsics for AES-NI
-//compile using gcc and following arguments: -g;-O0;-Wall;-msse2;-msse;-march=native;-maes
-
-/*
-static void AES_CBC_decrypt(const uint8_t *in,  uint8_t *out,  uint8_t iv[],  uint8_t len, uint8_t *key) {
+// AES-128 decryption of many independent keys at the time using AES-NI / VAES.
+//
+// Each key gets its own key schedule, the lanes are interleaved so the aesdec latency of
+// one key is hidden behind the other keys.  The functions are compiled with target attributes,
+// callers must check platform_aes_hw_available() / platform_vaes_hw_available() first.
+//
+// The key expansion does not use aeskeygenassist (slow on most cores), RotWord(SubWord(w3)) ^ rcon
+// is computed with pshufb + aesenclast instead.  VAES has no 256 bit aesimc, the inverse
+// MixColumns of the round keys is done as aesdec(aesenclast(k, 0), 0).
+
+#if defined(__x86_64__) || defined(__i386__) || defined(__i386)
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <immintrin.h>
+
+#define AESNI_LANES     8
+#define VAES_LANES      16
+
+#define AESNI_TARGET    __attribute__((target("aes,ssse3,sse4.1")))
+#define VAES_TARGET     __attribute__((target("aes,vaes,avx2")))
+
+static const int aes_rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+
+AESNI_TARGET static inline __m128i aes128_expand_ni(__m128i k, int rcon) {
+    const __m128i rot = _mm_set_epi8(12, 15, 14, 13, 12, 15, 14, 13, 12, 15, 14, 13, 12, 15, 14, 13);
+    __m128i t = _mm_aesenclast_si128(_mm_shuffle_epi8(k, rot), _mm_set1_epi32(rcon));
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 8));
+    return _mm_xor_si128(k, t);
+}
 
-    __m128i data, last_in;
-    __m128i feedback = _mm_loadu_si128 ((__m128i*)iv);
+// Decrypts block a and b (ECB) with up to AESNI_LANES keys (16 bytes each, back to back).
+// Unused lanes reuse the first key.
+AESNI_TARGET static void aes128_decrypt2_ni(const uint8_t *keys, size_t n, const uint8_t *a, const uint8_t *b, uint8_t *out_a, uint8_t *out_b) {
 
-    uint j;
-    for (uint8_t i = 0; i < len; i++){
-        last_in =_mm_loadu_si128 (&((__m128i*)in)[i]);
-        data = _mm_xor_si128 (last_in, ((__m128i*)key)[0]);
+    __m128i rk[11][AESNI_LANES];
+    for (size_t l = 0; l < AESNI_LANES; l++) {
+        rk[0][l] = _mm_loadu_si128((const __m128i *)(keys + ((l < n) ? l : 0) * 16));
+    }
 
-        for (j = 1; j < 10; j++){
-            data = _mm_aesdec_si128 (data, ((__m128i*)key)[j]);
+    for (int r = 1; r < 11; r++) {
+        for (size_t l = 0; l < AESNI_LANES; l++) {
+            rk[r][l] = aes128_expand_ni(rk[r - 1][l], aes_rcon[r - 1]);
         }
-        data = _mm_aesdeclast_si128 (data,((__m128i*)key)[j]);
-        data = _mm_xor_si128 (data, feedback);
-        _mm_storeu_si128 (&((__m128i*)out)[i], data);
-        feedback = last_in;
     }
-}
-*/
-
-/*
-INLINE static __m128i AES_128_ASSIST (__m128i temp1, __m128i temp2) {
-    __m128i temp3;
-    temp2 = _mm_shuffle_epi32 (temp2 ,0xff);
-    temp3 = _mm_slli_si128 (temp1, 0x4);
-    temp1 = _mm_xor_si128 (temp1, temp3);
-    temp3 = _mm_slli_si128 (temp3, 0x4);
-    temp1 = _mm_xor_si128 (temp1, temp3);
-    temp3 = _mm_slli_si128 (temp3, 0x4);
-    temp1 = _mm_xor_si128 (temp1, temp3);
-    temp1 = _mm_xor_si128 (temp1, temp2);
-    return temp1;
-}
 
-static void AES_128_Key_Expansion (uint8_t *userkey, __m128i *key) {
-    __m128i temp1, temp2;
-    temp1 = _mm_loadu_si128((__m128i*)userkey);
-    key[0] = temp1;
-    temp2 = _mm_aeskeygenassist_si128 (temp1 ,0x1);
-    temp1 = AES_128_ASSIST(temp1, temp2);
-    key[1] = temp1;
-    temp2 = _mm_aeskeygenassist_si128 (temp1,0x2);
-    temp1 = AES_128_ASSIST(temp1, temp2);
-    key[2] = temp1;
-    temp2 = _mm_aeskeygenassist_si128 (temp1,0x4);
-    temp1 = AES_128_ASSIST(temp1, temp2);
-    key[3] = temp1;
-    temp2 = _mm_aeskeygenassist_si128 (temp1,0x8);
-    temp1 = AES_128_ASSIST(temp1, temp2);
-    key[4] = temp1;
-    temp2 = _mm_aeskeygenassist_si128 (temp1,0x10);
-    temp1 = AES_128_ASSIST(temp1, temp2);
-    key[5] = temp1;
-    temp2 = _mm_aeskeygenassist_si128 (temp1,0x20);
-    temp1 = AES_128_ASSIST(temp1, temp2);
-    key[6] = temp1;
-    temp2 = _mm_aeskeygenassist_si128 (temp1,0x40);
-    temp1 = AES_128_ASSIST(temp1, temp2);
-    key[7] = temp1;
-    temp2 = _mm_aeskeygenassist_si128 (temp1,0x80);
-    temp1 = AES_128_ASSIST(temp1, temp2);
-    key[8] = temp1;
-    temp2 = _mm_aeskeygenassist_si128 (temp1,0x1b);
-    temp1 = AES_128_ASSIST(temp1, temp2);
-    key[9] = temp1;
-    temp2 = _mm_aeskeygenassist_si128 (temp1,0x36);
-    temp1 = AES_128_ASSIST(temp1, temp2);
-    key[10] = temp1;
-}
+    const __m128i ina = _mm_loadu_si128((const __m128i *)a);
+    const __m128i inb = _mm_loadu_si128((const __m128i *)b);
 
-static void aes_inv_key_10(AESContext * ctx) {
-
-    __m128i* keysched = (__m128i*)ctx->keysched;
-    __m128i* invkeysched = (__m128i*)ctx->invkeysched;
-
-    *(invkeysched + 10) = *(keysched + 0);
-    *(invkeysched + 9) = _mm_aesimc_si128(*(keysched + 1));
-    *(invkeysched + 8) = _mm_aesimc_si128(*(keysched + 2));
-    *(invkeysched + 7) = _mm_aesimc_si128(*(keysched + 3));
-    *(invkeysched + 6) = _mm_aesimc_si128(*(keysched + 4));
-    *(invkeysched + 5) = _mm_aesimc_si128(*(keysched + 5));
-    *(invkeysched + 4) = _mm_aesimc_si128(*(keysched + 6));
-    *(invkeysched + 3) = _mm_aesimc_si128(*(keysched + 7));
-    *(invkeysched + 2) = _mm_aesimc_si128(*(keysched + 8));
-    *(invkeysched + 1) = _mm_aesimc_si128(*(keysched + 9));
-    *(invkeysched + 0) = *(keysched + 10);
-}
-
-static void aes_decrypt_cbc_ni(const uint8_t *in,  uint8_t *out,  uint8_t iv[],  uint8_t len, uint8_t *key) {
+    __m128i da[AESNI_LANES], db[AESNI_LANES];
+    for (size_t l = 0; l < AESNI_LANES; l++) {
+        da[l] = _mm_xor_si128(ina, rk[10][l]);
+        db[l] = _mm_xor_si128(inb, rk[10][l]);
+    }
 
-    __m128i dec = _mm_setzero_si128();
-    __m128i* block = (__m128i*)in;
-    const __m128i* finish = (__m128i*)(in + len);
+    for (int r = 9; r > 0; r--) {
+        for (size_t l = 0; l < AESNI_LANES; l++) {
+            __m128i ik = _mm_aesimc_si128(rk[r][l]);
+            da[l] = _mm_aesdec_si128(da[l], ik);
+            db[l] = _mm_aesdec_si128(db[l], ik);
+        }
+    }
 
-    // Load IV
-    __m128i iv = _mm_loadu_si128((__m128i*)iv);
+    for (size_t l = 0; l < n; l++) {
+        _mm_storeu_si128((__m128i *)(out_a + l * 16), _mm_aesdeclast_si128(da[l], rk[0][l]));
+        _mm_storeu_si128((__m128i *)(out_b + l * 16), _mm_aesdeclast_si128(db[l], rk[0][l]));
+    }
+}
 
-    while (block < finish) {
+VAES_TARGET static inline __m256i aes128_expand_vaes(__m256i k, int rcon) {
+    const __m256i rot = _mm256_set_epi8(12, 15, 14, 13, 12, 15, 14, 13, 12, 15, 14, 13, 12, 15, 14, 13,
+                                        12, 15, 14, 13, 12, 15, 14, 13, 12, 15, 14, 13, 12, 15, 14, 13);
+    __m256i t = _mm256_aesenclast_epi128(_mm256_shuffle_epi8(k, rot), _mm256_set1_epi32(rcon));
+    k = _mm256_xor_si256(k, _mm256_bslli_epi128(k, 4));
+    k = _mm256_xor_si256(k, _mm256_bslli_epi128(k, 8));
+    return _mm256_xor_si256(k, t);
+}
 
-        // Key schedule ptr
-        __m128i* keysched = (__m128i*)ctx->invkeysched;
-        __m128i last = _mm_loadu_si128(block);
+// Same as aes128_decrypt2_ni() with two keys per 256 bit register, up to VAES_LANES keys.
+VAES_TARGET static void aes128_decrypt2_vaes(const uint8_t *keys, size_t n, const uint8_t *a, const uint8_t *b, uint8_t *out_a, uint8_t *out_b) {
 
-        dec  = _mm_xor_si128(last, *keysched);
+    __m256i rk[11][VAES_LANES / 2];
+    for (size_t l = 0; l < VAES_LANES / 2; l++) {
+        size_t lo = (2 * l < n) ? 2 * l : 0;
+        size_t hi = (2 * l + 1 < n) ? 2 * l + 1 : 0;
+        __m128i klo = _mm_loadu_si128((const __m128i *)(keys + lo * 16));
+        __m128i khi = _mm_loadu_si128((const __m128i *)(keys + hi * 16));
+        rk[0][l] = _mm256_inserti128_si256(_mm256_castsi128_si256(klo), khi, 1);
+    }
 
-        dec = _mm_aesdec_si128(dec, *(++keysched));
-        dec = _mm_aesdec_si128(dec, *(++keysched));
-        dec = _mm_aesdec_si128(dec, *(++keysched));
-        dec = _mm_aesdec_si128(dec, *(++keysched));
-        dec = _mm_aesdec_si128(dec, *(++keysched));
-        dec = _mm_aesdec_si128(dec, *(++keysched));
-        dec = _mm_aesdec_si128(dec, *(++keysched));
-        dec = _mm_aesdec_si128(dec, *(++keysched));
-        dec = _mm_aesdec_si128(dec, *(++keysched));
-        dec = _mm_aesdeclast_si128(dec, *(++keysched));
+    for (int r = 1; r < 11; r++) {
+        for (size_t l = 0; l < VAES_LANES / 2; l++) {
+            rk[r][l] = aes128_expand_vaes(rk[r - 1][l], aes_rcon[r - 1]);
+        }
+    }
 
-        /// Xor data with IV
-        dec  = _mm_xor_si128(iv, dec);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ina = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)a));
+    const __m256i inb = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)b));
 
-        // Store data
-        _mm_storeu_si128(block, dec);
-        iv = last;
+    __m256i da[VAES_LANES / 2], db[VAES_LANES / 2];
+    for (size_t l = 0; l < VAES_LANES / 2; l++) {
+        da[l] = _mm256_xor_si256(ina, rk[10][l]);
+        db[l] = _mm256_xor_si256(inb, rk[10][l]);
+    }
 
-        // Go to next block
-        ++block;
+    for (int r = 9; r > 0; r--) {
+        for (size_t l = 0; l < VAES_LANES / 2; l++) {
+            __m256i ik = _mm256_aesdec_epi128(_mm256_aesenclast_epi128(rk[r][l], zero), zero);
+            da[l] = _mm256_aesdec_epi128(da[l], ik);
+            db[l] = _mm256_aesdec_epi128(db[l], ik);
+        }
     }
 
-    // Update IV
-    _mm_storeu_si128((__m128i*)iv, dec);
+    uint8_t tmp_a[VAES_LANES * 16], tmp_b[VAES_LANES * 16];
+    for (size_t l = 0; l < VAES_LANES / 2; l++) {
+        _mm256_storeu_si256((__m256i *)(tmp_a + l * 32), _mm256_aesdeclast_epi128(da[l], rk[0][l]));
+        _mm256_storeu_si256((__m256i *)(tmp_b + l * 32), _mm256_aesdeclast_epi128(db[l], rk[0][l]));
+    }
+    memcpy(out_a, tmp_a, n * 16);
+    memcpy(out_b, tmp_b, n * 16);
 }
 
-static void aes_setup_ni(AESContext * ctx, uint8_t *key) {
-
-    __m128i *keysched = (__m128i*)ctx->keysched;
-
-    ctx->decrypt_cbc = aes_decrypt_cbc_ni;
-
-    // Now do the key setup itself.
-    AES_128_Key_Expansion (key, keysched);
-
-    // Now prepare the modified keys for the inverse cipher.
-    aes_inv_key_10(ctx);
-}
-*/
+#endif /* x86 */
 
 #endif
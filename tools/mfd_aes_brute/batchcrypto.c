@@ -0,0 +1,217 @@
+//-----------------------------------------------------------------------------
+//  Copyright Iceman 2022
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//-----------------------------------------------------------------------------
+// Batched check of MIFARE DESFire / UL-C authentication challenges against candidate keys
+//
+// The tag sends E(RndB), the reader answers E(RndA || rol(RndB)) CBC chained on the tag
+// challenge.  A key is right when the second half of the decrypted reader answer is the
+// decrypted tag challenge rotated left by one byte, so only the tag challenge and the
+// second half of the reader answer need decrypting.
+//-----------------------------------------------------------------------------
+
+#include "batchcrypto.h"
+
+#include <string.h>
+#include <stdbool.h>
+#include "mbedtls/aes.h"
+#include "mbedtls/des.h"
+#include "aes-ni.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(__i386)
+#include "detectaes.h"
+#endif
+
+// rndb = decrypted tag challenge, x = decrypted and chained second half of the reader answer
+static bool mfd_match(const uint8_t *rndb, const uint8_t *x, uint8_t len) {
+
+    // check rol byte first
+    if (x[len - 1] != rndb[0]) {
+        return false;
+    }
+    return memcmp(rndb + 1, x, len - 1) == 0;
+}
+
+static void xor_block(uint8_t *dst, const uint8_t *src, uint8_t len) {
+    for (uint8_t i = 0; i < len; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+static int check_aes_sw(const mfd_auth_t *auth, const uint8_t *keys, size_t n) {
+
+    mbedtls_aes_context ctx;
+    mbedtls_aes_init(&ctx);
+
+    int res = -1;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t rndb[16], x[16];
+        mbedtls_aes_setkey_dec(&ctx, keys + (i * 16), 128);
+        mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_DECRYPT, auth->tag, rndb);
+        mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_DECRYPT, auth->rdr + 16, x);
+        xor_block(x, auth->rdr, 16);
+        if (mfd_match(rndb, x, 16)) {
+            res = i;
+            break;
+        }
+    }
+
+    mbedtls_aes_free(&ctx);
+    return res;
+}
+
+#if defined(__x86_64__) || defined(__i386__) || defined(__i386)
+
+static int check_aes_blocks(const mfd_auth_t *auth, uint8_t *rndb, uint8_t *x, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint8_t *xi = x + (i * 16);
+        // cheap reject before chaining the whole block
+        if ((xi[15] ^ auth->rdr[15]) != rndb[i * 16]) {
+            continue;
+        }
+        xor_block(xi, auth->rdr, 16);
+        if (mfd_match(rndb + (i * 16), xi, 16)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int check_aes_ni(const mfd_auth_t *auth, const uint8_t *keys, size_t n) {
+    uint8_t rndb[MFD_BATCH_KEYS * 16], x[MFD_BATCH_KEYS * 16];
+    for (size_t off = 0; off < n; off += AESNI_LANES) {
+        size_t cnt = ((n - off) < AESNI_LANES) ? (n - off) : AESNI_LANES;
+        aes128_decrypt2_ni(keys + (off * 16), cnt, auth->tag, auth->rdr + 16, rndb + (off * 16), x + (off * 16));
+    }
+    return check_aes_blocks(auth, rndb, x, n);
+}
+
+static int check_aes_vaes(const mfd_auth_t *auth, const uint8_t *keys, size_t n) {
+    uint8_t rndb[MFD_BATCH_KEYS * 16], x[MFD_BATCH_KEYS * 16];
+    for (size_t off = 0; off < n; off += VAES_LANES) {
+        size_t cnt = ((n - off) < VAES_LANES) ? (n - off) : VAES_LANES;
+        aes128_decrypt2_vaes(keys + (off * 16), cnt, auth->tag, auth->rdr + 16, rndb + (off * 16), x + (off * 16));
+    }
+    return check_aes_blocks(auth, rndb, x, n);
+}
+
+#endif
+
+static int check_des(const mfd_auth_t *auth, const uint8_t *keys, size_t n) {
+
+    mbedtls_des_context ctx;
+    mbedtls_des_init(&ctx);
+
+    int res = -1;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t rndb[8], x[8];
+        mbedtls_des_setkey_dec(&ctx, keys + (i * 8));
+        mbedtls_des_crypt_ecb(&ctx, auth->tag, rndb);
+        mbedtls_des_crypt_ecb(&ctx, auth->rdr + 8, x);
+        xor_block(x, auth->rdr, 8);
+        if (mfd_match(rndb, x, 8)) {
+            res = i;
+            break;
+        }
+    }
+
+    mbedtls_des_free(&ctx);
+    return res;
+}
+
+static int check_3des(const mfd_auth_t *auth, const uint8_t *keys, size_t n) {
+
+    mbedtls_des3_context ctx;
+    mbedtls_des3_init(&ctx);
+
+    int res = -1;
+    for (size_t i = 0; i < n; i++) {
+
+        const uint8_t *key = keys + (i * auth->keylen);
+        if (auth->algo == MFD_ALGO_2TDEA) {
+            mbedtls_des3_set2key_dec(&ctx, key);
+        } else {
+            mbedtls_des3_set3key_dec(&ctx, key);
+        }
+
+        uint8_t rndb[16], x[16];
+        mbedtls_des3_crypt_ecb(&ctx, auth->tag, rndb);
+        mbedtls_des3_crypt_ecb(&ctx, auth->rdr + auth->chlen, x);
+        xor_block(x, auth->rdr + auth->chlen - 8, 8);
+
+        if (auth->chlen == 16) {
+            // 3TDEA uses 16 byte challenges, chain the second DES block of each
+            mbedtls_des3_crypt_ecb(&ctx, auth->tag + 8, rndb + 8);
+            mbedtls_des3_crypt_ecb(&ctx, auth->rdr + 24, x + 8);
+            xor_block(rndb + 8, auth->tag, 8);
+            xor_block(x + 8, auth->rdr + 16, 8);
+        }
+
+        if (mfd_match(rndb, x, auth->chlen)) {
+            res = i;
+            break;
+        }
+    }
+
+    mbedtls_des3_free(&ctx);
+    return res;
+}
+
+void mfd_auth_init(mfd_auth_t *auth, mfd_algo_t algo, const uint8_t *tag, const uint8_t *rdr) {
+
+    memset(auth, 0, sizeof(mfd_auth_t));
+    auth->algo = algo;
+
+    switch (algo) {
+        case MFD_ALGO_DES:
+            auth->keylen = 8;
+            auth->chlen = 8;
+            auth->engine = "DES";
+            auth->check = check_des;
+            break;
+        case MFD_ALGO_2TDEA:
+            auth->keylen = 16;
+            auth->chlen = 8;
+            auth->engine = "2TDEA";
+            auth->check = check_3des;
+            break;
+        case MFD_ALGO_3TDEA:
+            auth->keylen = 24;
+            auth->chlen = 16;
+            auth->engine = "3TDEA";
+            auth->check = check_3des;
+            break;
+        case MFD_ALGO_AES:
+        default:
+            auth->keylen = 16;
+            auth->chlen = 16;
+            auth->engine = "AES software";
+            auth->check = check_aes_sw;
+#if defined(__x86_64__) || defined(__i386__) || defined(__i386)
+            if (platform_vaes_hw_available()) {
+                auth->engine = "AES VAES";
+                auth->check = check_aes_vaes;
+            } else if (platform_aes_hw_available()) {
+                auth->engine = "AES-NI";
+                auth->check = check_aes_ni;
+            }
+#endif
+            break;
+    }
+
+    memcpy(auth->tag, tag, auth->chlen);
+    memcpy(auth->rdr, rdr, 2 * auth->chlen);
+}
@@ -0,0 +1,59 @@
+//-----------------------------------------------------------------------------
+//  Copyright Iceman 2022
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//-----------------------------------------------------------------------------
+// Batched check of MIFARE DESFire / UL-C authentication challenges against candidate keys
+//-----------------------------------------------------------------------------
+
+#ifndef BATCHCRYPTO_H__
+#define BATCHCRYPTO_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// max number of keys per mfd_auth_check() call
+#define MFD_BATCH_KEYS  16
+
+typedef enum {
+    MFD_ALGO_DES = 0,
+    MFD_ALGO_2TDEA,
+    MFD_ALGO_3TDEA,
+    MFD_ALGO_AES,
+} mfd_algo_t;
+
+typedef struct mfd_auth_s mfd_auth_t;
+typedef int (*mfd_check_fn)(const mfd_auth_t *auth, const uint8_t *keys, size_t n);
+
+struct mfd_auth_s {
+    mfd_algo_t algo;
+    uint8_t keylen;         // 8 / 16 / 24 / 16
+    uint8_t chlen;          // tag challenge length, the reader response is twice as long
+    uint8_t tag[16];        // encrypted tag challenge
+    uint8_t rdr[32];        // encrypted reader response + challenge
+    const char *engine;
+    mfd_check_fn check;
+};
+
+// selects the fastest engine this CPU supports, tag / rdr are chlen and 2 * chlen bytes
+void mfd_auth_init(mfd_auth_t *auth, mfd_algo_t algo, const uint8_t *tag, const uint8_t *rdr);
+
+// keys are n (<= MFD_BATCH_KEYS) keys of auth->keylen bytes back to back.
+// returns the index of the first key that matches the authentication, -1 if none.
+static inline int mfd_auth_check(const mfd_auth_t *auth, const uint8_t *keys, size_t n) {
+    return auth->check(auth, keys, n);
+}
+
+#endif
@@ -42,6 +42,26 @@ static bool platform_aes_hw_available(void) {
     return (CPUInfo[2] & (1 << 25)) != 0 && (CPUInfo[2] & (1 << 19)) != 0; /* Check AES and SSE4.1 */
 }
 
+static bool platform_vaes_hw_available(void) {
+    unsigned int CPUInfo[4];
+    __cpuid(1, CPUInfo[0], CPUInfo[1], CPUInfo[2], CPUInfo[3]);
+    /* OSXSAVE, the OS must save the YMM registers */
+    if ((CPUInfo[2] & (1 << 27)) == 0) {
+        return false;
+    }
+
+    unsigned int xcr0_lo, xcr0_hi;
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0x6) != 0x6) {
+        return false;
+    }
+
+    if (__get_cpuid_count(7, 0, &CPUInfo[0], &CPUInfo[1], &CPUInfo[2], &CPUInfo[3]) == 0) {
+        return false;
+    }
+    return (CPUInfo[1] & (1 << 5)) != 0 && (CPUInfo[2] & (1 << 9)) != 0; /* Check AVX2 and VAES */
+}
+
 #else /* defined(__clang__) || defined(__GNUC__) */
 
 static bool platform_aes_hw_available(void) {
@@ -50,6 +70,10 @@ static bool platform_aes_hw_available(void) {
     return (CPUInfo[2] & (1 << 25)) != 0 && (CPUInfo[2] & (1 << 19)) != 0; /* Check AES and SSE4.1 */
 }
 
+static bool platform_vaes_hw_available(void) {
+    return false;
+}
+
 #endif /* defined(__clang__) || defined(__GNUC__) */
 
 #else /* defined(__x86_64__) || defined(__i386) */
@@ -69,4 +93,8 @@ static bool platform_aes_hw_available(void) {
 #endif
 }
 
+static bool platform_vaes_hw_available(void) {
+    return false;
+}
+
 #endif /* defined(__x86_64__) || defined(__i386) */
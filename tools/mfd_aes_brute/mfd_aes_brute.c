@@ -27,14 +27,13 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <limits.h>
-#include <openssl/evp.h>
-#include <openssl/err.h>
 #include <string.h>
 #include <time.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include "../common/util_posix.h"
+#include "batchcrypto.h"
 
 #define AEND  "\x1b[0m"
 #define _RED_(s) "\x1b[31m" s AEND
@@ -53,52 +52,35 @@ typedef struct thread_args {
     int idx;
     uint64_t starttime;
     uint64_t stoptime;
-    uint8_t tag[16];
-    uint8_t rdr[32];
+    const mfd_auth_t *auth;
 } targs;
 
-static void make_key(uint32_t seed, uint8_t key[]) {
+// compasX key generation for n (<= MFD_BATCH_KEYS) consecutive seeds.
+// The seeds run side by side, one LCG per lane, so the compiler can vectorize it.
+static void make_keys(uint32_t seed, uint8_t keys[], size_t n) {
 
-    uint32_t lseed = seed;
-    lseed = (lseed * 22695477) % UINT_MAX;
-    lseed = (lseed + 1) % UINT_MAX;
-
-    for (int i = 0; i < 16; i++) {
-        lseed = (lseed * 22695477) % UINT_MAX;
-        lseed = (lseed + 1) % UINT_MAX;
-        key[i] = ((lseed >> 16) & 0x7fff) % 0xFF;
+    uint32_t lseed[MFD_BATCH_KEYS];
+    for (size_t l = 0; l < MFD_BATCH_KEYS; l++) {
+        uint32_t s = seed + l;
+        s = (s * 22695477) % UINT_MAX;
+        s = (s + 1) % UINT_MAX;
+        lseed[l] = s;
     }
-}
-
-static void handleErrors(void) {
-    ERR_print_errors_fp(stderr);
-    abort();
-}
-
-// source https://wiki.openssl.org/index.php/EVP_Symmetric_Encryption_and_Decryption#Decrypting_the_Message
-static int decrypt_aes(uint8_t ciphertext[], int ciphertext_len, uint8_t key[], uint8_t iv[], uint8_t plaintext[]) {
-    EVP_CIPHER_CTX *ctx;
-    if (!(ctx = EVP_CIPHER_CTX_new()))
-        handleErrors();
-
-    if (1 != EVP_DecryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, key, iv))
-        handleErrors();
-
-    EVP_CIPHER_CTX_set_padding(ctx, 0);
-
-    int len = 0;
-    if (1 != EVP_DecryptUpdate(ctx, plaintext, &len, ciphertext, ciphertext_len))
-        handleErrors();
-
-    int plaintext_len = len;
 
-    if (1 != EVP_DecryptFinal_ex(ctx, plaintext + len, &len))
-        handleErrors();
-
-    plaintext_len += len;
+    for (int i = 0; i < 16; i++) {
+        uint8_t out[MFD_BATCH_KEYS];
+        for (size_t l = 0; l < MFD_BATCH_KEYS; l++) {
+            uint32_t s = lseed[l];
+            s = (s * 22695477) % UINT_MAX;
+            s = (s + 1) % UINT_MAX;
+            lseed[l] = s;
+            out[l] = ((s >> 16) & 0x7fff) % 0xFF;
+        }
 
-    EVP_CIPHER_CTX_free(ctx);
-    return plaintext_len;
+        for (size_t l = 0; l < n; l++) {
+            keys[(l * 16) + i] = out[l];
+        }
+    }
 }
 
 static int hexstr_to_byte_array(char hexstr[], uint8_t bytes[], size_t byte_len) {
@@ -154,48 +136,25 @@ static void *brute_thread(void *arguments) {
     struct thread_args *args = (struct thread_args *) arguments;
 
     uint64_t starttime = args->starttime;
-
     uint64_t stoptime = args->stoptime;
-    uint8_t local_tag[16];
-    uint8_t local_rdr[32];
-    memcpy(local_tag, args->tag, 16);
-    memcpy(local_rdr, args->rdr, 32);
+    const mfd_auth_t *auth = args->auth;
+
+    // each thread takes MFD_BATCH_KEYS consecutive timestamps at the time
+    uint8_t keys[MFD_BATCH_KEYS * 16];
 
-    for (uint64_t i = starttime + args->idx; i < stoptime; i += thread_count) {
+    for (uint64_t i = starttime + (args->idx * MFD_BATCH_KEYS); i < stoptime; i += (thread_count * MFD_BATCH_KEYS)) {
 
         if (__atomic_load_n(&global_found, __ATOMIC_ACQUIRE) == 1) {
             break;
         }
 
-        uint8_t key[16] = {0x00};
-        make_key(i, key);
-
-        uint8_t iv[16] = {0x00};
-        uint8_t dec_tag[16] = {0x00};
-        decrypt_aes(local_tag, 16, key, iv, dec_tag);
-
-        uint8_t dec_rdr[32] = {0x00};
-        decrypt_aes(local_rdr, 32, key, local_tag, dec_rdr);
-
-        // check rol byte first
-        if (dec_tag[0] != dec_rdr[31]) continue;
-
-        // compare rest
-        if (dec_tag[1] != dec_rdr[16]) continue;
-        if (dec_tag[2] != dec_rdr[17]) continue;
-        if (dec_tag[3] != dec_rdr[18]) continue;
-        if (dec_tag[4] != dec_rdr[19]) continue;
-        if (dec_tag[5] != dec_rdr[20]) continue;
-        if (dec_tag[6] != dec_rdr[21]) continue;
-        if (dec_tag[7] != dec_rdr[22]) continue;
-        if (dec_tag[8] != dec_rdr[23]) continue;
-        if (dec_tag[9] != dec_rdr[24]) continue;
-        if (dec_tag[10] != dec_rdr[25]) continue;
-        if (dec_tag[11] != dec_rdr[26]) continue;
-        if (dec_tag[12] != dec_rdr[27]) continue;
-        if (dec_tag[13] != dec_rdr[28]) continue;
-        if (dec_tag[14] != dec_rdr[29]) continue;
-        if (dec_tag[15] != dec_rdr[30]) continue;
+        size_t n = ((stoptime - i) < MFD_BATCH_KEYS) ? (stoptime - i) : MFD_BATCH_KEYS;
+        make_keys(i, keys, n);
+
+        int hit = mfd_auth_check(auth, keys, n);
+        if (hit < 0) {
+            continue;
+        }
 
         __sync_fetch_and_add(&global_found, 1);
 
@@ -203,10 +162,10 @@ static void *brute_thread(void *arguments) {
         pthread_mutex_lock(&print_lock);
 
         printf("Found timestamp........ ");
-        print_time(i);
+        print_time(i + hit);
 
         printf("key.................... \x1b[32m");
-        print_hex(key, sizeof(key));
+        print_hex(keys + (hit * 16), 16);
         printf(AEND);
 
         pthread_mutex_unlock(&print_lock);
@@ -258,6 +217,10 @@ int main(int argc, char *argv[]) {
     print_hex(rdr_resp_challenge, sizeof(rdr_resp_challenge));
 
 
+    mfd_auth_t auth;
+    mfd_auth_init(&auth, MFD_ALGO_AES, tag_challenge, rdr_resp_challenge);
+    printf("Crypto engine.......... " _GREEN_("%s") "\n", auth.engine);
+
     uint64_t t1 = msclock();
 
 #if !defined(_WIN32) || !defined(__WIN32__)
@@ -281,8 +244,7 @@ int main(int argc, char *argv[]) {
         a->idx = i;
         a->starttime = start_time;
         a->stoptime = stop_time;
-        memcpy(a->tag, tag_challenge, 16);
-        memcpy(a->rdr, rdr_resp_challenge, 32);
+        a->auth = &auth;
         pthread_create(&threads[i], NULL, brute_thread, (void *)a);
     }
 
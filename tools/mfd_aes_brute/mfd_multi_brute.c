@@ -29,23 +29,14 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <limits.h>
-#include <openssl/evp.h>
-#include <openssl/err.h>
 #include <string.h>
 #include <time.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <inttypes.h>
-//#include <mbedtls/aes.h>
 #include "../common/util_posix.h"
 #include "randoms.h"
-
-#include "aes-ni.h"
-
-#if defined(__APPLE__) || defined(__MACH__)
-#else
-#include "detectaes.h"
-#endif
+#include "batchcrypto.h"
 
 
 #define AEND  "\x1b[0m"
@@ -56,14 +47,14 @@
 
 
 static generator_t generators[] = {
-    {"Borland",      make_key_borland_n},
-    {"Recipies",     make_key_recipies_n},
-    {"GlibC",        make_key_glibc_n},
-    {"AnsiC",        make_key_ansic_n},
-    {"Turbo Pascal", make_key_turbopascal_n},
-    {"posix rand_r",          make_key_posix_rand_r_n},
-    {"MS Visual/Quick C/C++",  make_key_ms_rand_r_n},
-    {NULL, NULL}
+    {"Borland",      make_key_borland_n,      make_keys_borland_batch},
+    {"Recipies",     make_key_recipies_n,     make_keys_recipies_batch},
+    {"GlibC",        make_key_glibc_n,        make_keys_glibc_batch},
+    {"AnsiC",        make_key_ansic_n,        make_keys_ansic_batch},
+    {"Turbo Pascal", make_key_turbopascal_n,  make_keys_turbopascal_batch},
+    {"posix rand_r",          make_key_posix_rand_r_n,  make_keys_posix_rand_r_batch},
+    {"MS Visual/Quick C/C++",  make_key_ms_rand_r_n,    make_keys_ms_rand_r_batch},
+    {NULL, NULL, NULL}
 };
 
 #define ARRAYLEN(x) (sizeof(x)/sizeof((x)[0]))
@@ -78,59 +69,12 @@ typedef struct thread_args {
     int thread;
     int idx;
     uint8_t generator_idx;
-    uint8_t algo;
     uint64_t starttime;
     uint64_t stoptime;
-    uint8_t tag[16];
-    uint8_t rdr[32];
+    const mfd_auth_t *auth;
 } targs;
 
 
-// source https://wiki.openssl.org/index.php/EVP_Symmetric_Encryption_and_Decryption#Decrypting_the_Message
-static void decrypt_aes(uint8_t ciphertext[], int ciphertext_len, uint8_t key[], uint8_t iv[], uint8_t plaintext[]) {
-    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-    EVP_DecryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, key, iv);
-//    EVP_CIPHER_CTX_set_padding(ctx, 0);
-    int len = 0;
-    EVP_DecryptUpdate(ctx, plaintext, &len, ciphertext, ciphertext_len);
-    EVP_DecryptFinal_ex(ctx, plaintext + len, &len);
-    EVP_CIPHER_CTX_free(ctx);
-}
-
-static void decrypt_3kdes(uint8_t ciphertext[], int ciphertext_len, uint8_t key[], uint8_t iv[], uint8_t plaintext[]) {
-    EVP_CIPHER_CTX *ctx;
-    ctx = EVP_CIPHER_CTX_new();
-
-    EVP_DecryptInit_ex(ctx, EVP_des_ede3_cbc(), NULL, key, iv);
-    EVP_CIPHER_CTX_set_padding(ctx, 0);
-    int len = 0;
-    EVP_DecryptUpdate(ctx, plaintext, &len, ciphertext, ciphertext_len);
-    EVP_DecryptFinal_ex(ctx, plaintext + len, &len);
-    EVP_CIPHER_CTX_free(ctx);
-}
-
-static void decrypt_2kdes(uint8_t ciphertext[], int ciphertext_len, uint8_t key[], uint8_t iv[], uint8_t plaintext[]) {
-    EVP_CIPHER_CTX *ctx;
-    ctx = EVP_CIPHER_CTX_new();
-    EVP_DecryptInit_ex(ctx, EVP_des_ede_cbc(), NULL, key, iv);
-    EVP_CIPHER_CTX_set_padding(ctx, 0);
-    int len = 0;
-    EVP_DecryptUpdate(ctx, plaintext, &len, ciphertext, ciphertext_len);
-    EVP_DecryptFinal_ex(ctx, plaintext + len, &len);
-    EVP_CIPHER_CTX_free(ctx);
-}
-
-static void decrypt_des(uint8_t ciphertext[], int ciphertext_len, uint8_t key[], uint8_t iv[], uint8_t plaintext[]) {
-    EVP_CIPHER_CTX *ctx;
-    ctx = EVP_CIPHER_CTX_new();
-    EVP_DecryptInit_ex(ctx, EVP_des_cbc(), NULL, key, iv);
-    EVP_CIPHER_CTX_set_padding(ctx, 0);
-    int len = 0;
-    EVP_DecryptUpdate(ctx, plaintext, &len, ciphertext, ciphertext_len);
-    EVP_DecryptFinal_ex(ctx, plaintext + len, &len);
-    EVP_CIPHER_CTX_free(ctx);
-}
-
 static int hexstr_to_byte_array(char hexstr[], uint8_t bytes[], size_t byte_len) {
     size_t hexstr_len = strlen(hexstr);
     if (hexstr_len % 16) {
@@ -181,131 +125,29 @@ static void print_time(uint64_t at) {
 
 static void *brute_thread(void *arguments) {
 
-    //const bool support_aesni = platform_aes_hw_available();
-
     struct thread_args *args = (struct thread_args *) arguments;
 
     uint64_t starttime = args->starttime;
     uint64_t stoptime = args->stoptime;
-    uint8_t local_algo = args->algo;
     uint8_t gidx = args->generator_idx;
-    uint8_t local_tag[16];
-    uint8_t local_rdr[32];
-    uint8_t keylen = 16;
-
-    if (local_algo == 0) {
-        memcpy(local_tag, args->tag, 8);
-        memcpy(local_rdr, args->rdr, 16);
-        keylen = 8;
-    } else if (local_algo == 1) {
-        memcpy(local_tag, args->tag, 8);
-        memcpy(local_rdr, args->rdr, 16);
-        keylen = 16;
-    } else if (local_algo == 2) {
-        memcpy(local_tag, args->tag, 16);
-        memcpy(local_rdr, args->rdr, 32);
-        keylen = 24;
-    } else if (local_algo == 3) {
-        memcpy(local_tag, args->tag, 16);
-        memcpy(local_rdr, args->rdr, 32);
-        keylen = 16;
-    }
+    const mfd_auth_t *auth = args->auth;
+    uint8_t keylen = auth->keylen;
 
-    for (uint64_t i = starttime + args->idx; i < stoptime; i += thread_count) {
+    // each thread takes RANDOMS_BATCH consecutive timestamps at the time
+    uint8_t keys[RANDOMS_BATCH * 24];
+
+    for (uint64_t i = starttime + (args->idx * RANDOMS_BATCH); i < stoptime; i += (thread_count * RANDOMS_BATCH)) {
 
         if (__atomic_load_n(&global_found, __ATOMIC_ACQUIRE) == 1) {
             break;
         }
 
-        uint8_t key[keylen];
-        generators[gidx].Parse(i, key, keylen);
-        //make_key_borland_n(i, key, keylen);
-
-        uint8_t iv[keylen << 1];
-        memset(iv, 0, sizeof(iv));
-
-        uint8_t dec_tag[16] = {0x00};
-        uint8_t dec_rdr[32] = {0x00};
-
-        if (local_algo == 0) {
-            decrypt_des(local_tag, 8, key, iv, dec_tag);
-            decrypt_des(local_rdr, 16, key, local_tag, dec_rdr);
-
-            // check rol byte first
-            if (dec_tag[0] != dec_rdr[15]) continue;
-
-            // compare rest
-            if (dec_tag[1] != dec_rdr[8]) continue;
-            if (dec_tag[2] != dec_rdr[9]) continue;
-            if (dec_tag[3] != dec_rdr[10]) continue;
-            if (dec_tag[4] != dec_rdr[11]) continue;
-            if (dec_tag[5] != dec_rdr[12]) continue;
-            if (dec_tag[6] != dec_rdr[13]) continue;
-            if (dec_tag[7] != dec_rdr[14]) continue;
-
-        } else if (local_algo == 1) {
-            decrypt_2kdes(local_tag, 8, key, iv, dec_tag);
-            decrypt_2kdes(local_rdr, 16, key, local_tag, dec_rdr);
-
-            // check rol byte first
-            if (dec_tag[0] != dec_rdr[15]) continue;
-
-            // compare rest
-            if (dec_tag[1] != dec_rdr[8]) continue;
-            if (dec_tag[2] != dec_rdr[9]) continue;
-            if (dec_tag[3] != dec_rdr[10]) continue;
-            if (dec_tag[4] != dec_rdr[11]) continue;
-            if (dec_tag[5] != dec_rdr[12]) continue;
-            if (dec_tag[6] != dec_rdr[13]) continue;
-            if (dec_tag[7] != dec_rdr[14]) continue;
-
-        } else if (local_algo == 2) {
-            decrypt_3kdes(local_tag, 16, key, iv, dec_tag);
-            decrypt_3kdes(local_rdr, 32, key, local_tag, dec_rdr);
-
-            // check rol byte first
-            if (dec_tag[0] != dec_rdr[31]) continue;
-
-            // compare rest
-            if (dec_tag[1] != dec_rdr[16]) continue;
-            if (dec_tag[2] != dec_rdr[17]) continue;
-            if (dec_tag[3] != dec_rdr[18]) continue;
-            if (dec_tag[4] != dec_rdr[19]) continue;
-            if (dec_tag[5] != dec_rdr[20]) continue;
-            if (dec_tag[6] != dec_rdr[21]) continue;
-            if (dec_tag[7] != dec_rdr[22]) continue;
-            if (dec_tag[8] != dec_rdr[23]) continue;
-            if (dec_tag[9] != dec_rdr[24]) continue;
-            if (dec_tag[10] != dec_rdr[25]) continue;
-            if (dec_tag[11] != dec_rdr[26]) continue;
-            if (dec_tag[12] != dec_rdr[27]) continue;
-            if (dec_tag[13] != dec_rdr[28]) continue;
-            if (dec_tag[14] != dec_rdr[29]) continue;
-            if (dec_tag[15] != dec_rdr[30]) continue;
-
-        } else if (local_algo == 3) {
-            decrypt_aes(local_tag, 16, key, iv, dec_tag);
-            decrypt_aes(local_rdr, 32, key, local_tag, dec_rdr);
-
-            // check rol byte first
-            if (dec_tag[0] != dec_rdr[31]) continue;
-
-            // compare rest
-            if (dec_tag[1] != dec_rdr[16]) continue;
-            if (dec_tag[2] != dec_rdr[17]) continue;
-            if (dec_tag[3] != dec_rdr[18]) continue;
-            if (dec_tag[4] != dec_rdr[19]) continue;
-            if (dec_tag[5] != dec_rdr[20]) continue;
-            if (dec_tag[6] != dec_rdr[21]) continue;
-            if (dec_tag[7] != dec_rdr[22]) continue;
-            if (dec_tag[8] != dec_rdr[23]) continue;
-            if (dec_tag[9] != dec_rdr[24]) continue;
-            if (dec_tag[10] != dec_rdr[25]) continue;
-            if (dec_tag[11] != dec_rdr[26]) continue;
-            if (dec_tag[12] != dec_rdr[27]) continue;
-            if (dec_tag[13] != dec_rdr[28]) continue;
-            if (dec_tag[14] != dec_rdr[29]) continue;
-            if (dec_tag[15] != dec_rdr[30]) continue;
+        size_t n = ((stoptime - i) < RANDOMS_BATCH) ? (stoptime - i) : RANDOMS_BATCH;
+        generators[gidx].Batch(i, keys, keylen, n);
+
+        int hit = mfd_auth_check(auth, keys, n);
+        if (hit < 0) {
+            continue;
         }
 
         __sync_fetch_and_add(&global_found, 1);
@@ -313,10 +155,10 @@ static void *brute_thread(void *arguments) {
         // lock this section to avoid interlacing prints from different threats
         pthread_mutex_lock(&print_lock);
         printf("Found timestamp........ ");
-        print_time(i);
+        print_time(i + hit);
 
         printf("Key.................... \x1b[32m");
-        print_hex(key, keylen);
+        print_hex(keys + (hit * keylen), keylen);
         printf(AEND);
 
         pthread_mutex_unlock(&print_lock);
@@ -390,12 +232,6 @@ int main(int argc, char *argv[]) {
     printf("Crypto algo............ " _GREEN_("%s") "\n", algostr);
     printf("LCR Random generator... " _GREEN_("%s") "\n", generators[g_idx].Name);
 
-#if defined(__APPLE__) || defined(__MACH__)
-#else
-    bool support_aesni = platform_aes_hw_available();
-    printf("AES-NI detected........ " _GREEN_("%s") "\n", (support_aesni) ? "yes" : "no");
-#endif
-
     printf("Starting timestamp..... ");
     print_time(start_time);
 
@@ -451,6 +287,10 @@ int main(int argc, char *argv[]) {
         print_hex(rdr_resp_challenge, 32);
     }
 
+    mfd_auth_t auth;
+    mfd_auth_init(&auth, (mfd_algo_t)algo, tag_challenge, rdr_resp_challenge);
+    printf("Crypto engine.......... " _GREEN_("%s") "\n", auth.engine);
+
     uint64_t t1 = msclock();
 
 #if !defined(_WIN32) || !defined(__WIN32__)
@@ -474,23 +314,9 @@ int main(int argc, char *argv[]) {
         a->thread = i;
         a->idx = i;
         a->generator_idx = g_idx;
-        a->algo = (uint8_t)algo;
         a->starttime = start_time;
         a->stoptime = stop_time;
-
-        if (algo == 0) {
-            memcpy(a->tag, tag_challenge, 8);
-            memcpy(a->rdr, rdr_resp_challenge, 16);
-        } else if (algo == 1) {
-            memcpy(a->tag, tag_challenge, 8);
-            memcpy(a->rdr, rdr_resp_challenge, 16);
-        } else if (algo == 2) {
-            memcpy(a->tag, tag_challenge, 16);
-            memcpy(a->rdr, rdr_resp_challenge, 32);
-        } else if (algo == 3) {
-            memcpy(a->tag, tag_challenge, 16);
-            memcpy(a->rdr, rdr_resp_challenge, 32);
-        }
+        a->auth = &auth;
 
         pthread_create(&threads[i], NULL, brute_thread, (void *)a);
     }
@@ -99,3 +99,74 @@ void make_key_ms_rand_r_n(uint32_t seed, uint8_t key[], const size_t keylen) {
         key[i] = ((lseed >> 16) & 0x7FFF);
     }
 }
+
+// Batched versions of the generators above.
+//
+// The seeds of a batch are run side by side, one LCG per lane, so the compiler can keep all
+// lanes in vector registers.  Results are identical to calling the _n version per seed.
+#define RANDOMS_BATCH_KEYS(INIT, STEP)                                  \
+    uint32_t lseed[RANDOMS_BATCH];                                      \
+    uint8_t out[RANDOMS_BATCH];                                         \
+    for (size_t l = 0; l < RANDOMS_BATCH; l++) {                        \
+        uint32_t s = seed + l;                                          \
+        lseed[l] = (INIT);                                              \
+    }                                                                   \
+    for (size_t i = 0; i < keylen; i++) {                               \
+        for (size_t l = 0; l < RANDOMS_BATCH; l++) {                    \
+            uint32_t s = lseed[l];                                      \
+            STEP;                                                       \
+            lseed[l] = s;                                               \
+        }                                                               \
+        for (size_t l = 0; l < n; l++) {                                \
+            keys[(l * keylen) + i] = out[l];                            \
+        }                                                               \
+    }
+
+void make_keys_borland_batch(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n) {
+    RANDOMS_BATCH_KEYS(((s * 22695477U) + 1) % UINT_MAX,
+                       s = ((s * 22695477U) + 1) % UINT_MAX;
+                       out[l] = ((s >> 16) & 0x7fff) % 0xFF)
+}
+
+void make_keys_recipies_batch(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n) {
+    RANDOMS_BATCH_KEYS(s,
+                       s = ((s * 1664525U) + 1013904223U) % UINT_MAX;
+                       out[l] = (s % 0xFF))
+}
+
+void make_keys_glibc_batch(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n) {
+    RANDOMS_BATCH_KEYS(s,
+                       s = ((s * 1103515245U) + 12345U) & 0x7fffffff;
+                       out[l] = (s & 0xFF))
+}
+
+void make_keys_ansic_batch(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n) {
+    RANDOMS_BATCH_KEYS(s,
+                       s = ((s * 1103515245U) + 12345U) & 0x7fffffff;
+                       out[l] = ((s >> 16) & 0x7fff) & 0xFF)
+}
+
+void make_keys_turbopascal_batch(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n) {
+    RANDOMS_BATCH_KEYS(s,
+                       s = ((s * 134775813) + 1) % UINT_MAX;
+                       out[l] = (s % 0xFF))
+}
+
+void make_keys_posix_rand_r_batch(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n) {
+    RANDOMS_BATCH_KEYS(s,
+                       s = (s * 1103515245) + 12345;
+                       int result = (uint16_t)(s / 0x10000) % 2048;
+                       s = (s * 1103515245) + 12345;
+                       result <<= 10;
+                       result ^= (uint16_t)(s / 0x10000) % 1024;
+                       s = (s * 1103515245) + 12345;
+                       result <<= 10;
+                       result ^= (uint16_t)(s / 0x10000) % 1024;
+                       out[l] = (result % 0xFF))
+}
+
+void make_keys_ms_rand_r_batch(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n) {
+    RANDOMS_BATCH_KEYS(s,
+                       s = ((s * 214013L) + 2531011L);
+                       out[l] = ((s >> 16) & 0x7FFF))
+}
@@ -24,9 +24,14 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+// number of keys generated per batch call
+#define RANDOMS_BATCH 16
+
 typedef struct generator_s {
     const char *Name;
     void (*Parse)(uint32_t seed, uint8_t key[], const size_t keylen);
+    // n (<= RANDOMS_BATCH) keys for seed, seed + 1, ..., stored back to back
+    void (*Batch)(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n);
 } generator_t;
 // generator_t array are expected to be NULL terminated
 
@@ -38,5 +43,13 @@ void make_key_ansic_n(uint32_t seed, uint8_t key[], const size_t keylen);
 void make_key_turbopascal_n(uint32_t seed, uint8_t key[], const size_t keylen);
 void make_key_posix_rand_r_n(uint32_t seed, uint8_t key[], const size_t keylen);
 void make_key_ms_rand_r_n(uint32_t seed, uint8_t key[], const size_t keylen);
+
+void make_keys_borland_batch(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n);
+void make_keys_recipies_batch(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n);
+void make_keys_glibc_batch(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n);
+void make_keys_ansic_batch(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n);
+void make_keys_turbopascal_batch(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n);
+void make_keys_posix_rand_r_batch(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n);
+void make_keys_ms_rand_r_batch(uint32_t seed, uint8_t keys[], const size_t keylen, const size_t n);
 #endif
 
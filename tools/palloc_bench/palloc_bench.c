@@ -0,0 +1,568 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// Host side test and benchmark harness for the palloc firmware allocator.
+//
+//  palloc_bench [-s <bytes>] [-n <loops>] [-c] replays/*.txt
+//  palloc_bench -r <seed> [-c]
+//
+// Builds armsrc/palloc.c for the host and runs it on a simulated SRAM region.
+// Replay files list the allocations the firmware makes for a command or a
+// session (trace, DMA, sample buffers, ...), the random mode throws a long
+// mix of sizes at it. Both report fragmentation and allocation latency, -c
+// checks the heap and the handed out memory after every step.
+//-----------------------------------------------------------------------------
+#define _POSIX_C_SOURCE 200809L
+#define __STDC_FORMAT_MACROS
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "ansi.h"
+#include "pm3_cmd.h"
+#include "palloc.h"
+#include "dbprint.h"
+
+#define BENCH_SRAM_SIZE   40960 // what is left between .bss and the stack of a full image, roughly
+#define BENCH_LOOPS       100
+#define BENCH_SLOTS       64
+#define BENCH_RANDOM_OPS  200000
+#define BENCH_MAX_OPS     4096
+
+// palloc logs through the firmware's Dbprintf
+debug_level g_dbglevel = DEBUG_NONE;
+
+void Dbprintf(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    printf("\n");
+}
+
+typedef enum {
+    OP_ALLOC,
+    OP_FREE,
+} op_kind_t;
+
+typedef enum {
+    OP_SIZE_FIXED,
+    OP_SIZE_MAX,    // size the allocation with palloc_largest_free()
+    OP_SIZE_TRACE,  // size the allocation with get_max_trace_length()
+} op_sizing_t;
+
+typedef struct {
+    op_kind_t kind;
+    op_sizing_t sizing;
+    uint8_t slot;
+    bool may_fail;  // a known firmware shortage, not counted as an error
+    uint16_t size;  // bytes, or the cap for `max` and `trace`
+} op_t;
+
+typedef struct {
+    uint8_t *ptr;
+    uint16_t size;
+} slot_t;
+
+typedef struct {
+    uint64_t sum;
+    uint64_t max;
+    uint32_t count;
+    uint32_t hist[64];  // power of two buckets, for the percentile
+} latency_t;
+
+typedef struct {
+    uint32_t ops;
+    uint32_t allocs;
+    uint32_t failed;
+    uint32_t known_failed;
+    uint32_t errors;
+    size_t peak_used;
+    size_t min_max_grant;  // smallest buffer a `max` or `trace` allocation got
+    double worst_frag;
+    double frag_sum;
+    uint32_t frag_samples;
+    uint32_t frees;
+    latency_t alloc_ns;
+    latency_t free_ns;
+} stats_t;
+
+static uint8_t g_sram[65536 + 8];
+static size_t g_sram_size = BENCH_SRAM_SIZE;
+static slot_t g_slots[BENCH_SLOTS];
+static bool g_check = false;
+
+static void latency_add(latency_t *l, uint64_t ns) {
+    uint8_t bucket = 0;
+    while ((ns >> bucket) > 1) {
+        bucket++;
+    }
+    l->hist[bucket]++;
+    l->sum += ns;
+    l->count++;
+    if (ns > l->max) {
+        l->max = ns;
+    }
+}
+
+// upper bound of the bucket that holds the 99th percentile
+static uint64_t latency_p99(const latency_t *l) {
+    uint64_t seen = 0;
+    for (uint8_t i = 0; i < 64; i++) {
+        seen += l->hist[i];
+        if (seen * 100 >= (uint64_t)l->count * 99) {
+            return 2ULL << i;
+        }
+    }
+    return l->max;
+}
+
+static void latency_print(const char *name, const latency_t *l) {
+    printf("[=]   %-11s avg %6.0f ns, p99 < %6" PRIu64 " ns, max %7" PRIu64 " ns\n",
+           name, l->count ? (double)l->sum / l->count : 0.0, latency_p99(l), l->max);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+// xorshift, so random runs are the same on every host
+static uint32_t g_rng = 1;
+static uint32_t rng(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return g_rng;
+}
+
+static void bench_reset(void) {
+    memset(g_sram, 0xA5, sizeof(g_sram));
+    memset(g_slots, 0, sizeof(g_slots));
+    // deliberately misaligned by 4, like a .bss end that only is word aligned
+    palloc_init_region(g_sram + 4, g_sram_size);
+}
+
+static bool check_heap(stats_t *st, const char *what, uint32_t step) {
+    if (g_check == false) {
+        return true;
+    }
+
+    if (palloc_heap_integrity() == false) {
+        printf("[!] heap integrity check failed after step %u (%s)\n", step, what);
+        st->errors++;
+        return false;
+    }
+    return true;
+}
+
+static void sample_fragmentation(stats_t *st) {
+    size_t left = palloc_sram_left();
+    if (left == 0) {
+        return;
+    }
+    size_t largest = palloc_largest_free();
+    // the cap isn't fragmentation
+    if (largest == MAX_BLOCK_SIZE && left >= MAX_BLOCK_SIZE) {
+        left = largest;
+    }
+    double frag = 1.0 - ((double)largest / (double)left);
+    if (frag > st->worst_frag) {
+        st->worst_frag = frag;
+    }
+    st->frag_sum += frag;
+    st->frag_samples++;
+}
+
+// replays mark the allocations that may fail, any other failure is an error
+static void alloc_failed(stats_t *st, uint8_t slot, uint16_t size, bool known) {
+    st->failed++;
+    if (known) {
+        st->known_failed++;
+    } else {
+        printf("[!] slot %u, %u bytes could not be allocated after step %u\n", slot, size, st->ops);
+        st->errors++;
+    }
+}
+
+// armsrc/tracer.c does not build on the host, this is its get_max_trace_length()
+static size_t max_trace_length(void) {
+    size_t largest = palloc_largest_free();
+    return (largest > 2 * TRACE_HEAP_RESERVE ? largest - TRACE_HEAP_RESERVE : largest / 2);
+}
+
+static void do_alloc(stats_t *st, uint8_t slot, uint16_t size, op_sizing_t sizing, bool may_fail) {
+    slot_t *s = &g_slots[slot];
+    if (s->ptr != NULL) {
+        // the firmware would leak it, we free it so the replay stays meaningful
+        palloc_free(s->ptr);
+        s->ptr = NULL;
+    }
+
+    sample_fragmentation(st);
+
+    if (sizing != OP_SIZE_FIXED) {
+        size_t largest = (sizing == OP_SIZE_TRACE) ? max_trace_length() : palloc_largest_free();
+        if (size == 0 || largest < size) {
+            size = largest;
+        }
+        if (size < st->min_max_grant) {
+            st->min_max_grant = size;
+        }
+    }
+
+    st->allocs++;
+    if (size == 0) {
+        alloc_failed(st, slot, size, may_fail);
+        return;
+    }
+
+    uint64_t t = now_ns();
+    uint8_t *p = (uint8_t *)palloc(1, size);
+    t = now_ns() - t;
+    latency_add(&st->alloc_ns, t);
+
+    if (p == NULL) {
+        alloc_failed(st, slot, size, may_fail);
+        return;
+    }
+
+    if (g_check) {
+        // calloc like, 8 byte aligned and inside the region
+        if (((size_t)p & 7) != 0 || p < g_sram || p + size > g_sram + sizeof(g_sram)) {
+            printf("[!] slot %u got a bad pointer %p\n", slot, (void *)p);
+            st->errors++;
+        }
+        for (uint16_t i = 0; i < size; i++) {
+            if (p[i] != 0) {
+                printf("[!] slot %u not zeroed at %u\n", slot, i);
+                st->errors++;
+                break;
+            }
+        }
+        memset(p, slot + 1, size);
+    }
+
+    s->ptr = p;
+    s->size = size;
+
+    size_t used = palloc_sram_size() - palloc_sram_left();
+    if (used > st->peak_used) {
+        st->peak_used = used;
+    }
+}
+
+static void do_free(stats_t *st, uint8_t slot) {
+    slot_t *s = &g_slots[slot];
+    if (s->ptr == NULL) {
+        return;
+    }
+
+    if (g_check) {
+        // anything else scribbling on our block means blocks overlap
+        for (uint16_t i = 0; i < s->size; i++) {
+            if (s->ptr[i] != (uint8_t)(slot + 1)) {
+                printf("[!] slot %u overwritten at %u\n", slot, i);
+                st->errors++;
+                break;
+            }
+        }
+    }
+
+    uint64_t t = now_ns();
+    bool ok = palloc_free(s->ptr);
+    t = now_ns() - t;
+    latency_add(&st->free_ns, t);
+    st->frees++;
+
+    if (ok == false) {
+        printf("[!] slot %u could not be freed\n", slot);
+        st->errors++;
+    } else if (g_check && palloc_free(s->ptr)) {
+        printf("[!] slot %u could be freed twice\n", slot);
+        st->errors++;
+    }
+
+    s->ptr = NULL;
+    s->size = 0;
+}
+
+// once everything is freed the heap has to be back to a single free block
+static void check_all_free(stats_t *st, size_t left_start) {
+    if (palloc_used_blocks() != 0 || palloc_free_blocks() != 1 || palloc_sram_left() != left_start) {
+        printf("[!] memory did not come back together, %d used / %d free blocks, %zu of %zu bytes\n",
+               palloc_used_blocks(), palloc_free_blocks(), palloc_sram_left(), left_start);
+        st->errors++;
+    }
+}
+
+static void free_all(stats_t *st) {
+    for (uint8_t i = 0; i < BENCH_SLOTS; i++) {
+        do_free(st, i);
+    }
+}
+
+static void stats_print(const char *name, const stats_t *st) {
+    printf("[=] " _YELLOW_("%s") "\n", name);
+    printf("[=]   steps %u, allocations %u, %u failed (%u known), peak used %zu of %u bytes\n",
+           st->ops, st->allocs, st->failed, st->known_failed, st->peak_used, palloc_sram_size());
+    if (st->min_max_grant != SIZE_MAX) {
+        printf("[=]   smallest take-what-is-left buffer %zu bytes\n", st->min_max_grant);
+    }
+    printf("[=]   fragmentation worst %.1f%%, average %.1f%% (1 - largest free block / free memory)\n",
+           st->worst_frag * 100.0, st->frag_samples ? (st->frag_sum * 100.0) / st->frag_samples : 0.0);
+    latency_print("palloc", &st->alloc_ns);
+    latency_print("palloc_free", &st->free_ns);
+    if (st->errors) {
+        printf("[!]   " _RED_("%u errors") "\n", st->errors);
+    }
+}
+
+static int load_replay(const char *fn, op_t *ops, uint32_t *n) {
+    FILE *f = fopen(fn, "r");
+    if (f == NULL) {
+        fprintf(stderr, "[!] could not open %s\n", fn);
+        return PM3_EFILE;
+    }
+
+    char line[256];
+    uint32_t lineno = 0;
+    *n = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = '\0';
+        }
+
+        char *mark = strchr(line, '?');
+        if (mark) {
+            *mark = ' ';
+        }
+
+        char kind[8] = {0}, size[16] = {0};
+        unsigned int slot = 0, cap = 0;
+        int items = sscanf(line, "%7s %u %15s %u", kind, &slot, size, &cap);
+        if (items <= 0) {
+            continue;
+        }
+
+        if (*n >= BENCH_MAX_OPS || items < 2 || slot >= BENCH_SLOTS) {
+            fprintf(stderr, "[!] %s:%u bad line\n", fn, lineno);
+            fclose(f);
+            return PM3_EINVARG;
+        }
+
+        op_t *op = &ops[(*n)++];
+        memset(op, 0, sizeof(*op));
+        op->slot = slot;
+        op->may_fail = (mark != NULL);
+
+        if (strcmp(kind, "f") == 0 && items == 2 && mark == NULL) {
+            op->kind = OP_FREE;
+        } else if (strcmp(kind, "a") == 0 && items >= 3) {
+            op->kind = OP_ALLOC;
+            if (strcmp(size, "max") == 0 || strcmp(size, "trace") == 0) {
+                op->sizing = (size[0] == 'm') ? OP_SIZE_MAX : OP_SIZE_TRACE;
+                op->size = (items == 4) ? cap : 0;
+            } else {
+                op->size = strtoul(size, NULL, 0);
+            }
+        } else {
+            fprintf(stderr, "[!] %s:%u bad line\n", fn, lineno);
+            fclose(f);
+            return PM3_EINVARG;
+        }
+    }
+    fclose(f);
+    return PM3_SUCCESS;
+}
+
+static int run_replay(const char *fn, uint32_t loops) {
+    static op_t ops[BENCH_MAX_OPS];
+    uint32_t n = 0;
+
+    int res = load_replay(fn, ops, &n);
+    if (res != PM3_SUCCESS) {
+        return res;
+    }
+
+    stats_t st = { .min_max_grant = SIZE_MAX };
+    bench_reset();
+    size_t left_start = palloc_sram_left();
+
+    for (uint32_t l = 0; l < loops && st.errors == 0; l++) {
+        for (uint32_t i = 0; i < n && st.errors == 0; i++) {
+            if (ops[i].kind == OP_ALLOC) {
+                do_alloc(&st, ops[i].slot, ops[i].size, ops[i].sizing, ops[i].may_fail);
+            } else {
+                do_free(&st, ops[i].slot);
+            }
+            st.ops++;
+            check_heap(&st, fn, st.ops);
+        }
+    }
+
+    free_all(&st);
+    check_heap(&st, "free all", st.ops);
+    check_all_free(&st, left_start);
+
+    const char *name = strrchr(fn, '/');
+    stats_print(name ? name + 1 : fn, &st);
+    return st.errors ? PM3_ESOFT : PM3_SUCCESS;
+}
+
+static uint16_t random_size(void) {
+    uint32_t r = rng() % 100;
+    if (r < 70) {
+        return 1 + (rng() % 300);     // frames, parity, responses
+    }
+    if (r < 95) {
+        return 300 + (rng() % 2700);  // DMA buffers, FPGA queue, answers
+    }
+    return 3000 + (rng() % 13000);    // sample buffers, traces
+}
+
+static int run_random(uint32_t seed, uint32_t nops) {
+    stats_t st = { .min_max_grant = SIZE_MAX };
+    g_rng = seed ? seed : 1;
+    bench_reset();
+    size_t left_start = palloc_sram_left();
+
+    for (uint32_t i = 0; i < nops; i++) {
+        uint8_t slot = rng() % BENCH_SLOTS;
+        if (g_slots[slot].ptr) {
+            do_free(&st, slot);
+        } else {
+            do_alloc(&st, slot, random_size(), ((rng() % 50) == 0) ? OP_SIZE_MAX : OP_SIZE_FIXED, true);
+        }
+        st.ops++;
+
+        // pointers that were never ours have to be turned away
+        if (g_check && (i % 1024) == 0) {
+            // (a tiny block may still hold a stale header right behind its first 8 bytes)
+            uint8_t *any = g_slots[slot].size >= 16 ? g_slots[slot].ptr : NULL;
+            if ((any && palloc_free(any + 8)) || palloc_free(g_sram) || palloc_free(&st)) {
+                printf("[!] palloc_free accepted a foreign pointer\n");
+                st.errors++;
+            }
+        }
+
+        if (check_heap(&st, "random", st.ops) == false) {
+            break;
+        }
+    }
+
+    free_all(&st);
+    check_heap(&st, "free all", st.ops);
+    check_all_free(&st, left_start);
+
+    char name[32];
+    snprintf(name, sizeof(name), "random, seed %u", seed);
+    stats_print(name, &st);
+    return st.errors ? PM3_ESOFT : PM3_SUCCESS;
+}
+
+static int usage(void) {
+    printf("\n");
+    printf("syntax:  palloc_bench [-s <bytes>] [-n <loops>] [-c] [-v] <replay.txt> ...\n");
+    printf("         palloc_bench -r <seed> [-o <ops>] [-s <bytes>] [-c] [-v]\n\n");
+    printf("Runs the firmware allocator (armsrc/palloc.c) on a simulated SRAM region\n\n");
+    printf("  -s <bytes>   size of the simulated heap, default %u\n", BENCH_SRAM_SIZE);
+    printf("  -n <loops>   how often every replay is run back to back, default %u\n", BENCH_LOOPS);
+    printf("  -r <seed>    random allocations instead of replays\n");
+    printf("  -o <ops>     number of random steps, default %u\n", BENCH_RANDOM_OPS);
+    printf("  -c           check the heap and the allocated memory after every step\n");
+    printf("  -v           print the palloc debug messages\n\n");
+    printf("replay lines:\n");
+    printf("\n");
+    printf("  a <slot> <bytes>       allocate\n");
+    printf("  a <slot> max [<cap>]   allocate palloc_largest_free(), at most <cap> bytes\n");
+    printf("  a <slot> trace [<cap>] allocate get_max_trace_length(), at most <cap> bytes\n");
+    printf("  f <slot>               free\n");
+    printf("  a ... ?                allocation that may fail, any other failed allocation is an error\n");
+    printf("\n");
+    printf("samples:\n");
+    printf("\n");
+    printf("  ./palloc_bench replays/*.txt\n");
+    printf("  ./palloc_bench -c -r 1\n");
+    printf("\n");
+    return 1;
+}
+
+int main(int argc, char *const argv[]) {
+    uint32_t loops = BENCH_LOOPS, nops = BENCH_RANDOM_OPS, seed = 0;
+    bool random = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:r:o:cvh")) != -1) {
+        switch (opt) {
+            case 's':
+                g_sram_size = strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                loops = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                random = true;
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'o':
+                nops = strtoul(optarg, NULL, 0);
+                break;
+            case 'c':
+                g_check = true;
+                break;
+            case 'v':
+                g_dbglevel = DEBUG_FULL;
+                break;
+            case 'h':
+            default:
+                return usage();
+        }
+    }
+
+    if ((random == false && optind == argc) || (random && optind != argc)) {
+        return usage();
+    }
+
+    if (g_sram_size < 64 || g_sram_size > sizeof(g_sram) - 8) {
+        fprintf(stderr, "[!] heap size has to be between 64 and %zu bytes\n", sizeof(g_sram) - 8);
+        return 1;
+    }
+
+    int res = PM3_SUCCESS;
+    if (random) {
+        res = run_random(seed, nops);
+    } else {
+        for (int i = optind; i < argc; i++) {
+            int r = run_replay(argv[i], loops);
+            if (r != PM3_SUCCESS) {
+                res = r;
+            }
+        }
+    }
+
+    if (res == PM3_SUCCESS) {
+        printf("[+] " _GREEN_("OK") "\n");
+    }
+    return res == PM3_SUCCESS ? 0 : 1;
+}
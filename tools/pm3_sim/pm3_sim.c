@@ -0,0 +1,1025 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) Proxmark3 contributors. See AUTHORS.md for details.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See LICENSE.txt for the text of the license.
+//-----------------------------------------------------------------------------
+// Proxmark3 device simulator.
+//
+//  pm3_sim [-p <port>]                    listens on tcp port 18888 by default
+//  proxmark3 -p tcp:localhost:18888      the client connects as to a networked device
+//
+// Speaks the NG / MIX / OLD frames of armsrc/cmd.c and answers a subset of the
+// firmware commands against a software MIFARE Classic card (common/crapto1)
+// and a BigBuf preloaded from .pm3 samples or a .trace file. Meant to test and
+// benchmark the client without a device attached, e.g. in CI.
+//-----------------------------------------------------------------------------
+#define __STDC_FORMAT_MACROS
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "common.h"
+#include "pm3_cmd.h"
+#include "mifare.h"
+#include "protocols.h"
+#include "crc16.h"
+#include "commonutil.h"
+#include "util_posix.h"
+#include "crapto1/crapto1.h"
+#include "ansi.h"
+
+#define SIM_DEFAULT_PORT   "18888"
+#define SIM_SRAM_SIZE      40000
+#define SIM_CARD_SIZE      4096
+#define SIM_MAX_SECTORS    40
+// card PRNG steps between two authentications, and between the two auths of a nested attack
+#define SIM_AUTH_DIST      8000
+#define SIM_NESTED_DIST    160
+
+typedef struct {
+    uint8_t keyA[6];
+    uint8_t keyB[6];
+} PACKED sim_sector_t;
+
+typedef struct {
+    uint8_t uid[4];
+    uint8_t sectors;
+    uint8_t mem[SIM_CARD_SIZE];  // blocks as in a .bin dump, keys in the sector trailers
+    uint32_t nt;                 // last nonce of the card, a weak 16 bit LFSR
+} sim_card_t;
+
+typedef struct {
+    int fd;
+    bool verbose;
+    uint32_t auth_delay_us;
+    uint64_t pending_us;
+
+    sim_card_t card;
+    uint8_t emul[SIM_CARD_SIZE];
+
+    uint8_t bigbuf[SIM_SRAM_SIZE];
+    uint32_t samples_len;
+    uint32_t trace_len;
+    sample_config config;
+
+    // CMD_HF_MIFARE_CHKKEYS_FAST keeps its results between key chunks, as the firmware does
+    sim_sector_t k_sector[SIM_MAX_SECTORS];
+    uint8_t found[SIM_MAX_SECTORS * 2];
+    uint8_t foundkeys;
+
+    // per connection statistics
+    uint32_t commands;
+    uint64_t auths;
+    uint64_t bytes_out;
+} sim_t;
+
+static sim_t g_sim;
+
+static const uint64_t sim_default_keys[][2] = {
+    {0xFFFFFFFFFFFF, 0xFFFFFFFFFFFF},
+    {0xA0A1A2A3A4A5, 0xB0B1B2B3B4B5},
+    {0xD3F7D3F7D3F7, 0xFFFFFFFFFFFF},
+};
+
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+//-----------------------------------------------------------------------------
+// Software MIFARE Classic card
+//-----------------------------------------------------------------------------
+static uint8_t first_block(uint8_t s) {
+    return (s < 32) ? (s * 4) : (128 + (s - 32) * 16);
+}
+
+static uint8_t blocks_in_sector(uint8_t s) {
+    return (s < 32) ? 4 : 16;
+}
+
+static uint8_t sector_of(uint8_t b) {
+    return (b < 128) ? (b / 4) : (32 + (b - 128) / 16);
+}
+
+static uint8_t *trailer_of(sim_card_t *c, uint8_t s) {
+    return c->mem + (first_block(s) + blocks_in_sector(s) - 1) * 16;
+}
+
+static uint64_t card_key(sim_card_t *c, uint8_t s, uint8_t keytype) {
+    return bytes_to_num(trailer_of(c, s) + (keytype ? 10 : 0), 6);
+}
+
+// key B can be read with key A for the trailer access conditions 000, 010 and 001
+static bool card_keyb_readable(sim_card_t *c, uint8_t s) {
+    const uint8_t *t = trailer_of(c, s);
+    bool c1 = (t[7] >> 7) & 1;
+    bool c2 = (t[8] >> 3) & 1;
+    bool c3 = (t[8] >> 7) & 1;
+    return (c1 == false) && ((c2 && c3) == false);
+}
+
+static uint32_t card_cuid(const sim_card_t *c) {
+    return (uint32_t)bytes_to_num(c->uid, 4);
+}
+
+static uint32_t card_next_nonce(sim_card_t *c, uint32_t dist) {
+    c->nt = prng_successor(c->nt, dist);
+    return c->nt;
+}
+
+// every authentication costs the configured delay, paid before the next reply
+static bool card_auth(sim_t *sim, uint8_t block, uint8_t keytype, uint64_t key) {
+    sim->auths++;
+    sim->pending_us += sim->auth_delay_us;
+    card_next_nonce(&sim->card, SIM_AUTH_DIST);
+
+    uint8_t s = sector_of(block);
+    if (s >= sim->card.sectors) {
+        return false;
+    }
+    return card_key(&sim->card, s, keytype & 1) == key;
+}
+
+static void card_read_block(sim_card_t *c, uint8_t block, uint8_t *out) {
+    memcpy(out, c->mem + block * 16, 16);
+    uint8_t s = sector_of(block);
+    if (block == first_block(s) + blocks_in_sector(s) - 1) {
+        // key A is never readable
+        memset(out, 0x00, 6);
+        if (card_keyb_readable(c, s) == false) {
+            memset(out + 10, 0x00, 6);
+        }
+    }
+}
+
+static void card_init_default(sim_card_t *c, uint64_t seed, uint8_t sectors) {
+    memset(c, 0, sizeof(sim_card_t));
+    c->sectors = sectors;
+
+    uint64_t x = seed;
+    num_to_bytes(splitmix64(&x), 4, c->uid);
+
+    uint8_t *b0 = c->mem;
+    memcpy(b0, c->uid, 4);
+    b0[4] = c->uid[0] ^ c->uid[1] ^ c->uid[2] ^ c->uid[3];
+    b0[5] = (sectors > 16) ? 0x18 : 0x08;
+    b0[6] = (sectors > 16) ? 0x02 : 0x04;
+    b0[7] = 0x00;
+    memcpy(b0 + 8, "PM3 SIM!", 8);
+
+    // a mix of dictionary keys and, every fourth sector, keys only nested finds
+    for (uint8_t s = 0; s < sectors; s++) {
+        uint64_t ka, kb;
+        if ((s % 4) == 3) {
+            ka = splitmix64(&x) & 0xFFFFFFFFFFFFULL;
+            kb = splitmix64(&x) & 0xFFFFFFFFFFFFULL;
+        } else {
+            ka = sim_default_keys[s % 4][0];
+            kb = sim_default_keys[s % 4][1];
+        }
+        uint8_t *t = trailer_of(c, s);
+        num_to_bytes(ka, 6, t);
+        memcpy(t + 6, "\xFF\x07\x80\x69", 4);
+        num_to_bytes(kb, 6, t + 10);
+    }
+
+    // any 16 bit start value gives a valid nonce after 16 steps
+    c->nt = prng_successor((uint32_t)(splitmix64(&x) & 0xFFFF) | 1, 16);
+}
+
+static int card_load(sim_card_t *c, const char *fn) {
+    FILE *f = fopen(fn, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "[!] could not open %s\n", fn);
+        return PM3_EFILE;
+    }
+    size_t len = fread(c->mem, 1, sizeof(c->mem), f);
+    fclose(f);
+
+    switch (len) {
+        case 320:   // mini
+            c->sectors = 5;
+            break;
+        case 1024:  // 1K
+            c->sectors = 16;
+            break;
+        case 2048:  // 2K
+            c->sectors = 32;
+            break;
+        case 4096:  // 4K
+            c->sectors = 40;
+            break;
+        default:
+            fprintf(stderr, "[!] %s: %zu bytes is not a MIFARE Classic dump\n", fn, len);
+            return PM3_EFILE;
+    }
+    memcpy(c->uid, c->mem, 4);
+    c->nt = prng_successor((card_cuid(c) & 0xFFFF) | 1, 16);
+    return PM3_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+// BigBuf contents
+//-----------------------------------------------------------------------------
+
+// .pm3 files hold one sample per line, as written by `data save`
+static int bigbuf_load_samples(sim_t *sim, const char *fn) {
+    FILE *f = fopen(fn, "r");
+    if (f == NULL) {
+        fprintf(stderr, "[!] could not open %s\n", fn);
+        return PM3_EFILE;
+    }
+    int v;
+    sim->samples_len = 0;
+    while (sim->samples_len < sizeof(sim->bigbuf) && fscanf(f, "%d", &v) == 1) {
+        v += 127;
+        sim->bigbuf[sim->samples_len++] = (v < 0) ? 0 : ((v > 255) ? 255 : v);
+    }
+    fclose(f);
+    if (sim->samples_len == 0) {
+        fprintf(stderr, "[!] no samples in %s\n", fn);
+        return PM3_EFILE;
+    }
+    return PM3_SUCCESS;
+}
+
+// .trace files are a raw copy of the trace buffer, as written by `trace save`
+static int bigbuf_load_trace(sim_t *sim, const char *fn) {
+    FILE *f = fopen(fn, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "[!] could not open %s\n", fn);
+        return PM3_EFILE;
+    }
+    sim->trace_len = fread(sim->bigbuf, 1, sizeof(sim->bigbuf), f);
+    fclose(f);
+    return PM3_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+// Framing, see armsrc/cmd.c
+//-----------------------------------------------------------------------------
+static bool sim_read(int fd, void *buf, size_t len) {
+    uint8_t *p = buf;
+    while (len) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static int sim_write(sim_t *sim, const void *buf, size_t len) {
+    // pay the simulated air time before answering
+    if (sim->pending_us) {
+        usleep(sim->pending_us);
+        sim->pending_us = 0;
+    }
+
+    const uint8_t *p = buf;
+    while (len) {
+        ssize_t n = send(sim->fd, p, len, 0);
+        if (n <= 0) {
+            return PM3_EIO;
+        }
+        p += n;
+        len -= n;
+        sim->bytes_out += n;
+    }
+    return PM3_SUCCESS;
+}
+
+static int reply_old(sim_t *sim, uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, const void *data, size_t len) {
+    PacketResponseOLD txcmd;
+    memset(&txcmd, 0, sizeof(txcmd));
+    txcmd.cmd = cmd;
+    txcmd.arg[0] = arg0;
+    txcmd.arg[1] = arg1;
+    txcmd.arg[2] = arg2;
+    if (data && len) {
+        memcpy(txcmd.d.asBytes, data, MIN(len, PM3_CMD_DATA_SIZE));
+    }
+    return sim_write(sim, &txcmd, sizeof(txcmd));
+}
+
+static int reply_ng_internal(sim_t *sim, uint16_t cmd, int16_t status, const uint8_t *data, size_t len, bool ng) {
+    PacketResponseNGRaw txBufferNG;
+
+    txBufferNG.pre.magic = RESPONSENG_PREAMBLE_MAGIC;
+    txBufferNG.pre.cmd = cmd;
+    txBufferNG.pre.status = status;
+    txBufferNG.pre.ng = ng;
+    if (len > PM3_CMD_DATA_SIZE) {
+        len = PM3_CMD_DATA_SIZE;
+        txBufferNG.pre.status = PM3_EOVFLOW;
+    }
+    txBufferNG.pre.length = (len & 0x7FFF);
+    if (data && len) {
+        memcpy(txBufferNG.data, data, len);
+    }
+
+    // like USB-CDC, no CRC on replies
+    PacketResponseNGPostamble *tx_post = (PacketResponseNGPostamble *)((uint8_t *)&txBufferNG + sizeof(PacketResponseNGPreamble) + len);
+    tx_post->crc = RESPONSENG_POSTAMBLE_MAGIC;
+
+    return sim_write(sim, &txBufferNG, sizeof(PacketResponseNGPreamble) + len + sizeof(PacketResponseNGPostamble));
+}
+
+static int reply_ng(sim_t *sim, uint16_t cmd, int16_t status, const void *data, size_t len) {
+    return reply_ng_internal(sim, cmd, status, data, len, true);
+}
+
+static int reply_mix(sim_t *sim, uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, const void *data, size_t len) {
+    int16_t status = PM3_SUCCESS;
+    uint64_t arg[3] = {arg0, arg1, arg2};
+    if (len > PM3_CMD_DATA_SIZE - sizeof(arg)) {
+        len = PM3_CMD_DATA_SIZE - sizeof(arg);
+        status = PM3_EOVFLOW;
+    }
+    uint8_t cmddata[PM3_CMD_DATA_SIZE];
+    memcpy(cmddata, arg, sizeof(arg));
+    if (data && len) {
+        memcpy(cmddata + sizeof(arg), data, len);
+    }
+    return reply_ng_internal(sim, (cmd & 0xFFFF), status, cmddata, len + sizeof(arg), false);
+}
+
+static int receive_ng(sim_t *sim, PacketCommandNG *rx) {
+    PacketCommandNGRaw rx_raw;
+    if (sim_read(sim->fd, &rx_raw.pre, sizeof(PacketCommandNGPreamble)) == false) {
+        return PM3_EIO;
+    }
+
+    rx->magic = rx_raw.pre.magic;
+    rx->ng = rx_raw.pre.ng;
+    rx->cmd = rx_raw.pre.cmd;
+    uint16_t length = rx_raw.pre.length;
+
+    if (rx->magic == COMMANDNG_PREAMBLE_MAGIC) {
+        if (length > PM3_CMD_DATA_SIZE) {
+            return PM3_EOVFLOW;
+        }
+        if (sim_read(sim->fd, rx_raw.data, length) == false) {
+            return PM3_EIO;
+        }
+
+        if (rx->ng) {
+            memcpy(rx->data.asBytes, rx_raw.data, length);
+            rx->length = length;
+        } else {
+            uint64_t arg[3];
+            if (length < sizeof(arg)) {
+                return PM3_EIO;
+            }
+            memcpy(arg, rx_raw.data, sizeof(arg));
+            rx->oldarg[0] = arg[0];
+            rx->oldarg[1] = arg[1];
+            rx->oldarg[2] = arg[2];
+            memcpy(rx->data.asBytes, rx_raw.data + sizeof(arg), length - sizeof(arg));
+            rx->length = length - sizeof(arg);
+        }
+
+        PacketCommandNGPostamble post;
+        if (sim_read(sim->fd, &post, sizeof(post)) == false) {
+            return PM3_EIO;
+        }
+
+        // check CRC, accept MAGIC as placeholder
+        rx->crc = post.crc;
+        if (rx->crc != COMMANDNG_POSTAMBLE_MAGIC) {
+            uint8_t first, second;
+            compute_crc(CRC_14443_A, (uint8_t *)&rx_raw, sizeof(PacketCommandNGPreamble) + length, &first, &second);
+            if ((first << 8) + second != rx->crc) {
+                return PM3_ECRC;
+            }
+        }
+    } else {
+        PacketCommandOLD rx_old;
+        memcpy(&rx_old, &rx_raw.pre, sizeof(PacketCommandNGPreamble));
+        if (sim_read(sim->fd, ((uint8_t *)&rx_old) + sizeof(PacketCommandNGPreamble), sizeof(PacketCommandOLD) - sizeof(PacketCommandNGPreamble)) == false) {
+            return PM3_EIO;
+        }
+        rx->ng = false;
+        rx->magic = 0;
+        rx->crc = 0;
+        rx->cmd = (rx_old.cmd & 0xFFFF);
+        rx->oldarg[0] = rx_old.arg[0];
+        rx->oldarg[1] = rx_old.arg[1];
+        rx->oldarg[2] = rx_old.arg[2];
+        rx->length = PM3_CMD_DATA_SIZE;
+        memcpy(rx->data.asBytes, rx_old.d.asBytes, PM3_CMD_DATA_SIZE);
+    }
+    return PM3_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+// Commands
+//-----------------------------------------------------------------------------
+static void sim_capabilities(sim_t *sim) {
+    capabilities_t cap;
+    memset(&cap, 0, sizeof(cap));
+    cap.version = CAPABILITIES_VERSION;
+    cap.via_usb = true;
+    cap.sram_size = SIM_SRAM_SIZE;
+    cap.compiled_with_lf = true;
+    cap.compiled_with_iso14443a = true;
+    reply_ng(sim, CMD_CAPABILITIES, PM3_SUCCESS, &cap, sizeof(cap));
+}
+
+static void sim_version(sim_t *sim) {
+    struct p {
+        uint32_t id;
+        uint32_t section_size;
+        uint32_t versionstr_len;
+        char versionstr[PM3_CMD_DATA_SIZE - 12];
+    } PACKED payload;
+    memset(&payload, 0, sizeof(payload));
+    // AT91SAM7S512 rev B, as on the RDV4
+    payload.id = 0x270B0A40;
+    snprintf(payload.versionstr, sizeof(payload.versionstr), " [ ARM ]\n    os: pm3_sim, software device simulator\n");
+    payload.versionstr_len = strlen(payload.versionstr) + 1;
+    reply_ng(sim, CMD_VERSION, PM3_SUCCESS, &payload, 12 + payload.versionstr_len);
+}
+
+static void sim_download(sim_t *sim, const uint8_t *mem, size_t memlen, uint32_t startidx, uint32_t numofbytes, uint16_t chunk_cmd, uint32_t arg2) {
+    for (size_t i = 0; i < numofbytes; i += PM3_CMD_DATA_SIZE) {
+        size_t len = MIN((numofbytes - i), PM3_CMD_DATA_SIZE);
+        uint8_t chunk[PM3_CMD_DATA_SIZE] = {0};
+        if (startidx + i < memlen) {
+            memcpy(chunk, mem + startidx + i, MIN(len, memlen - startidx - i));
+        }
+        if (reply_old(sim, chunk_cmd, i, len, arg2, chunk, len) != PM3_SUCCESS) {
+            return;
+        }
+    }
+}
+
+static void sim_chk_found(sim_t *sim, uint8_t s, uint8_t keytype, uint64_t key) {
+    num_to_bytes(key, 6, keytype ? sim->k_sector[s].keyB : sim->k_sector[s].keyA);
+    sim->found[(s * 2) + keytype] = 1;
+    sim->foundkeys++;
+}
+
+// a found key is tried on all other sectors, and key B is read out where the access bits allow,
+// see chkKey_scanA / chkKey_scanB / chkKey_loopBonly in armsrc/mifarecmd.c
+static void sim_chk_scan(sim_t *sim, uint8_t sectorcnt, uint8_t keytype, uint64_t key) {
+    for (uint8_t s = 0; s < sectorcnt; s++) {
+        if (sim->found[(s * 2) + keytype] == 0 && card_auth(sim, first_block(s), keytype, key)) {
+            sim_chk_found(sim, s, keytype, key);
+        }
+    }
+    if (keytype == MF_KEY_B) {
+        return;
+    }
+    for (uint8_t s = 0; s < sectorcnt; s++) {
+        if (sim->found[s * 2] && sim->found[(s * 2) + 1] == 0 && s < sim->card.sectors && card_keyb_readable(&sim->card, s)) {
+            uint64_t keyb = card_key(&sim->card, s, MF_KEY_B);
+            sim_chk_found(sim, s, MF_KEY_B, keyb);
+            sim_chk_scan(sim, sectorcnt, MF_KEY_B, keyb);
+        }
+    }
+}
+
+static void sim_chk_sector_key(sim_t *sim, uint8_t sectorcnt, uint8_t s, uint64_t key) {
+    for (uint8_t keytype = MF_KEY_A; keytype <= MF_KEY_B; keytype++) {
+        if (sim->found[(s * 2) + keytype] == 0 && card_auth(sim, first_block(s), keytype, key)) {
+            sim_chk_found(sim, s, keytype, key);
+            sim_chk_scan(sim, sectorcnt, keytype, key);
+        }
+    }
+}
+
+static void sim_chkkeys_fast(sim_t *sim, const PacketCommandNG *packet) {
+    uint8_t sectorcnt = MIN(packet->oldarg[0] & 0xFF, SIM_MAX_SECTORS);
+    uint8_t firstchunk = (packet->oldarg[0] >> 8) & 0xF;
+    uint8_t lastchunk = (packet->oldarg[0] >> 12) & 0xF;
+    uint8_t strategy = packet->oldarg[1] & 0xFF;
+    uint8_t use_flashmem = (packet->oldarg[1] >> 8) & 0xFF;
+    uint16_t keycnt = packet->oldarg[2] & 0xFF;
+    uint8_t allkeys = sectorcnt << 1;
+
+    if (firstchunk) {
+        memset(sim->k_sector, 0, sizeof(sim->k_sector));
+        memset(sim->found, 0, sizeof(sim->found));
+        sim->foundkeys = 0;
+    }
+
+    // no flash memory to read a dictionary from
+    if (use_flashmem) {
+        keycnt = 0;
+    }
+
+    if (strategy == 1) {
+        // depth first, stops at the first sector where this chunk finds nothing
+        for (uint8_t s = 0; s < sectorcnt && sim->foundkeys < allkeys; s++) {
+            if (sim->found[s * 2] && sim->found[(s * 2) + 1]) {
+                continue;
+            }
+            uint8_t before = sim->foundkeys;
+            for (uint16_t i = 0; i < keycnt; i++) {
+                sim_chk_sector_key(sim, sectorcnt, s, bytes_to_num(packet->data.asBytes + i * 6, 6));
+            }
+            if (sim->foundkeys == before) {
+                break;
+            }
+        }
+    } else {
+        // width first
+        for (uint16_t i = 0; i < keycnt && sim->foundkeys < allkeys; i++) {
+            uint64_t key = bytes_to_num(packet->data.asBytes + i * 6, 6);
+            for (uint8_t s = 0; s < sectorcnt; s++) {
+                sim_chk_sector_key(sim, sectorcnt, s, key);
+            }
+        }
+    }
+
+    if (sim->foundkeys == allkeys || lastchunk) {
+        uint64_t foo = 0;
+        for (uint8_t m = 0; m < 64; m++) {
+            foo |= ((uint64_t)(sim->found[m] & 1) << m);
+        }
+        uint16_t bar = 0;
+        for (uint8_t m = 64; m < ARRAYLEN(sim->found); m++) {
+            bar |= ((uint16_t)(sim->found[m] & 1) << (m - 64));
+        }
+
+        uint8_t tmp[480 + 10] = {0};
+        memcpy(tmp, sim->k_sector, sectorcnt * sizeof(sim_sector_t));
+        num_to_bytes(foo, 8, tmp + 480);
+        tmp[488] = bar & 0xFF;
+        tmp[489] = bar >> 8 & 0xFF;
+        reply_old(sim, CMD_ACK, sim->foundkeys, 0, 0, tmp, sizeof(tmp));
+    } else {
+        reply_mix(sim, CMD_ACK, sim->foundkeys, 0, 0, NULL, 0);
+    }
+}
+
+static void sim_chkkeys(sim_t *sim, const PacketCommandNG *packet) {
+    struct {
+        uint8_t key[6];
+        bool found;
+    } PACKED keyresult;
+    memset(&keyresult, 0, sizeof(keyresult));
+
+    const uint8_t *datain = packet->data.asBytes;
+    uint8_t keytype = datain[0];
+    uint8_t block = datain[1];
+    uint16_t keycnt = (datain[3] << 8) | datain[4];
+    keycnt = MIN(keycnt, (PM3_CMD_DATA_SIZE - 5) / 6);
+
+    for (uint16_t i = 0; i < keycnt; i++) {
+        if (card_auth(sim, block, keytype, bytes_to_num(datain + 5 + i * 6, 6))) {
+            memcpy(keyresult.key, datain + 5 + i * 6, 6);
+            keyresult.found = true;
+            break;
+        }
+    }
+    reply_ng(sim, CMD_HF_MIFARE_CHKKEYS, PM3_SUCCESS, &keyresult, sizeof(keyresult));
+}
+
+// The firmware calibrates the nonce distance and guesses the plain nonce from parity,
+// the simulator knows the card PRNG and answers with the exact nonces and keystreams.
+static void sim_nested(sim_t *sim, const PacketCommandNG *packet) {
+    struct p {
+        uint8_t block;
+        uint8_t keytype;
+        uint8_t target_block;
+        uint8_t target_keytype;
+        bool calibrate;
+        uint8_t key[6];
+    } PACKED;
+    const struct p *payload = (const struct p *)packet->data.asBytes;
+
+    struct {
+        int16_t isOK;
+        uint8_t block;
+        uint8_t keytype;
+        uint8_t cuid[4];
+        uint8_t nt_a[4];
+        uint8_t ks_a[4];
+        uint8_t nt_b[4];
+        uint8_t ks_b[4];
+    } PACKED reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.block = payload->target_block;
+    reply.keytype = payload->target_keytype;
+
+    uint32_t cuid = card_cuid(&sim->card);
+    memcpy(reply.cuid, &cuid, 4);
+
+    uint64_t key = bytes_to_num(payload->key, 6);
+    uint8_t ts = sector_of(payload->target_block);
+    if (ts >= sim->card.sectors) {
+        reply.isOK = PM3_ESOFT;
+        reply_ng(sim, CMD_HF_MIFARE_NESTED, PM3_SUCCESS, &reply, sizeof(reply));
+        return;
+    }
+    uint64_t target_key = card_key(&sim->card, ts, payload->target_keytype & 1);
+
+    uint32_t target_nt[2], target_ks[2];
+    for (uint8_t i = 0; i < 2; i++) {
+        if (card_auth(sim, payload->block, payload->keytype, key) == false) {
+            reply.isOK = PM3_ESOFT;
+            reply_ng(sim, CMD_HF_MIFARE_NESTED, PM3_SUCCESS, &reply, sizeof(reply));
+            return;
+        }
+
+        // nested auth, the card encrypts its nonce with the first keystream word of the target key
+        sim->auths++;
+        sim->pending_us += sim->auth_delay_us;
+        uint32_t nt = card_next_nonce(&sim->card, SIM_NESTED_DIST);
+
+        struct Crypto1State pcs;
+        crypto1_init(&pcs, target_key);
+        target_nt[i] = nt;
+        target_ks[i] = crypto1_word(&pcs, cuid ^ nt, 0);
+    }
+
+    memcpy(reply.nt_a, &target_nt[0], 4);
+    memcpy(reply.ks_a, &target_ks[0], 4);
+    memcpy(reply.nt_b, &target_nt[1], 4);
+    memcpy(reply.ks_b, &target_ks[1], 4);
+    reply.isOK = PM3_SUCCESS;
+    reply_ng(sim, CMD_HF_MIFARE_NESTED, PM3_SUCCESS, &reply, sizeof(reply));
+}
+
+static void sim_14a_reader(sim_t *sim, const PacketCommandNG *packet) {
+    uint32_t flags = packet->oldarg[0];
+    uint16_t len = packet->oldarg[1] & 0xFFFF;
+
+    if (flags & ISO14A_CONNECT) {
+        iso14a_card_select_t card;
+        memset(&card, 0, sizeof(card));
+        memcpy(card.uid, sim->card.uid, 4);
+        card.uidlen = 4;
+        card.atqa[0] = sim->card.mem[6];
+        card.atqa[1] = sim->card.mem[7];
+        card.sak = sim->card.mem[5];
+        // 2 = selected, card without RATS support
+        reply_mix(sim, CMD_ACK, 2, 0, 0, &card, sizeof(card));
+    }
+
+    if ((flags & ISO14A_RAW) && len) {
+        // only the first step of an authentication, the card answers with its plain nonce
+        const uint8_t *cmd = packet->data.asBytes;
+        if (cmd[0] == MIFARE_AUTH_KEYA || cmd[0] == MIFARE_AUTH_KEYB) {
+            uint8_t nt[4];
+            num_to_bytes(card_next_nonce(&sim->card, SIM_AUTH_DIST), 4, nt);
+            reply_mix(sim, CMD_ACK, sizeof(nt), 0, 0, nt, sizeof(nt));
+        } else {
+            reply_mix(sim, CMD_ACK, 0, 0, 0, NULL, 0);
+        }
+    }
+}
+
+// ecfill, reads the card into emulator memory with the keys found in its sector trailers
+static void sim_eml_load(sim_t *sim, const PacketCommandNG *packet) {
+    const mfc_eload_t *payload = (const mfc_eload_t *)packet->data.asBytes;
+    int retval = PM3_SUCCESS;
+
+    for (uint8_t s = 0; s < payload->sectorcnt && s < SIM_MAX_SECTORS; s++) {
+        uint8_t *st = sim->emul + (first_block(s) + blocks_in_sector(s) - 1) * 16;
+        uint64_t key = bytes_to_num(st + ((payload->keytype & 1) ? 10 : 0), 6);
+        if (card_auth(sim, first_block(s), payload->keytype, key) == false) {
+            retval = PM3_EPARTIAL;
+            continue;
+        }
+        for (uint8_t b = 0; b < blocks_in_sector(s); b++) {
+            uint8_t tb = first_block(s) + b;
+            uint8_t data[16];
+            card_read_block(&sim->card, tb, data);
+            if (b == blocks_in_sector(s) - 1) {
+                // sector trailer, keep the keys, set only the AC
+                memcpy(st + 6, data + 6, 4);
+            } else {
+                memcpy(sim->emul + tb * 16, data, 16);
+            }
+        }
+    }
+    reply_ng(sim, CMD_HF_MIFARE_EML_LOAD, retval, NULL, 0);
+}
+
+static void sim_eml_clear(sim_t *sim) {
+    const uint8_t trailer[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x07, 0x80, 0x69, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    memset(sim->emul, 0, sizeof(sim->emul));
+    for (uint8_t s = 0; s < SIM_MAX_SECTORS; s++) {
+        memcpy(sim->emul + (first_block(s) + blocks_in_sector(s) - 1) * 16, trailer, sizeof(trailer));
+    }
+}
+
+static void sim_handle(sim_t *sim, const PacketCommandNG *packet) {
+    switch (packet->cmd) {
+        case CMD_PING: {
+            reply_ng(sim, CMD_PING, PM3_SUCCESS, packet->data.asBytes, packet->length);
+            break;
+        }
+        case CMD_CAPABILITIES: {
+            sim_capabilities(sim);
+            break;
+        }
+        case CMD_VERSION: {
+            sim_version(sim);
+            break;
+        }
+        case CMD_SET_DBGMODE: {
+            reply_ng(sim, CMD_SET_DBGMODE, PM3_SUCCESS, NULL, 0);
+            break;
+        }
+        case CMD_BREAK_LOOP:
+        case CMD_QUIT_SESSION: {
+            break;
+        }
+        case CMD_DOWNLOAD_TRACE: {
+            sim_download(sim, sim->bigbuf, sizeof(sim->bigbuf), packet->oldarg[0], packet->oldarg[1], CMD_DOWNLOADED_TRACE, sim->trace_len);
+            reply_mix(sim, CMD_ACK, 1, 0, sim->trace_len, &sim->config, sizeof(sample_config));
+            break;
+        }
+        case CMD_DOWNLOAD_EMULATOR: {
+            sim_download(sim, sim->emul, sizeof(sim->emul), packet->oldarg[0], packet->oldarg[1], CMD_DOWNLOADED_EMULATOR, 0);
+            reply_mix(sim, CMD_ACK, 1, 0, 0, NULL, 0);
+            break;
+        }
+        case CMD_LF_SAMPLING_GET_CONFIG: {
+            reply_ng(sim, CMD_LF_SAMPLING_GET_CONFIG, PM3_SUCCESS, &sim->config, sizeof(sample_config));
+            break;
+        }
+        case CMD_LF_ACQ_RAW_ADC: {
+            // the samples are already in BigBuf, report how many bits were "acquired"
+            const lf_sample_payload_t *payload = (const lf_sample_payload_t *)packet->data.asBytes;
+            uint32_t samples = sim->samples_len;
+            if (payload->samples && payload->samples < samples) {
+                samples = payload->samples;
+            }
+            uint32_t bits = samples * sim->config.bits_per_sample;
+            reply_ng(sim, CMD_LF_ACQ_RAW_ADC, PM3_SUCCESS, &bits, sizeof(bits));
+            break;
+        }
+        case CMD_HF_ISO14443A_READER: {
+            sim_14a_reader(sim, packet);
+            break;
+        }
+        case CMD_HF_MIFARE_STATIC_NONCE: {
+            uint8_t type = NONCE_NORMAL;
+            reply_ng(sim, CMD_HF_MIFARE_STATIC_NONCE, PM3_SUCCESS, &type, sizeof(type));
+            break;
+        }
+        case CMD_HF_MIFARE_CHKKEYS: {
+            sim_chkkeys(sim, packet);
+            break;
+        }
+        case CMD_HF_MIFARE_CHKKEYS_FAST: {
+            sim_chkkeys_fast(sim, packet);
+            break;
+        }
+        case CMD_HF_MIFARE_NESTED: {
+            sim_nested(sim, packet);
+            break;
+        }
+        case CMD_HF_MIFARE_EML_MEMCLR: {
+            sim_eml_clear(sim);
+            reply_ng(sim, CMD_HF_MIFARE_EML_MEMCLR, PM3_SUCCESS, NULL, 0);
+            break;
+        }
+        case CMD_HF_MIFARE_EML_MEMSET: {
+            struct p {
+                uint8_t blockno;
+                uint8_t blockcnt;
+                uint8_t blockwidth;
+                uint8_t data[];
+            } PACKED;
+            const struct p *payload = (const struct p *)packet->data.asBytes;
+            uint8_t width = (payload->blockwidth) ? payload->blockwidth : 16;
+            size_t offset = payload->blockno * width;
+            size_t size = payload->blockcnt * width;
+            if (offset + size <= sizeof(sim->emul) && size <= PM3_CMD_DATA_SIZE - 3) {
+                memcpy(sim->emul + offset, payload->data, size);
+            }
+            break;
+        }
+        case CMD_HF_MIFARE_EML_MEMGET: {
+            uint8_t blockno = packet->data.asBytes[0];
+            uint8_t blockcnt = packet->data.asBytes[1];
+            size_t size = blockcnt * 16;
+            if (size > PM3_CMD_DATA_SIZE || blockno * 16 + size > sizeof(sim->emul)) {
+                reply_ng(sim, CMD_HF_MIFARE_EML_MEMGET, PM3_EMALLOC, NULL, 0);
+                break;
+            }
+            reply_ng(sim, CMD_HF_MIFARE_EML_MEMGET, PM3_SUCCESS, sim->emul + blockno * 16, size);
+            break;
+        }
+        case CMD_HF_MIFARE_EML_LOAD: {
+            sim_eml_load(sim, packet);
+            break;
+        }
+        default: {
+            if (sim->verbose) {
+                fprintf(stderr, "[-] unsupported command 0x%04x\n", packet->cmd);
+            }
+            reply_ng(sim, packet->cmd, PM3_ENOTIMPL, NULL, 0);
+            break;
+        }
+    }
+}
+
+static int sim_listen(const char *port) {
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    int s = getaddrinfo(NULL, port, &hints, &res);
+    if (s != 0) {
+        fprintf(stderr, "[!] getaddrinfo: %s\n", gai_strerror(s));
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo *rp = res; rp != NULL; rp = rp->ai_next) {
+        fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, rp->ai_addr, rp->ai_addrlen) == 0 && listen(fd, 1) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd < 0) {
+        fprintf(stderr, "[!] could not listen on port %s\n", port);
+    }
+    return fd;
+}
+
+static int usage(void) {
+    printf("\n");
+    printf("syntax:  pm3_sim [-p <port>] [-c <dump.bin>] [-l <samples.pm3>] [-t <file.trace>] [-s <seed>] [-d <us>] [-1] [-v]\n\n");
+    printf("Simulates a Proxmark3 for the client, connect with " _YELLOW_("proxmark3 -p tcp:localhost:<port>") "\n\n");
+    printf("  -p <port>    tcp port to listen on, default " SIM_DEFAULT_PORT "\n");
+    printf("  -c <file>    MIFARE Classic dump for the simulated card, default a generated 1K card\n");
+    printf("  -s <seed>    seed of the generated card UID, keys and nonces\n");
+    printf("  -l <file>    LF samples served by `data samples` and `lf read`\n");
+    printf("  -t <file>    trace served by `trace list`\n");
+    printf("  -d <us>      time one card authentication takes, default 0\n");
+    printf("  -1           exit after the first client disconnects\n");
+    printf("  -v           verbose\n\n");
+    printf("samples:\n");
+    printf("\n");
+    printf("  ./pm3_sim -1 &\n");
+    printf("  proxmark3 -p tcp:localhost:18888 -c \"hf mf fchk --1k -f mfc_default_keys\"\n");
+    printf("  ./pm3_sim -c hf-mf-01020304-dump.bin -d 5000\n");
+    printf("\n");
+    return 1;
+}
+
+int main(int argc, char *const argv[]) {
+
+    sim_t *sim = &g_sim;
+    const char *port = SIM_DEFAULT_PORT;
+    const char *dumpfn = NULL, *lffn = NULL, *tracefn = NULL;
+    uint64_t seed = 0x504D3353494DULL;
+    bool once = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:c:l:t:s:d:1vh")) != -1) {
+        switch (opt) {
+            case 'p':
+                port = optarg;
+                break;
+            case 'c':
+                dumpfn = optarg;
+                break;
+            case 'l':
+                lffn = optarg;
+                break;
+            case 't':
+                tracefn = optarg;
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'd':
+                sim->auth_delay_us = strtoul(optarg, NULL, 0);
+                break;
+            case '1':
+                once = true;
+                break;
+            case 'v':
+                sim->verbose = true;
+                break;
+            case 'h':
+            default:
+                return usage();
+        }
+    }
+    if (optind != argc) {
+        return usage();
+    }
+
+    if (lffn && tracefn) {
+        fprintf(stderr, "[!] BigBuf holds either samples or a trace, not both\n");
+        return 1;
+    }
+
+    card_init_default(&sim->card, seed, 16);
+    if (dumpfn && card_load(&sim->card, dumpfn) != PM3_SUCCESS) {
+        return 1;
+    }
+    if (lffn && bigbuf_load_samples(sim, lffn) != PM3_SUCCESS) {
+        return 1;
+    }
+    if (tracefn && bigbuf_load_trace(sim, tracefn) != PM3_SUCCESS) {
+        return 1;
+    }
+    sim_eml_clear(sim);
+
+    sim->config.decimation = 1;
+    sim->config.bits_per_sample = 8;
+    sim->config.averaging = 1;
+    sim->config.divisor = LF_DIVISOR_125;
+
+    // a client going away mid reply must not kill the simulator
+    signal(SIGPIPE, SIG_IGN);
+
+    int lfd = sim_listen(port);
+    if (lfd < 0) {
+        return 1;
+    }
+
+    printf("[=] card UID " _YELLOW_("%02X%02X%02X%02X") ", %u sectors\n", sim->card.uid[0], sim->card.uid[1], sim->card.uid[2], sim->card.uid[3], sim->card.sectors);
+    if (sim->verbose) {
+        for (uint8_t s = 0; s < sim->card.sectors; s++) {
+            printf("[=]   sector %2u  A %012" PRIx64 "  B %012" PRIx64 "\n", s, card_key(&sim->card, s, MF_KEY_A), card_key(&sim->card, s, MF_KEY_B));
+        }
+    }
+    if (sim->samples_len) {
+        printf("[=] %u LF samples\n", sim->samples_len);
+    }
+    if (sim->trace_len) {
+        printf("[=] trace of %u bytes\n", sim->trace_len);
+    }
+    printf("[=] listening on tcp port " _YELLOW_("%s") "\n", port);
+    fflush(stdout);
+
+    do {
+        sim->fd = accept(lfd, NULL, NULL);
+        if (sim->fd < 0) {
+            continue;
+        }
+        int one = 1;
+        setsockopt(sim->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        sim->commands = 0;
+        sim->auths = 0;
+        sim->bytes_out = 0;
+        uint64_t t1 = msclock();
+
+        PacketCommandNG packet;
+        int res;
+        while ((res = receive_ng(sim, &packet)) == PM3_SUCCESS) {
+            sim->commands++;
+            if (sim->verbose) {
+                fprintf(stderr, "[+] %s command 0x%04x, %u bytes\n", (packet.magic == 0) ? "OLD" : (packet.ng ? "NG" : "MIX"), packet.cmd, packet.length);
+            }
+            sim_handle(sim, &packet);
+        }
+        if (res == PM3_ECRC || res == PM3_EOVFLOW) {
+            fprintf(stderr, "[!] bad frame from client (%d), dropping the connection\n", res);
+        }
+        close(sim->fd);
+
+        printf("[=] client done, %u commands, %" PRIu64 " authentications, %" PRIu64 " bytes sent in %.1fs\n",
+               sim->commands, sim->auths, sim->bytes_out, (float)(msclock() - t1) / 1000.0);
+        fflush(stdout);
+    } while (once == false);
+
+    close(lfd);
+    return 0;
+}
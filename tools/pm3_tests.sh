@@ -13,7 +13,10 @@ TESTMFKEY=false
 TESTNONCE2KEY=false
 TESTMFNONCEBRUTE=false
 TESTMFDAESBRUTE=false
+TESTHARDNESTEDWORKER=false
 TESTHITAG2CRACK=false
+TESTPM3SIM=false
+TESTPALLOCBENCH=false
 TESTCRYPTORF=false
 TESTFPGACOMPRESS=false
 TESTBOOTROM=false
@@ -28,7 +31,7 @@ while (( "$#" )); do
   case "$1" in
     -h|--help)
       echo """
-Usage: $0 [--long] [--opencl] [--clientbin /path/to/proxmark3] [mfkey|nonce2key|mf_nonce_brute|mfd_aes_brute|cryptorf|fpga_compress|bootrom|armsrc|client|recovery|common]
+Usage: $0 [--long] [--opencl] [--clientbin /path/to/proxmark3] [mfkey|nonce2key|mf_nonce_brute|mfd_aes_brute|hardnested_worker|pm3_sim|palloc_bench|cryptorf|fpga_compress|bootrom|armsrc|client|recovery|common]
     --long:          Enable slow tests
     --opencl:        Enable tests requiring OpenCL (preferably a Nvidia GPU)
     --clientbin ...: Specify path to proxmark3 binary to test
@@ -78,6 +81,11 @@ Usage: $0 [--long] [--opencl] [--clientbin /path/to/proxmark3] [mfkey|nonce2key|
       TESTMFDAESBRUTE=true
       shift
       ;;
+    hardnested_worker)
+      TESTALL=false
+      TESTHARDNESTEDWORKER=true
+      shift
+      ;;
     fpga_compress)
       TESTALL=false
       TESTFPGACOMPRESS=true
@@ -88,6 +96,16 @@ Usage: $0 [--long] [--opencl] [--clientbin /path/to/proxmark3] [mfkey|nonce2key|
       TESTHITAG2CRACK=true
       shift
       ;;
+    pm3_sim)
+      TESTALL=false
+      TESTPM3SIM=true
+      shift
+      ;;
+    palloc_bench)
+      TESTALL=false
+      TESTPALLOCBENCH=true
+      shift
+      ;;
     bootrom)
       TESTALL=false
       TESTBOOTROM=true
@@ -310,6 +328,25 @@ while true; do
       if ! CheckFileExist "mfd_aes_brute exists"          "$MFDASEBRUTEBIN"; then break; fi
       if ! CheckExecute      "mfd_aes_brute test 1/2"         "$MFDASEBRUTEBIN 1629394800 bb6aea729414a5b1eff7b16328ce37fd 82f5f498dbc29f7570102397a2e5ef2b6dc14a864f665b3c54d11765af81e95c" "key.................... .*261C07A23F2BC8262F69F10A5BDF3764"; then break; fi
       if ! CheckExecute slow "mfd_aes_brute test 2/2"         "$MFDASEBRUTEBIN 1546300800 3fda933e2953ca5e6cfbbf95d1b51ddf 97fe4b5de24188458d102959b888938c988e96fb98469ce7426f50f108eaa583" "key.................... .*E757178E13516A4F3171BC6EA85E165A"; then break; fi
+      echo -e "\n${C_BLUE}Testing mfd_multi_brute:${C_NC} ${MFDMULTIBRUTEBIN:=./tools/mfd_aes_brute/mfd_multi_brute}"
+      if ! CheckFileExist "mfd_multi_brute exists"        "$MFDMULTIBRUTEBIN"; then break; fi
+      if ! CheckExecute      "mfd_multi_brute DES test"       "$MFDMULTIBRUTEBIN DES 0 1599999999 118565f6e5e6c839 d570fd1578079e6b22aaa187b99f0a2a" "Key.................... .*1C53F758BF5DAEEA"; then break; fi
+      if ! CheckExecute      "mfd_multi_brute AES test"       "$MFDMULTIBRUTEBIN AES 0 1629394800 bb6aea729414a5b1eff7b16328ce37fd 82f5f498dbc29f7570102397a2e5ef2b6dc14a864f665b3c54d11765af81e95c" "Key.................... .*261C07A23F2BC8262F69F10A5BDF3764"; then break; fi
+      if ! CheckExecute slow "mfd_multi_brute 3TDEA test"     "$MFDMULTIBRUTEBIN 3TDEA 0 1599999999 1fe1f0330e9da5407cd2bc9294e56a7e 920037b5e02872b2fd9a070eade2b172ddc0fe6b10e5e55dd32cebdcc94747b4" "Key.................... .*8B795DDE54B24AD2938AC758F0B262FA3EE38952EC619BB8"; then break; fi
+    fi
+    if $TESTALL || $TESTHARDNESTEDWORKER; then
+      echo -e "\n${C_BLUE}Testing hardnested_worker:${C_NC} ${HNWORKERBIN:=./tools/hardnested_worker/hardnested_worker}"
+      if ! CheckFileExist "hardnested_worker exists"      "$HNWORKERBIN"; then break; fi
+      if ! CheckExecute      "hardnested_worker usage"       "$HNWORKERBIN -h" "syntax:  hardnested_worker"; then break; fi
+      if ! CheckFileExist "proxmark3 exists"              "${CLIENTBIN:=./client/proxmark3}"; then break; fi
+      # export, crack a slice of the units, merge. Nonces of a simulated card with key a0a1a2a3a4a5
+      # Order of magnitude to export them: ~40s -> tagged as "slow"
+      HNWORKDIR=$(mktemp -d)
+      if ! CheckExecute slow "hardnested_worker export"      "$CLIENTBIN --incognito -c 'hf mf hardnested -r -f traces/hf_mf_hardnested_nonces.bin --export $HNWORKDIR'" "Work units written"; then break; fi
+      if ! CheckExecute slow "hardnested_worker merge empty" "$CLIENTBIN --incognito -c 'hf mf hardnested --merge $HNWORKDIR'" "some work units are still pending"; then break; fi
+      if ! CheckExecute slow "hardnested_worker slice"       "$HNWORKERBIN $HNWORKDIR/hardnested_unit_0000*.bin" "Key found .*a0a1a2a3a4a5"; then break; fi
+      if ! CheckExecute slow "hardnested_worker merge"       "$CLIENTBIN --incognito -c 'hf mf hardnested --merge $HNWORKDIR'" "Found key .*a0a1a2a3a4a5"; then break; fi
+      rm -rf "$HNWORKDIR"
     fi
 
     if $TESTALL || $TESTCRYPTORF; then
@@ -319,6 +356,25 @@ while true; do
 #      if ! CheckExecute slow  "sma test"             "$CRYPTRFBRUTEBIN ffffffffffffffff 1234567812345678 88c9d4466a501a87 dec2ee1b1c9276e9" "key found \[.*4f794a463ff81d81.*\]"; then break; fi
       if ! CheckExecute slow  "sma_multi test"       "$CRYPTRF_MULTI_BRUTEBIN ffffffffffffffff 1234567812345678 88c9d4466a501a87 dec2ee1b1c9276e9" "key found \[.*4f794a463ff81d81.*\]"; then break; fi
     fi
+    if $TESTALL || $TESTPALLOCBENCH; then
+      echo -e "\n${C_BLUE}Testing palloc_bench:${C_NC} ${PALLOCBENCHBIN:=./tools/palloc_bench/palloc_bench}"
+      if ! CheckFileExist "palloc_bench exists"            "$PALLOCBENCHBIN"; then break; fi
+      if ! CheckExecute "palloc_bench usage"               "$PALLOCBENCHBIN -h" "syntax:  palloc_bench"; then break; fi
+      if ! CheckExecute "palloc_bench replays"             "$PALLOCBENCHBIN -c -n 20 tools/palloc_bench/replays/*.txt" "OK"; then break; fi
+      if ! CheckExecute "palloc_bench mode switches"       "$PALLOCBENCHBIN -c -n 20 tools/palloc_bench/replays/mixed_session.txt" "allocations 400, 0 failed"; then break; fi
+      if ! CheckExecute "palloc_bench random"              "$PALLOCBENCHBIN -c -r 1 -o 50000" "OK"; then break; fi
+      if ! CheckExecute "palloc_bench small heap"          "$PALLOCBENCHBIN -c -r 2 -o 20000 -s 2048" "OK"; then break; fi
+    fi
+    # pm3_sim not part of "all"
+    if $TESTPM3SIM; then
+      echo -e "\n${C_BLUE}Testing pm3_sim:${C_NC} ${PM3SIMBIN:=./tools/pm3_sim/pm3_sim} ${CLIENTBIN:=./client/proxmark3}"
+      if ! CheckFileExist "pm3_sim exists"                 "$PM3SIMBIN"; then break; fi
+      if ! CheckExecute "pm3_sim usage"                    "$PM3SIMBIN -h" "syntax:  pm3_sim"; then break; fi
+      if ! CheckFileExist "proxmark3 exists"               "$CLIENTBIN"; then break; fi
+      if ! CheckExecute "pm3_sim fchk"                     "($PM3SIMBIN -1 -p 18887 >/dev/null &); sleep 1; $CLIENTBIN --incognito -p tcp:localhost:18887 -c 'hf mf fchk --1k -f mfc_default_keys'" "014 \| 059 \| D3F7D3F7D3F7"; then break; fi
+      if ! CheckExecute "pm3_sim nested"                   "($PM3SIMBIN -1 -p 18887 >/dev/null &); sleep 1; $CLIENTBIN --incognito -p tcp:localhost:18887 -c 'hf mf nested --1k --blk 0 -a -k FFFFFFFFFFFF --tblk 15 --ta'" "found valid key \[ .*10A4C6224D78"; then break; fi
+      if ! CheckExecute "pm3_sim lf samples"               "($PM3SIMBIN -1 -p 18887 -l traces/lf_ATA5577_HID-FC1-C9.pm3 >/dev/null &); sleep 1; $CLIENTBIN --incognito -p tcp:localhost:18887 -c 'data samples -n 16000; lf search -1'" "Valid HID Prox ID"; then break; fi
+    fi
     # hitag2crack not yet part of "all"
     # if $TESTALL || $TESTHITAG2CRACK; then
     if $TESTHITAG2CRACK; then
@@ -408,6 +464,20 @@ while true; do
       if ! CheckExecute "jooki encode test"       "$CLIENTBIN -c 'hf jooki encode -t'" "04 28 F4 DA F0 4A 81  \( ok \)"; then break; fi
       if ! CheckExecute "trace load/list 14a"     "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfu.trace; trace list -1 -t 14a;'" "READBLOCK\(8\)"; then break; fi
       if ! CheckExecute "trace load/list x"       "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfu.trace; trace list -x1 -t 14a;'" "0.0101840425"; then break; fi
+      if ! CheckExecute "trace list mf nested key" "$CLIENTBIN -c 'trace load -f traces/hf_mf_hid_sio_sim.trace; trace list -1 -t mf;'" "key 3B7E4FD575AD"; then break; fi
+      if ! CheckExecute "trace list mf page key"  "$CLIENTBIN -c 'trace load -f traces/hf_mf_hid_sio_sim.trace; trace list -1 -t mf --page 2 --rows 10;'" "key A0A1A2A3A4A5"; then break; fi
+      if ! CheckExecute "trace list mf page decrypt" "$CLIENTBIN -c 'trace load -f traces/hf_mf_hid_sio_sim.trace; trace list -1 -t mf --page 4 --rows 10;'" "30  0C  6E  62 .*ok .*READBLOCK\(12\)"; then break; fi
+      if ! CheckExecute "trace list mf start decrypt" "$CLIENTBIN -c 'trace load -f traces/hf_mf_hid_sio_sim.trace; trace list -1 -t mf --start 5000000;'" "60  0C  99  B1 .*ok .*AUTH-A\(12\)"; then break; fi
+      if ! CheckExecute "trace list mf page = full" "diff <($CLIENTBIN -c 'trace load -f traces/hf_mf_hid_sio_sim.trace; trace list -1 -t mf;' | awk '/ 5338370 /{f=1} / 12173860 |^$/{f=0} f') <($CLIENTBIN -c 'trace load -f traces/hf_mf_hid_sio_sim.trace; trace list -1 -t mf --page 4 --rows 10;' | awk '/ 5338370 /{f=1} / 12173860 |^$/{f=0} f') && echo 'same decryption'" "same decryption"; then break; fi
+      if ! CheckExecute "trace list iclass tag"   "$CLIENTBIN -c 'trace load -f traces/hf_iclass_sniff.trace; trace list -1 -t iclass --tag;'" "2057952 .*CHECK SUCCESS"; then break; fi
+      if ! CheckExecute "trace list filter cmd"   "$CLIENTBIN -c 'trace load -f traces/hf_mf_hid_sio_sim.trace; trace list -1 -t 14a --cmd 93;'" "Showing 8 of 8 matching"; then break; fi
+      if ! CheckExecute "trace list filter uid"   "$CLIENTBIN -c 'trace load -f traces/hf_mf_hid_sio_sim.trace; trace list -1 -t 14a --uid 56DD8978 --rdr;'" "Showing 2 of 2 matching"; then break; fi
+      if ! CheckExecute "trace list 14a page ulc"  "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfuc_defaultkey.trace; trace list -1 -t 14a --page 14 --rows 1;'" "AUTH-2 ANSW OK"; then break; fi
+      if ! CheckExecute "trace list page past end" "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfuc_defaultkey.trace; trace list -1 -t 14a --page 4294967295 --rows 4294967295;'" "Page 4294967295 is past the end"; then break; fi
+      if ! CheckExecute "trace load > 64 KiB"     "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace'" "TraceLen = 70070"; then break; fi
+      # the last copy starts at 65065, its frames are only found if the records past 64 KiB are read
+      if ! CheckExecute "trace list > 64 KiB"     "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace; trace list -1 -t 14a --cmd 6A'" "Showing 56 of 56 matching records \\( 4284 records in trace \\)"; then break; fi
+      if ! CheckExecute "trace load timeline"     "$CLIENTBIN -c 'trace load -f traces/hf_14a_mfu-sim.trace -f traces/hf_14a_mfu-sim.trace; trace list -1 -t 14a' | awk -F'|' '/^ *[0-9]+ *[|]/ { if (\$1 + 0 < p) b++; p = \$1 + 0 } END { print \"backwards \" b + 0 }'" "backwards 0"; then break; fi
       if ! CheckExecute "nfc decode test - oob"          "$CLIENTBIN -c 'nfc decode -d DA2010016170706C69636174696F6E2F766E642E626C7565746F6F74682E65702E6F6F62301000649201B96DFB0709466C65782032'" "Flex 2"; then break; fi
       if ! CheckExecute "nfc decode test - device info"  "$CLIENTBIN -c 'nfc decode -d d1025744690004536f6e79010752432d533338300220426c61636b204e46432052656164657220636f6e6e656374656420746f2050430310123e4567e89b12d3a45642665544000004124e464320506f72742d3130302076312e3032'" "NFC Port-100 v1.02"; then break; fi
       if ! CheckExecute "nfc decode test - vcard"        "$CLIENTBIN -c 'nfc decode -d d20ca3746578742f782d7643617264424547494e3a56434152440a56455253494f4e3a332e300a4e3a43687269733b4963656d616e3b3b3b0a464e3a476f7468656e627572670a5245563a323032312d30362d32345432303a31353a30385a0a6974656d322e582d4142444154453b747970653d707265663a323032302d30362d32340a4954454d322e582d41424c4142454c3a5f24213c416e6e69766572736172793e21245f0a454e443a56434152440a'" "END:VCARD"; then break; fi
@@ -416,16 +486,19 @@ while true; do
 
       echo -e "\n${C_BLUE}Testing LF:${C_NC}"
       if ! CheckExecute "lf hitag2 test"             "$CLIENTBIN -c 'lf hitag test'" "Tests \( ok"; then break; fi
+      if ! CheckExecute slow "lf hitag2 crack test"       "$CLIENTBIN -c 'lf hitag crack --uid 12345678 --nrar 71DA20AA7EFDF3FA --nrar 2A4265F959653B07'" "Found valid key \[ AABBCCDDEEFF \]"; then break; fi
       if ! CheckExecute "lf cotag demod test"        "$CLIENTBIN -c 'data load -f traces/lf_cotag_220_8331.pm3; data norm; data cthreshold -u 50 -d -20; data envelope; data raw --ar -c 272; lf cotag demod'" \
                                                                      "COTAG Found: FC 220, CN: 8331 Raw: FFB841170363FFFE00001E7F00000000"; then break; fi
       if ! CheckExecute "lf AWID test"               "$CLIENTBIN -c 'data load -f traces/lf_AWID-15-259.pm3;lf search -1'" "AWID ID found"; then break; fi
       if ! CheckExecute "lf EM410x test"             "$CLIENTBIN -c 'data load -f traces/lf_EM4102-1.pm3;lf search -1'" "EM410x ID found"; then break; fi
+      if ! CheckExecute "lf search batch test"       "$CLIENTBIN -c 'lf search --dir traces/lf_EM4102-1.pm3 -t 1'" "\"tag\":\"EM410x ID\""; then break; fi
       if ! CheckExecute "lf EM4x05 test"             "$CLIENTBIN -c 'data load -f traces/lf_EM4x05.pm3;lf search -1'" "FDX-B ID found"; then break; fi
       if ! CheckExecute "lf EM4x70 calc test"        "$CLIENTBIN -c 'lf em 4x70 calc --key F32AA98CF5BE4ADFA6D3480B --rnd 45F54ADA252AAC'" "FRN: 4866BB70  GRN: 9BD180"; then break; fi
       if ! CheckExecute "lf EM4x70 recover test 1/3" "$CLIENTBIN -c 'lf em 4x70 recover --key 022A028C02BE --rnd 7D5167003571F8 --frn 982DBCC0 --grn 36C0E0'" "022a028c02be000102030405"; then break; fi
       if ! CheckExecute "lf EM4x70 recover test 2/3" "$CLIENTBIN -c 'lf em 4x70 recover --key 022A028C02BE --rnd 7D5167003571F8 --frn 982DBCC0 --grn 36C0E0'" "022a028c02be366866191b60"; then break; fi
       if ! CheckExecute "lf EM4x70 recover test 3/3" "$CLIENTBIN -c 'lf em 4x70 recover --key 022A028C02BE --rnd 7D5167003571F8 --frn 982DBCC0 --grn 36C0E0'" "022a028c02bef1e352c2718d"; then break; fi
       if ! CheckExecute "lf FDX-A FECAVA test"       "$CLIENTBIN -c 'data load -f traces/lf_EM4305_fdxa_destron.pm3;lf search -1'" "FDX-A FECAVA Destron ID found"; then break; fi
+      if ! CheckExecute "lf search continue test"    "$CLIENTBIN -c 'data load -f traces/lf_EM4305_fdxa_destron.pm3;lf search -1 -c' | grep -E -c 'Valid (FDX-A FECAVA Destron|HID Prox) ID found'" "^2$"; then break; fi
       if ! CheckExecute "lf FDX-B test"              "$CLIENTBIN -c 'data load -f traces/lf_HomeAgain1600.pm3;lf search -1'" "FDX-B ID found"; then break; fi
       if ! CheckExecute "lf FDX/BioThermo test"      "$CLIENTBIN -c 'data load -f traces/lf_FDXB_Bio-Thermo.pm3; lf fdxb demod'" "95.2 F / 35.1 C"; then break; fi
       if ! CheckExecute "lf GPROXII test"            "$CLIENTBIN -c 'data load -f traces/lf_GProx_36_30_14489.pm3; lf search -1'" "Guardall G-Prox II ID found"; then break; fi
@@ -532,6 +605,7 @@ while true; do
 
       echo -e "\n${C_BLUE}Testing HF:${C_NC}"
       if ! CheckExecute "hf mf offline text"               "$CLIENTBIN -c 'hf mf'" "content from tag dump file"; then break; fi
+      if ! CheckExecute "hf mf mfkey trace test"           "$CLIENTBIN -c 'hf mf mfkey -f traces/hf_mf_hid_sio_sim.trace'" "A0A1A2A3A4A5 \| mfkey64"; then break; fi
       if ! CheckExecute slow retry ignore "hf mf hardnested long test"  "$CLIENTBIN -c 'hf mf hardnested -t --tk 000000000000'" "found:"; then break; fi
       if ! CheckExecute slow "hf iclass loclass long test" "$CLIENTBIN -c 'hf iclass loclass --long'" "verified \( ok \)"; then break; fi
       if ! CheckExecute slow "emv long test"               "$CLIENTBIN -c 'emv test -l'" "Tests \( ok"; then break; fi